@@ -5,6 +5,7 @@
 #include "tinybuf.h"
 #include "tinybuf_plugin.h"
 #include "tinybuf_log.h"
+#include "tinybuf_memory.h"
 extern "C"{
     #include "static_oop.h"
     #include "dyn_sys.h"
@@ -33,8 +34,14 @@ TB_METHOD_DEF(Counter, void, Counter_add, int x)
 TB_TRAIT(Addable);
 #include "jsoncpp/json.h"
 #include <sstream>
+#include <atomic>
+#include <future>
+#include <climits>
 #ifndef _WIN32
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <thread>
 #include <cassert>
 #else
@@ -1160,6 +1167,49 @@ static void strpool_basic_tests()
     buffer_free(buf);
     tinybuf_value_free(m);
     tinybuf_value_free(v);
+
+    // 构造的trie pool: 一条链上每个节点都是叶子 还原出的字符串总长随节点数平方增长
+    // 1000个节点正常解码 70000个节点时超过2GB 读取失败 不分配也不越界
+    auto put_varint = [](std::string &o, uint64_t x) {
+        while (x >= 0x80)
+        {
+            o.push_back((char)(x | 0x80));
+            x >>= 7;
+        }
+        o.push_back((char)x);
+    };
+    const int chain_sizes[2] = {1000, 70000};
+    for (int k = 0; k < 2; ++k)
+    {
+        const int n = chain_sizes[k];
+        // str_pool_table(25) 5字节offset=8 str_index(23)下标0 之后是str_trie_pool(27)
+        std::string box = {(char)25, (char)0x88, (char)0x80, (char)0x80, (char)0x80, 0, (char)23, 0, (char)27};
+        put_varint(box, (uint64_t)n);
+        box += std::string("\0\0\0", 3);
+        for (int i = 1; i < n; ++i)
+        {
+            put_varint(box, (uint64_t)i);
+            box.push_back('a');
+            box.push_back(1);
+            // 最深的叶子是下标0
+            put_varint(box, i == n - 1 ? 0 : (uint64_t)i);
+        }
+        tinybuf_value *cv = tinybuf_value_alloc();
+        buf_ref cb{box.data(), (int64_t)box.size(), box.data(), (int64_t)box.size()};
+        tinybuf_error cr = tinybuf_result_ok(0);
+        int rn = tinybuf_try_read_box(&cb, cv, any_version, &cr);
+        if (k == 0)
+        {
+            assert(rn > 0 && tinybuf_value_get_type(cv) == tinybuf_string);
+            assert(buffer_get_length(tinybuf_value_get_string(cv, &cr)) == n - 1);
+        }
+        else
+        {
+            assert(rn < 0);
+        }
+        tinybuf_result_unref(&cr);
+        tinybuf_value_free(cv);
+    }
 }
 
 static void strpool_perf_tests()
@@ -1313,6 +1363,46 @@ static void strpool_perf_tests()
             tinybuf_value_free(arr);
         }
     }
+
+    // distinct keys: 读端每个str_index都应是O(1)查表 总耗时随key数线性增长
+    const int distinct_sizes[] = {1000, 10000, 100000};
+    for (int si = 0; si < 3; ++si)
+    {
+        const int n = distinct_sizes[si];
+        tinybuf_value *arr = tinybuf_value_alloc_with_type(tinybuf_array);
+        tinybuf_value_array_reserve(arr, n);
+        for (int k = 0; k < n; k++)
+        {
+            tinybuf_value *s = tinybuf_value_alloc();
+            string key = "distinct-key-" + to_string(k);
+            tinybuf_value_init_string(s, key.data(), (int)key.size());
+            tinybuf_value_array_append(arr, s);
+        }
+        buffer *b = buffer_alloc();
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        {
+            tinybuf_error wr = tinybuf_result_ok(0);
+            int wn = tinybuf_try_write_box(b, arr, &wr);
+            assert(wn > 0);
+            tinybuf_result_unref(&wr);
+        }
+        uint64_t t1 = getCurrentMicrosecondOrigin();
+        tinybuf_value *out = tinybuf_value_alloc();
+        buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+        {
+            tinybuf_error rr = tinybuf_result_ok(0);
+            int rn = tinybuf_try_read_box(&br, out, any_version, &rr);
+            assert(rn > 0);
+            tinybuf_result_unref(&rr);
+        }
+        uint64_t t2 = getCurrentMicrosecondOrigin();
+        assert(tinybuf_value_is_same(arr, out));
+        LOGI("strpool distinct keys=%d: write %lld us, read %lld us (%.1f ns/key)", n, (long long)(t1 - t0), (long long)(t2 - t1), (t2 - t1) * 1000.0 / n);
+        tinybuf_value_free(out);
+        buffer_free(b);
+        tinybuf_value_free(arr);
+    }
+    tinybuf_set_use_strpool(0);
 }
 
 static void plugin_basic_tests()
@@ -1475,36 +1565,33 @@ static void partition_concurrent_read_tests()
         assert(rn > 0);
         tinybuf_result_unref(&rr);
     }
-    const uint8_t *base = (const uint8_t *)buffer_get_data(b);
+    const char *base = buffer_get_data(b);
     int64_t all = (int64_t)buffer_get_length(b);
-    int pos = 0;
-    assert(base[0] == 22);
-    pos++;
-    uint64_t cnt = 0;
-    int c = varint_deserialize_local(base + pos, (int)(all - pos), &cnt);
-    pos += c;
-    assert(cnt >= 1);
-    std::vector<uint64_t> offs(cnt);
-    for (uint64_t i = 0; i < cnt; ++i)
-    {
-        uint64_t off = 0;
-        int k = varint_deserialize_local(base + pos, (int)(all - pos), &off);
-        pos += k;
-        offs[(size_t)i] = off;
-    }
-    std::vector<tinybuf_value *> outs(cnt - 1);
+    buf_ref whole{base, all, base, all};
+    tinybuf_error tr = tinybuf_result_ok(0);
+    tinybuf_part_table *table = tinybuf_part_table_open(&whole, &tr);
+    assert(table && tinybuf_part_table_count(table) == 4);
+    // offset指向各分区的类型字节
+    for (int64_t i = 0; i < 4; ++i)
+        assert((uint8_t)base[tinybuf_part_table_offsets(table)[i]] == 21);
+    std::vector<tinybuf_value *> outs(3);
     std::vector<std::thread> th;
-    for (size_t i = 1; i < offs.size(); ++i)
+    for (size_t i = 0; i < outs.size(); ++i)
     {
-        outs[i - 1] = tinybuf_value_alloc();
+        outs[i] = tinybuf_value_alloc();
         th.emplace_back([&, i]
                         {
-            buf_ref br{(const char*)base, all, (const char*)base + (int64_t)offs[i], all - (int64_t)offs[i]};
             tinybuf_error r = tinybuf_result_ok(0);
-            assert(tinybuf_try_read_box(&br, outs[i-1], any_version, &r)>0); });
+            assert(tinybuf_part_read(table, (int64_t)i + 1, outs[i], any_version, &r) > 0);
+            tinybuf_result_unref(&r); });
     }
     for (auto &t : th)
         t.join();
+    for (size_t i = 0; i < outs.size(); ++i)
+        assert(tinybuf_value_is_same(outs[i], subs[i]));
+    assert(tinybuf_part_read(table, 4, outs[0], any_version, &tr) == -1);
+    tinybuf_part_table_close(table);
+    tinybuf_result_unref(&tr);
     tinybuf_value *out = tinybuf_value_alloc();
     {
         buf_ref br{(const char *)base, all, (const char *)base, all};
@@ -1519,6 +1606,78 @@ static void partition_concurrent_read_tests()
     tinybuf_value_free(s1);
     tinybuf_value_free(s2);
     tinybuf_value_free(s3);
+
+    // 吞吐: 256个分区 逐个读取与并行读取结果一致 strpool开关各测一次
+    const int part_count = 256;
+    std::vector<tinybuf_value *> big(part_count);
+    for (int p = 0; p < part_count; ++p)
+    {
+        tinybuf_value *m = tinybuf_value_alloc();
+        for (int k = 0; k < 64; ++k)
+        {
+            tinybuf_value *row = tinybuf_value_alloc();
+            for (int j = 0; j < 32; ++j)
+            {
+                tinybuf_value *x = tinybuf_value_alloc();
+                tinybuf_value_init_double(x, p * 0.5 + k * j);
+                tinybuf_value_array_append(row, x);
+            }
+            std::string key = "col_" + std::to_string(k);
+            tinybuf_value_map_set(m, key.c_str(), row);
+        }
+        big[p] = m;
+    }
+    tinybuf_value *head = tinybuf_value_alloc();
+    tinybuf_value_init_string(head, "checkpoint", 10);
+    unsigned hw = std::thread::hardware_concurrency();
+    for (int pool = 0; pool < 2; ++pool)
+    {
+        tinybuf_set_use_strpool(pool);
+        buffer *arc = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int64_t n = tinybuf_try_write_partitions64(arc, head, (const tinybuf_value **)big.data(), part_count, &r);
+        assert(n > 0);
+        buf_ref br{buffer_get_data(arc), n, buffer_get_data(arc), n};
+        tinybuf_part_table *t = tinybuf_part_table_open(&br, &r);
+        assert(t && tinybuf_part_table_count(t) == part_count + 1);
+        std::vector<int64_t> idx(part_count);
+        std::vector<tinybuf_value *> serial(part_count), para(part_count), forced(part_count);
+        for (int i = 0; i < part_count; ++i)
+        {
+            idx[i] = i + 1;
+            serial[i] = tinybuf_value_alloc();
+            para[i] = tinybuf_value_alloc();
+            forced[i] = tinybuf_value_alloc();
+        }
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < part_count; ++i)
+            assert(tinybuf_part_read(t, idx[i], serial[i], any_version, &r) > 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        assert(tinybuf_parts_read_parallel(t, idx.data(), part_count, para.data(), 0, any_version, &r) == 0);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        // 单核机器上也覆盖多线程路径
+        assert(tinybuf_parts_read_parallel(t, idx.data(), part_count, forced.data(), 8, any_version, &r) == 0);
+        for (int i = 0; i < part_count; ++i)
+        {
+            assert(tinybuf_value_is_same(serial[i], big[i]));
+            assert(tinybuf_value_is_same(para[i], big[i]));
+            assert(tinybuf_value_is_same(forced[i], big[i]));
+            tinybuf_value_free(serial[i]);
+            tinybuf_value_free(para[i]);
+            tinybuf_value_free(forced[i]);
+        }
+        double ms1 = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double ms2 = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        LOGI("read partitions x%d strpool=%d %lld bytes: serial %.2f ms (%.1f MB/s) parallel[%u cpus] %.2f ms (%.1f MB/s)",
+             part_count, pool, (long long)n, ms1, n / 1048576.0 / (ms1 / 1000.0), hw, ms2, n / 1048576.0 / (ms2 / 1000.0));
+        tinybuf_part_table_close(t);
+        tinybuf_result_unref(&r);
+        buffer_free(arc);
+    }
+    tinybuf_set_use_strpool(0);
+    for (auto *v : big)
+        tinybuf_value_free(v);
+    tinybuf_value_free(head);
     LOGI("partition_concurrent_read_tests done");
 }
 
@@ -2171,6 +2330,15 @@ static void partition_concurrent_write_tests()
         assert(tinybuf_try_read_box(&br, readv, any_version, &r) > 0);
         tinybuf_value_free(readv);
     }
+    // 手工拼接的结果与并行写分区一致
+    {
+        buffer *pout = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        assert(tinybuf_try_write_partitions_parallel(pout, mainv, subs, 3, 4, &r) == buffer_get_length(out));
+        assert(memcmp(buffer_get_data(pout), buffer_get_data(out), buffer_get_length(out)) == 0);
+        tinybuf_result_unref(&r);
+        buffer_free(pout);
+    }
     for (auto *p : parts)
         buffer_free(p);
     buffer_free(out);
@@ -2178,9 +2346,2711 @@ static void partition_concurrent_write_tests()
     tinybuf_value_free(s1);
     tinybuf_value_free(s2);
     tinybuf_value_free(s3);
+
+    // 吞吐: 256个分区 串行与并行输出逐字节一致 strpool开关各测一次
+    const int part_count = 256;
+    std::vector<tinybuf_value *> big(part_count);
+    for (int p = 0; p < part_count; ++p)
+    {
+        tinybuf_value *m = tinybuf_value_alloc();
+        for (int k = 0; k < 64; ++k)
+        {
+            tinybuf_value *row = tinybuf_value_alloc();
+            for (int j = 0; j < 32; ++j)
+            {
+                tinybuf_value *x = tinybuf_value_alloc();
+                tinybuf_value_init_double(x, p * 0.5 + k * j);
+                tinybuf_value_array_append(row, x);
+            }
+            std::string key = "col_" + std::to_string(k);
+            tinybuf_value_map_set(m, key.c_str(), row);
+        }
+        big[p] = m;
+    }
+    tinybuf_value *head = tinybuf_value_alloc();
+    tinybuf_value_init_string(head, "checkpoint", 10);
+    unsigned hw = std::thread::hardware_concurrency();
+    for (int pool = 0; pool < 2; ++pool)
+    {
+        tinybuf_set_use_strpool(pool);
+        buffer *serial = buffer_alloc();
+        buffer *para = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        auto t0 = std::chrono::high_resolution_clock::now();
+        int64_t n1 = tinybuf_try_write_partitions64(serial, head, (const tinybuf_value **)big.data(), part_count, &r);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        int64_t n2 = tinybuf_try_write_partitions_parallel(para, head, (const tinybuf_value **)big.data(), part_count, 0, &r);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        assert(n1 > 0 && n1 == n2);
+        assert(memcmp(buffer_get_data(serial), buffer_get_data(para), (size_t)n1) == 0);
+        // 单核机器上threads=0退化为串行 显式指定线程数覆盖并行路径
+        buffer *forced = buffer_alloc();
+        assert(tinybuf_try_write_partitions_parallel(forced, head, (const tinybuf_value **)big.data(), part_count, 8, &r) == n1);
+        assert(memcmp(buffer_get_data(serial), buffer_get_data(forced), (size_t)n1) == 0);
+        buffer_free(forced);
+        double ms1 = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double ms2 = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        LOGI("partitions x%d strpool=%d %lld bytes: serial %.2f ms (%.1f MB/s) parallel[%u cpus] %.2f ms (%.1f MB/s)",
+             part_count, pool, (long long)n1, ms1, n1 / 1048576.0 / (ms1 / 1000.0), hw, ms2, n2 / 1048576.0 / (ms2 / 1000.0));
+        tinybuf_result_unref(&r);
+        buffer_free(serial);
+        buffer_free(para);
+    }
+    tinybuf_set_use_strpool(0);
+    for (auto *v : big)
+        tinybuf_value_free(v);
+    tinybuf_value_free(head);
     LOGI("partition_concurrent_write_tests done");
 }
 
+static std::atomic<long long> s_alloc_count{0};
+static void *counting_malloc(int size)
+{
+    s_alloc_count++;
+    return malloc(size);
+}
+static std::atomic<long long> s_realloc_count{0};
+static void *counting_realloc(void *ptr, int size)
+{
+    s_alloc_count++;
+    s_realloc_count++;
+    return realloc(ptr, size);
+}
+
+static void result_alloc_per_node_tests()
+{
+    LOGI("\r\nresult_alloc_per_node_tests");
+    const int N = 10000;
+    tinybuf_value *arr = tinybuf_value_alloc_with_type(tinybuf_array);
+    for (int i = 0; i < N; ++i)
+    {
+        tinybuf_value *c = tinybuf_value_alloc();
+        tinybuf_value_init_int(c, i);
+        tinybuf_value_array_append(arr, c);
+    }
+    long long allocs[2] = {0, 0};
+    for (int fast = 0; fast < 2; ++fast)
+    {
+        tinybuf_result_set_fast_mode(fast);
+        buffer *b = buffer_alloc();
+        buffer_append(b, "x", 1);
+        buffer_set_length(b, 0);
+        set_malloc_ptr(counting_malloc);
+        set_realloc_ptr(counting_realloc);
+        s_alloc_count = 0;
+        {
+            TimePrinter tp(fast ? "[result fast] " : "[result legacy] ");
+            tinybuf_error wr = tinybuf_result_ok(0);
+            int wn = tinybuf_try_write_box(b, arr, &wr);
+            assert(wn > 0);
+            tinybuf_result_unref(&wr);
+        }
+        allocs[fast] = s_alloc_count.load();
+        set_malloc_ptr(NULL);
+        set_realloc_ptr(NULL);
+        LOGI("result %s: allocs=%lld per_node=%.3f", fast ? "fast" : "legacy", allocs[fast], (double)allocs[fast] / (N + 1));
+        buffer_free(b);
+    }
+    tinybuf_result_set_fast_mode(1);
+    assert(allocs[1] < allocs[0]);
+    {
+        tinybuf_error r = tinybuf_result_ok(1);
+        assert(r.refcnt == NULL && r.msgs == NULL);
+        tinybuf_result_add_msg_const(&r, "first error");
+        assert(r.refcnt != NULL && tinybuf_result_msg_count(&r) == 1);
+        assert(tinybuf_result_unref(&r) == 0);
+    }
+    tinybuf_value_free(arr);
+    LOGI("result_alloc_per_node_tests done");
+}
+
+static void array_vector_perf_tests()
+{
+    LOGI("\r\narray_vector_perf_tests");
+    const int N = 100000;
+    tinybuf_value *arr = tinybuf_value_alloc_with_type(tinybuf_array);
+    set_malloc_ptr(counting_malloc);
+    set_realloc_ptr(counting_realloc);
+    s_alloc_count = 0;
+    {
+        TimePrinter tp("[array append] ");
+        for (int i = 0; i < N; ++i)
+        {
+            tinybuf_value *c = tinybuf_value_alloc();
+            tinybuf_value_init_int(c, i);
+            tinybuf_value_array_append(arr, c);
+        }
+    }
+    long long append_allocs = s_alloc_count.load();
+    set_malloc_ptr(NULL);
+    set_realloc_ptr(NULL);
+    LOGI("array append: allocs=%lld per_elem=%.3f", append_allocs, (double)append_allocs / N);
+    // 每个成员只有value本身的一次分配 外加vector的对数次扩容
+    assert(append_allocs < N + 64);
+    {
+        TimePrinter tp("[array index] ");
+        tinybuf_error r = tinybuf_result_ok(0);
+        int64_t sum = 0;
+        for (int i = 0; i < N; ++i)
+        {
+            sum += tinybuf_value_get_int(tinybuf_value_get_array_child(arr, i, &r), &r);
+        }
+        assert(sum == (int64_t)N * (N - 1) / 2);
+        assert(tinybuf_value_get_array_child(arr, N, &r) == NULL);
+        tinybuf_result_unref(&r);
+    }
+    buffer *b = buffer_alloc();
+    {
+        TimePrinter tp("[array serialize] ");
+        tinybuf_error r = tinybuf_result_ok(0);
+        assert(tinybuf_try_write_box(b, arr, &r) > 0);
+        tinybuf_result_unref(&r);
+    }
+    tinybuf_value *back = tinybuf_value_alloc();
+    {
+        TimePrinter tp("[array deserialize] ");
+        buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+        tinybuf_error r = tinybuf_result_ok(0);
+        assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+        tinybuf_result_unref(&r);
+    }
+    tinybuf_value *copy = NULL;
+    {
+        TimePrinter tp("[array clone] ");
+        copy = tinybuf_value_clone(back);
+    }
+    {
+        TimePrinter tp("[array is_same] ");
+        assert(tinybuf_value_is_same(arr, back));
+        assert(tinybuf_value_is_same(arr, copy));
+    }
+    {
+        TimePrinter tp("[array json] ");
+        buffer *json = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        tinybuf_value_serialize_as_json(copy, json, 1, &r);
+        assert(buffer_get_length(json) > N);
+        tinybuf_result_unref(&r);
+        buffer_free(json);
+    }
+    tinybuf_value_free(copy);
+    tinybuf_value_free(back);
+    tinybuf_value_free(arr);
+    buffer_free(b);
+    LOGI("array_vector_perf_tests done");
+}
+
+static void map_backend_perf_tests()
+{
+    LOGI("\r\nmap_backend_perf_tests");
+    const int sizes[] = {8, 64, 4096};
+    const char *names[] = {"avl", "hash"};
+    const int total_ops = 400000;
+    for (int si = 0; si < 3; ++si)
+    {
+        const int n = sizes[si];
+        const int rounds = total_ops / n;
+        vector<string> keys;
+        for (int i = 0; i < n; ++i)
+        {
+            keys.push_back("field_" + to_string(i * 7919));
+        }
+        double build_ns[2] = {0, 0};
+        double lookup_ns[2] = {0, 0};
+        for (int backend = 0; backend < 2; ++backend)
+        {
+            tinybuf_set_map_backend(backend ? tinybuf_map_backend_hash : tinybuf_map_backend_avl);
+            uint64_t t0 = getCurrentMicrosecondOrigin();
+            for (int round = 0; round < rounds; ++round)
+            {
+                tinybuf_value *m = tinybuf_value_alloc_with_type(tinybuf_map);
+                for (int i = 0; i < n; ++i)
+                {
+                    tinybuf_value *c = tinybuf_value_alloc();
+                    tinybuf_value_init_int(c, i);
+                    tinybuf_value_map_set(m, keys[i].c_str(), c);
+                }
+                tinybuf_value_free(m);
+            }
+            build_ns[backend] = (getCurrentMicrosecondOrigin() - t0) * 1000.0 / ((double)rounds * n);
+
+            tinybuf_value *m = tinybuf_value_alloc_with_type(tinybuf_map);
+            for (int i = 0; i < n; ++i)
+            {
+                tinybuf_value *c = tinybuf_value_alloc();
+                tinybuf_value_init_int(c, i);
+                tinybuf_value_map_set(m, keys[i].c_str(), c);
+            }
+            tinybuf_error r = tinybuf_result_ok(0);
+            int64_t sum = 0;
+            t0 = getCurrentMicrosecondOrigin();
+            for (int round = 0; round < rounds; ++round)
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    sum += tinybuf_value_get_int(tinybuf_value_get_map_child2(m, keys[i].data(), (int)keys[i].size(), &r), &r);
+                }
+            }
+            lookup_ns[backend] = (getCurrentMicrosecondOrigin() - t0) * 1000.0 / ((double)rounds * n);
+            assert(sum == (int64_t)rounds * n * (n - 1) / 2);
+            assert(tinybuf_result_msg_count(&r) == 0);
+            tinybuf_result_unref(&r);
+
+            // hash后端按插入顺序遍历
+            if (backend)
+            {
+                tinybuf_error rk = tinybuf_result_ok(0);
+                for (int i = 0; i < n; ++i)
+                {
+                    buffer *key = NULL;
+                    const tinybuf_value *c = tinybuf_value_get_map_child_and_key(m, i, &key, &rk);
+                    assert(c && key);
+                    assert(buffer_get_length(key) == (int)keys[i].size());
+                    assert(memcmp(buffer_get_data(key), keys[i].data(), keys[i].size()) == 0);
+                }
+                // 继续插入使entries扩容后 之前取得的key仍然有效
+                buffer *first = NULL;
+                tinybuf_value_get_map_child_and_key(m, 0, &first, &rk);
+                for (int i = 0; i < n; ++i)
+                {
+                    tinybuf_value *c = tinybuf_value_alloc();
+                    tinybuf_value_map_set(m, ("more_" + to_string(i)).c_str(), c);
+                }
+                assert(buffer_get_length(first) == (int)keys[0].size());
+                assert(memcmp(buffer_get_data(first), keys[0].data(), keys[0].size()) == 0);
+                tinybuf_result_unref(&rk);
+            }
+            tinybuf_value_free(m);
+        }
+        for (int backend = 0; backend < 2; ++backend)
+        {
+            LOGI("map %s keys=%d: build %.1f ns/key, lookup %.1f ns/key", names[backend], n, build_ns[backend], lookup_ns[backend]);
+        }
+    }
+    // 两种后端序列化后再读回应当得到相同内容
+    {
+        tinybuf_value *src[2];
+        for (int backend = 0; backend < 2; ++backend)
+        {
+            tinybuf_set_map_backend(backend ? tinybuf_map_backend_hash : tinybuf_map_backend_avl);
+            src[backend] = tinybuf_value_alloc();
+            for (int i = 64; i > 0; --i)
+            {
+                tinybuf_value *c = tinybuf_value_alloc();
+                tinybuf_value_init_int(c, i);
+                tinybuf_value_map_set(src[backend], ("k" + to_string(i)).c_str(), c);
+            }
+        }
+        for (int backend = 0; backend < 2; ++backend)
+        {
+            tinybuf_set_map_backend(backend ? tinybuf_map_backend_hash : tinybuf_map_backend_avl);
+            buffer *b = buffer_alloc();
+            tinybuf_error r = tinybuf_result_ok(0);
+            assert(tinybuf_try_write_box(b, src[backend], &r) > 0);
+            buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+            tinybuf_value *back = tinybuf_value_alloc();
+            assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+            assert(tinybuf_value_is_same(back, src[0]));
+            assert(tinybuf_value_is_same(back, src[1]));
+            tinybuf_value *copy = tinybuf_value_clone(back);
+            assert(tinybuf_value_is_same(copy, src[backend]));
+            tinybuf_value_free(copy);
+            tinybuf_value_free(back);
+            tinybuf_result_unref(&r);
+            buffer_free(b);
+        }
+        tinybuf_value_free(src[0]);
+        tinybuf_value_free(src[1]);
+    }
+    tinybuf_set_map_backend(tinybuf_map_backend_avl);
+    LOGI("map_backend_perf_tests done");
+}
+
+static tinybuf_value *ctx_parallel_make_doc(int seed)
+{
+    tinybuf_value *m = tinybuf_value_alloc_with_type(tinybuf_map);
+    for (int i = 0; i < 32; ++i)
+    {
+        tinybuf_value *row = tinybuf_value_alloc_with_type(tinybuf_map);
+        tinybuf_value *name = tinybuf_value_alloc();
+        string s = "name_" + to_string((seed + i) % 7);
+        tinybuf_value_init_string(name, s.c_str(), (int)s.size());
+        tinybuf_value_map_set(row, "name", name);
+        tinybuf_value *id = tinybuf_value_alloc();
+        tinybuf_value_init_int(id, seed * 100 + i);
+        tinybuf_value_map_set(row, "id", id);
+        tinybuf_value_map_set(m, ("row" + to_string(i)).c_str(), row);
+    }
+    return m;
+}
+
+static void ctx_parallel_perf_tests()
+{
+    LOGI("\r\nctx_parallel_perf_tests");
+    // 每个线程使用自己的writer/reader上下文 编解码互不干扰 不再经过全局锁
+    tinybuf_set_use_strpool(1);
+    const int jobs_per_thread = 2000;
+    const int thread_counts[] = {1, 2, 4, 8};
+    double base_rate = 0;
+    for (int tc : thread_counts)
+    {
+        std::atomic<int> bad{0};
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        vector<std::thread> th;
+        for (int t = 0; t < tc; ++t)
+        {
+            th.emplace_back([t, &bad, jobs_per_thread]
+                            {
+                tinybuf_writer_ctx *wctx = tinybuf_writer_ctx_new();
+                tinybuf_reader_ctx *rctx = tinybuf_reader_ctx_new();
+                tinybuf_value *doc = ctx_parallel_make_doc(t);
+                for (int j = 0; j < jobs_per_thread; ++j)
+                {
+                    buffer *b = buffer_alloc();
+                    tinybuf_error r = tinybuf_result_ok(0);
+                    if (tinybuf_try_write_box_ctx(wctx, b, doc, &r) <= 0)
+                        ++bad;
+                    buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+                    tinybuf_value *back = tinybuf_value_alloc();
+                    if (tinybuf_try_read_box_ctx(rctx, &br, back, any_version, &r) <= 0 || !tinybuf_value_is_same(back, doc))
+                        ++bad;
+                    tinybuf_value_free(back);
+                    tinybuf_result_unref(&r);
+                    buffer_free(b);
+                }
+                tinybuf_value_free(doc);
+                tinybuf_reader_ctx_free(rctx);
+                tinybuf_writer_ctx_free(wctx); });
+        }
+        for (auto &x : th)
+            x.join();
+        double sec = (getCurrentMicrosecondOrigin() - t0) / 1e6;
+        double rate = (double)tc * jobs_per_thread / sec;
+        if (tc == 1)
+            base_rate = rate;
+        LOGI("ctx parallel threads=%d: %.0f docs/s, speedup %.2fx", tc, rate, rate / base_rate);
+        assert(bad.load() == 0);
+    }
+    tinybuf_set_use_strpool(0);
+    LOGI("ctx_parallel_perf_tests done");
+}
+
+static int offset_pool_last_version(uint64_t version) { return version == 99999; }
+
+static void offset_pool_perf_tests()
+{
+    LOGI("\r\noffset_pool_perf_tests");
+    const int nodes = 100000;
+    // 不带指针: 1000个map 每个map 99个int 共100k个节点
+    {
+        tinybuf_value *root = tinybuf_value_alloc_with_type(tinybuf_array);
+        for (int i = 0; i < nodes / 100; ++i)
+        {
+            tinybuf_value *m = tinybuf_value_alloc_with_type(tinybuf_map);
+            for (int j = 0; j < 99; ++j)
+            {
+                tinybuf_value *c = tinybuf_value_alloc();
+                tinybuf_value_init_int(c, i * 100 + j);
+                tinybuf_value_map_set(m, ("k" + to_string(j)).c_str(), c);
+            }
+            tinybuf_value_array_append(root, m);
+        }
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        assert(tinybuf_try_write_box(b, root, &r) > 0);
+        buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+        tinybuf_value *back = tinybuf_value_alloc();
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+        uint64_t us = getCurrentMicrosecondOrigin() - t0;
+        assert(tinybuf_value_is_same(back, root));
+        LOGI("read tree without pointers: %d nodes in %.2f ms (%.1f ns/node)", nodes, us / 1000.0, us * 1000.0 / nodes);
+        tinybuf_value_free(back);
+        tinybuf_value_free(root);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    // 一次读取经过100k个box: version list只接受最后一个版本 前面的box都要读过并登记到offset池
+    {
+        vector<tinybuf_value *> boxes;
+        vector<uint64_t> versions;
+        for (int i = 0; i < nodes; ++i)
+        {
+            tinybuf_value *v = tinybuf_value_alloc();
+            tinybuf_value_init_int(v, i + 1);
+            boxes.push_back(v);
+            versions.push_back((uint64_t)i);
+        }
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        assert(tinybuf_try_write_version_list(b, versions.data(), (const tinybuf_value **)boxes.data(), nodes, &r) > 0);
+        buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+        tinybuf_value *back = tinybuf_value_alloc();
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        assert(tinybuf_try_read_box(&br, back, offset_pool_last_version, &r) > 0);
+        uint64_t us = getCurrentMicrosecondOrigin() - t0;
+        assert(tinybuf_value_get_int(back, &r) == nodes);
+        LOGI("read version list: %d boxes in %.2f ms (%.1f ns/box)", nodes, us / 1000.0, us * 1000.0 / nodes);
+        tinybuf_value_free(back);
+        for (auto v : boxes)
+            tinybuf_value_free(v);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    // 带指针: 连续写100k个box 奇数位置是指向前一个box的指针 逐个读取
+    {
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int64_t prev = 0;
+        for (int i = 0; i < nodes; ++i)
+        {
+            if (i & 1)
+            {
+                assert(tinybuf_try_write_pointer(b, tinybuf_offset_start, prev, &r) > 0);
+            }
+            else
+            {
+                prev = (int64_t)buffer_get_length(b);
+                tinybuf_value *v = tinybuf_value_alloc();
+                tinybuf_value_init_int(v, i + 1);
+                assert(tinybuf_try_write_box(b, v, &r) > 0);
+                tinybuf_value_free(v);
+            }
+        }
+        buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < nodes; ++i)
+        {
+            tinybuf_value *back = tinybuf_value_alloc();
+            assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+            assert(tinybuf_value_get_int(back, &r) == (i & ~1) + 1);
+            tinybuf_value_free(back);
+        }
+        uint64_t us = getCurrentMicrosecondOrigin() - t0;
+        LOGI("read stream with pointers: %d boxes in %.2f ms (%.1f ns/box)", nodes, us / 1000.0, us * 1000.0 / nodes);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    LOGI("offset_pool_perf_tests done");
+}
+
+static void strpool_table_write_perf_tests()
+{
+    LOGI("\r\nstrpool_table_write_perf_tests");
+    // 几MB的文档 body和pool直接写入out 比较最短编码回填与固定宽度offset
+    tinybuf_value *doc = tinybuf_value_alloc_with_type(tinybuf_array);
+    for (int i = 0; i < 50000; ++i)
+    {
+        tinybuf_value *m = tinybuf_value_alloc_with_type(tinybuf_map);
+        tinybuf_value *s = tinybuf_value_alloc();
+        string v = "value_" + to_string(i % 500) + "_with_some_padding_text";
+        tinybuf_value_init_string(s, v.c_str(), (int)v.size());
+        tinybuf_value_map_set(m, "name", s);
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_int(n, i);
+        tinybuf_value_map_set(m, "id", n);
+        tinybuf_value_array_append(doc, m);
+    }
+    tinybuf_set_use_strpool(1);
+    // 默认使用固定宽度的offset 写入时不需要后移body和pool
+    int default_len = 0;
+    {
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        default_len = tinybuf_try_write_box(b, doc, &r);
+        assert(default_len > 0);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    int lens[2] = {0, 0};
+    for (int fixed = 0; fixed < 2; ++fixed)
+    {
+        tinybuf_set_strpool_fixed_offset(fixed);
+        // 取3次中最快的一次 减少堆状态对realloc的影响
+        uint64_t best_us = UINT64_MAX;
+        long long allocs = 0;
+        for (int round = 0; round < 3; ++round)
+        {
+            buffer *b = buffer_alloc();
+            buffer_append(b, "x", 1);
+            buffer_set_length(b, 0);
+            set_malloc_ptr(counting_malloc);
+            set_realloc_ptr(counting_realloc);
+            s_alloc_count = 0;
+            tinybuf_error r = tinybuf_result_ok(0);
+            uint64_t t0 = getCurrentMicrosecondOrigin();
+            int wn = tinybuf_try_write_box(b, doc, &r);
+            uint64_t us = getCurrentMicrosecondOrigin() - t0;
+            allocs = s_alloc_count.load();
+            set_malloc_ptr(NULL);
+            set_realloc_ptr(NULL);
+            assert(wn > 0 && wn == buffer_get_length(b));
+            lens[fixed] = wn;
+            if (us < best_us)
+                best_us = us;
+            buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+            tinybuf_value *back = tinybuf_value_alloc();
+            assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+            assert(tinybuf_value_is_same(back, doc));
+            tinybuf_value_free(back);
+            tinybuf_result_unref(&r);
+            buffer_free(b);
+        }
+        LOGI("strpool table %s offset: %d bytes in %.2f ms, allocs=%lld", fixed ? "fixed" : "compact", lens[fixed], best_us / 1000.0, allocs);
+    }
+    // 固定宽度只影响offset本身
+    assert(lens[1] >= lens[0] && lens[1] - lens[0] <= 4);
+    assert(default_len == lens[1]);
+    tinybuf_set_strpool_fixed_offset(1);
+    tinybuf_set_use_strpool(0);
+    tinybuf_value_free(doc);
+    LOGI("strpool_table_write_perf_tests done");
+}
+
+static void buffer_growth_perf_tests()
+{
+    LOGI("\r\nbuffer_growth_perf_tests");
+    // 逐个写入约100字节的小字段 统计写到目标长度所需的realloc次数
+    tinybuf_value *field = tinybuf_value_alloc();
+    string text(96, 'g');
+    tinybuf_value_init_string(field, text.c_str(), (int)text.size());
+    const int sizes_mb[3] = {1, 16, 256};
+    const double factors[2] = {1.0, 2.0};
+    for (int si = 0; si < 3; ++si)
+    {
+        int target = sizes_mb[si] << 20;
+        long long reallocs[2] = {0, 0};
+        for (int fi = 0; fi < 2; ++fi)
+        {
+            buffer_set_growth_factor(factors[fi]);
+            buffer *b = buffer_alloc();
+            set_malloc_ptr(counting_malloc);
+            set_realloc_ptr(counting_realloc);
+            s_realloc_count = 0;
+            tinybuf_error r = tinybuf_result_ok(0);
+            uint64_t t0 = getCurrentMicrosecondOrigin();
+            while (buffer_get_length(b) < target)
+            {
+                tinybuf_value_serialize(field, b, &r);
+            }
+            uint64_t us = getCurrentMicrosecondOrigin() - t0;
+            reallocs[fi] = s_realloc_count.load();
+            set_malloc_ptr(NULL);
+            set_realloc_ptr(NULL);
+            LOGI("%dMB growth %.1f: reallocs=%lld in %.2f ms", sizes_mb[si], factors[fi], reallocs[fi], us / 1000.0);
+            tinybuf_result_unref(&r);
+            buffer_free(b);
+        }
+        // 倍增后realloc次数只与目标长度的对数相关
+        assert(reallocs[1] <= 32);
+        assert(reallocs[1] * 100 < reallocs[0]);
+    }
+    buffer_set_growth_factor(2.0);
+    tinybuf_value_free(field);
+
+    // 按估计长度预留后 整个文档的序列化只需要一次分配
+    tinybuf_value *doc = tinybuf_value_alloc_with_type(tinybuf_array);
+    for (int i = 0; i < 100000; ++i)
+    {
+        tinybuf_value *m = tinybuf_value_alloc_with_type(tinybuf_map);
+        tinybuf_value *s = tinybuf_value_alloc();
+        string v = "item_" + to_string(i);
+        tinybuf_value_init_string(s, v.c_str(), (int)v.size());
+        tinybuf_value_map_set(m, "name", s);
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_double(n, i * 0.5);
+        tinybuf_value_map_set(m, "score", n);
+        tinybuf_value_array_append(doc, m);
+    }
+    int lens[2] = {0, 0};
+    for (int reserve = 0; reserve < 2; ++reserve)
+    {
+        buffer *b = buffer_alloc();
+        set_malloc_ptr(counting_malloc);
+        set_realloc_ptr(counting_realloc);
+        s_alloc_count = 0;
+        tinybuf_error r = tinybuf_result_ok(0);
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        lens[reserve] = reserve ? tinybuf_value_serialize_with_reserve(doc, b, &r) : tinybuf_value_serialize(doc, b, &r);
+        uint64_t us = getCurrentMicrosecondOrigin() - t0;
+        long long allocs = s_alloc_count.load();
+        set_malloc_ptr(NULL);
+        set_realloc_ptr(NULL);
+        LOGI("serialize %s: %d bytes, buffer allocs=%lld in %.2f ms", reserve ? "with reserve" : "plain", lens[reserve], allocs, us / 1000.0);
+        if (reserve)
+        {
+            assert(allocs == 1);
+        }
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    assert(lens[0] > 0 && lens[0] == lens[1]);
+    tinybuf_value_free(doc);
+    LOGI("buffer_growth_perf_tests done");
+}
+
+static tinybuf_value *make_size_sample()
+{
+    tinybuf_value *root = tinybuf_value_alloc_with_type(tinybuf_map);
+    const int64_t ints[] = {0, 1, -1, 127, 128, -300, 1LL << 40, -(1LL << 62)};
+    tinybuf_value *arr = tinybuf_value_alloc_with_type(tinybuf_array);
+    for (int64_t v : ints)
+    {
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_int(n, v);
+        tinybuf_value_array_append(arr, n);
+    }
+    for (int i = 0; i < 300; ++i)
+    {
+        tinybuf_value *s = tinybuf_value_alloc();
+        string v(i % 150, (char)('a' + i % 7));
+        tinybuf_value_init_string(s, v.c_str(), (int)v.size());
+        tinybuf_value_array_append(arr, s);
+    }
+    tinybuf_value_map_set(root, "values", arr);
+    tinybuf_value *d = tinybuf_value_alloc();
+    tinybuf_value_init_double(d, 3.25);
+    tinybuf_value_map_set(root, "pi", d);
+    tinybuf_value_map_set(root, "none", tinybuf_value_alloc());
+    tinybuf_value *b = tinybuf_value_alloc();
+    tinybuf_value_init_bool(b, 1);
+    tinybuf_value_map_set(root, "flag", b);
+    // 各种dtype的一维和多维tensor
+    double dd[6] = {1, 2, 3, 4, 5, 6};
+    float ff[6] = {1, 2, 3, 4, 5, 6};
+    uint8_t bb[6] = {1, 0, 1, 1, 0, 1};
+    int64_t ii[6] = {0, -5, 200, -70000, 1LL << 35, 9};
+    const void *datas[4] = {dd, ff, bb, ii};
+    const int dtypes[4] = {8, 10, 11, 0};
+    int64_t shape1[1] = {6};
+    int64_t shape2[2] = {2, 3};
+    for (int k = 0; k < 4; ++k)
+    {
+        tinybuf_value *t1 = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(t1, dtypes[k], shape1, 1, datas[k], 6);
+        tinybuf_value_map_set(root, ("vec" + to_string(k)).c_str(), t1);
+        tinybuf_value *t2 = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(t2, dtypes[k], shape2, 2, datas[k], 6);
+        tinybuf_value_map_set(root, ("mat" + to_string(k)).c_str(), t2);
+    }
+    uint8_t bits[3] = {0xA5, 0x0F, 0x80};
+    tinybuf_value *bm = tinybuf_value_alloc();
+    tinybuf_value_init_bool_map(bm, bits, 17);
+    tinybuf_value_map_set(root, "bits", bm);
+    return root;
+}
+
+static void serialized_size_tests()
+{
+    LOGI("\r\nserialized_size_tests");
+    tinybuf_value *root = make_size_sample();
+    // 不开strpool 开strpool(最短/固定宽度offset)三种编码下 预计算长度与实际写入一致
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        tinybuf_set_use_strpool(mode > 0);
+        tinybuf_set_strpool_fixed_offset(mode == 2);
+        int64_t size = tinybuf_value_serialized_size(root);
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, root, &r);
+        LOGI("mode %d: predicted %lld, written %d", mode, (long long)size, wn);
+        assert(wn > 0 && size == wn);
+
+        // 写入刚好够大的外部内存 内容与普通写入相同 末尾的哨兵字节不被改动
+        vector<char> slab((size_t)size + 1, (char)0x5A);
+        tinybuf_error r2 = tinybuf_result_ok(0);
+        int in = tinybuf_try_write_box_into(slab.data(), (int)size, root, &r2);
+        assert(in == size);
+        assert(memcmp(slab.data(), buffer_get_data(b), (size_t)size) == 0);
+        assert(slab[(size_t)size] == (char)0x5A);
+        tinybuf_result_unref(&r2);
+
+        // 少一个字节时失败
+        tinybuf_error r3 = tinybuf_result_ok(0);
+        std::fill(slab.begin(), slab.end(), (char)0x5A);
+        assert(tinybuf_try_write_box_into(slab.data(), (int)size - 1, root, &r3) < 0);
+        assert(slab[(size_t)size - 1] == (char)0x5A);
+        tinybuf_result_unref(&r3);
+
+        // 分区表
+        const tinybuf_value *subs[2] = {root, tinybuf_value_get_map_child(root, "values", &r)};
+        buffer *pb = buffer_alloc();
+        int pn = tinybuf_try_write_partitions(pb, root, subs, 2, &r);
+        assert(pn > 0 && tinybuf_partitions_serialized_size(root, subs, 2) == pn);
+        buffer_free(pb);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    tinybuf_set_strpool_fixed_offset(1);
+
+    // 外部内存从1字节逐个加大 容量不够时失败且不写出容量之外 strpool三种offset编码都覆盖
+    tinybuf_value *one = tinybuf_value_alloc();
+    tinybuf_value_init_int(one, 7);
+    const tinybuf_value *samples[2] = {one, root};
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        tinybuf_set_strpool_fixed_offset(mode != 0);
+        tinybuf_set_tensor_native(mode == 2);
+        for (int s = 0; s < 2; ++s)
+        {
+            int64_t size = tinybuf_value_serialized_size(samples[s]);
+            assert(size > 0);
+            for (int cap = 1; cap <= size + 1; ++cap)
+            {
+                vector<char> slab((size_t)cap + 16, (char)0x5A);
+                tinybuf_error rc = tinybuf_result_ok(0);
+                int in = tinybuf_try_write_box_into(slab.data(), cap, samples[s], &rc);
+                assert(cap < size ? in < 0 : in == size);
+                for (size_t i = (size_t)cap; i < slab.size(); ++i)
+                    assert(slab[i] == (char)0x5A);
+                tinybuf_result_unref(&rc);
+
+                buffer *fb = buffer_alloc_fixed(slab.data(), cap);
+                tinybuf_error rp = tinybuf_result_ok(0);
+                int pn = tinybuf_try_write_part(fb, samples[s], &rp);
+                assert(buffer_is_overflow(fb) || pn > 0);
+                for (size_t i = (size_t)cap; i < slab.size(); ++i)
+                    assert(slab[i] == (char)0x5A);
+                tinybuf_result_unref(&rp);
+                buffer_free(fb);
+            }
+        }
+    }
+    tinybuf_set_tensor_native(0);
+    tinybuf_set_strpool_fixed_offset(1);
+    tinybuf_set_use_strpool(0);
+    tinybuf_value_free(one);
+
+    // 开启precache重定向时长度无法预先计算
+    tinybuf_precache_set_redirect(1);
+    assert(tinybuf_value_serialized_size(root) == -1);
+    tinybuf_precache_set_redirect(0);
+    assert(tinybuf_value_serialized_size(root) > 0);
+    tinybuf_value_free(root);
+    LOGI("serialized_size_tests done");
+}
+
+static void view_perf_tests()
+{
+    LOGI("\r\nview_perf_tests");
+    // 约50KB的消息 只读其中5个字段 比较视图与完整反序列化
+    tinybuf_value *msg = tinybuf_value_alloc_with_type(tinybuf_map);
+    for (int i = 0; i < 400; ++i)
+    {
+        tinybuf_value *s = tinybuf_value_alloc();
+        string v = "payload_" + to_string(i) + string(100, 'p');
+        tinybuf_value_init_string(s, v.c_str(), (int)v.size());
+        tinybuf_value_map_set(msg, ("field_" + to_string(i)).c_str(), s);
+    }
+    tinybuf_value *items = tinybuf_value_alloc_with_type(tinybuf_array);
+    for (int i = 0; i < 100; ++i)
+    {
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_int(n, -i * 1000);
+        tinybuf_value_array_append(items, n);
+    }
+    tinybuf_value_map_set(msg, "items", items);
+    tinybuf_value *id = tinybuf_value_alloc();
+    tinybuf_value_init_int(id, 123456789);
+    tinybuf_value_map_set(msg, "id", id);
+    tinybuf_value *score = tinybuf_value_alloc();
+    tinybuf_value_init_double(score, 98.5);
+    tinybuf_value_map_set(msg, "score", score);
+    tinybuf_value *ok = tinybuf_value_alloc();
+    tinybuf_value_init_bool(ok, 1);
+    tinybuf_value_map_set(msg, "ok", ok);
+
+    for (int pool = 0; pool < 2; ++pool)
+    {
+        tinybuf_set_use_strpool(pool);
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, msg, &r);
+        assert(wn > 0);
+        buf_ref br{buffer_get_data(b), (int64_t)wn, buffer_get_data(b), (int64_t)wn};
+        const int rounds = 2000;
+
+        long long view_allocs = 0;
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        for (int k = 0; k < rounds; ++k)
+        {
+            if (k == 1)
+            {
+                // 第一次读取strpool时会建立解码表 之后不再分配
+                set_malloc_ptr(counting_malloc);
+                set_realloc_ptr(counting_realloc);
+                s_alloc_count = 0;
+            }
+            tinybuf_view root, f;
+            assert(tinybuf_view_init(&root, &br) == 0);
+            assert(tinybuf_view_type(&root) == tinybuf_map);
+            int64_t iv = 0;
+            double dv = 0;
+            int bv = 0;
+            const char *str = NULL;
+            int slen = 0;
+            assert(tinybuf_view_map_get(&root, "id", 0, &f) == 0 && tinybuf_view_get_int(&f, &iv) == 0 && iv == 123456789);
+            assert(tinybuf_view_map_get(&root, "score", 0, &f) == 0 && tinybuf_view_get_double(&f, &dv) == 0 && dv == 98.5);
+            assert(tinybuf_view_map_get(&root, "ok", 0, &f) == 0 && tinybuf_view_get_bool(&f, &bv) == 0 && bv == 1);
+            assert(tinybuf_view_map_get(&root, "field_250", 0, &f) == 0 && tinybuf_view_get_string(&f, &str, &slen) == 0);
+            assert(slen == 111 && memcmp(str, "payload_250", 11) == 0);
+            tinybuf_view arr, e;
+            assert(tinybuf_view_map_get(&root, "items", 0, &arr) == 0 && tinybuf_view_size(&arr) == 100);
+            assert(tinybuf_view_array_at(&arr, 42, &e) == 0 && tinybuf_view_get_int(&e, &iv) == 0 && iv == -42000);
+        }
+        uint64_t view_us = getCurrentMicrosecondOrigin() - t0;
+        view_allocs = s_alloc_count.load();
+        set_malloc_ptr(NULL);
+        set_realloc_ptr(NULL);
+        assert(view_allocs == 0);
+
+        t0 = getCurrentMicrosecondOrigin();
+        for (int k = 0; k < rounds; ++k)
+        {
+            buf_ref rb = br;
+            tinybuf_value *back = tinybuf_value_alloc();
+            assert(tinybuf_try_read_box(&rb, back, any_version, &r) > 0);
+            const tinybuf_value *f = tinybuf_value_get_map_child(back, "id", &r);
+            assert(f && tinybuf_value_get_int(f, &r) == 123456789);
+            tinybuf_value_free(back);
+        }
+        uint64_t dom_us = getCurrentMicrosecondOrigin() - t0;
+        LOGI("%s %d bytes: view 5 fields %.2f us/msg, full read %.2f us/msg", pool ? "strpool" : "plain", wn,
+             (double)view_us / rounds, (double)dom_us / rounds);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    tinybuf_set_use_strpool(0);
+    tinybuf_value_free(msg);
+
+    // 同一块接收内存先后写入两个box 解码表不能沿用上一个box的
+    tinybuf_set_use_strpool(1);
+    const char *words[2] = {"alpha-one", "bravo-two"};
+    char mem[256];
+    for (int i = 0; i < 2; ++i)
+    {
+        tinybuf_error r = tinybuf_result_ok(0);
+        tinybuf_value *s = tinybuf_value_alloc();
+        tinybuf_value_init_string(s, words[i], 9);
+        int wn = tinybuf_try_write_box_into(mem, sizeof(mem), s, &r);
+        assert(wn > 0);
+        buf_ref br{mem, (int64_t)wn, mem, (int64_t)wn};
+        tinybuf_view v;
+        const char *str = NULL;
+        int slen = 0;
+        assert(tinybuf_view_init(&v, &br) == 0 && tinybuf_view_get_string(&v, &str, &slen) == 0);
+        assert(slen == 9 && memcmp(str, words[i], 9) == 0);
+        tinybuf_value_free(s);
+        tinybuf_result_unref(&r);
+    }
+
+    // 视图交给另一个线程读取 那个线程之前解码过同一地址上的旧box 读取编号不能和它的重复
+    {
+        auto write_word = [&](int i) {
+            tinybuf_error r = tinybuf_result_ok(0);
+            tinybuf_value *s = tinybuf_value_alloc();
+            tinybuf_value_init_string(s, words[i], 9);
+            int wn = tinybuf_try_write_box_into(mem, sizeof(mem), s, &r);
+            assert(wn > 0);
+            tinybuf_value_free(s);
+            tinybuf_result_unref(&r);
+            return wn;
+        };
+        std::promise<void> decoded;
+        std::promise<tinybuf_view> handed;
+        std::future<tinybuf_view> handed_view = handed.get_future();
+        std::string seen;
+        int wn = write_word(0);
+        std::thread reader([&]() {
+            buf_ref br{mem, (int64_t)wn, mem, (int64_t)wn};
+            tinybuf_view v;
+            const char *str = NULL;
+            int slen = 0;
+            assert(tinybuf_view_init(&v, &br) == 0 && tinybuf_view_get_string(&v, &str, &slen) == 0);
+            decoded.set_value();
+            v = handed_view.get();
+            assert(tinybuf_view_get_string(&v, &str, &slen) == 0);
+            seen.assign(str, slen);
+        });
+        decoded.get_future().wait();
+        wn = write_word(1);
+        std::thread maker([&]() {
+            buf_ref br{mem, (int64_t)wn, mem, (int64_t)wn};
+            tinybuf_view v;
+            assert(tinybuf_view_init(&v, &br) == 0);
+            handed.set_value(v);
+        });
+        maker.join();
+        reader.join();
+        assert(seen == words[1]);
+    }
+    tinybuf_set_use_strpool(0);
+
+    // version包装的值 类型为tinybuf_version 展开后读取被包装的值 16=version 6=string
+    const char versioned[] = {16, 7, 6, 3, 'a', 'b', 'c'};
+    {
+        buf_ref br{versioned, (int64_t)sizeof(versioned), versioned, (int64_t)sizeof(versioned)};
+        tinybuf_view v, inner;
+        uint64_t version = 0;
+        const char *str = NULL;
+        int slen = 0;
+        assert(tinybuf_view_init(&v, &br) == 0 && tinybuf_view_type(&v) == tinybuf_version);
+        assert(tinybuf_view_get_string(&v, &str, &slen) < 0);
+        assert(tinybuf_view_version(&v, &version, &inner) == 0 && version == 7);
+        assert(tinybuf_view_type(&inner) == tinybuf_string && tinybuf_view_get_string(&inner, &str, &slen) == 0);
+        assert(slen == 3 && memcmp(str, "abc", 3) == 0);
+        assert(tinybuf_view_version(&inner, &version, &inner) < 0);
+    }
+    LOGI("view_perf_tests done");
+}
+
+static void sized_container_perf_tests()
+{
+    LOGI("\r\nsized_container_perf_tests");
+    // 前面是若干大容器 最后一个字段是要读取的目标
+    tinybuf_value *doc = tinybuf_value_alloc_with_type(tinybuf_map);
+    for (int c = 0; c < 8; ++c)
+    {
+        tinybuf_value *rows = tinybuf_value_alloc_with_type(tinybuf_array);
+        for (int i = 0; i < 2000; ++i)
+        {
+            tinybuf_value *row = tinybuf_value_alloc_with_type(tinybuf_map);
+            tinybuf_value *n = tinybuf_value_alloc();
+            tinybuf_value_init_int(n, i);
+            tinybuf_value_map_set(row, "n", n);
+            tinybuf_value *s = tinybuf_value_alloc();
+            tinybuf_value_init_string(s, "cell", 4);
+            tinybuf_value_map_set(row, "s", s);
+            tinybuf_value_array_append(rows, row);
+        }
+        tinybuf_value_map_set(doc, ("block_" + to_string(c)).c_str(), rows);
+    }
+    tinybuf_value *target = tinybuf_value_alloc();
+    tinybuf_value_init_int(target, 42);
+    tinybuf_value_map_set(doc, "zz_target", target);
+
+    string dumps[2];
+    double us_per_lookup[2] = {0, 0};
+    for (int sized = 0; sized < 2; ++sized)
+    {
+        // 只有大容器使用带长度的编码 每行的小map不受影响
+        tinybuf_set_sized_container_min_count(sized ? 64 : 0);
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, doc, &r);
+        assert(wn > 0 && tinybuf_value_serialized_size(doc) == wn);
+
+        buf_ref br{buffer_get_data(b), (int64_t)wn, buffer_get_data(b), (int64_t)wn};
+        tinybuf_value *back = tinybuf_value_alloc();
+        assert(tinybuf_try_read_box(&br, back, any_version, &r) == wn);
+        assert(tinybuf_value_is_same(back, doc));
+        tinybuf_value_free(back);
+
+        buffer *text = buffer_alloc();
+        tinybuf_dump_buffer_as_text(buffer_get_data(b), wn, text);
+        dumps[sized].assign(buffer_get_data(text), buffer_get_length(text));
+        buffer_free(text);
+
+        const int rounds = 200;
+        br = buf_ref{buffer_get_data(b), (int64_t)wn, buffer_get_data(b), (int64_t)wn};
+        tinybuf_view root, f;
+        assert(tinybuf_view_init(&root, &br) == 0);
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        for (int k = 0; k < rounds; ++k)
+        {
+            int64_t v = 0;
+            assert(tinybuf_view_map_get(&root, "zz_target", 0, &f) == 0 && tinybuf_view_get_int(&f, &v) == 0 && v == 42);
+        }
+        us_per_lookup[sized] = (double)(getCurrentMicrosecondOrigin() - t0) / rounds;
+        LOGI("%s containers: %d bytes, lookup after 8x2000 rows %.2f us", sized ? "sized" : "plain", wn, us_per_lookup[sized]);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    tinybuf_set_sized_container_min_count(0);
+    // 两种编码的文本dump一致 带长度时跳过整个容器不再逐个解析
+    assert(dumps[0] == dumps[1]);
+    assert(us_per_lookup[1] * 10 < us_per_lookup[0]);
+    tinybuf_value_free(doc);
+    LOGI("sized_container_perf_tests done");
+}
+
+// 把[{id,name,score,tags}]形式的行转换为列
+struct sax_columns
+{
+    vector<int64_t> ids;
+    vector<string> names;
+    vector<double> scores;
+    int64_t tensor_sum = 0;
+    string key;
+    int depth = 0;
+};
+
+static tinybuf_value *make_sax_rows(int rows)
+{
+    tinybuf_value *doc = tinybuf_value_alloc_with_type(tinybuf_array);
+    for (int i = 0; i < rows; ++i)
+    {
+        tinybuf_value *row = tinybuf_value_alloc_with_type(tinybuf_map);
+        tinybuf_value *id = tinybuf_value_alloc();
+        tinybuf_value_init_int(id, i - 100);
+        tinybuf_value_map_set(row, "id", id);
+        tinybuf_value *name = tinybuf_value_alloc();
+        string n = "user_" + to_string(i % 1000);
+        tinybuf_value_init_string(name, n.c_str(), (int)n.size());
+        tinybuf_value_map_set(row, "name", name);
+        tinybuf_value *score = tinybuf_value_alloc();
+        tinybuf_value_init_double(score, i * 0.25);
+        tinybuf_value_map_set(row, "score", score);
+        int64_t tags[3] = {i, -i, 7};
+        int64_t shape[1] = {3};
+        tinybuf_value *t = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(t, 0, shape, 1, tags, 3);
+        tinybuf_value_map_set(row, "tags", t);
+        tinybuf_value_array_append(doc, row);
+    }
+    return doc;
+}
+
+static void sax_columns_handler(tinybuf_sax_handler *out)
+{
+    tinybuf_sax_handler h;
+    memset(&h, 0, sizeof(h));
+    h.on_map_begin = [](void *ud, int64_t) { ((sax_columns *)ud)->depth++; return 0; };
+    h.on_array_begin = [](void *ud, int64_t) { ((sax_columns *)ud)->depth++; return 0; };
+    h.on_end = [](void *ud) { ((sax_columns *)ud)->depth--; return 0; };
+    h.on_key = [](void *ud, const char *k, int len) { ((sax_columns *)ud)->key.assign(k, len); return 0; };
+    h.on_int = [](void *ud, int64_t v) { ((sax_columns *)ud)->ids.push_back(v); return 0; };
+    h.on_double = [](void *ud, double v) { ((sax_columns *)ud)->scores.push_back(v); return 0; };
+    h.on_string = [](void *ud, const char *d, int len) { ((sax_columns *)ud)->names.emplace_back(d, len); return 0; };
+    h.on_tensor = [](void *ud, int dtype, const int64_t *, int, const void *data, int64_t count) {
+        assert(dtype == 0);
+        for (int64_t i = 0; i < count; ++i)
+            ((sax_columns *)ud)->tensor_sum += ((const int64_t *)data)[i];
+        return 0;
+    };
+    *out = h;
+}
+
+static void sax_perf_tests()
+{
+    LOGI("\r\nsax_perf_tests");
+    const int rows = 20000;
+    tinybuf_value *doc = make_sax_rows(rows);
+    tinybuf_sax_handler h;
+    sax_columns_handler(&h);
+
+    for (int pool = 0; pool < 2; ++pool)
+    {
+        tinybuf_set_use_strpool(pool);
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, doc, &r);
+        assert(wn > 0);
+
+        sax_columns cols;
+        buf_ref br{buffer_get_data(b), (int64_t)wn, buffer_get_data(b), (int64_t)wn};
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        int consumed = tinybuf_sax_read(&br, &h, &cols, &r);
+        uint64_t sax_us = getCurrentMicrosecondOrigin() - t0;
+        assert(consumed > 0 && cols.depth == 0);
+        assert((int)cols.ids.size() == rows && (int)cols.names.size() == rows && (int)cols.scores.size() == rows);
+        assert(cols.ids[5] == -95 && cols.names[1234] == "user_234" && cols.scores[8] == 2.0);
+        assert(cols.tensor_sum == 7LL * rows);
+
+        // DOM方式 先构建tinybuf_value再按列取出
+        sax_columns dom;
+        br = buf_ref{buffer_get_data(b), (int64_t)wn, buffer_get_data(b), (int64_t)wn};
+        t0 = getCurrentMicrosecondOrigin();
+        tinybuf_value *back = tinybuf_value_alloc();
+        assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+        for (int i = 0; i < tinybuf_value_get_child_size(back, &r); ++i)
+        {
+            const tinybuf_value *row = tinybuf_value_get_array_child(back, i, &r);
+            dom.ids.push_back(tinybuf_value_get_int(tinybuf_value_get_map_child(row, "id", &r), &r));
+            buffer *nb = tinybuf_value_get_string(tinybuf_value_get_map_child(row, "name", &r), &r);
+            dom.names.emplace_back(buffer_get_data(nb), buffer_get_length(nb));
+            dom.scores.push_back(tinybuf_value_get_double(tinybuf_value_get_map_child(row, "score", &r), &r));
+        }
+        tinybuf_value_free(back);
+        uint64_t dom_us = getCurrentMicrosecondOrigin() - t0;
+        assert(dom.ids == cols.ids && dom.names == cols.names && dom.scores == cols.scores);
+        LOGI("%s %d rows: sax %.2f ms, dom %.2f ms", pool ? "strpool" : "plain", rows, sax_us / 1000.0, dom_us / 1000.0);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+
+    // 复用同一块内存时strpool解码表不能沿用上一次的
+    const char *words[2] = {"alpha-one", "bravo-two"};
+    char mem[256];
+    for (int i = 0; i < 2; ++i)
+    {
+        tinybuf_error r = tinybuf_result_ok(0);
+        tinybuf_value *s = tinybuf_value_alloc();
+        tinybuf_value_init_string(s, words[i], 9);
+        int wn = tinybuf_try_write_box_into(mem, sizeof(mem), s, &r);
+        assert(wn > 0);
+        sax_columns one;
+        buf_ref br{mem, (int64_t)wn, mem, (int64_t)wn};
+        assert(tinybuf_sax_read(&br, &h, &one, &r) > 0);
+        assert(one.names.size() == 1 && one.names[0] == words[i]);
+        tinybuf_value_free(s);
+        tinybuf_result_unref(&r);
+    }
+    tinybuf_set_use_strpool(0);
+
+    // 回调返回非0时中止
+    buffer *b = buffer_alloc();
+    tinybuf_error r = tinybuf_result_ok(0);
+    tinybuf_try_write_box(b, doc, &r);
+    buf_ref br{buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
+    tinybuf_sax_handler stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.on_double = [](void *, double) { return 1; };
+    assert(tinybuf_sax_read(&br, &stop, NULL, &r) < 0);
+    assert(br.ptr == buffer_get_data(b));
+    tinybuf_result_unref(&r);
+    buffer_free(b);
+    tinybuf_value_free(doc);
+
+    // 构造的指针链: 第i层是两个指向第i-1层的指针(13=pointer_from_start_p) 第0层是字符串(6) 展开量随层数指数增长
+    // 层数少时正常展开 层数多时超过展开预算报错 不会一直运行下去
+    const int layer_counts[2] = {4, 48};
+    for (int k = 0; k < 2; ++k)
+    {
+        std::string bomb;
+        bomb.push_back((char)6);
+        bomb.push_back((char)1);
+        bomb.push_back('x');
+        size_t prev = 0;
+        for (int i = 1; i <= layer_counts[k]; ++i)
+        {
+            size_t at = bomb.size();
+            bomb.push_back((char)8);
+            bomb.push_back((char)2);
+            for (int j = 0; j < 2; ++j)
+            {
+                bomb.push_back((char)13);
+                for (uint64_t x = prev;; x >>= 7)
+                {
+                    bomb.push_back((char)(x >= 0x80 ? (x & 0x7f) | 0x80 : x));
+                    if (x < 0x80)
+                        break;
+                }
+            }
+            prev = at;
+        }
+        sax_columns leaves;
+        tinybuf_sax_handler count;
+        memset(&count, 0, sizeof(count));
+        count.on_string = [](void *ud, const char *, int) {
+            ((sax_columns *)ud)->names.emplace_back("x");
+            return 0;
+        };
+        tinybuf_error br_r = tinybuf_result_ok(0);
+        buf_ref bb{bomb.data(), (int64_t)bomb.size(), bomb.data() + prev, (int64_t)(bomb.size() - prev)};
+        int bn = tinybuf_sax_read(&bb, &count, &leaves, &br_r);
+        if (k == 0)
+            assert(bn == (int)(bomb.size() - prev) && leaves.names.size() == 16);
+        else
+            assert(bn < 0 && leaves.names.size() < (1u << 20));
+        tinybuf_result_unref(&br_r);
+    }
+    LOGI("sax_perf_tests done");
+}
+
+static void push_parser_perf_tests()
+{
+    LOGI("\r\npush_parser_perf_tests");
+    const int rows = 20000;
+    tinybuf_value *doc = make_sax_rows(rows);
+    tinybuf_sax_handler h;
+    sax_columns_handler(&h);
+
+    for (int sized = 0; sized < 2; ++sized)
+    {
+        tinybuf_set_sized_container_min_count(sized);
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, doc, &r);
+        assert(wn > 0);
+        // 尾部附加一个字节 检查返回值只计入属于该box的部分
+        buffer_append(b, "\x01", 1);
+        const char *data = buffer_get_data(b);
+
+        sax_columns whole;
+        buf_ref br{data, (int64_t)wn, data, (int64_t)wn};
+        assert(tinybuf_sax_read(&br, &h, &whole, &r) == wn);
+
+        const int chunks[] = {1, 7, 4096};
+        for (int chunk : chunks)
+        {
+            sax_columns cols;
+            tinybuf_push_parser *pp = tinybuf_push_parser_new(&h, &cols);
+            uint64_t t0 = getCurrentMicrosecondOrigin();
+            int off = 0, ret = 0;
+            while (off < wn + 1)
+            {
+                int len = std::min(chunk, wn + 1 - off);
+                ret = tinybuf_push_parser_feed(pp, data + off, len, &r);
+                assert(ret >= 0);
+                if (ret > 0)
+                {
+                    off += ret;
+                    break;
+                }
+                off += len;
+            }
+            uint64_t push_us = getCurrentMicrosecondOrigin() - t0;
+            assert(ret > 0 && off == wn);
+            assert(tinybuf_push_parser_feed(pp, data + off, 1, &r) < 0);
+            assert(cols.ids == whole.ids && cols.names == whole.names && cols.scores == whole.scores);
+            assert(cols.tensor_sum == whole.tensor_sum && cols.depth == 0);
+
+            // reset后可以解析下一个box
+            sax_columns again;
+            tinybuf_push_parser_free(pp);
+            pp = tinybuf_push_parser_new(&h, &again);
+            tinybuf_push_parser_feed(pp, data, wn / 2, &r);
+            tinybuf_push_parser_reset(pp);
+            again = sax_columns();
+            assert(tinybuf_push_parser_feed(pp, data, wn, &r) == wn);
+            assert(again.ids == whole.ids);
+            tinybuf_push_parser_free(pp);
+
+            if (chunk < 4096)
+            {
+                LOGI("%s %d bytes, %d-byte chunks: push %.2f ms", sized ? "sized" : "plain", wn, chunk, push_us / 1000.0);
+                continue;
+            }
+            // 对照: 每收到一块都从头重新解析 直到完整
+            uint64_t reparse_us = 0;
+            int reparse_count = 0;
+            for (int have = chunk;; have += chunk)
+            {
+                if (have > wn)
+                    have = wn;
+                sax_columns tmp;
+                buf_ref part{data, (int64_t)have, data, (int64_t)have};
+                t0 = getCurrentMicrosecondOrigin();
+                int n = tinybuf_sax_read(&part, &h, &tmp, &r);
+                reparse_us += getCurrentMicrosecondOrigin() - t0;
+                ++reparse_count;
+                if (n > 0)
+                    break;
+            }
+            LOGI("%s %d bytes, %d-byte chunks: push %.2f ms, reparse from start %.2f ms (%d passes)",
+                 sized ? "sized" : "plain", wn, chunk, push_us / 1000.0, reparse_us / 1000.0, reparse_count);
+        }
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+    }
+    tinybuf_set_sized_container_min_count(0);
+
+    // 逐元素varint的大tensor分块到达 已解码的元素跨feed保留 不随块数重新解析
+    {
+        const int64_t count = 1 << 20;
+        std::vector<int64_t> vals(count);
+        int64_t expect = 0;
+        for (int64_t i = 0; i < count; ++i)
+        {
+            vals[i] = (i % 2 ? -1 : 1) * (i * 37 % 100000);
+            expect += vals[i];
+        }
+        tinybuf_value *t = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(t, 0, &count, 1, vals.data(), count);
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, t, &r);
+        assert(wn > 0);
+        const char *data = buffer_get_data(b);
+
+        sax_columns whole;
+        buf_ref br{data, (int64_t)wn, data, (int64_t)wn};
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        assert(tinybuf_sax_read(&br, &h, &whole, &r) == wn);
+        uint64_t sax_us = getCurrentMicrosecondOrigin() - t0;
+        assert(whole.tensor_sum == expect);
+
+        const int chunk = 1024;
+        sax_columns cols;
+        tinybuf_push_parser *pp = tinybuf_push_parser_new(&h, &cols);
+        t0 = getCurrentMicrosecondOrigin();
+        int off = 0, ret = 0;
+        while (off < wn && ret == 0)
+        {
+            int len = std::min(chunk, wn - off);
+            ret = tinybuf_push_parser_feed(pp, data + off, len, &r);
+            assert(ret >= 0);
+            off += len;
+        }
+        uint64_t push_us = getCurrentMicrosecondOrigin() - t0;
+        assert(ret > 0 && off == wn);
+        assert(cols.tensor_sum == expect);
+        tinybuf_push_parser_free(pp);
+        LOGI("int tensor %d bytes, %d-byte chunks (%d feeds): push %.2f ms, sax whole %.2f ms",
+             wn, chunk, (wn + chunk - 1) / chunk, push_us / 1000.0, sax_us / 1000.0);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+        tinybuf_value_free(t);
+    }
+
+    // str_pool_table需要整个buffer 增量解析报错
+    tinybuf_set_use_strpool(1);
+    buffer *b = buffer_alloc();
+    tinybuf_error r = tinybuf_result_ok(0);
+    tinybuf_try_write_box(b, doc, &r);
+    tinybuf_set_use_strpool(0);
+    sax_columns cols;
+    tinybuf_push_parser *pp = tinybuf_push_parser_new(&h, &cols);
+    assert(tinybuf_push_parser_feed(pp, buffer_get_data(b), buffer_get_length(b), &r) < 0);
+    tinybuf_push_parser_free(pp);
+    tinybuf_result_unref(&r);
+    buffer_free(b);
+    tinybuf_value_free(doc);
+
+    // 分块到达的大字符串暂存在carry中 扩容失败时报错 不会写到NULL上
+    if (strcmp(tinybuf_allocator_name(), "malloc") == 0)
+    {
+        tinybuf_value *big = tinybuf_value_alloc();
+        std::string text(4 << 20, 'q');
+        tinybuf_value_init_string(big, text.data(), (int)text.size());
+        b = buffer_alloc();
+        r = tinybuf_result_ok(0);
+        int wn = tinybuf_try_write_box(b, big, &r);
+        assert(wn > 0);
+        set_realloc64_ptr([](void *ptr, size_t size) -> void * { return size > (1 << 20) ? NULL : realloc(ptr, size); });
+        pp = tinybuf_push_parser_new(&h, &cols);
+        int off = 0, ret = 0;
+        while (off < wn && ret == 0)
+        {
+            int len = std::min(64 * 1024, wn - off);
+            ret = tinybuf_push_parser_feed(pp, buffer_get_data(b) + off, len, &r);
+            off += len;
+        }
+        set_realloc64_ptr(NULL);
+        assert(ret < 0 && off < wn);
+        tinybuf_push_parser_free(pp);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+        tinybuf_value_free(big);
+    }
+    LOGI("push_parser_perf_tests done");
+}
+
+// 写入定宽varint 高位用0x80填充 读取方按普通varint解析
+static int varint_padded_local(uint64_t in, uint8_t *out, int width)
+{
+    for (int i = 0; i < width; ++i)
+    {
+        out[i] = (uint8_t)(in & 0x7F) | (i + 1 < width ? 0x80 : 0);
+        in >>= 7;
+    }
+    return width;
+}
+
+static void mmap_archive_perf_tests()
+{
+    LOGI("\r\nmmap_archive_perf_tests");
+#ifdef _WIN32
+    LOGI("mmap_archive_perf_tests skipped on windows");
+#else
+    // 行中含tensor tinybuf_value_is_same不支持 比较序列化结果
+    auto same = [](const tinybuf_value *a, const tinybuf_value *b) {
+        buffer *ba = buffer_alloc();
+        buffer *bb = buffer_alloc();
+        tinybuf_error e = tinybuf_result_ok(0);
+        tinybuf_try_write_box(ba, a, &e);
+        tinybuf_try_write_box(bb, b, &e);
+        bool eq = buffer_get_length(ba) == buffer_get_length(bb) &&
+                  memcmp(buffer_get_data(ba), buffer_get_data(bb), buffer_get_length(ba)) == 0;
+        tinybuf_result_unref(&e);
+        buffer_free(ba);
+        buffer_free(bb);
+        return eq;
+    };
+    const char *path = "tinybuf_mmap_archive.bin";
+    // 小文件 用try_write_partitions写出后逐个分区读取
+    {
+        tinybuf_value *mainv = tinybuf_value_alloc();
+        tinybuf_value_init_string(mainv, "hello", 5);
+        tinybuf_value *s1 = make_sax_rows(10);
+        tinybuf_value *s2 = tinybuf_value_alloc();
+        tinybuf_value_init_int(s2, 2);
+        const tinybuf_value *subs[2] = {s1, s2};
+        buffer *b = buffer_alloc();
+        tinybuf_error r = tinybuf_result_ok(0);
+        assert(tinybuf_try_write_partitions(b, mainv, subs, 2, &r) > 0);
+        FILE *fp = fopen(path, "wb");
+        assert(fp);
+        fwrite(buffer_get_data(b), 1, buffer_get_length(b), fp);
+        fclose(fp);
+
+        tinybuf_file *f = tinybuf_file_open_mmap(path, &r);
+        assert(f);
+        buf_ref all = tinybuf_file_buf(f);
+        assert(all.all_size == buffer_get_length(b) && memcmp(all.base, buffer_get_data(b), all.all_size) == 0);
+        assert(tinybuf_file_part_count(f) == 3);
+        const tinybuf_value *expect[3] = {mainv, s1, s2};
+        for (int i = 2; i >= 0; --i)
+        {
+            tinybuf_value *out = tinybuf_value_alloc();
+            assert(tinybuf_file_read_part(f, i, out, any_version, &r) > 0);
+            assert(same(expect[i], out));
+            tinybuf_value_free(out);
+        }
+        buf_ref part;
+        assert(tinybuf_file_part_ref(f, 3, &part, &r) < 0);
+        tinybuf_file_close(f);
+        assert(tinybuf_file_open_mmap("tinybuf_mmap_missing.bin", &r) == NULL);
+        tinybuf_result_unref(&r);
+        buffer_free(b);
+        tinybuf_value_free(mainv);
+        tinybuf_value_free(s1);
+        tinybuf_value_free(s2);
+    }
+
+    // 4GB稀疏文件: 分区表 + 3个约1.3GB的字符串分区 + 最后一个真实分区
+    const int fillers = 3;
+    const uint64_t filler_len = (4ULL << 30) / fillers;
+    const int total = fillers + 2;
+    const int off_width = 5;
+    tinybuf_value *target = make_sax_rows(1000);
+    buffer *tb = buffer_alloc();
+    tinybuf_error r = tinybuf_result_ok(0);
+    assert(tinybuf_try_write_part(tb, target, &r) > 0);
+    buffer *mb = buffer_alloc();
+    tinybuf_value *mainv = tinybuf_value_alloc();
+    tinybuf_value_init_int(mainv, 42);
+    assert(tinybuf_try_write_part(mb, mainv, &r) > 0);
+
+    uint8_t head[16];
+    std::vector<uint64_t> offs(total);
+    uint64_t table_len = 1 + varint_serialize_local((uint64_t)total, head) + (uint64_t)total * off_width;
+    // 每个填充分区: [part][len][string][slen][slen字节的空洞]
+    const int filler_head = 1 + off_width + 1 + off_width;
+    offs[0] = table_len;
+    offs[1] = offs[0] + buffer_get_length(mb);
+    for (int i = 2; i < total; ++i)
+        offs[i] = offs[i - 1] + filler_len;
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    assert(fd >= 0);
+    std::vector<uint8_t> table;
+    table.push_back(22);
+    int hn = varint_serialize_local((uint64_t)total, head);
+    table.insert(table.end(), head, head + hn);
+    for (int i = 0; i < total; ++i)
+    {
+        varint_padded_local(offs[i], head, off_width);
+        table.insert(table.end(), head, head + off_width);
+    }
+    assert(pwrite(fd, table.data(), table.size(), 0) == (ssize_t)table.size());
+    assert(pwrite(fd, buffer_get_data(mb), buffer_get_length(mb), (off_t)offs[0]) == buffer_get_length(mb));
+    for (int i = 1; i <= fillers; ++i)
+    {
+        uint8_t fh[32];
+        int k = 0;
+        fh[k++] = 21;
+        k += varint_padded_local(filler_len - 1 - off_width, fh + k, off_width);
+        fh[k++] = 6;
+        k += varint_padded_local(filler_len - filler_head, fh + k, off_width);
+        assert(pwrite(fd, fh, k, (off_t)offs[i]) == k);
+    }
+    assert(pwrite(fd, buffer_get_data(tb), buffer_get_length(tb), (off_t)offs[total - 1]) == buffer_get_length(tb));
+    close(fd);
+
+    // 丢弃写入时留在页缓存中的内容 读取时真实缺页
+    fd = open(path, O_RDONLY);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    uint64_t t0 = getCurrentMicrosecondOrigin();
+    tinybuf_file *f = tinybuf_file_open_mmap(path, &r);
+    assert(f);
+    tinybuf_value *out = tinybuf_value_alloc();
+    assert(tinybuf_file_read_part(f, total - 1, out, any_version, &r) > 0);
+    uint64_t read_us = getCurrentMicrosecondOrigin() - t0;
+    assert(same(target, out));
+    buf_ref all = tinybuf_file_buf(f);
+    assert(all.all_size == (int64_t)(offs[total - 1] + buffer_get_length(tb)));
+
+    // 只有分区表和目标分区所在的页被读入
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = (size_t)((all.all_size + page - 1) / page);
+    std::vector<unsigned char> resident(pages);
+    assert(mincore((void *)all.base, (size_t)all.all_size, resident.data()) == 0);
+    size_t touched = 0;
+    for (unsigned char c : resident)
+        touched += c & 1;
+    LOGI("%.2f GB archive, %d parts: open + read last part %.2f ms, %zu of %zu pages resident",
+         all.all_size / (double)(1 << 30), total, read_us / 1000.0, touched, pages);
+    assert(touched * (size_t)page < 16u << 20);
+
+    tinybuf_value *first = tinybuf_value_alloc();
+    assert(tinybuf_file_read_part(f, 0, first, any_version, &r) > 0);
+    assert(same(mainv, first));
+    tinybuf_value_free(first);
+    tinybuf_value_free(out);
+    tinybuf_file_close(f);
+    remove(path);
+    tinybuf_result_unref(&r);
+    buffer_free(tb);
+    buffer_free(mb);
+    tinybuf_value_free(mainv);
+    tinybuf_value_free(target);
+#endif
+    LOGI("mmap_archive_perf_tests done");
+}
+
+static void large_length_perf_tests()
+{
+    LOGI("\r\nlarge_length_perf_tests");
+    // 超过2GB的float向量 源数据不写入 页面按需清零 峰值内存约为一份序列化结果
+    const int64_t count = ((int64_t)INT_MAX + 64 * 1024 * 1024) / 4;
+    int64_t shape[1] = {count};
+    tinybuf_value *v = tinybuf_value_alloc();
+    assert(tinybuf_value_init_tensor(v, 10, shape, 1, NULL, count) == 0);
+    int64_t expect = tinybuf_value_serialized_size(v);
+    assert(expect > INT_MAX);
+
+    buffer *out = buffer_alloc();
+    assert(buffer_reserve64(out, expect) == 0);
+    assert(buffer_get_capacity(out) == -1 && buffer_get_capacity64(out) >= expect);
+    tinybuf_error r = tinybuf_result_ok(0);
+    // int接口无法表示长度 返回-1且不留下半截数据
+    assert(tinybuf_value_serialize(v, out, &r) == -1);
+    assert(buffer_get_length64(out) == 0);
+    tinybuf_result_unref(&r);
+    r = tinybuf_result_ok(0);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    int64_t n = tinybuf_value_serialize64(v, out, &r);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(n == expect && buffer_get_length64(out) == expect);
+    assert(buffer_get_length(out) == -1);
+    LOGI("serialize64 %lld bytes: %lld ms", (long long)n,
+         (long long)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+    tinybuf_value_free(v);
+
+    // 头部之后全是payload 用只写了头部的新缓冲区解码 避免同时持有两份数据
+    int64_t head = expect - count * 4;
+    buffer *in = buffer_alloc();
+    assert(buffer_reserve64(in, expect) == 0);
+    memcpy(buffer_get_data(in), buffer_get_data(out), (size_t)head);
+    buffer_free(out);
+    // 只写首尾两个元素 首元素0.0f 末尾元素1.0f 网络字节序 中间的payload不检查
+    const unsigned char zero[4] = {0x00, 0x00, 0x00, 0x00};
+    const unsigned char one[4] = {0x3f, 0x80, 0x00, 0x00};
+    memcpy(buffer_get_data(in) + head, zero, 4);
+    memcpy(buffer_get_data(in) + expect - 4, one, 4);
+    assert(buffer_set_length64(in, expect) == 0);
+
+    tinybuf_value *back = tinybuf_value_alloc();
+    t0 = std::chrono::high_resolution_clock::now();
+    n = tinybuf_value_deserialize64(buffer_get_data(in), buffer_get_length64(in), back, &r);
+    t1 = std::chrono::high_resolution_clock::now();
+    assert(n == expect);
+    LOGI("deserialize64 %lld bytes: %lld ms", (long long)n,
+         (long long)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
+    assert(tinybuf_tensor_get_count(back, &r) == count);
+    const float *pf = (const float *)tinybuf_tensor_get_data_const(back, &r);
+    assert(pf[0] == 0.0f && pf[count - 1] == 1.0f);
+    tinybuf_value_free(back);
+
+    // int接口拒绝超过2GB的box 并恢复buf
+    buf_ref br = {buffer_get_data(in), expect, buffer_get_data(in), expect};
+    back = tinybuf_value_alloc();
+    assert(tinybuf_try_read_box(&br, back, NULL, &r) == -1);
+    assert(br.ptr == buffer_get_data(in) && br.size == expect);
+    tinybuf_value_free(back);
+    buffer_free(in);
+    tinybuf_result_unref(&r);
+    LOGI("large_length_perf_tests done");
+}
+
+static void tensor_bswap_perf_tests()
+{
+    LOGI("\r\ntensor_bswap_perf_tests");
+    tinybuf_error r = tinybuf_result_ok(0);
+    auto encode = [&](const tinybuf_value *v) {
+        buffer *b = buffer_alloc();
+        assert(tinybuf_value_serialize64(v, b, &r) > 0);
+        return b;
+    };
+    // 尾部元素由标量处理 各种长度下SIMD与标量的编码结果一致 且能解码回原值
+    for (int dtype : {8, 10})
+    {
+        for (int64_t n = 0; n < 40; ++n)
+        {
+            std::vector<double> d((size_t)n + 1);
+            std::vector<float> f((size_t)n + 1);
+            for (int64_t i = 0; i < n; ++i)
+            {
+                d[(size_t)i] = i * 1.25 - 7;
+                f[(size_t)i] = (float)(i * 0.5 - 3);
+            }
+            int64_t shape[1] = {n};
+            tinybuf_value *v = tinybuf_value_alloc();
+            tinybuf_value_init_tensor(v, dtype, shape, 1, dtype == 8 ? (const void *)d.data() : (const void *)f.data(), n);
+            tinybuf_set_simd_enabled(0);
+            buffer *scalar = encode(v);
+            tinybuf_set_simd_enabled(1);
+            buffer *simd = encode(v);
+            assert(buffer_get_length64(scalar) == buffer_get_length64(simd));
+            assert(memcmp(buffer_get_data(scalar), buffer_get_data(simd), (size_t)buffer_get_length64(simd)) == 0);
+            tinybuf_value *back = tinybuf_value_alloc();
+            assert(tinybuf_value_deserialize64(buffer_get_data(simd), buffer_get_length64(simd), back, &r) == buffer_get_length64(simd));
+            assert(tinybuf_tensor_get_count(back, &r) == n);
+            size_t width = dtype == 8 ? 8 : 4;
+            assert(n == 0 || memcmp(tinybuf_tensor_get_data_const(back, &r), tinybuf_tensor_get_data_const(v, &r), (size_t)n * width) == 0);
+            tinybuf_value_free(back);
+            buffer_free(scalar);
+            buffer_free(simd);
+            tinybuf_value_free(v);
+        }
+    }
+    // 第一个元素1.0按大端写出
+    {
+        double one = 1.0;
+        int64_t shape[1] = {1};
+        tinybuf_value *v = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(v, 8, shape, 1, &one, 1);
+        buffer *b = encode(v);
+        const unsigned char be[8] = {0x3f, 0xf0, 0, 0, 0, 0, 0, 0};
+        assert(memcmp(buffer_get_data(b) + buffer_get_length(b) - 8, be, 8) == 0);
+        buffer_free(b);
+        tinybuf_value_free(v);
+    }
+
+    // 1M元素的double/float向量与二维tensor 对比标量实现和memcpy带宽
+    const int64_t count = 1 << 20;
+    const int rounds = 20;
+    LOGI("simd level %d", tinybuf_simd_level());
+    for (int dtype : {8, 10})
+    {
+        size_t width = dtype == 8 ? 8 : 4;
+        std::vector<char> src((size_t)count * width);
+        for (int64_t i = 0; i < count; ++i)
+        {
+            if (dtype == 8)
+            {
+                double x = i * 0.001;
+                memcpy(&src[(size_t)i * 8], &x, 8);
+            }
+            else
+            {
+                float x = (float)(i * 0.001);
+                memcpy(&src[(size_t)i * 4], &x, 4);
+            }
+        }
+        for (int dims : {1, 2})
+        {
+            int64_t shape[2] = {dims == 1 ? count : 1024, count / 1024};
+            tinybuf_value *v = tinybuf_value_alloc();
+            tinybuf_value_init_tensor(v, dtype, shape, dims, src.data(), count);
+            double enc_ms[2] = {0, 0}, dec_ms[2] = {0, 0};
+            std::vector<char> encoded[2];
+            for (int simd = 0; simd < 2; ++simd)
+            {
+                tinybuf_set_simd_enabled(simd);
+                buffer *b = buffer_alloc();
+                for (int k = 0; k < rounds; ++k)
+                {
+                    buffer_set_length(b, 0);
+                    auto t0 = std::chrono::high_resolution_clock::now();
+                    tinybuf_value_serialize64(v, b, &r);
+                    auto t1 = std::chrono::high_resolution_clock::now();
+                    tinybuf_value *back = tinybuf_value_alloc();
+                    tinybuf_value_deserialize64(buffer_get_data(b), buffer_get_length64(b), back, &r);
+                    auto t2 = std::chrono::high_resolution_clock::now();
+                    if (k == 0)
+                        assert(memcmp(tinybuf_tensor_get_data_const(back, &r), src.data(), src.size()) == 0);
+                    tinybuf_value_free(back);
+                    enc_ms[simd] += std::chrono::duration<double, std::milli>(t1 - t0).count();
+                    dec_ms[simd] += std::chrono::duration<double, std::milli>(t2 - t1).count();
+                }
+                encoded[simd].assign(buffer_get_data(b), buffer_get_data(b) + buffer_get_length64(b));
+                buffer_free(b);
+            }
+            assert(encoded[0] == encoded[1]);
+            std::vector<char> dst(src.size());
+            auto t0 = std::chrono::high_resolution_clock::now();
+            for (int k = 0; k < rounds; ++k)
+                memcpy(dst.data(), src.data(), src.size());
+            auto t1 = std::chrono::high_resolution_clock::now();
+            double copy_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            double mb = (double)src.size() * rounds / 1048576.0;
+            LOGI("dtype %d dims %d: encode scalar %.0f MB/s simd %.0f MB/s, decode scalar %.0f MB/s simd %.0f MB/s, memcpy %.0f MB/s",
+                 dtype, dims, mb / (enc_ms[0] / 1000), mb / (enc_ms[1] / 1000), mb / (dec_ms[0] / 1000), mb / (dec_ms[1] / 1000),
+                 mb / (copy_ms / 1000));
+            tinybuf_value_free(v);
+        }
+    }
+    tinybuf_set_simd_enabled(1);
+    tinybuf_result_unref(&r);
+    LOGI("tensor_bswap_perf_tests done");
+}
+
+static void native_tensor_perf_tests()
+{
+    LOGI("\r\nnative_tensor_perf_tests");
+    tinybuf_error r = tinybuf_result_ok(0);
+    // [前缀字符串, float 2x3, double向量, int64 2x2, bool向量, 7] 前缀长度不同时数据仍按64字节对齐
+    for (int prefix = 0; prefix < 70; prefix += 23)
+    {
+        float f[6] = {1, 2, 3, 4, 5, 6};
+        double d[5] = {0.5, -1.5, 2.5, 1e300, -0.0};
+        int64_t q[4] = {-1, 0, 1LL << 40, 7};
+        uint8_t bools[10] = {1, 0, 1, 1, 0, 0, 0, 1, 1, 0};
+        int64_t fs[2] = {2, 3}, ds[1] = {5}, qs[2] = {2, 2}, bs[1] = {10};
+        tinybuf_value *arr = tinybuf_value_alloc();
+        tinybuf_value *x = tinybuf_value_alloc();
+        std::string pre((size_t)prefix, 'p');
+        tinybuf_value_init_string(x, pre.c_str(), prefix);
+        tinybuf_value_array_append(arr, x);
+        const void *datas[4] = {f, d, q, bools};
+        int dtypes[4] = {10, 8, 9, 11};
+        int dimss[4] = {2, 1, 2, 1};
+        const int64_t *shapes[4] = {fs, ds, qs, bs};
+        int64_t counts[4] = {6, 5, 4, 10};
+        size_t widths[4] = {4, 8, 8, 1};
+        for (int i = 0; i < 4; ++i)
+        {
+            x = tinybuf_value_alloc();
+            tinybuf_value_init_tensor(x, dtypes[i], shapes[i], dimss[i], datas[i], counts[i]);
+            tinybuf_value_array_append(arr, x);
+        }
+        x = tinybuf_value_alloc();
+        tinybuf_value_init_int(x, 7);
+        tinybuf_value_array_append(arr, x);
+
+        tinybuf_set_tensor_native(1);
+        buffer *b = buffer_alloc();
+        int64_t n = tinybuf_value_serialize64(arr, b, &r);
+        assert(n > 0 && n == tinybuf_value_serialized_size(arr));
+        tinybuf_set_tensor_native(0);
+        const char *base = buffer_get_data(b);
+
+        for (int zc = 0; zc < 2; ++zc)
+        {
+            tinybuf_set_tensor_zero_copy(zc);
+            tinybuf_value *back = tinybuf_value_alloc();
+            assert(tinybuf_value_deserialize64(base, n, back, &r) == n);
+            for (int i = 0; i < 4; ++i)
+            {
+                const tinybuf_value *t = tinybuf_value_get_array_child(back, i + 1, &r);
+                const char *p = (const char *)tinybuf_tensor_get_data_const(t, &r);
+                assert(tinybuf_tensor_get_count(t, &r) == counts[i] && tinybuf_tensor_get_ndim(t, &r) == dimss[i]);
+                assert(memcmp(p, datas[i], (size_t)counts[i] * widths[i]) == 0);
+                bool inside = p >= base && p < base + n;
+                assert(inside == (zc == 1));
+                if (inside)
+                    assert((p - base) % 64 == 0);
+            }
+            // 可写访问先拷贝 不写入源buffer
+            tinybuf_value *ft = (tinybuf_value *)tinybuf_value_get_array_child(back, 1, &r);
+            float *w = (float *)tinybuf_tensor_get_data(ft, &r);
+            assert(!((const char *)w >= base && (const char *)w < base + n));
+            w[0] = 42;
+            assert(memcmp(tinybuf_tensor_get_data_const(tinybuf_value_get_array_child(back, 1, &r), &r), f, 4) != 0);
+            // 克隆得到独立的数据
+            tinybuf_value *c = tinybuf_value_clone(tinybuf_value_get_array_child(back, 2, &r));
+            assert(memcmp(tinybuf_tensor_get_data_const(c, &r), d, sizeof(d)) == 0);
+            tinybuf_value_free(c);
+            assert(tinybuf_value_get_int(tinybuf_value_get_array_child(back, 5, &r), &r) == 7);
+            tinybuf_value_free(back);
+        }
+        tinybuf_set_tensor_zero_copy(0);
+
+        // view跳过native tensor定位到后面的元素
+        buf_ref br{base, n, base, n};
+        tinybuf_view v, last;
+        assert(tinybuf_view_init(&v, &br) == 0);
+        assert(tinybuf_view_array_at(&v, 5, &last) == 0);
+        int64_t seven = 0;
+        assert(tinybuf_view_get_int(&last, &seven) == 0 && seven == 7);
+
+        // SAX回调得到的数据
+        struct sax_ud
+        {
+            int tensors;
+            const char *base;
+            int64_t n;
+        } ud = {0, base, n};
+        tinybuf_sax_handler h;
+        memset(&h, 0, sizeof(h));
+        h.on_tensor = [](void *u, int dtype, const int64_t *shape, int dims, const void *data, int64_t count) -> int {
+            sax_ud *s = (sax_ud *)u;
+            ++s->tensors;
+            if (dtype == 11)
+                return ((const uint8_t *)data)[0] == 0xb1 ? 0 : 1; // 1,0,1,1,0,0,0,1
+            // 对齐的小端数据直接指向源buffer
+            const char *p = (const char *)data;
+            return p >= s->base && p < s->base + s->n ? 0 : 1;
+        };
+        buf_ref sb{base, n, base, n};
+        assert(tinybuf_sax_read(&sb, &h, &ud, &r) == n && ud.tensors == 4);
+
+        buffer *text = buffer_alloc();
+        tinybuf_dump_buffer_as_text(base, (int)n, text);
+        assert(strstr(buffer_get_data(text), "tensor(shape=[2,3], dtype=10, count=6, native)"));
+        buffer_free(text);
+        buffer_free(b);
+        tinybuf_value_free(arr);
+    }
+
+    // strpool box、单个part、分区表中的数据也按最终位置对齐 输出buffer已有前缀时同样对齐
+    {
+        tinybuf_value *doc = tinybuf_value_alloc();
+        tinybuf_value *x = tinybuf_value_alloc();
+        tinybuf_value_init_string(x, "weights-v1", 10);
+        tinybuf_value_map_set(doc, "name", x);
+        float f[15];
+        for (int i = 0; i < 15; ++i)
+            f[i] = i * 0.5f;
+        double d[7] = {1, 2, 3, 4, 5, 6, 7};
+        int64_t fs[2] = {3, 5}, ds[1] = {7};
+        x = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(x, 10, fs, 2, f, 15);
+        tinybuf_value_map_set(doc, "w", x);
+        x = tinybuf_value_alloc();
+        tinybuf_value_init_tensor(x, 8, ds, 1, d, 7);
+        tinybuf_value_map_set(doc, "d", x);
+        const tinybuf_value *subs[2] = {doc, doc};
+        auto check_aligned = [&](const tinybuf_value *v, const char *base, int64_t n) {
+            const char *keys[2] = {"w", "d"};
+            for (const char *k : keys)
+            {
+                const char *p = (const char *)tinybuf_tensor_get_data_const(tinybuf_value_get_map_child(v, k, &r), &r);
+                assert(p >= base && p < base + n && (p - base) % 64 == 0);
+            }
+        };
+        tinybuf_set_tensor_zero_copy(1);
+        // 0不用strpool 1 strpool 2 strpool最短offset
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            tinybuf_set_use_strpool(mode > 0);
+            tinybuf_set_strpool_fixed_offset(mode != 2);
+            for (int pre = 0; pre < 13; pre += 6)
+            {
+                tinybuf_set_tensor_native(1);
+                int64_t size = tinybuf_value_serialized_size(doc);
+                int64_t psize = tinybuf_partitions_serialized_size(doc, subs, 2);
+                buffer *box = buffer_alloc(), *part = buffer_alloc(), *table = buffer_alloc();
+                std::string prefix((size_t)pre, 'x');
+                buffer_append(box, prefix.data(), pre);
+                buffer_append(part, prefix.data(), pre);
+                buffer_append(table, prefix.data(), pre);
+                int bn = tinybuf_try_write_box(box, doc, &r);
+                int pn = tinybuf_try_write_part(part, doc, &r);
+                int64_t tn = tinybuf_try_write_partitions_parallel(table, doc, subs, 2, pre ? 2 : 1, &r);
+                tinybuf_set_tensor_native(0);
+                assert(bn > 0 && pn > 0 && tn > 0);
+                if (!pre)
+                    assert(bn == size && tn == psize);
+
+                const char *base = buffer_get_data(box);
+                buf_ref br{base + pre, bn, base + pre, bn};
+                tinybuf_value *back = tinybuf_value_alloc();
+                assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+                check_aligned(back, base, pre + bn);
+                tinybuf_value_free(back);
+
+                // part: [part][长度][box]
+                base = buffer_get_data(part);
+                int head = 1;
+                while ((uint8_t)base[pre + head] & 0x80)
+                    ++head;
+                ++head;
+                buf_ref pb{base + pre + head, pn - head, base + pre + head, pn - head};
+                back = tinybuf_value_alloc();
+                assert(tinybuf_try_read_box(&pb, back, any_version, &r) > 0);
+                check_aligned(back, base, pre + pn);
+                tinybuf_value_free(back);
+
+                base = buffer_get_data(table);
+                buf_ref tb{base + pre, tn, base + pre, tn};
+                tinybuf_part_table *t = tinybuf_part_table_open(&tb, &r);
+                assert(t && tinybuf_part_table_count(t) == 3);
+                for (int i = 0; i < 3; ++i)
+                {
+                    back = tinybuf_value_alloc();
+                    assert(tinybuf_part_read(t, i, back, any_version, &r) > 0);
+                    check_aligned(back, base, pre + tn);
+                    tinybuf_value_free(back);
+                }
+                tinybuf_part_table_close(t);
+                buffer_free(box);
+                buffer_free(part);
+                buffer_free(table);
+            }
+        }
+        tinybuf_set_tensor_zero_copy(0);
+        tinybuf_set_strpool_fixed_offset(1);
+        tinybuf_set_use_strpool(0);
+        tinybuf_value_free(doc);
+    }
+
+    // 256MB float权重写入文件后mmap读取: 大端编码解码 native拷贝 native零拷贝
+    const int64_t count = 64LL * 1024 * 1024;
+    int64_t shape[2] = {8192, count / 8192};
+    tinybuf_value *weights = tinybuf_value_alloc();
+    tinybuf_value_init_tensor(weights, 10, shape, 2, NULL, count);
+    float *wd = (float *)tinybuf_tensor_get_data(weights, &r);
+    for (int64_t i = 0; i < count; ++i)
+        wd[i] = (float)(i % 1000) * 0.25f;
+#ifndef _WIN32
+    const char *names[2] = {"tinybuf_weights_be.bin", "tinybuf_weights_native.bin"};
+    for (int native = 0; native < 2; ++native)
+    {
+        tinybuf_set_tensor_native(native);
+        buffer *b = buffer_alloc();
+        assert(tinybuf_try_write_box64(b, weights, &r) > 0);
+        tinybuf_set_tensor_native(0);
+        FILE *fp = fopen(names[native], "wb");
+        assert(fp);
+        fwrite(buffer_get_data(b), 1, (size_t)buffer_get_length64(b), fp);
+        fclose(fp);
+        buffer_free(b);
+    }
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        tinybuf_file *f = tinybuf_file_open_mmap(names[mode == 0 ? 0 : 1], &r);
+        assert(f);
+        tinybuf_set_tensor_zero_copy(mode == 2);
+        buf_ref all = tinybuf_file_buf(f);
+        tinybuf_value *loaded = tinybuf_value_alloc();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        assert(tinybuf_try_read_box64(&all, loaded, any_version, &r) > 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        const float *ld = (const float *)tinybuf_tensor_get_data_const(loaded, &r);
+        assert(ld[0] == wd[0] && ld[count - 1] == wd[count - 1] && ld[count / 2] == wd[count / 2]);
+        LOGI("load 256MB float tensor from mmap (%s): %.3f ms", mode == 0 ? "big-endian decode" : (mode == 1 ? "native copy" : "native zero-copy"),
+             std::chrono::duration<double, std::milli>(t1 - t0).count());
+        tinybuf_value_free(loaded);
+        tinybuf_file_close(f);
+    }
+    tinybuf_set_tensor_zero_copy(0);
+    remove(names[0]);
+    remove(names[1]);
+#endif
+    tinybuf_value_free(weights);
+    tinybuf_result_unref(&r);
+    LOGI("native_tensor_perf_tests done");
+}
+
+// 请求处理中典型的消息: 几十个短key 嵌套的map/array和字符串
+static tinybuf_value *arena_sample_message(int items)
+{
+    tinybuf_value *msg = tinybuf_value_alloc();
+    for (int i = 0; i < 24; ++i)
+    {
+        tinybuf_value *c = tinybuf_value_alloc();
+        if (i % 3 == 0)
+            tinybuf_value_init_string(c, ("value_" + to_string(i)).c_str(), 0);
+        else
+            tinybuf_value_init_int(c, i * 1000);
+        tinybuf_value_map_set(msg, ("field_" + to_string(i)).c_str(), c);
+    }
+    tinybuf_value *list = tinybuf_value_alloc();
+    for (int i = 0; i < items; ++i)
+    {
+        tinybuf_value *item = tinybuf_value_alloc();
+        tinybuf_value *id = tinybuf_value_alloc();
+        tinybuf_value_init_int(id, i);
+        tinybuf_value_map_set(item, "id", id);
+        tinybuf_value *name = tinybuf_value_alloc();
+        tinybuf_value_init_string(name, ("item_name_" + to_string(i)).c_str(), 0);
+        tinybuf_value_map_set(item, "name", name);
+        tinybuf_value *price = tinybuf_value_alloc();
+        tinybuf_value_init_double(price, i * 0.5);
+        tinybuf_value_map_set(item, "price", price);
+        tinybuf_value_array_append(list, item);
+    }
+    tinybuf_value_map_set(msg, "items", list);
+    return msg;
+}
+
+static void arena_perf_tests()
+{
+    LOGI("\r\narena_perf_tests");
+    tinybuf_error r = tinybuf_result_ok(0);
+    tinybuf_value *msg = arena_sample_message(32);
+    buffer *b = buffer_alloc();
+    assert(tinybuf_try_write_box(b, msg, &r) > 0);
+    const char *data = buffer_get_data(b);
+    int64_t n = buffer_get_length64(b);
+    tinybuf_arena *arena = tinybuf_arena_new(0);
+
+    for (int backend = 0; backend < 2; ++backend)
+    {
+        tinybuf_set_map_backend(backend ? tinybuf_map_backend_hash : tinybuf_map_backend_avl);
+        buf_ref br{data, n, data, n};
+        tinybuf_value *v = NULL;
+        assert(tinybuf_try_read_box_arena(&br, arena, &v, any_version, &r) == n && v);
+        assert(tinybuf_value_is_same(msg, v));
+        assert(tinybuf_arena_used(arena) > 0);
+        // free/clear对arena中的节点不释放内存
+        tinybuf_value *items = (tinybuf_value *)tinybuf_value_get_map_child2(v, "items", 5, &r);
+        tinybuf_value_free((tinybuf_value *)tinybuf_value_get_array_child(items, 0, &r));
+        // 容器从自己的arena扩容 新节点绑定arena后分配 随arena一起释放
+        tinybuf_arena *old = tinybuf_arena_bind(arena);
+        tinybuf_value *extra = tinybuf_value_alloc();
+        tinybuf_arena_bind(old);
+        tinybuf_value_init_int(extra, 99);
+        tinybuf_value_array_append(items, extra);
+        assert(tinybuf_value_get_int(tinybuf_value_get_array_child(items, 32, &r), &r) == 99);
+        // 解绑后修改arena中的节点 新建的子节点/字符串仍从节点所属的arena分配
+        int64_t used = tinybuf_arena_used(arena);
+        tinybuf_value *first = (tinybuf_value *)tinybuf_value_get_array_child(items, 1, &r);
+        tinybuf_value_clear(first);
+        assert(tinybuf_value_deserialize64(data, n, first, &r) == n);
+        assert(tinybuf_value_is_same(msg, first));
+        assert(tinybuf_arena_used(arena) > used);
+        // 修改前先克隆到堆上 reset后克隆仍然有效
+        tinybuf_value *copy = tinybuf_value_clone(v);
+        tinybuf_value_clear(v);
+        tinybuf_arena_reset(arena);
+        assert(tinybuf_arena_used(arena) == 0);
+        tinybuf_value *arr = (tinybuf_value *)tinybuf_value_get_map_child2(copy, "items", 5, &r);
+        assert(tinybuf_value_get_child_size(arr, &r) == 33);
+        tinybuf_value_free(copy);
+    }
+    tinybuf_set_map_backend(tinybuf_map_backend_avl);
+
+    // tensor和bool_map的payload在堆上 由reset释放
+    {
+        tinybuf_value *t = tinybuf_value_alloc();
+        int64_t shape[1] = {4};
+        double d[4] = {1, 2, 3, 4};
+        tinybuf_value_init_tensor(t, 8, shape, 1, d, 4);
+        buffer *tb = buffer_alloc();
+        assert(tinybuf_try_write_box(tb, t, &r) > 0);
+        buf_ref br{buffer_get_data(tb), buffer_get_length64(tb), buffer_get_data(tb), buffer_get_length64(tb)};
+        tinybuf_value *v = NULL;
+        assert(tinybuf_try_read_box_arena(&br, arena, &v, any_version, &r) > 0);
+        assert(memcmp(tinybuf_tensor_get_data_const(v, &r), d, sizeof(d)) == 0);
+        tinybuf_arena_reset(arena);
+        buffer_free(tb);
+        tinybuf_value_free(t);
+    }
+
+    // 每条消息解码 读取一个字段 丢弃
+    const int rounds = 20000;
+    double us[2] = {0, 0};
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        int64_t sum = 0;
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < rounds; ++i)
+        {
+            buf_ref br{data, n, data, n};
+            tinybuf_value *v = NULL;
+            if (mode)
+            {
+                assert(tinybuf_try_read_box_arena(&br, arena, &v, any_version, &r) == n);
+            }
+            else
+            {
+                v = tinybuf_value_alloc();
+                assert(tinybuf_try_read_box64(&br, v, any_version, &r) == n);
+            }
+            sum += tinybuf_value_get_int(tinybuf_value_get_map_child2(v, "field_1", 7, &r), &r);
+            if (mode)
+                tinybuf_arena_reset(arena);
+            else
+                tinybuf_value_free(v);
+        }
+        us[mode] = (double)(getCurrentMicrosecondOrigin() - t0) / rounds;
+        assert(sum == (int64_t)rounds * 1000);
+    }
+    LOGI("decode+drop %lld byte message: heap %.2f us, arena %.2f us", (long long)n, us[0], us[1]);
+
+    tinybuf_arena_free(arena);
+    buffer_free(b);
+    tinybuf_value_free(msg);
+    tinybuf_result_unref(&r);
+    LOGI("arena_perf_tests done");
+}
+
+static void allocator_perf_tests()
+{
+    LOGI("\r\nallocator_perf_tests");
+    // 开着池分配 关掉后释放 走各自来源的路径
+    tinybuf_set_small_pool(1);
+    tinybuf_value *kept = tinybuf_make_test_value();
+    buffer *kb = buffer_alloc();
+    tinybuf_set_small_pool(0);
+    tinybuf_value *heap = tinybuf_value_clone(kept);
+    assert(tinybuf_value_is_same(kept, heap));
+    tinybuf_set_small_pool(1);
+    tinybuf_value_free(heap);
+    tinybuf_set_small_pool(0);
+    tinybuf_value_free(kept);
+    buffer_free(kb);
+
+    // 池中的块16字节对齐 关闭时直接来自tinybuf_malloc64 释放按地址区分来源
+    {
+        void *plain = tinybuf_small_alloc(40);
+        tinybuf_set_small_pool(1);
+        std::vector<void *> pooled;
+        for (size_t size = 1; size <= 200; ++size)
+        {
+            pooled.push_back(tinybuf_small_alloc(size));
+            assert(((uintptr_t)pooled.back() & 15) == 0);
+        }
+        tinybuf_small_free(plain);
+        tinybuf_set_small_pool(0);
+        for (auto p : pooled)
+            tinybuf_small_free(p);
+    }
+
+    // 一个线程分配 另一个线程释放
+    tinybuf_set_small_pool(1);
+    {
+        std::vector<tinybuf_value *> made(20000);
+        std::thread producer([&]() {
+            for (auto &v : made)
+            {
+                v = tinybuf_value_alloc();
+                tinybuf_value_init_string(v, "cross-thread", 0);
+            }
+        });
+        producer.join();
+        std::thread consumer([&]() {
+            for (auto v : made)
+                tinybuf_value_free(v);
+        });
+        consumer.join();
+    }
+
+    // 每次新建的短命线程 退出时交还空闲块 下一批线程复用 内存不随轮数增长
+    {
+        unsigned long long mem0 = tb_get_mem_usage();
+        for (int round = 0; round < 1000; ++round)
+        {
+            tinybuf_value *kept[4];
+            std::vector<std::thread> workers;
+            for (int t = 0; t < 4; ++t)
+            {
+                workers.emplace_back([&kept, t]() {
+                    tinybuf_value *v = tinybuf_value_alloc();
+                    tinybuf_value_init_string(v, "a string longer than sso", 0);
+                    tinybuf_value_array_append(v, tinybuf_value_alloc());
+                    kept[t] = v;
+                });
+            }
+            for (auto &w : workers)
+                w.join();
+            for (auto v : kept)
+                tinybuf_value_free(v);
+        }
+        unsigned long long mem1 = tb_get_mem_usage();
+        LOGI("short-lived threads x4000 with small pool: +%llu KB", (mem1 - mem0) / 1024);
+        assert(mem1 - mem0 < 64ULL * 1024 * 1024);
+    }
+
+    // benchmark_performance中的编解码流程
+    tinybuf_value *value = tinybuf_make_test_value();
+    buffer *bin = buffer_alloc();
+    buffer *json = buffer_alloc();
+    tinybuf_error r = tinybuf_result_ok(0);
+    assert(tinybuf_try_write_box(bin, value, &r) > 0);
+    (void)tinybuf_value_serialize_as_json(value, json, JSON_COMPACT, &r);
+    tinybuf_result_unref(&r);
+    double ms[2][3];
+    for (int pool = 0; pool < 2; ++pool)
+    {
+        tinybuf_set_small_pool(pool);
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < MAX_COUNT; ++i)
+        {
+            tinybuf_value *v = tinybuf_value_clone(value);
+            tinybuf_value_free(v);
+        }
+        uint64_t t1 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < MAX_COUNT; ++i)
+        {
+            tinybuf_value *v = tinybuf_value_alloc();
+            buf_ref br{buffer_get_data(bin), buffer_get_length64(bin), buffer_get_data(bin), buffer_get_length64(bin)};
+            tinybuf_error rr = tinybuf_result_ok(0);
+            assert(tinybuf_try_read_box(&br, v, any_version, &rr) > 0);
+            tinybuf_result_unref(&rr);
+            tinybuf_value_free(v);
+        }
+        uint64_t t2 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < MAX_COUNT; ++i)
+        {
+            tinybuf_value *v = tinybuf_value_alloc();
+            tinybuf_error jr = tinybuf_result_ok(0);
+            (void)tinybuf_value_deserialize_from_json(buffer_get_data(json), buffer_get_length(json), v, &jr);
+            tinybuf_result_unref(&jr);
+            tinybuf_value_free(v);
+        }
+        uint64_t t3 = getCurrentMicrosecondOrigin();
+        ms[pool][0] = (t1 - t0) / 1000.0;
+        ms[pool][1] = (t2 - t1) / 1000.0;
+        ms[pool][2] = (t3 - t2) / 1000.0;
+    }
+    tinybuf_set_small_pool(0);
+    const char *steps[3] = {"clone+free", "tryread box+free", "json deserialize+free"};
+    for (int i = 0; i < 3; ++i)
+    {
+        LOGI("%s x%d: %s %.2f ms, small pool %.2f ms", steps[i], MAX_COUNT, tinybuf_allocator_name(), ms[0][i], ms[1][i]);
+    }
+    buffer_free(bin);
+    buffer_free(json);
+    tinybuf_value_free(value);
+    LOGI("allocator_perf_tests done");
+}
+
+static void sso_perf_tests()
+{
+    LOGI("\r\nsso_perf_tests");
+    tinybuf_error r = tinybuf_result_ok(0);
+    // 15字节内联 16字节走buffer 两者来回切换
+    tinybuf_value *s = tinybuf_value_alloc();
+    const char *data = NULL;
+    int64_t len = -1;
+    tinybuf_value_init_string(s, "", 0);
+    assert(tinybuf_value_get_string_view(s, &data, &len, &r) == 0 && len == 0 && data[0] == '\0');
+    tinybuf_value_init_string(s, "0123456789abcde", 15);
+    assert(tinybuf_value_get_string_view(s, &data, &len, &r) == 0 && len == 15 && memcmp(data, "0123456789abcde", 16) == 0);
+    tinybuf_value *c = tinybuf_value_clone(s);
+    assert(tinybuf_value_is_same(s, c));
+    tinybuf_value_init_string(c, "0123456789abcdef", 16);
+    assert(!tinybuf_value_is_same(s, c));
+    tinybuf_value_init_string(c, "short", 5);
+    assert(tinybuf_value_get_string_view(c, &data, &len, &r) == 0 && len == 5 && memcmp(data, "short", 5) == 0);
+    // 按buffer取出是副本 value仍然是短字符串 同一个value重复取出得到同一个buffer
+    buffer *b = tinybuf_value_get_string(s, &r);
+    assert(b && buffer_get_length(b) == 15 && memcmp(buffer_get_data(b), "0123456789abcde", 15) == 0);
+    assert(tinybuf_value_get_string(s, &r) == b);
+    assert(tinybuf_value_get_string_view(s, &data, &len, &r) == 0 && len == 15 && memcmp(data, "0123456789abcde", 15) == 0);
+    tinybuf_value_init_string(s, "xyz", 3);
+    b = tinybuf_value_get_string(s, &r);
+    assert(buffer_get_length(b) == 3 && memcmp(buffer_get_data(b), "xyz", 3) == 0);
+    {
+        // 多个线程同时读取share出来的短字符串
+        tinybuf_value *holder = tinybuf_value_alloc();
+        for (int i = 0; i < 64; ++i)
+        {
+            tinybuf_value *item = tinybuf_value_alloc();
+            char key[16];
+            int kl = snprintf(key, sizeof(key), "k%d", i);
+            tinybuf_value_init_string(item, key, kl);
+            tinybuf_value_map_set(holder, key, item);
+        }
+        tinybuf_value *shared = tinybuf_value_share(holder);
+        std::vector<std::thread> readers;
+        std::atomic<int> bad{0};
+        for (int t = 0; t < 4; ++t)
+        {
+            readers.emplace_back([&]()
+                                 {
+                tinybuf_error er = tinybuf_result_ok(0);
+                for (int round = 0; round < 100; ++round)
+                {
+                    for (int i = 0; i < 64; ++i)
+                    {
+                        char key[16];
+                        int kl = snprintf(key, sizeof(key), "k%d", i);
+                        buffer *sb = tinybuf_value_get_string(tinybuf_value_get_map_child(shared, key, &er), &er);
+                        if (!sb || buffer_get_length(sb) != kl || memcmp(buffer_get_data(sb), key, kl) != 0)
+                            ++bad;
+                    }
+                }
+                tinybuf_result_unref(&er); });
+        }
+        for (auto &th : readers)
+            th.join();
+        assert(bad == 0);
+        tinybuf_value_free(shared);
+        tinybuf_value_free(holder);
+    }
+    tinybuf_value_init_int(s, 1);
+    assert(tinybuf_value_get_string_view(s, &data, &len, &r) != 0);
+    tinybuf_value_free(c);
+
+    // 编解码往返 包括空字符串和短key
+    tinybuf_value *m = tinybuf_value_alloc();
+    tinybuf_value *e = tinybuf_value_alloc();
+    tinybuf_value_init_string(e, "", 0);
+    tinybuf_value_map_set(m, "empty", e);
+    tinybuf_value *l = tinybuf_value_alloc();
+    tinybuf_value_init_string(l, "a string longer than fifteen bytes", 0);
+    tinybuf_value_map_set(m, "long", l);
+    buffer *out = buffer_alloc();
+    assert(tinybuf_try_write_box(out, m, &r) > 0);
+    tinybuf_value *back = tinybuf_value_alloc();
+    buf_ref br{buffer_get_data(out), buffer_get_length64(out), buffer_get_data(out), buffer_get_length64(out)};
+    assert(tinybuf_try_read_box(&br, back, any_version, &r) > 0);
+    assert(tinybuf_value_is_same(m, back));
+    tinybuf_value_free(back);
+    tinybuf_value_free(m);
+    tinybuf_value_free(s);
+
+    // 只含短字符串的记录与刚好超过内联长度的记录对比
+    double ms[2][2];
+    for (int k = 0; k < 2; ++k)
+    {
+        const char *word = k == 0 ? "abcdefghijklmno" : "abcdefghijklmnop";
+        tinybuf_value *rows = tinybuf_value_alloc();
+        for (int i = 0; i < 200; ++i)
+        {
+            tinybuf_value *row = tinybuf_value_alloc();
+            const char *keys[4] = {"id", "name", "tag", "city"};
+            for (int j = 0; j < 4; ++j)
+            {
+                tinybuf_value *v = tinybuf_value_alloc();
+                tinybuf_value_init_string(v, word, 0);
+                tinybuf_value_map_set(row, keys[j], v);
+            }
+            tinybuf_value_array_append(rows, row);
+        }
+        buffer_set_length(out, 0);
+        assert(tinybuf_try_write_box(out, rows, &r) > 0);
+        uint64_t t0 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < MAX_COUNT / 100; ++i)
+        {
+            tinybuf_value *v = tinybuf_value_clone(rows);
+            tinybuf_value_free(v);
+        }
+        uint64_t t1 = getCurrentMicrosecondOrigin();
+        for (int i = 0; i < MAX_COUNT / 100; ++i)
+        {
+            tinybuf_value *v = tinybuf_value_alloc();
+            buf_ref rb{buffer_get_data(out), buffer_get_length64(out), buffer_get_data(out), buffer_get_length64(out)};
+            tinybuf_error rr = tinybuf_result_ok(0);
+            assert(tinybuf_try_read_box(&rb, v, any_version, &rr) > 0);
+            tinybuf_result_unref(&rr);
+            tinybuf_value_free(v);
+        }
+        uint64_t t2 = getCurrentMicrosecondOrigin();
+        ms[k][0] = (t1 - t0) / 1000.0;
+        ms[k][1] = (t2 - t1) / 1000.0;
+        tinybuf_value_free(rows);
+    }
+    LOGI("clone+free x%d: 15 byte strings %.2f ms, 16 byte strings %.2f ms", MAX_COUNT / 100, ms[0][0], ms[1][0]);
+    LOGI("tryread box+free x%d: 15 byte strings %.2f ms, 16 byte strings %.2f ms", MAX_COUNT / 100, ms[0][1], ms[1][1]);
+    buffer_free(out);
+    tinybuf_result_unref(&r);
+    LOGI("sso_perf_tests done");
+}
+
+static void cow_perf_tests()
+{
+    LOGI("\r\ncow_perf_tests");
+    tinybuf_error r = tinybuf_result_ok(0);
+    for (int backend = 0; backend < 2; ++backend)
+    {
+        // 副本共享子节点表 通过_mut取出的成员修改后只影响自己
+        tinybuf_set_map_backend((tinybuf_map_backend)backend);
+        tinybuf_value *doc = tinybuf_make_test_value();
+        tinybuf_value *copy = tinybuf_value_share(doc);
+        assert(tinybuf_value_is_same(doc, copy));
+        tinybuf_value *conf = tinybuf_value_alloc();
+        tinybuf_value *port = tinybuf_value_alloc();
+        tinybuf_value_init_int(port, 80);
+        tinybuf_value_map_set(conf, "port", port);
+        tinybuf_value *list = tinybuf_value_alloc();
+        for (int i = 0; i < 4; ++i)
+        {
+            tinybuf_value *item = tinybuf_value_alloc();
+            tinybuf_value_init_int(item, i);
+            tinybuf_value_array_append(list, item);
+        }
+        tinybuf_value_map_set(conf, "list", list);
+        tinybuf_value *c1 = tinybuf_value_share(conf);
+        tinybuf_value *c2 = tinybuf_value_share(c1);
+        tinybuf_value_init_int(tinybuf_value_get_map_child_mut(c1, "port", &r), 8080);
+        tinybuf_value *c1_list = tinybuf_value_get_map_child_mut(c1, "list", &r);
+        tinybuf_value_init_int(tinybuf_value_get_array_child_mut(c1_list, 2, &r), 42);
+        tinybuf_value *extra = tinybuf_value_alloc();
+        tinybuf_value_init_int(extra, 7);
+        tinybuf_value_array_append(c1_list, extra);
+        tinybuf_value *c2_extra = tinybuf_value_alloc();
+        tinybuf_value_map_set(c2, "extra", c2_extra);
+        assert(tinybuf_value_get_int(tinybuf_value_get_map_child(conf, "port", &r), &r) == 80);
+        assert(tinybuf_value_get_int(tinybuf_value_get_map_child(c2, "port", &r), &r) == 80);
+        assert(tinybuf_value_get_int(tinybuf_value_get_map_child(c1, "port", &r), &r) == 8080);
+        const tinybuf_value *conf_list = tinybuf_value_get_map_child(conf, "list", &r);
+        assert(tinybuf_value_get_child_size(conf_list, &r) == 4);
+        assert(tinybuf_value_get_int(tinybuf_value_get_array_child(conf_list, 2, &r), &r) == 2);
+        assert(tinybuf_value_get_child_size(c1_list, &r) == 5);
+        assert(tinybuf_value_get_child_size(conf, &r) == 2 && tinybuf_value_get_child_size(c2, &r) == 3);
+        // 原对象先释放 副本仍然有效
+        tinybuf_value_free(conf);
+        assert(tinybuf_value_get_int(tinybuf_value_get_array_child(tinybuf_value_get_map_child(c2, "list", &r), 3, &r), &r) == 3);
+        tinybuf_value_free(c1);
+        tinybuf_value_free(c2);
+        // 原对象释放后 对副本中共享的成员强制转换修改 不能再通知已释放的原对象
+        tinybuf_value *d = tinybuf_value_alloc();
+        tinybuf_value *inner = tinybuf_value_alloc();
+        tinybuf_value *leaf = tinybuf_value_alloc();
+        tinybuf_value_init_int(leaf, 1);
+        tinybuf_value_array_append(inner, leaf);
+        tinybuf_value_array_append(d, inner);
+        tinybuf_value *dc = tinybuf_value_share(d);
+        tinybuf_value_free(d);
+        tinybuf_value_init_int((tinybuf_value *)tinybuf_value_get_array_child(dc, 0, &r), 5);
+        assert(tinybuf_value_get_int(tinybuf_value_get_array_child(dc, 0, &r), &r) == 5);
+        tinybuf_value *dm = tinybuf_value_alloc();
+        tinybuf_value_map_set(dm, "inner", tinybuf_value_share(dc));
+        tinybuf_value *dmc = tinybuf_value_share(dm);
+        tinybuf_value_free(dm);
+        tinybuf_value_init_int((tinybuf_value *)tinybuf_value_get_map_child(dmc, "inner", &r), 6);
+        assert(tinybuf_value_get_int(tinybuf_value_get_map_child(dmc, "inner", &r), &r) == 6);
+        tinybuf_value_free(dmc);
+        tinybuf_value_free(dc);
+
+        // 多个线程同时复制和释放同一个文档
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t)
+        {
+            workers.emplace_back([doc]() {
+                tinybuf_error tr = tinybuf_result_ok(0);
+                for (int i = 0; i < 2000; ++i)
+                {
+                    tinybuf_value *v = tinybuf_value_share(doc);
+                    tinybuf_value *n = tinybuf_value_alloc();
+                    tinybuf_value_init_int(n, i);
+                    tinybuf_value_map_set(v, "request_id", n);
+                    tinybuf_value_free(v);
+                }
+                tinybuf_result_unref(&tr);
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        buffer *a = buffer_alloc();
+        buffer *b = buffer_alloc();
+        assert(tinybuf_try_write_box(a, doc, &r) > 0);
+        assert(tinybuf_try_write_box(b, copy, &r) > 0);
+        assert(buffer_is_same(a, b));
+        buffer_free(a);
+        buffer_free(b);
+        tinybuf_value_free(copy);
+        tinybuf_value_free(doc);
+    }
+    tinybuf_set_map_backend(tinybuf_map_backend_avl);
+
+    // clone仍是深拷贝 对const接口取得的成员强制转换后修改不影响原对象
+    tinybuf_value *orig = tinybuf_value_alloc();
+    tinybuf_value *one = tinybuf_value_alloc();
+    tinybuf_value_init_int(one, 1);
+    tinybuf_value_array_append(orig, one);
+    tinybuf_value *deep = tinybuf_value_clone(orig);
+    tinybuf_value_init_int((tinybuf_value *)tinybuf_value_get_array_child(deep, 0, &r), 2);
+    assert(tinybuf_value_get_int(tinybuf_value_get_array_child(orig, 0, &r), &r) == 1);
+    tinybuf_value_free(deep);
+    tinybuf_value_free(orig);
+
+    // 一份配置分发成多份 每份改一个字段 与编解码复制对比
+    tinybuf_value *doc = tinybuf_make_test_value();
+    buffer *bin = buffer_alloc();
+    assert(tinybuf_try_write_box(bin, doc, &r) > 0);
+    uint64_t t0 = getCurrentMicrosecondOrigin();
+    for (int i = 0; i < MAX_COUNT; ++i)
+    {
+        tinybuf_value *v = tinybuf_value_alloc();
+        buf_ref br{buffer_get_data(bin), buffer_get_length64(bin), buffer_get_data(bin), buffer_get_length64(bin)};
+        tinybuf_error rr = tinybuf_result_ok(0);
+        assert(tinybuf_try_read_box(&br, v, any_version, &rr) > 0);
+        tinybuf_result_unref(&rr);
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_int(n, i);
+        tinybuf_value_map_set(v, "request_id", n);
+        tinybuf_value_free(v);
+    }
+    uint64_t t1 = getCurrentMicrosecondOrigin();
+    for (int i = 0; i < MAX_COUNT; ++i)
+    {
+        tinybuf_value *v = tinybuf_value_clone(doc);
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_int(n, i);
+        tinybuf_value_map_set(v, "request_id", n);
+        tinybuf_value_free(v);
+    }
+    uint64_t t2 = getCurrentMicrosecondOrigin();
+    for (int i = 0; i < MAX_COUNT; ++i)
+    {
+        tinybuf_value *v = tinybuf_value_share(doc);
+        tinybuf_value *n = tinybuf_value_alloc();
+        tinybuf_value_init_int(n, i);
+        tinybuf_value_map_set(v, "request_id", n);
+        tinybuf_value_free(v);
+    }
+    uint64_t t3 = getCurrentMicrosecondOrigin();
+    LOGI("copy+set one field x%d: tryread box %.2f ms, clone %.2f ms, share %.2f ms", MAX_COUNT, (t1 - t0) / 1000.0, (t2 - t1) / 1000.0, (t3 - t2) / 1000.0);
+    buffer_free(bin);
+    tinybuf_value_free(doc);
+    tinybuf_result_unref(&r);
+    LOGI("cow_perf_tests done");
+}
+
+static void hash_perf_tests()
+{
+    LOGI("\r\nhash_perf_tests");
+    tinybuf_error r = tinybuf_result_ok(0);
+    // is_same为1时哈希相同 与map后端和插入顺序无关
+    tinybuf_value *a = tinybuf_value_alloc();
+    tinybuf_value *b = tinybuf_value_alloc();
+    tinybuf_set_map_backend(tinybuf_map_backend_hash);
+    const char *keys[3] = {"x", "y", "a string key longer than fifteen"};
+    for (int i = 0; i < 3; ++i)
+    {
+        tinybuf_value *v = tinybuf_value_alloc();
+        tinybuf_value_init_double(v, i == 0 ? -0.0 : i);
+        tinybuf_value_map_set(a, keys[i], v);
+    }
+    tinybuf_set_map_backend(tinybuf_map_backend_avl);
+    for (int i = 2; i >= 0; --i)
+    {
+        tinybuf_value *v = tinybuf_value_alloc();
+        tinybuf_value_init_double(v, i == 0 ? 0.0 : i);
+        tinybuf_value_map_set(b, keys[i], v);
+    }
+    assert(tinybuf_value_is_same(a, b));
+    assert(tinybuf_value_hash(a) == tinybuf_value_hash(b));
+    tinybuf_value *s1 = tinybuf_value_alloc();
+    tinybuf_value *s2 = tinybuf_value_alloc();
+    tinybuf_value_init_string(s1, "short", 5);
+    tinybuf_value_init_string2(s2, buffer_alloc2("short", 5));
+    assert(tinybuf_value_hash(s1) == tinybuf_value_hash(s2));
+    tinybuf_value_free(s1);
+    tinybuf_value_free(s2);
+
+    // 修改后哈希随之变化
+    uint64_t hb = tinybuf_value_hash(b);
+    tinybuf_value_init_double(tinybuf_value_get_map_child_mut(b, "y", &r), 5);
+    assert(tinybuf_value_hash(b) != hb);
+    assert(!tinybuf_value_is_same(a, b));
+    tinybuf_value_init_double(tinybuf_value_get_map_child_mut(b, "y", &r), 1);
+    assert(tinybuf_value_hash(b) == hb && tinybuf_value_is_same(a, b));
+    tinybuf_value *extra = tinybuf_value_alloc();
+    tinybuf_value_map_set(b, "z", extra);
+    assert(tinybuf_value_hash(b) != hb);
+    // 先取出子节点再计算父节点哈希 之后修改子节点 父节点的哈希与比较结果仍然正确
+    tinybuf_value *x = tinybuf_value_alloc();
+    tinybuf_value *z = tinybuf_value_alloc();
+    for (int k = 0; k < 2; ++k)
+    {
+        tinybuf_value *inner = tinybuf_value_alloc();
+        for (int i = 0; i <= k; ++i)
+        {
+            tinybuf_value *n = tinybuf_value_alloc();
+            tinybuf_value_init_int(n, i);
+            tinybuf_value_array_append(inner, n);
+        }
+        tinybuf_value_array_append(k ? z : x, inner);
+    }
+    tinybuf_value *inner = tinybuf_value_get_array_child_mut(x, 0, &r);
+    uint64_t hx = tinybuf_value_hash(x);
+    tinybuf_value *one = tinybuf_value_alloc();
+    tinybuf_value_init_int(one, 1);
+    tinybuf_value_array_append(inner, one);
+    assert(tinybuf_value_hash(x) != hx && tinybuf_value_hash(x) == tinybuf_value_hash(z));
+    assert(tinybuf_value_is_same(x, z));
+    // 共享后释放原对象 对副本中共享的成员强制转换修改 副本和原来的父节点都不能用旧的哈希
+    tinybuf_value *holder = tinybuf_value_alloc();
+    tinybuf_value *orig = tinybuf_value_clone(z);
+    tinybuf_value_map_set(holder, "z", orig);
+    uint64_t hh = tinybuf_value_hash(holder);
+    tinybuf_value *copy = tinybuf_value_share(orig);
+    uint64_t hc = tinybuf_value_hash(copy);
+    assert(tinybuf_value_is_same(copy, z));
+    tinybuf_value *seven = tinybuf_value_alloc();
+    tinybuf_value_init_int(seven, 7);
+    tinybuf_value_array_append((tinybuf_value *)tinybuf_value_get_array_child(copy, 0, &r), seven);
+    assert(tinybuf_value_hash(holder) != hh);
+    tinybuf_value_free(holder);
+    assert(tinybuf_value_hash(copy) != hc && !tinybuf_value_is_same(copy, z));
+    tinybuf_value *z_inner = tinybuf_value_get_array_child_mut(z, 0, &r);
+    seven = tinybuf_value_alloc();
+    tinybuf_value_init_int(seven, 7);
+    tinybuf_value_array_append(z_inner, seven);
+    assert(tinybuf_value_is_same(copy, z) && tinybuf_value_hash(copy) == tinybuf_value_hash(z));
+    tinybuf_value_init_int((tinybuf_value *)tinybuf_value_get_array_child(tinybuf_value_get_array_child(copy, 0, &r), 0, &r), 3);
+    assert(!tinybuf_value_is_same(copy, z) && tinybuf_value_hash(copy) != tinybuf_value_hash(z));
+    tinybuf_value_free(copy);
+    tinybuf_value_free(x);
+    tinybuf_value_free(z);
+    tinybuf_value *list = tinybuf_value_alloc();
+    tinybuf_value_array_append(list, tinybuf_value_clone(a));
+    uint64_t hl = tinybuf_value_hash(list);
+    tinybuf_value_array_append(list, tinybuf_value_alloc());
+    assert(tinybuf_value_hash(list) != hl);
+    tinybuf_value_free(list);
+    tinybuf_value_free(b);
+
+    // 与已注册对象内容相同的值也写成指针
+    tinybuf_value *big = tinybuf_make_test_value();
+    tinybuf_value *same = tinybuf_make_test_value();
+    buffer *plain = buffer_alloc();
+    assert(tinybuf_try_write_box(plain, same, &r) > 0);
+    buffer *buf = buffer_alloc();
+    tinybuf_precache_set_match_equal(1);
+    tinybuf_precache_reset(buf);
+    assert(tinybuf_precache_register(buf, big, &r) >= 0);
+    int64_t registered = buffer_get_length64(buf);
+    tinybuf_precache_set_redirect(1);
+    assert(tinybuf_try_write_box(buf, same, &r) > 0);
+    tinybuf_precache_set_redirect(0);
+    tinybuf_precache_set_match_equal(0);
+    assert(buffer_get_length64(buf) - registered < buffer_get_length64(plain));
+    tinybuf_value *out = tinybuf_value_alloc();
+    buf_ref br{buffer_get_data(buf) + registered, buffer_get_length64(buf) - registered, buffer_get_data(buf), buffer_get_length64(buf)};
+    assert(tinybuf_try_read_box(&br, out, any_version, &r) > 0);
+    assert(tinybuf_value_is_same(out, same));
+    tinybuf_value_free(out);
+    buffer_free(buf);
+    buffer_free(plain);
+    tinybuf_value_free(same);
+
+    // 大文档只有一个叶子不同 比较逐个is_same与各算一次哈希的耗时
+    tinybuf_value *docs[2];
+    for (int k = 0; k < 2; ++k)
+    {
+        docs[k] = tinybuf_value_alloc();
+        for (int i = 0; i < 1000; ++i)
+        {
+            tinybuf_value *row = tinybuf_value_clone(big);
+            tinybuf_value *id = tinybuf_value_alloc();
+            tinybuf_value_init_int(id, (k && i == 999) ? -1 : i);
+            tinybuf_value_map_set(row, "id", id);
+            tinybuf_value_array_append(docs[k], row);
+        }
+    }
+    uint64_t t0 = getCurrentMicrosecondOrigin();
+    for (int i = 0; i < 10; ++i)
+    {
+        assert(!tinybuf_value_is_same(docs[0], docs[1]));
+    }
+    uint64_t t1 = getCurrentMicrosecondOrigin();
+    uint64_t h0 = tinybuf_value_hash(docs[0]);
+    uint64_t h1 = tinybuf_value_hash(docs[1]);
+    uint64_t t2 = getCurrentMicrosecondOrigin();
+    assert(h0 != h1);
+    // 哈希已缓存 再次is_same在根节点比较哈希后直接返回
+    for (int i = 0; i < 10; ++i)
+    {
+        assert(!tinybuf_value_is_same(docs[0], docs[1]));
+        assert(tinybuf_value_hash(docs[0]) == h0);
+    }
+    uint64_t t3 = getCurrentMicrosecondOrigin();
+    LOGI("is_same x10 on 1000 rows: %.3f ms, hash both once %.3f ms, cached is_same+hash x10 %.3f ms",
+         (t1 - t0) / 1000.0, (t2 - t1) / 1000.0, (t3 - t2) / 1000.0);
+    // 改动最后一行的叶子 只有这条路径上的缓存失效
+    tinybuf_value *last = tinybuf_value_get_array_child_mut(docs[1], 999, &r);
+    tinybuf_value_init_int(tinybuf_value_get_map_child_mut(last, "id", &r), 999);
+    assert(tinybuf_value_hash(docs[1]) == h0 && tinybuf_value_is_same(docs[0], docs[1]));
+    tinybuf_value_free(docs[0]);
+    tinybuf_value_free(docs[1]);
+    tinybuf_value_free(big);
+    tinybuf_value_free(a);
+    tinybuf_result_unref(&r);
+    LOGI("hash_perf_tests done");
+}
+
 TEST_CASE("tinybuf_value", "[benchmark]") { tinybuf_value_test(); }
 TEST_CASE("ring_self_pointer", "[benchmark]") { ring_self_pointer_test(); }
 TEST_CASE("version_box", "[benchmark]") { version_box_tests(); }
@@ -2231,6 +5101,27 @@ TEST_CASE("pointer_readable_dump", "[benchmark]") {
     tinybuf_value_free(base);
     buffer_free(buf);
 }
+TEST_CASE("result_alloc_per_node", "[benchmark][performance]") { result_alloc_per_node_tests(); }
+TEST_CASE("array_vector_perf", "[benchmark][performance]") { array_vector_perf_tests(); }
+TEST_CASE("map_backend_perf", "[benchmark][performance]") { map_backend_perf_tests(); }
+TEST_CASE("ctx_parallel_perf", "[benchmark][performance]") { ctx_parallel_perf_tests(); }
+TEST_CASE("offset_pool_perf", "[benchmark][performance]") { offset_pool_perf_tests(); }
+TEST_CASE("strpool_table_write_perf", "[benchmark][performance]") { strpool_table_write_perf_tests(); }
+TEST_CASE("buffer_growth_perf", "[benchmark][performance]") { buffer_growth_perf_tests(); }
+TEST_CASE("serialized_size", "[benchmark]") { serialized_size_tests(); }
+TEST_CASE("view_perf", "[benchmark][performance]") { view_perf_tests(); }
+TEST_CASE("sized_container_perf", "[benchmark][performance]") { sized_container_perf_tests(); }
+TEST_CASE("sax_perf", "[benchmark][performance]") { sax_perf_tests(); }
+TEST_CASE("push_parser_perf", "[benchmark][performance]") { push_parser_perf_tests(); }
+TEST_CASE("mmap_archive_perf", "[benchmark][performance]") { mmap_archive_perf_tests(); }
+TEST_CASE("large_length_perf", "[benchmark][performance]") { large_length_perf_tests(); }
+TEST_CASE("tensor_bswap_perf", "[benchmark][performance]") { tensor_bswap_perf_tests(); }
+TEST_CASE("native_tensor_perf", "[benchmark][performance]") { native_tensor_perf_tests(); }
+TEST_CASE("arena_perf", "[benchmark][performance]") { arena_perf_tests(); }
+TEST_CASE("allocator_perf", "[benchmark][performance]") { allocator_perf_tests(); }
+TEST_CASE("sso_perf", "[benchmark][performance]") { sso_perf_tests(); }
+TEST_CASE("cow_perf", "[benchmark][performance]") { cow_perf_tests(); }
+TEST_CASE("hash_perf", "[benchmark][performance]") { hash_perf_tests(); }
 TEST_CASE("benchmark_performance", "[benchmark][performance]") {
     tinybuf_value *value = tinybuf_make_test_value();
     buffer *buf_binary = buffer_alloc();
@@ -71,6 +71,16 @@ extern "C"
      */
     tinybuf_value *tinybuf_value_clone(const tinybuf_value *value);
 
+    /**
+     * 复制对象 map和array的子节点表与原对象共享(引用计数) 复制为O(1) 任何一方修改时才复制被修改的那一层
+     * 共享的子节点只能通过map_set/array_append/_mut接口修改 对const接口取得的子节点强制转换后修改会影响所有副本
+     * 共享的部分可以在多个线程中同时读取和复制 读取字符串用tinybuf_value_get_string_view
+     * 需要随意修改时使用tinybuf_value_clone
+     * @param value 原对象
+     * @return
+     */
+    tinybuf_value *tinybuf_value_share(const tinybuf_value *value);
+
     /**
      * 比较两个对象是否一致
      * @param value1 对象1
@@ -79,6 +89,16 @@ extern "C"
      */
     int tinybuf_value_is_same(const tinybuf_value *value1, const tinybuf_value *value2);
 
+    /**
+     * 计算对象的64位结构哈希 tinybuf_value_is_same为1的两个对象哈希相同
+     * map/array的结果缓存在节点上 经map_set/array_append/init系列/clear或_mut取出的子节点修改时沿父链失效
+     * 不要绕过这些接口直接改写节点字段 子节点表被tinybuf_value_share共享时这一路上不缓存
+     * 哈希值只在当前进程内有效 不要持久化
+     * @param value 对象
+     * @return 哈希值
+     */
+    uint64_t tinybuf_value_hash(const tinybuf_value *value);
+
     /**
      * 获取数据类型
      * @param value 对象
@@ -117,11 +137,22 @@ extern "C"
 
     /**
      * 读取string值
+     * 不超过15字节的短字符串保存在value内部 返回的是按value地址缓存的一份副本 不修改value 可以在多个线程中同时调用
+     * 副本在value改写或释放前有效 修改它不会改变value 只读访问优先使用tinybuf_value_get_string_view
      * @param value 对象
      * @return string值
      */
     buffer *tinybuf_value_get_string(const tinybuf_value *value, tinybuf_error *r);
 
+    /**
+     * 只读方式读取string值 不会为短字符串申请buffer
+     * @param value 对象
+     * @param data 字符串内容 value修改或释放前有效 可为NULL
+     * @param len 字符串长度 可为NULL
+     * @return 0成功 -1不是string
+     */
+    int tinybuf_value_get_string_view(const tinybuf_value *value, const char **data, int64_t *len, tinybuf_error *r);
+
     /**
      * 获取array或map类型时的成员个数
      * @param value 对象
@@ -150,11 +181,21 @@ extern "C"
      * 获取map成员对象以及key
      * @param value 对象
      * @param index 索引
-     * @param key key指针的指针
+     * @param key key指针的指针 两种后端下都在map释放前有效 继续插入不影响
      * @return 成员对象的指针
      */
     const tinybuf_value *tinybuf_value_get_map_child_and_key(const tinybuf_value *value, int index, buffer **key, tinybuf_error *r);
 
+    /**
+     * 获取可以修改的成员
+     * 与tinybuf_value_share的副本共享的子节点表先复制一份(只复制这一层) 修改返回的成员不影响其他副本
+     * 上面的const版本返回的成员可能被多个副本共享 不能修改
+     * @param value 对象
+     * @return 成员对象的指针
+     */
+    tinybuf_value *tinybuf_value_get_array_child_mut(tinybuf_value *value, int index, tinybuf_error *r);
+    tinybuf_value *tinybuf_value_get_map_child_mut(tinybuf_value *value, const char *key, tinybuf_error *r);
+
     int tinybuf_dump_buffer_as_text(const char *data, int len, buffer *out);
 
     int tinybuf_try_write_array_header(buffer *out, int count, tinybuf_error *r);
@@ -164,11 +205,42 @@ extern "C"
     void tinybuf_set_read_pointer_mode(tinybuf_read_pointer_mode mode);
 
     void tinybuf_set_use_strpool(int enable);
+    // str_pool_table的offset使用固定5字节宽度(默认开启) 写入时无需移动数据
+    // 关闭后offset按最短编码 每个box少几个字节 但offset超过1字节时要把body和pool整体后移
+    void tinybuf_set_strpool_fixed_offset(int enable);
+    // 元素个数不少于min_count的map/array写成带字节长度的形式 读取方可以直接跳过 0(默认)表示不使用
+    void tinybuf_set_sized_container_min_count(int min_count);
+    // tensor按主机小端原样写出 数据相对输出buffer起始按64字节对齐 大端主机写出时转换
+    // 对齐按在最终输出中的位置计算: str_pool_table的offset和part的长度改为固定9字节 分区起始也按64字节对齐
+    void tinybuf_set_tensor_native(int enable);
+    // 读取native tensor时data直接指向源数据 不申请内存不拷贝 源数据需在value释放前一直有效
+    // 仅在小端主机且数据按元素宽度对齐时生效 否则仍然拷贝 tinybuf_tensor_get_data会先拷贝一份再返回
+    void tinybuf_set_tensor_zero_copy(int enable);
+    // double/float tensor编解码时字节翻转使用的指令集 0标量 1SSSE3 2AVX2 按cpu运行时检测
+    int tinybuf_simd_level(void);
+    // 关闭后固定使用标量实现 用于对比测试
+    void tinybuf_set_simd_enabled(int enable);
+
+    // map的存储后端 avl按key排序遍历 hash按插入顺序遍历
+    typedef enum
+    {
+        tinybuf_map_backend_avl = 0,
+        tinybuf_map_backend_hash = 1,
+    } tinybuf_map_backend;
+
+    /**
+     * 设置之后新建的map使用的存储后端 已存在的map不受影响
+     * hash后端查找为O(1) 但序列化时按插入顺序输出key
+     */
+    void tinybuf_set_map_backend(tinybuf_map_backend backend);
+    tinybuf_map_backend tinybuf_get_map_backend(void);
 
     void tinybuf_precache_reset(buffer *out);
     int64_t tinybuf_precache_register(buffer *out, const tinybuf_value *value, tinybuf_error *r);
     void tinybuf_precache_set_redirect(int enable);
     int tinybuf_precache_is_redirect(void);
+    // 开启后与已注册对象内容相同(tinybuf_value_is_same)的值也写成指针 按tinybuf_value_hash查找 需在注册前设置
+    void tinybuf_precache_set_match_equal(int enable);
     ////////////////////////////////赋值////////////////////////////////
 
     /**
@@ -248,6 +320,14 @@ extern "C"
      */
     int tinybuf_value_array_append(tinybuf_value *parent, tinybuf_value *value);
 
+    /**
+     * 对象转换成array并预留成员空间,避免逐个append时反复扩容
+     * @param parent 对象
+     * @param count 预留的成员个数
+     * @return 0成功,-1参数错误
+     */
+    int tinybuf_value_array_reserve(tinybuf_value *parent, int count);
+
     ////////////////////////////////序列化////////////////////////////////
 
     /**
@@ -258,6 +338,20 @@ extern "C"
      */
     int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_error *r);
 
+    /**
+     * 64位长度版本 写入超过2GB时tinybuf_value_serialize返回-1 并撤销本次写入
+     * @return 写入的字节数
+     */
+    int64_t tinybuf_value_serialize64(const tinybuf_value *value, buffer *out, tinybuf_error *r);
+
+    /**
+     * 先按tinybuf_value_serialized_size的精确长度预留out容量 再序列化 写入过程中不再扩容
+     * @param value 对象
+     * @param out 字节流存放地址
+     * @return 与tinybuf_value_serialize相同
+     */
+    int tinybuf_value_serialize_with_reserve(const tinybuf_value *value, buffer *out, tinybuf_error *r);
+
     /**
      * 对象序列化成json字节流
      * @param value 对象
@@ -278,6 +372,11 @@ extern "C"
      */
     int tinybuf_value_deserialize(const char *ptr, int size, tinybuf_value *out, tinybuf_error *r);
 
+    /**
+     * 64位长度版本 用于超过2GB的字符串、tensor和容器
+     */
+    int64_t tinybuf_value_deserialize64(const char *ptr, int64_t size, tinybuf_value *out, tinybuf_error *r);
+
     /**
      * 加载value部分
      * @param ptr json字符串
@@ -287,6 +386,269 @@ extern "C"
      */
     int tinybuf_value_deserialize_from_json(const char *ptr, int size, tinybuf_value *out, tinybuf_error *r);
 
+    ////////////////////////////////只读视图////////////////////////////////
+
+    /**
+     * 序列化字节流上的只读视图，按需解码，不创建tinybuf_value也不分配内存
+     * 字符串直接指向源字节，源字节必须在视图使用期间保持有效
+     * 视图是值类型，可以直接复制
+     */
+    typedef struct
+    {
+        const char *base;  // 整个字节流的起始 解析指针时使用
+        int64_t all_size;  // 整个字节流的长度
+        const char *ptr;   // 当前值的类型字节
+        int64_t size;      // ptr之后可读的字节数
+        const char *pool;  // 所在str_pool_table的pool 没有时为NULL
+        int64_t pool_size;
+        uint32_t pool_gen; // tinybuf_view_init分配的读取编号 解码表只在同一编号内复用
+    } tinybuf_view;
+
+    /**
+     * 在buf当前位置创建视图，str_pool_table会被展开为其中的值
+     * @param view 输出视图
+     * @param buf 字节流
+     * @return 0成功，-1失败
+     */
+    int tinybuf_view_init(tinybuf_view *view, const buf_ref *buf);
+
+    /**
+     * 获取值的类型，指针会被跟随到目标
+     * @return 类型，无法识别的编码返回-1
+     */
+    int tinybuf_view_type(const tinybuf_view *view);
+
+    /**
+     * 读取标量，类型不符时返回-1
+     */
+    int tinybuf_view_get_int(const tinybuf_view *view, int64_t *out);
+    int tinybuf_view_get_double(const tinybuf_view *view, double *out);
+    int tinybuf_view_get_bool(const tinybuf_view *view, int *out);
+
+    /**
+     * 读取字符串，data指向源字节
+     * strpool中的字符串通过当前线程reader_ctx的解码表查找，从同一次tinybuf_view_init得到的视图共用一张表 pool只解码一次
+     * @return 0成功，-1失败
+     */
+    int tinybuf_view_get_string(const tinybuf_view *view, const char **data, int *len);
+
+    /**
+     * 展开version包装，tinybuf_view_type为tinybuf_version时使用
+     * @param version 版本号 可为NULL
+     * @param out 被包装的值的视图
+     * @return 0成功，-1不是version或数据不完整
+     */
+    int tinybuf_view_version(const tinybuf_view *view, uint64_t *version, tinybuf_view *out);
+
+    /**
+     * 数组或map的元素个数
+     * @return 元素个数，其他类型返回-1
+     */
+    int64_t tinybuf_view_size(const tinybuf_view *view);
+
+    /**
+     * 数组下标访问，需要跳过前面的元素
+     * @return 0成功，-1失败
+     */
+    int tinybuf_view_array_at(const tinybuf_view *view, int64_t index, tinybuf_view *out);
+
+    /**
+     * 按key查找map中的值
+     * @return 0成功，-1失败或不存在
+     */
+    int tinybuf_view_map_get(const tinybuf_view *view, const char *key, int key_len, tinybuf_view *out);
+
+    /**
+     * 按下标遍历map，key指向源字节
+     * @return 0成功，-1失败
+     */
+    int tinybuf_view_map_at(const tinybuf_view *view, int64_t index, const char **key, int *key_len, tinybuf_view *out);
+
+    /**
+     * 当前值编码占用的字节数
+     * @return 字节数，无法识别的编码返回-1
+     */
+    int64_t tinybuf_view_byte_size(const tinybuf_view *view);
+
+    ////////////////////////////////事件流读取////////////////////////////////
+
+    /**
+     * 事件回调 直接由字节流驱动 不构建tinybuf_value
+     * 回调为NULL时忽略对应事件 返回非0时中止解析
+     * 字符串、key和bool_map的指针指向源字节 只在回调期间保证有效
+     */
+    typedef struct
+    {
+        int (*on_null)(void *user_data);
+        int (*on_bool)(void *user_data, int value);
+        int (*on_int)(void *user_data, int64_t value);
+        int (*on_double)(void *user_data, double value);
+        int (*on_string)(void *user_data, const char *data, int len);
+        int (*on_map_begin)(void *user_data, int64_t count);
+        int (*on_key)(void *user_data, const char *key, int len);
+        int (*on_array_begin)(void *user_data, int64_t count);
+        // map或array结束
+        int (*on_end)(void *user_data);
+        /**
+         * tensor数据已解码为本机格式 dtype 8为double 10为float 11为按位打包的bool(与bool_map相同) 其余为int64_t
+         */
+        int (*on_tensor)(void *user_data, int dtype, const int64_t *shape, int dims, const void *data, int64_t count);
+        // bits按高位在前打包
+        int (*on_bool_map)(void *user_data, const uint8_t *bits, int64_t count);
+    } tinybuf_sax_handler;
+
+    /**
+     * 以事件流方式读取buf当前位置的box 支持str_pool_table、指针、version和带长度的容器
+     * 指针按目标内容产生事件 成环或展开的总量超过buffer大小的16倍(至少1MB)时报错 字符串、key或box超过2GB时报错
+     * @param buf 字节流 成功时前移消耗的字节数
+     * @param handler 回调表
+     * @param user_data 传给回调的参数
+     * @return 消耗的字节数 0表示数据不完整 小于0表示失败或被回调中止
+     */
+    int tinybuf_sax_read(buf_ref *buf, const tinybuf_sax_handler *handler, void *user_data, tinybuf_error *r);
+
+    /**
+     * 可恢复的增量解析器 数据分块到达时逐块输入 已完整的值立即产生事件
+     * 容器栈和未读完的varint、字符串会保存在解析器中 不需要从头重新解析
+     * str_pool_table和指针需要随机访问整个字节流 不支持 请在收齐后使用tinybuf_sax_read
+     */
+    typedef struct T_tinybuf_push_parser tinybuf_push_parser;
+    tinybuf_push_parser *tinybuf_push_parser_new(const tinybuf_sax_handler *handler, void *user_data);
+    void tinybuf_push_parser_free(tinybuf_push_parser *parser);
+    // 丢弃当前状态 准备解析下一个box
+    void tinybuf_push_parser_reset(tinybuf_push_parser *parser);
+
+    /**
+     * 输入一块数据
+     * @return 0表示数据已全部消耗但box还没结束 大于0表示box已完整 返回值为本块中属于该box的字节数 小于0表示失败
+     */
+    int tinybuf_push_parser_feed(tinybuf_push_parser *parser, const char *data, int len, tinybuf_error *r);
+
+    ////////////////////////////////arena////////////////////////////////
+
+    /**
+     * 按块顺序分配的内存 用于整棵value树 只能通过reset/free整体释放
+     * 绑定到线程后新建的value以及解码产生的key、字符串、子节点表都从arena分配
+     * arena中的value调用tinybuf_value_free/tinybuf_value_clear不会释放内存
+     * 之后向arena中的value挂上堆上的新内容不会被arena释放 需要修改时先tinybuf_value_clone出堆上的副本
+     * arena不是线程安全的 同一时间只能在一个线程中使用
+     */
+    typedef struct T_tinybuf_arena tinybuf_arena;
+
+    /**
+     * @param chunk_size 每块的字节数 小于等于0时为64KB 超过块大小的申请单独占一块
+     */
+    tinybuf_arena *tinybuf_arena_new(int64_t chunk_size);
+
+    // 释放arena中的全部value 保留内存块供下次使用 之前取得的value全部失效
+    void tinybuf_arena_reset(tinybuf_arena *arena);
+    void tinybuf_arena_free(tinybuf_arena *arena);
+
+    // 自上次reset以来分配出去的字节数
+    int64_t tinybuf_arena_used(const tinybuf_arena *arena);
+
+    // 绑定到当前线程 传NULL解除绑定 返回之前绑定的arena
+    tinybuf_arena *tinybuf_arena_bind(tinybuf_arena *arena);
+
+    /**
+     * 在arena中新建根节点并读取一个box 等同于绑定arena后调用tinybuf_try_read_box64
+     * @param out 成功时为arena中的根节点 失败时为NULL
+     * @return 消耗的字节数 失败返回小于等于0
+     */
+    int64_t tinybuf_try_read_box_arena(buf_ref *buf, tinybuf_arena *arena, tinybuf_value **out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
+
+    ////////////////////////////////分区表////////////////////////////////
+
+    /**
+     * tinybuf_try_write_partitions写出的分区表 打开后可按下标随机读取分区
+     * 只引用buf中的数据 buf需在关闭前一直有效 不修改buf
+     * 不使用全局读状态 多个线程可同时读取同一个表中的分区
+     */
+    typedef struct T_tinybuf_part_table tinybuf_part_table;
+
+    /**
+     * 解析buf->ptr处的分区表
+     * @return 失败或不是分区表时返回NULL
+     */
+    tinybuf_part_table *tinybuf_part_table_open(const buf_ref *buf, tinybuf_error *r);
+    void tinybuf_part_table_close(tinybuf_part_table *table);
+
+    // 分区个数 第0个为主分区
+    int64_t tinybuf_part_table_count(const tinybuf_part_table *table);
+
+    // 各分区相对于分区表起始的offset 共tinybuf_part_table_count个
+    const uint64_t *tinybuf_part_table_offsets(const tinybuf_part_table *table);
+
+    /**
+     * 获取第index个分区内容的buf_ref 不读取分区内容
+     * @return 0成功，-1失败
+     */
+    int tinybuf_part_ref(const tinybuf_part_table *table, int64_t index, buf_ref *out, tinybuf_error *r);
+
+    /**
+     * 读取第index个分区
+     * @return 消耗的字节数 失败返回小于等于0
+     */
+    int64_t tinybuf_part_read(const tinybuf_part_table *table, int64_t index, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
+
+    /**
+     * 在threads个线程上读取count个分区 第i个结果写入outs[i]
+     * @param indexes 要读取的分区下标 为NULL时读取0到count-1
+     * @param threads 线程数 小于等于0时按cpu个数
+     * @return 0全部成功，-1有分区读取失败
+     */
+    int tinybuf_parts_read_parallel(const tinybuf_part_table *table, const int64_t *indexes, int count, tinybuf_value **outs, int threads, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
+
+    ////////////////////////////////内存映射文件////////////////////////////////
+
+    /**
+     * 只读映射整个文件 不把文件读入内存 适合多GB的分区文件
+     * 文件以分区表开头时读取单个分区只访问分区表和该分区所在的页
+     */
+    typedef struct T_tinybuf_file tinybuf_file;
+
+    typedef enum
+    {
+        tinybuf_advise_normal = 0,
+        // 即将顺序读取 加大预读
+        tinybuf_advise_sequential,
+        // 随机访问 关闭预读
+        tinybuf_advise_random,
+        // 立即开始预取
+        tinybuf_advise_willneed,
+    } tinybuf_advise;
+
+    /**
+     * 打开并映射文件
+     * @return 失败返回NULL
+     */
+    tinybuf_file *tinybuf_file_open_mmap(const char *path, tinybuf_error *r);
+    void tinybuf_file_close(tinybuf_file *file);
+
+    // 整个文件的buf_ref 文件关闭前有效
+    buf_ref tinybuf_file_buf(const tinybuf_file *file);
+
+    // 对[offset, offset+len)给出访问提示 不支持的平台忽略
+    int tinybuf_file_advise(tinybuf_file *file, int64_t offset, int64_t len, tinybuf_advise advice);
+
+    // 分区个数 文件不以分区表开头时返回-1
+    int64_t tinybuf_file_part_count(const tinybuf_file *file);
+
+    // 文件的分区表 可用于tinybuf_parts_read_parallel 文件不以分区表开头时返回NULL
+    const tinybuf_part_table *tinybuf_file_part_table(const tinybuf_file *file);
+
+    /**
+     * 获取第index个分区内容的buf_ref 不读取分区内容
+     * @return 0成功，-1失败
+     */
+    int tinybuf_file_part_ref(tinybuf_file *file, int64_t index, buf_ref *out, tinybuf_error *r);
+
+    /**
+     * 读取第index个分区
+     * @return 消耗的字节数 失败返回小于等于0
+     */
+    int64_t tinybuf_file_read_part(tinybuf_file *file, int64_t index, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
+
     int tinybuf_value_set_plugin_index(tinybuf_value *value, int index);
     int tinybuf_value_get_plugin_index(const tinybuf_value *value);
     int tinybuf_value_set_custom_box_tag(tinybuf_value *value, int tag);
@@ -1,5 +1,6 @@
 #ifndef TINYBUF_BUFFER_H
 #define TINYBUF_BUFFER_H
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -16,6 +17,20 @@ extern "C"
     buffer *buffer_alloc(void);
     buffer *buffer_alloc2(const char *str, int len);
 
+    /**
+     * 在调用者提供的内存上创建buffer对象，写入时不会重新分配也不会释放mem
+     * 写满后的追加会被丢弃，可以通过buffer_is_overflow检查
+     * @param mem 外部内存
+     * @param capacity 外部内存的字节数，数据可以写满整个mem，此时末尾不保留'\0'
+     * @return buffer对象，用buffer_free释放
+     */
+    buffer *buffer_alloc_fixed(char *mem, int capacity);
+
+    /**
+     * 外部内存的buffer是否因容量不足丢弃过数据
+     */
+    int buffer_is_overflow(const buffer *buf);
+
     /**
      * 释放堆上的buffer对象
      * @param buf buffer对象指针
@@ -33,9 +48,10 @@ extern "C"
     /**
      * 获取数据长度
      * @param buf 对象
-     * @return 数据长度
+     * @return 数据长度，超过INT_MAX时返回-1，请使用buffer_get_length64
      */
     int buffer_get_length(buffer *buf);
+    int64_t buffer_get_length64(buffer *buf);
 
     /**
      * 设置长度，不能超过(容量-1)
@@ -44,13 +60,15 @@ extern "C"
      * @return 0成功，-1失败
      */
     int buffer_set_length(buffer *buf, int len);
+    int buffer_set_length64(buffer *buf, int64_t len);
 
     /**
      * 获取对象容量
      * @param buf 对象
-     * @return 容量大小
+     * @return 容量大小，超过INT_MAX时返回-1
      */
     int buffer_get_capacity(buffer *buf);
+    int64_t buffer_get_capacity64(buffer *buf);
 
     /**
      * 追加数据至buffer对象末尾
@@ -60,6 +78,7 @@ extern "C"
      * @return 0为成功
      */
     int buffer_append(buffer *buf, const char *data, int len);
+    int buffer_append64(buffer *buf, const char *data, int64_t len);
 
     /**
      * 追加容量
@@ -69,6 +88,23 @@ extern "C"
      */
     int buffer_add_capacity(buffer *buf, int add);
 
+    /**
+     * 预留容量，保证总长度达到capacity前追加数据不再重新分配
+     * @param buf 对象
+     * @param capacity 期望容纳的数据长度(不含末尾的'\0')
+     * @return 0为成功
+     */
+    int buffer_reserve(buffer *buf, int capacity);
+    int buffer_reserve64(buffer *buf, int64_t capacity);
+
+    /**
+     * 设置容量不足时的增长倍数，对所有buffer生效，默认2.0
+     * 小于1.0按1.0处理，1.0表示每次只扩到刚好够用
+     * @param factor 增长倍数
+     */
+    void buffer_set_growth_factor(double factor);
+    double buffer_get_growth_factor(void);
+
     /**
      * 追加数据至buffer对象末尾
      * @param buf 对象指针
@@ -85,6 +121,7 @@ extern "C"
      * @return 0为成功
      */
     int buffer_assign(buffer *buf, const char *data, int len);
+    int buffer_assign64(buffer *buf, const char *data, int64_t len);
 
     /**
      * 把src对象里面的数据移动至dst，内部有无memcpy
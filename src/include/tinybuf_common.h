@@ -56,10 +56,14 @@ extern "C"
     int tinybuf_result_msg_count(const tinybuf_error *r);
     tinybuf_str tinybuf_result_msg_at(const tinybuf_error *r, int idx);
     int tinybuf_result_format_msgs(const tinybuf_error *r, char *dst, int dst_len);
+    /* per-thread, like errno */
     const char *tinybuf_last_error_message(void);
 
     int tinybuf_result_ref(tinybuf_error *r);
     int tinybuf_result_unref(tinybuf_error *r);
+    /* fast mode (default on): tinybuf_result_ok allocates nothing until the first error message */
+    void tinybuf_result_set_fast_mode(int enable);
+    int tinybuf_result_is_fast_mode(void);
 
     int tinybuf_result_append_merge(tinybuf_error *dst, tinybuf_error *src, int (*mergeres)(int, int));
     int tinybuf_merger_sum(int a, int b);
@@ -69,9 +73,25 @@ extern "C"
 
     int tinybuf_try_read_box_with_mode(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_read_pointer_mode mode, tinybuf_error *r);
     int tinybuf_try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
+    /* 64-bit variant for boxes larger than 2GB; tinybuf_try_read_box fails on them without moving buf */
+    int64_t tinybuf_try_read_box64(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
     int tinybuf_try_write_box(buffer *out, const tinybuf_value *value, tinybuf_error *r);
     int tinybuf_try_read_box_with_plugins(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
 
+    /* reader/writer contexts own the mutable pool, precache and pointer-resolution state.
+       Each thread gets its own default context; a context must not be used by two threads at once. */
+    typedef struct T_tinybuf_writer_ctx tinybuf_writer_ctx;
+    typedef struct T_tinybuf_reader_ctx tinybuf_reader_ctx;
+    tinybuf_writer_ctx *tinybuf_writer_ctx_new(void);
+    void tinybuf_writer_ctx_free(tinybuf_writer_ctx *ctx);
+    tinybuf_reader_ctx *tinybuf_reader_ctx_new(void);
+    void tinybuf_reader_ctx_free(tinybuf_reader_ctx *ctx);
+    /* bind ctx to the calling thread for all following calls (NULL restores the default); returns the previous binding */
+    tinybuf_writer_ctx *tinybuf_writer_ctx_bind(tinybuf_writer_ctx *ctx);
+    tinybuf_reader_ctx *tinybuf_reader_ctx_bind(tinybuf_reader_ctx *ctx);
+    int tinybuf_try_write_box_ctx(tinybuf_writer_ctx *ctx, buffer *out, const tinybuf_value *value, tinybuf_error *r);
+    int tinybuf_try_read_box_ctx(tinybuf_reader_ctx *ctx, buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
+
     typedef int (*tinybuf_custom_read_fn)(const char *name, const uint8_t *data, int len, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r);
     typedef int (*tinybuf_custom_write_fn)(const char *name, const tinybuf_value *in, buffer *out, tinybuf_error *r);
     typedef int (*tinybuf_custom_dump_fn)(const char *name, buf_ref *buf, buffer *out, tinybuf_error *r);
@@ -86,6 +106,21 @@ extern "C"
 
     int tinybuf_try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r);
     int tinybuf_try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r);
+    /* 64-bit variants: the int versions return -1 and roll out back once more than 2GB would be written */
+    int64_t tinybuf_try_write_box64(buffer *out, const tinybuf_value *value, tinybuf_error *r);
+    int64_t tinybuf_try_write_partitions64(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r);
+    /* same bytes as tinybuf_try_write_partitions, but the parts are serialized on `threads` threads
+       (<= 0: one per cpu), each with its own writer ctx; the calling thread's ctx is left untouched */
+    int64_t tinybuf_try_write_partitions_parallel(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, int threads, tinybuf_error *r);
+    /* exact number of bytes tinybuf_try_write_box / tinybuf_try_write_partitions will write
+       (strpool table included); -1 on failure or while precache redirect is enabled, since
+       redirected values are written as pointers whose size depends on the output position.
+       with tinybuf_set_tensor_native the padding depends on the position too: the sizes are
+       exact for output starting at a 64-byte aligned offset of the buffer (e.g. an empty one) */
+    int64_t tinybuf_value_serialized_size(const tinybuf_value *value);
+    int64_t tinybuf_partitions_serialized_size(const tinybuf_value *mainbox, const tinybuf_value **subs, int count);
+    /* write a box into caller-owned memory without ever reallocating; fails when capacity is too small */
+    int tinybuf_try_write_box_into(char *mem, int capacity, const tinybuf_value *value, tinybuf_error *r);
 
     int tinybuf_try_write_pointer(buffer *out, int t, int64_t offset, tinybuf_error *r);
     int tinybuf_try_write_sub_ref(buffer *out, int t, int64_t offset, tinybuf_error *r);
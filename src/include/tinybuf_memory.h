@@ -1,5 +1,6 @@
 #ifndef TINYBUF_MEMORY_H
 #define TINYBUF_MEMORY_H
+#include <stddef.h>
 #ifdef __cplusplus
 extern "C"
 {
@@ -10,18 +11,37 @@ extern "C"
     typedef void (*free_ptr)(void *ptr);
     typedef void *(*realloc_ptr)(void *ptr, int size);
     typedef char *(*strdup_ptr)(const char *str);
+    // 64位长度版本 设置后优先于int版本 超过2GB的申请只能走这里
+    typedef void *(*malloc64_ptr)(size_t size);
+    typedef void *(*realloc64_ptr)(void *ptr, size_t size);
 
     ///////////////////替换内存相关的函数/////////////////////////////
     void set_malloc_ptr(malloc_ptr ptr);
     void set_free_ptr(free_ptr ptr);
     void set_realloc_ptr(realloc_ptr ptr);
     void set_strdup_ptr(strdup_ptr ptr);
+    void set_malloc64_ptr(malloc64_ptr ptr);
+    void set_realloc64_ptr(realloc64_ptr ptr);
 
     ///////////////////内存相关的函数/////////////////////////////
     void *tinybuf_malloc(int size);
     void tinybuf_free(void *ptr);
     void *tinybuf_realloc(void *ptr, int size);
     char *tinybuf_strdup(const char *str);
+    // 只设置了int版本的替换函数时 超过INT_MAX的申请返回NULL
+    void *tinybuf_malloc64(size_t size);
+    void *tinybuf_realloc64(void *ptr, size_t size);
+
+    ///////////////////小对象池/////////////////////////////
+    // tinybuf_value、buffer、AVL节点、hole_value、错误引用计数等固定大小小对象的分配函数
+    // 开启后按大小分级 每个线程维护自己的空闲链表 线程退出时交还全局 关闭时直接使用tinybuf_malloc64(默认关闭)
+    // 池中的对象16字节对齐 释放时按地址判断来源 可随时开关 tinybuf_small_alloc得到的内存只能用tinybuf_small_free释放
+    void tinybuf_set_small_pool(int enable);
+    int tinybuf_is_small_pool(void);
+    void *tinybuf_small_alloc(size_t size);
+    void tinybuf_small_free(void *ptr);
+    // 底层分配器 "malloc"或编译时选择的"jemalloc"
+    const char *tinybuf_allocator_name(void);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -4,29 +4,6 @@
 #include "tinybuf_memory.h"
 #include <stdio.h>
 #include <string.h>
-static tinybuf_value *clone_box(const tinybuf_value *in)
-{
-    buffer *b = buffer_alloc();
-    tinybuf_error wr = tinybuf_result_ok(0);
-    int wl = tinybuf_try_write_box(b, in, &wr);
-    if (wl <= 0)
-    {
-        buffer_free(b);
-        return NULL;
-    }
-    buf_ref br = (buf_ref){buffer_get_data(b), (int64_t)buffer_get_length(b), buffer_get_data(b), (int64_t)buffer_get_length(b)};
-    tinybuf_value *out = tinybuf_value_alloc();
-    tinybuf_error rr = tinybuf_result_ok(0);
-    int rl = tinybuf_try_read_box(&br, out, NULL, &rr);
-    buffer_free(b);
-    if (rl <= 0)
-    {
-        tinybuf_value_free(out);
-        return NULL;
-    }
-    return out;
-}
-
 static int op_hlist_insert(tinybuf_value *value, const tinybuf_value *args, tinybuf_value *out)
 {
     if (tinybuf_value_get_type(value) != tinybuf_array)
@@ -58,24 +35,21 @@ static int op_hlist_insert(tinybuf_value *value, const tinybuf_value *args, tiny
         return -1;
     }
     tinybuf_value_clear(out);
+    // 结果中的元素与输入共享子节点表(copy-on-write) 不做深拷贝 delete/concat同样
     tinybuf_error cr1 = tinybuf_result_ok(0);
     int before = tinybuf_value_get_child_size(value, &cr1);
     for (int i = 0; i <= before; i++)
     {
         if (i == idx)
         {
-            tinybuf_value *cpins = clone_box(ins);
-            if (!cpins)
-                return -1;
+            tinybuf_value *cpins = tinybuf_value_share(ins);
             tinybuf_value_array_append(out, cpins);
         }
         if (i < before)
         {
             tinybuf_error rr2 = tinybuf_result_ok(0);
             const tinybuf_value *ch = tinybuf_value_get_array_child(value, i, &rr2);
-            tinybuf_value *cp = clone_box(ch);
-            if (!cp)
-                return -1;
+            tinybuf_value *cp = tinybuf_value_share(ch);
             tinybuf_value_array_append(out, cp);
         }
     }
@@ -112,9 +86,7 @@ static int op_hlist_delete(tinybuf_value *value, const tinybuf_value *args, tiny
             continue;
         tinybuf_error rr3 = tinybuf_result_ok(0);
         const tinybuf_value *ch = tinybuf_value_get_array_child(value, i, &rr3);
-        tinybuf_value *cp = clone_box(ch);
-        if (!cp)
-            return -1;
+        tinybuf_value *cp = tinybuf_value_share(ch);
         tinybuf_value_array_append(out, cp);
     }
     return 0;
@@ -143,9 +115,7 @@ static int op_hlist_concat(tinybuf_value *value, const tinybuf_value *args, tiny
     {
         tinybuf_error rr5 = tinybuf_result_ok(0);
         const tinybuf_value *ch = tinybuf_value_get_array_child(value, i, &rr5);
-        tinybuf_value *cp = clone_box(ch);
-        if (!cp)
-            return -1;
+        tinybuf_value *cp = tinybuf_value_share(ch);
         tinybuf_value_array_append(out, cp);
     }
     tinybuf_error cr4 = tinybuf_result_ok(0);
@@ -154,9 +124,7 @@ static int op_hlist_concat(tinybuf_value *value, const tinybuf_value *args, tiny
     {
         tinybuf_error rr6 = tinybuf_result_ok(0);
         const tinybuf_value *ch2 = tinybuf_value_get_array_child(other, j, &rr6);
-        tinybuf_value *cp2 = clone_box(ch2);
-        if (!cp2)
-            return -1;
+        tinybuf_value *cp2 = tinybuf_value_share(ch2);
         tinybuf_value_array_append(out, cp2);
     }
     return 0;
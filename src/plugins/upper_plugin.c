@@ -53,22 +53,21 @@ static int dll_upper_write(uint8_t type, const tinybuf_value *in, buffer *out, t
         return -1;
     }
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(in, &gr);
-    if (!s)
+    const char *s;
+    int64_t slen;
+    if (tinybuf_value_get_string_view(in, &s, &slen, &gr) != 0)
     {
         tinybuf_error er = tinybuf_result_err(-1, "upper write: not string", NULL);
         tinybuf_result_append_merge(&er, &gr, tinybuf_merger_left);
         tinybuf_result_append_merge(r, &er, tinybuf_merger_left);
         return -1;
     }
-    int len = buffer_get_length(s);
-    if (len > 255)
-        len = 255;
+    int len = slen > 255 ? 255 : (int)slen;
     uint8_t t = DLL_UPPER_TYPE;
     buffer_append(out, (const char *)&t, 1);
     uint8_t l = (uint8_t)len;
     buffer_append(out, (const char *)&l, 1);
-    buffer_append(out, buffer_get_data(s), len);
+    buffer_append(out, s, len);
     return 2 + len;
 }
 
@@ -114,8 +113,9 @@ static int dll_upper_show_value(uint8_t type, const tinybuf_value *in, buffer *o
         return -1;
     }
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(in, &gr);
-    if (!s)
+    const char *s;
+    int64_t len;
+    if (tinybuf_value_get_string_view(in, &s, &len, &gr) != 0)
     {
         tinybuf_error er = tinybuf_result_err(-1, "null string", NULL);
         tinybuf_result_append_merge(&er, &gr, tinybuf_merger_left);
@@ -123,21 +123,21 @@ static int dll_upper_show_value(uint8_t type, const tinybuf_value *in, buffer *o
         return -1;
     }
     buffer_append(out, "dll_upper(", 10);
-    buffer_append(out, buffer_get_data(s), buffer_get_length(s));
+    buffer_append(out, s, (int)len);
     buffer_append(out, ")", 1);
-    return buffer_get_length(s) + 11;
+    return (int)len + 11;
 }
 
 static int dll_to_lower(tinybuf_value *value, const tinybuf_value *args, tinybuf_value *out)
 {
     (void)args;
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(value, &gr);
-    if (!s)
+    const char *p = NULL;
+    int64_t len64 = 0;
+    if (tinybuf_value_get_string_view(value, &p, &len64, &gr) != 0)
         return -1;
-    int len = buffer_get_length(s);
+    int len = (int)len64;
     char *tmp = (char *)tinybuf_malloc(len);
-    const char *p = buffer_get_data(s);
     for (int i = 0; i < len; ++i)
     {
         char c = p[i];
@@ -21,6 +21,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include "avl-tree.h"
 #include "tinybuf_memory.h"
+#include "tb_lock.h"
 
 /* malloc() / free() testing */
 
@@ -45,6 +46,13 @@ struct _AVLTree {
 	AVLTreeNode *root_node;
 	AVLTreeCompareFunc compare_func;
 	unsigned int num_nodes;
+	/* NULL: nodes come from tinybuf_small_alloc; otherwise owned by the allocator */
+	AVLTreeAllocFunc alloc_func;
+	void *alloc_ctx;
+	/* number of references besides the owner, see avl_tree_share */
+	tb_atomic_t shares;
+	/* opaque to the tree, see avl_tree_get_tag */
+	uint64_t tag;
 };
 
 static inline void free_node_key_value(AVLTreeNode *node){
@@ -61,12 +69,14 @@ static inline void free_node_key_value(AVLTreeNode *node){
     }
 }
 
-static inline void free_node(AVLTreeNode *node){
+static inline void free_node(AVLTree *tree, AVLTreeNode *node){
     if(!node){
         return;
     }
     free_node_key_value(node);
-    tinybuf_free(node);
+    if(!tree->alloc_func){
+        tinybuf_small_free(node);
+    }
 }
 
 
@@ -74,7 +84,29 @@ AVLTree *avl_tree_new(AVLTreeCompareFunc compare_func)
 {
 	AVLTree *new_tree;
 
-	new_tree = (AVLTree *) tinybuf_malloc(sizeof(AVLTree));
+	new_tree = (AVLTree *) tinybuf_small_alloc(sizeof(AVLTree));
+
+	if (new_tree == NULL) {
+		return NULL;
+	}
+
+	new_tree->root_node = NULL;
+	new_tree->compare_func = compare_func;
+	new_tree->num_nodes = 0;
+	new_tree->alloc_func = NULL;
+	new_tree->alloc_ctx = NULL;
+	new_tree->shares = 0;
+	new_tree->tag = 0;
+
+	return new_tree;
+}
+
+AVLTree *avl_tree_new_with_alloc(AVLTreeCompareFunc compare_func,
+                                 AVLTreeAllocFunc alloc_func, void *alloc_ctx)
+{
+	AVLTree *new_tree;
+
+	new_tree = (AVLTree *) alloc_func(alloc_ctx, sizeof(AVLTree));
 
 	if (new_tree == NULL) {
 		return NULL;
@@ -83,6 +115,10 @@ AVLTree *avl_tree_new(AVLTreeCompareFunc compare_func)
 	new_tree->root_node = NULL;
 	new_tree->compare_func = compare_func;
 	new_tree->num_nodes = 0;
+	new_tree->alloc_func = alloc_func;
+	new_tree->alloc_ctx = alloc_ctx;
+	new_tree->shares = 0;
+	new_tree->tag = 0;
 
 	return new_tree;
 }
@@ -96,18 +132,46 @@ static void avl_tree_free_subtree(AVLTree *tree, AVLTreeNode *node)
 	avl_tree_free_subtree(tree, node->children[AVL_TREE_NODE_LEFT]);
 	avl_tree_free_subtree(tree, node->children[AVL_TREE_NODE_RIGHT]);
 
-    free_node(node);
+    free_node(tree, node);
 }
 
 void avl_tree_free(AVLTree *tree)
 {
+	/* Other references remain */
+
+	if (tb_atomic_load(&tree->shares) > 0 && tb_atomic_add(&tree->shares, -1) >= 0) {
+		return;
+	}
+
 	/* Destroy all nodes */
 
 	avl_tree_free_subtree(tree, tree->root_node);
 
 	/* Free back the main tree data structure */
 
-	tinybuf_free(tree);
+	if (!tree->alloc_func) {
+		tinybuf_small_free(tree);
+	}
+}
+
+void avl_tree_share(AVLTree *tree)
+{
+	tb_atomic_add(&tree->shares, 1);
+}
+
+int avl_tree_is_shared(AVLTree *tree)
+{
+	return tb_atomic_load(&tree->shares) > 0;
+}
+
+uint64_t avl_tree_get_tag(AVLTree *tree)
+{
+	return tree->tag;
+}
+
+void avl_tree_set_tag(AVLTree *tree, uint64_t tag)
+{
+	tree->tag = tag;
 }
 
 int avl_tree_subtree_height(AVLTreeNode *node)
@@ -362,7 +426,11 @@ AVLTreeNode *avl_tree_insert(AVLTree *tree, AVLTreeKey key, AVLTreeValue value,
 
 	/* Create a new node.  Use the last node visited as the parent link. */
 
-	new_node = (AVLTreeNode *) tinybuf_malloc(sizeof(AVLTreeNode));
+	if (tree->alloc_func) {
+		new_node = (AVLTreeNode *) tree->alloc_func(tree->alloc_ctx, sizeof(AVLTreeNode));
+	} else {
+		new_node = (AVLTreeNode *) tinybuf_small_alloc(sizeof(AVLTreeNode));
+	}
 
 	if (new_node == NULL) {
 		return NULL;
@@ -506,7 +574,7 @@ void avl_tree_remove_node(AVLTree *tree, AVLTreeNode *node)
 
 	/* Destroy the node */
 
-    free_node(node);
+    free_node(tree, node);
 
 	/* Keep track of the number of nodes */
 
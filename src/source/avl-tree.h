@@ -54,6 +54,9 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #ifndef ALGORITHM_AVLTREE_H
 #define ALGORITHM_AVLTREE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -128,6 +131,12 @@ typedef void (*AVLTreeFreeKeyFunc)(AVLTreeKey key);
  */
 typedef void (*AVLTreeFreeValueFunc)(AVLTreeValue value);
 
+/**
+ * 树和节点的外部分配函数 分配出的内存由分配者负责 树不会释放
+ */
+
+typedef void *(*AVLTreeAllocFunc)(void *alloc_ctx, size_t size);
+
 
 
 /**
@@ -141,13 +150,68 @@ typedef void (*AVLTreeFreeValueFunc)(AVLTreeValue value);
 AVLTree *avl_tree_new(AVLTreeCompareFunc compare_func);
 
 /**
- * Destroy an AVL tree.
+ * Create a new AVL tree whose structure and nodes come from an external
+ * allocator.  Removing nodes or freeing the tree still calls the key and
+ * value free functions but never releases the memory itself.
+ *
+ * @param compare_func    Function to use when comparing keys in the tree.
+ * @param alloc_func      Allocator for the tree and its nodes.
+ * @param alloc_ctx       Passed to alloc_func.
+ * @return                A new AVL tree, or NULL if it was not possible
+ *                        to allocate the memory.
+ */
+
+AVLTree *avl_tree_new_with_alloc(AVLTreeCompareFunc compare_func,
+                                 AVLTreeAllocFunc alloc_func, void *alloc_ctx);
+
+/**
+ * Destroy an AVL tree.  If the tree has been shared with
+ * @ref avl_tree_share, only one reference is dropped and the tree
+ * is destroyed when the last reference is freed.
  *
  * @param tree            The tree to destroy.
  */
 
 void avl_tree_free(AVLTree *tree);
 
+/**
+ * Add a reference to an AVL tree.  A shared tree must not be
+ * modified; each holder calls @ref avl_tree_free once.
+ * Reference counting is atomic.
+ *
+ * @param tree            The tree.
+ */
+
+void avl_tree_share(AVLTree *tree);
+
+/**
+ * Check whether an AVL tree currently has more than one reference.
+ *
+ * @param tree            The tree.
+ * @return                Non-zero if the tree is shared.
+ */
+
+int avl_tree_is_shared(AVLTree *tree);
+
+/**
+ * Read the tag word of an AVL tree.  The tag is not interpreted by
+ * the tree; it is zero when the tree is created.
+ *
+ * @param tree            The tree.
+ * @return                The tag value.
+ */
+
+uint64_t avl_tree_get_tag(AVLTree *tree);
+
+/**
+ * Set the tag word of an AVL tree.
+ *
+ * @param tree            The tree.
+ * @param tag             The new tag value.
+ */
+
+void avl_tree_set_tag(AVLTree *tree, uint64_t tag);
+
 /**
  * Insert a new key-value pair into an AVL tree.
  *
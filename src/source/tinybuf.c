@@ -148,6 +148,26 @@ void tinybuf_set_use_strpool(int enable)
     s_use_strpool = enable ? 1 : 0;
 }
 
+void tinybuf_set_strpool_fixed_offset(int enable)
+{
+    s_strpool_fixed_offset = enable ? 1 : 0;
+}
+
+void tinybuf_set_tensor_native(int enable)
+{
+    s_tensor_native = enable ? 1 : 0;
+}
+
+void tinybuf_set_tensor_zero_copy(int enable)
+{
+    s_tensor_zero_copy = enable ? 1 : 0;
+}
+
+void tinybuf_set_sized_container_min_count(int min_count)
+{
+    s_sized_container_min_count = min_count > 0 ? min_count : 0;
+}
+
 static inline tinybuf_error _err_with(const char *msg, int rc)
 {
     return tinybuf_result_err(rc, msg, NULL);
@@ -0,0 +1,186 @@
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+
+// 按块顺序分配的内存 只能整体释放
+// 绑定到线程后 新建的value及其key/字符串/子节点表都从arena分配 tinybuf_value_free/clear对它们不释放内存
+// reset时保留普通大小的块重复使用 超大的块归还给tinybuf_free
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+#define ARENA_ALIGN 16
+
+typedef struct arena_chunk
+{
+    struct arena_chunk *next;
+    int64_t size;
+    int64_t used;
+} arena_chunk;
+
+// 块头按ARENA_ALIGN对齐后紧跟数据
+#define ARENA_CHUNK_HEAD ((int64_t)((sizeof(arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1)))
+
+struct T_tinybuf_arena
+{
+    arena_chunk *head;
+    arena_chunk *cur;
+    int64_t chunk_size;
+    int64_t used;
+    // 自己持有堆上payload的节点(tensor/bool_map) reset时释放payload
+    tinybuf_value **tracked;
+    int tracked_count;
+    int tracked_capacity;
+};
+
+TB_THREAD_LOCAL tinybuf_arena *s_value_arena = NULL;
+
+static arena_chunk *chunk_new(int64_t size)
+{
+    arena_chunk *c = (arena_chunk *)tinybuf_malloc64((size_t)(ARENA_CHUNK_HEAD + size));
+    if (!c)
+        return NULL;
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+tinybuf_arena *tinybuf_arena_new(int64_t chunk_size)
+{
+    tinybuf_arena *a = (tinybuf_arena *)tinybuf_malloc(sizeof(tinybuf_arena));
+    assert(a);
+    memset(a, 0, sizeof(tinybuf_arena));
+    a->chunk_size = chunk_size > 0 ? chunk_size : ARENA_DEFAULT_CHUNK;
+    return a;
+}
+
+void *tinybuf_arena_alloc(tinybuf_arena *a, size_t size)
+{
+    assert(a);
+    int64_t need = (int64_t)((size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+    arena_chunk *c = a->cur;
+    while (c && c->size - c->used < need)
+    {
+        // reset后保留的块依次复用
+        c = c->next;
+    }
+    if (!c)
+    {
+        // 超过块大小的申请单独占一块 接在当前块之后 不影响后续小块继续使用当前块
+        c = chunk_new(need > a->chunk_size ? need : a->chunk_size);
+        if (!c)
+            return NULL;
+        if (a->cur)
+        {
+            c->next = a->cur->next;
+            a->cur->next = c;
+        }
+        else
+        {
+            c->next = a->head;
+            a->head = c;
+        }
+    }
+    if (c->size == a->chunk_size || !a->cur)
+    {
+        a->cur = c;
+    }
+    void *p = (char *)c + ARENA_CHUNK_HEAD + c->used;
+    c->used += need;
+    a->used += need;
+    return p;
+}
+
+void tinybuf_arena_track(tinybuf_arena *a, tinybuf_value *value)
+{
+    assert(a);
+    if (a->tracked_count == a->tracked_capacity)
+    {
+        int newcap = a->tracked_capacity ? a->tracked_capacity * 2 : 16;
+        a->tracked = (tinybuf_value **)tinybuf_realloc(a->tracked, (int)sizeof(tinybuf_value *) * newcap);
+        assert(a->tracked);
+        a->tracked_capacity = newcap;
+    }
+    a->tracked[a->tracked_count++] = value;
+}
+
+buffer *tinybuf_arena_buffer(tinybuf_arena *a, const char *data, int64_t len)
+{
+    struct T_buffer *buf = (struct T_buffer *)tinybuf_arena_alloc(a, sizeof(struct T_buffer) + (size_t)len + 1);
+    if (!buf)
+        return NULL;
+    buf->_data = (char *)(buf + 1);
+    if (len)
+        memcpy(buf->_data, data, (size_t)len);
+    buf->_data[len] = '\0';
+    buf->_len = len;
+    buf->_capacity = len + 1;
+    buf->_fixed = 1;
+    buf->_in_arena = 1;
+    return buf;
+}
+
+void tinybuf_arena_reset(tinybuf_arena *a)
+{
+    assert(a);
+    for (int i = 0; i < a->tracked_count; ++i)
+    {
+        tinybuf_value_release_payload(a->tracked[i]);
+    }
+    a->tracked_count = 0;
+    arena_chunk **link = &a->head;
+    while (*link)
+    {
+        arena_chunk *c = *link;
+        if (c->size > a->chunk_size)
+        {
+            *link = c->next;
+            tinybuf_free(c);
+            continue;
+        }
+        c->used = 0;
+        link = &c->next;
+    }
+    a->cur = a->head;
+    a->used = 0;
+}
+
+void tinybuf_arena_free(tinybuf_arena *a)
+{
+    if (!a)
+        return;
+    tinybuf_arena_reset(a);
+    while (a->head)
+    {
+        arena_chunk *next = a->head->next;
+        tinybuf_free(a->head);
+        a->head = next;
+    }
+    if (s_value_arena == a)
+        s_value_arena = NULL;
+    tinybuf_free(a->tracked);
+    tinybuf_free(a);
+}
+
+int64_t tinybuf_arena_used(const tinybuf_arena *a)
+{
+    assert(a);
+    return a->used;
+}
+
+tinybuf_arena *tinybuf_arena_bind(tinybuf_arena *a)
+{
+    tinybuf_arena *old = s_value_arena;
+    s_value_arena = a;
+    return old;
+}
+
+int64_t tinybuf_try_read_box_arena(buf_ref *buf, tinybuf_arena *a, tinybuf_value **out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+{
+    assert(a);
+    assert(out);
+    tinybuf_arena *old = tinybuf_arena_bind(a);
+    tinybuf_value *value = tinybuf_value_alloc();
+    int64_t rr = tinybuf_try_read_box64(buf, value, contain_handler, r);
+    tinybuf_arena_bind(old);
+    *out = rr > 0 ? value : NULL;
+    return rr;
+}
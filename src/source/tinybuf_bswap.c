@@ -0,0 +1,254 @@
+#include "tinybuf_private.h"
+#include <string.h>
+
+// tensor的double/float按大端编码 小端机器上整段做字节翻转
+// x86上运行时选择AVX2/SSSE3的pshufb实现 其余平台用标量实现(编译器通常能自动向量化)
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define TB_HOST_BIG_ENDIAN 1
+#endif
+
+#if !defined(TB_HOST_BIG_ENDIAN) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define TB_BSWAP_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TB_TARGET(x)
+#else
+#define TB_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+typedef void (*bswap_fn)(void *dst, const void *src, int64_t count);
+
+static inline uint32_t bswap32_scalar(uint32_t v)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _byteswap_ulong(v);
+#else
+    return __builtin_bswap32(v);
+#endif
+}
+
+static inline uint64_t bswap64_scalar(uint64_t v)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+static void bswap32_copy_scalar(void *dst, const void *src, int64_t count)
+{
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    for (int64_t i = 0; i < count; ++i)
+    {
+        uint32_t v;
+        memcpy(&v, s + i * 4, 4);
+        v = bswap32_scalar(v);
+        memcpy(d + i * 4, &v, 4);
+    }
+}
+
+static void bswap64_copy_scalar(void *dst, const void *src, int64_t count)
+{
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    for (int64_t i = 0; i < count; ++i)
+    {
+        uint64_t v;
+        memcpy(&v, s + i * 8, 8);
+        v = bswap64_scalar(v);
+        memcpy(d + i * 8, &v, 8);
+    }
+}
+
+#ifdef TB_BSWAP_X86
+TB_TARGET("ssse3")
+static void bswap32_copy_ssse3(void *dst, const void *src, int64_t count)
+{
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    int64_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i * 4));
+        _mm_storeu_si128((__m128i *)(d + i * 4), _mm_shuffle_epi8(v, mask));
+    }
+    bswap32_copy_scalar(d + i * 4, s + i * 4, count - i);
+}
+
+TB_TARGET("ssse3")
+static void bswap64_copy_ssse3(void *dst, const void *src, int64_t count)
+{
+    const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    int64_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i * 8));
+        _mm_storeu_si128((__m128i *)(d + i * 8), _mm_shuffle_epi8(v, mask));
+    }
+    bswap64_copy_scalar(d + i * 8, s + i * 8, count - i);
+}
+
+// pshufb在每个128位lane内独立翻转 两个lane用相同的mask
+TB_TARGET("avx2")
+static void bswap32_copy_avx2(void *dst, const void *src, int64_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    int64_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s + i * 4));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + i * 4 + 32));
+        _mm256_storeu_si256((__m256i *)(d + i * 4), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256((__m256i *)(d + i * 4 + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    bswap32_copy_scalar(d + i * 4, s + i * 4, count - i);
+}
+
+TB_TARGET("avx2")
+static void bswap64_copy_avx2(void *dst, const void *src, int64_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    int64_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s + i * 8));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + i * 8 + 32));
+        _mm256_storeu_si256((__m256i *)(d + i * 8), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256((__m256i *)(d + i * 8 + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    bswap64_copy_scalar(d + i * 8, s + i * 8, count - i);
+}
+
+static int detect_simd_level(void)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    int ssse3 = (info[2] >> 9) & 1;
+    int osxsave = (info[2] >> 27) & 1;
+    int avx = (info[2] >> 28) & 1;
+    int avx2 = 0;
+    // AVX2还需要操作系统保存ymm寄存器
+    if (osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] >> 5) & 1;
+    }
+    return avx2 ? 2 : (ssse3 ? 1 : 0);
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return 2;
+    if (__builtin_cpu_supports("ssse3"))
+        return 1;
+    return 0;
+#endif
+}
+#else
+static int detect_simd_level(void)
+{
+    return 0;
+}
+#endif
+
+// -1表示尚未检测 检测结果相同 多线程下重复检测无害
+static int s_simd_level = -1;
+static int s_simd_enabled = 1;
+
+int tinybuf_simd_level(void)
+{
+    if (s_simd_level < 0)
+        s_simd_level = detect_simd_level();
+    return s_simd_enabled ? s_simd_level : 0;
+}
+
+void tinybuf_set_simd_enabled(int enable)
+{
+    s_simd_enabled = enable ? 1 : 0;
+}
+
+void tensor_bswap32_copy(void *dst, const void *src, int64_t count)
+{
+#ifdef TB_HOST_BIG_ENDIAN
+    memcpy(dst, src, (size_t)count * 4);
+#else
+    bswap_fn fn = bswap32_copy_scalar;
+#ifdef TB_BSWAP_X86
+    switch (tinybuf_simd_level())
+    {
+    case 2:
+        fn = bswap32_copy_avx2;
+        break;
+    case 1:
+        fn = bswap32_copy_ssse3;
+        break;
+    default:
+        break;
+    }
+#endif
+    fn(dst, src, count);
+#endif
+}
+
+void tensor_bswap64_copy(void *dst, const void *src, int64_t count)
+{
+#ifdef TB_HOST_BIG_ENDIAN
+    memcpy(dst, src, (size_t)count * 8);
+#else
+    bswap_fn fn = bswap64_copy_scalar;
+#ifdef TB_BSWAP_X86
+    switch (tinybuf_simd_level())
+    {
+    case 2:
+        fn = bswap64_copy_avx2;
+        break;
+    case 1:
+        fn = bswap64_copy_ssse3;
+        break;
+    default:
+        break;
+    }
+#endif
+    fn(dst, src, count);
+#endif
+}
+
+int tensor_host_little_endian(void)
+{
+#ifdef TB_HOST_BIG_ENDIAN
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+void tensor_le_copy(void *dst, const void *src, int64_t count, int width)
+{
+#ifdef TB_HOST_BIG_ENDIAN
+    if (width == 8)
+    {
+        bswap64_copy_scalar(dst, src, count);
+        return;
+    }
+    if (width == 4)
+    {
+        bswap32_copy_scalar(dst, src, count);
+        return;
+    }
+#endif
+    memcpy(dst, src, (size_t)(count * width));
+}
@@ -2,12 +2,17 @@
 #include <assert.h>
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #include "tinybuf_buffer.h"
 #include "tinybuf_memory.h"
 #include "tinybuf_buffer_private.h"
 
 #define RESERVED_SIZE 64
 
+//容量不足时按当前容量的倍数扩容 1.0表示只扩到刚好够用(旧行为)
+static double s_growth_factor = 2.0;
+
 
 static inline void my_memcpy(char *dst, const char *src, size_t len){
     assert(dst);
@@ -26,7 +31,7 @@ static inline void my_memcpy(char *dst, const char *src, size_t len){
 
 static inline int buffer_release(buffer *buf){
     assert(buf);
-    if(buf->_capacity && buf->_data){
+    if(buf->_capacity && buf->_data && !buf->_fixed){
         tinybuf_free(buf->_data);
         //LOGD("free:%d",buf->_capacity);
     }
@@ -35,12 +40,39 @@ static inline int buffer_release(buffer *buf){
 }
 
 buffer *buffer_alloc(void){
-    buffer *ret = (buffer *) tinybuf_malloc(sizeof(buffer));
+    buffer *ret = (buffer *) tinybuf_small_alloc(sizeof(buffer));
     assert(ret);
     memset(ret,0, sizeof(buffer));;
     return ret;
 }
 
+buffer *buffer_alloc_packed(const char *data,int64_t len){
+    assert(len >= 0);
+    buffer *ret = (buffer *) tinybuf_small_alloc(sizeof(buffer) + (size_t)len + 1);
+    assert(ret);
+    memset(ret,0, sizeof(buffer));
+    ret->_data = (char *)(ret + 1);
+    my_memcpy(ret->_data, data, (size_t)len);
+    ret->_data[len] = '\0';
+    ret->_len = len;
+    ret->_capacity = len + 1;
+    ret->_fixed = 1;
+    return ret;
+}
+
+buffer *buffer_alloc_fixed(char *mem,int capacity){
+    assert(mem);
+    buffer *ret = buffer_alloc();
+    ret->_data = mem;
+    ret->_capacity = capacity;
+    ret->_fixed = 1;
+    return ret;
+}
+
+int buffer_is_overflow(const buffer *buf){
+    return buf && buf->_fixed == 2;
+}
+
 buffer *buffer_alloc2(const char *str,int len){
     buffer *ret = buffer_alloc();
     buffer_assign(ret,str,len);
@@ -50,8 +82,12 @@ buffer *buffer_alloc2(const char *str,int len){
 
 int buffer_free(buffer *buf){
     assert(buf);
+    if(buf->_in_arena){
+        //随arena整体释放
+        return 0;
+    }
     buffer_release(buf);
-    tinybuf_free(buf);
+    tinybuf_small_free(buf);
     return 0;
 }
 
@@ -63,19 +99,33 @@ char *buffer_get_data(buffer *buf){
     return buf->_data;
 }
 
-int buffer_get_length(buffer *buf){
+int64_t buffer_get_length64(buffer *buf){
     if(!buf){
         return 0;
     }
     return buf->_len;
 }
 
+int buffer_get_length(buffer *buf){
+    int64_t len = buffer_get_length64(buf);
+    return len > INT_MAX ? -1 : (int)len;
+}
+
 int buffer_set_length(buffer *buf, int len){
-    if(!buf){
+    return buffer_set_length64(buf,len);
+}
+
+int buffer_set_length64(buffer *buf, int64_t len){
+    if(!buf || len < 0){
         return -1;
     }
     if(buf->_capacity <= len){
-        return -1;
+        //外部内存可以写满 不保留'\0'
+        if(!buf->_fixed || buf->_capacity < len){
+            return -1;
+        }
+        buf->_len = len;
+        return 0;
     }
 
     buf->_len = len;
@@ -83,75 +133,167 @@ int buffer_set_length(buffer *buf, int len){
     return 0;
 }
 
-int buffer_get_capacity(buffer *buf){
+int64_t buffer_get_capacity64(buffer *buf){
     if(!buf){
         return 0;
     }
     return buf->_capacity;
 }
 
+int buffer_get_capacity(buffer *buf){
+    int64_t cap = buffer_get_capacity64(buf);
+    return cap > INT_MAX ? -1 : (int)cap;
+}
+
 int buffer_append_buffer(buffer *buf,const buffer *from){
     assert(buf);
     assert(from);
-    return buffer_append(buf,from->_data,from->_len);
+    if(!from->_len){
+        return 0;
+    }
+    return buffer_append64(buf,from->_data,from->_len);
+}
+
+void buffer_set_growth_factor(double factor){
+    s_growth_factor = factor < 1.0 ? 1.0 : factor;
+}
+
+double buffer_get_growth_factor(void){
+    return s_growth_factor;
+}
+
+//保证至少能再写入need字节(不含末尾的'\0') 不够时按增长倍数扩容
+int buffer_ensure_free(buffer *buf,int64_t need){
+    int64_t want = buf->_len + need + 1;
+    if(buf->_capacity >= want){
+        return 0;
+    }
+    if(buf->_fixed){
+        return buf->_capacity >= want - 1 ? 0 : -1;
+    }
+    int64_t newcap = buf->_len + need + RESERVED_SIZE;
+    int64_t scaled = (int64_t)(buf->_capacity * s_growth_factor);
+    if(scaled > newcap){
+        newcap = scaled;
+    }
+    char *data = buf->_capacity ? tinybuf_realloc64(buf->_data,(size_t)newcap) : tinybuf_malloc64((size_t)newcap);
+    if(!data && newcap > want){
+        //倍数扩容申请失败时退回到刚好够用
+        newcap = want;
+        data = buf->_capacity ? tinybuf_realloc64(buf->_data,(size_t)newcap) : tinybuf_malloc64((size_t)newcap);
+    }
+    if(!data){
+        return -1;
+    }
+    buf->_data = data;
+    buf->_capacity = newcap;
+    return 0;
+}
+
+int buffer_reserve(buffer *buf,int capacity){
+    return buffer_reserve64(buf,capacity);
+}
+
+int buffer_reserve64(buffer *buf,int64_t capacity){
+    assert(buf);
+    if(capacity < buf->_len){
+        capacity = buf->_len;
+    }
+    if(buf->_capacity > capacity){
+        return 0;
+    }
+    if(buf->_fixed){
+        return -1;
+    }
+    int64_t newcap = capacity + 1;
+    char *data = buf->_capacity ? tinybuf_realloc64(buf->_data,(size_t)newcap) : tinybuf_malloc64((size_t)newcap);
+    if(!data){
+        return -1;
+    }
+    buf->_data = data;
+    buf->_capacity = newcap;
+    return 0;
 }
 
 int buffer_add_capacity(buffer *buf,int len){
     assert(buf);
+    if(buf->_fixed){
+        return -1;
+    }
     if(!buf->_capacity){
         //内存尚未开辟
         buf->_data = tinybuf_malloc(len);
         buf->_capacity = len;
         return 0;
     }
-    buf->_data = tinybuf_realloc(buf->_data,len + buf->_capacity);
+    char *data = tinybuf_realloc64(buf->_data,(size_t)(len + buf->_capacity));
+    if(!data){
+        return -1;
+    }
+    buf->_data = data;
     buf->_capacity += len;
     return 0;
 }
 
 int buffer_append(buffer *buf,const char *data,int len){
+    return buffer_append64(buf,data,len);
+}
+
+int buffer_append64(buffer *buf,const char *data,int64_t len){
     assert(buf);
     assert(data);
     if(len <= 0){
         len = strlen(data);
     }
 
-    if(!buf->_capacity){
-        //内存尚未开辟
-        buffer_add_capacity(buf,len + RESERVED_SIZE);
+    if(buf->_capacity <= buf->_len + len){
+        //容量不够 按增长策略扩容
+        if(buffer_ensure_free(buf,len) < 0){
+            buf->_fixed = 2;
+            return -1;
+        }
     }
-
-    if(buf->_capacity > buf->_len + len){
-        //容量够
-        my_memcpy(buf->_data + buf->_len ,data,len);
-        buf->_len += len;
+    my_memcpy(buf->_data + buf->_len ,data,(size_t)len);
+    buf->_len += len;
+    if(buf->_len < buf->_capacity){
         buf->_data[buf->_len] = '\0';
-        return 0;
     }
-
-    //已经开辟的容量不够
-    buf->_data = tinybuf_realloc(buf->_data,len + buf->_len + RESERVED_SIZE);
-    assert(buf->_data);
-    my_memcpy(buf->_data + buf->_len ,data,len);
-    buf->_len += len;
-    buf->_data[buf->_len] = '\0';
-    buf->_capacity = buf->_len + RESERVED_SIZE;
     return 0;
 }
+char *buffer_append_space64(buffer *buf,int64_t len){
+    assert(buf);
+    assert(len >= 0);
+    if(buf->_capacity <= buf->_len + len){
+        if(buffer_ensure_free(buf,len) < 0){
+            buf->_fixed = 2;
+            return NULL;
+        }
+    }
+    char *space = buf->_data + buf->_len;
+    buf->_len += len;
+    if(buf->_len < buf->_capacity){
+        buf->_data[buf->_len] = '\0';
+    }
+    return space;
+}
 int buffer_assign(buffer *buf,const char *data,int len){
+    return buffer_assign64(buf,data,len);
+}
+
+int buffer_assign64(buffer *buf,const char *data,int64_t len){
     assert(buf);
     assert(data);
     if(len <= 0){
         len = strlen(data);
     }
     if(buf->_capacity > len){
-        my_memcpy(buf->_data,data,len);
+        my_memcpy(buf->_data,data,(size_t)len);
         buf->_len = len;
         buf->_data[buf->_len] = '\0';
         return 0;
     }
     buf->_len = 0;
-    return buffer_append(buf,data,len);
+    return buffer_append64(buf,data,len);
 }
 
 int buffer_move(buffer *dst,buffer *src){
@@ -159,17 +301,11 @@ int buffer_move(buffer *dst,buffer *src){
     dst->_data = src->_data;
     dst->_len = src->_len;
     dst->_capacity = src->_capacity;
+    dst->_fixed = src->_fixed;
     memset(src,0, sizeof(buffer));
     return 0;
 }
 
-static int buffer_length(buffer *buf){
-    if(!buf){
-        return 0;
-    }
-    return buf->_len;
-}
-
 int buffer_push(buffer *buf,char ch){
     assert(buf);
     if(buf->_len + 1 < buf->_capacity){
@@ -212,5 +348,5 @@ int buffer_is_same(const buffer *buf1,const buffer *buf2){
         //长度不一致
         return 0;
     }
-    return 0 == memcmp(buf1->_data,buf2->_data,buf1->_len);
+    return 0 == memcmp(buf1->_data,buf2->_data,(size_t)buf1->_len);
 }
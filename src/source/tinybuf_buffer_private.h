@@ -1,12 +1,29 @@
 #ifndef TINYBUF_BUFFER_PRIVATE_H
 #define TINYBUF_BUFFER_PRIVATE_H
+#include <stdint.h>
 
 struct T_buffer{
     char *_data;
-    int _len;
-    int _capacity;
+    int64_t _len;
+    int64_t _capacity;
+    //0:普通buffer 1:使用外部内存 不释放也不扩容 2:外部内存写满后仍有写入被丢弃
+    int _fixed;
+    //1:结构体和数据都在arena中 buffer_free不释放
+    int _in_arena;
 };
 
+//保证至少还能写入need字节 按buffer_set_growth_factor设置的倍数扩容
+//外部内存的buffer不扩容 空间不足时返回-1
+int buffer_ensure_free(buffer *buf,int64_t need);
+
+//结构体和数据在同一块内存中的只读buffer 一次分配 用于map的key
+//写入时与buffer_alloc_fixed一样不扩容 用buffer_free释放
+buffer *buffer_alloc_packed(const char *data,int64_t len);
+
+//在末尾追加len字节并返回这段区域 由调用者直接填充 省去中间拷贝
+//空间不足时与buffer_append一样标记写满并返回NULL
+char *buffer_append_space64(buffer *buf,int64_t len);
+
 #define inline_optimization 1
 
 #if inline_optimization
@@ -0,0 +1,230 @@
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// 每个线程有自己的默认上下文 旧接口不带ctx时使用 线程退出时释放
+// 通过tinybuf_*_ctx_bind绑定的上下文优先于默认上下文
+static TB_THREAD_LOCAL tinybuf_writer_ctx *s_bound_writer = NULL;
+static TB_THREAD_LOCAL tinybuf_reader_ctx *s_bound_reader = NULL;
+static TB_THREAD_LOCAL tinybuf_writer_ctx *s_default_writer = NULL;
+static TB_THREAD_LOCAL tinybuf_reader_ctx *s_default_reader = NULL;
+
+static void default_writer_exit(void *ctx)
+{
+    tinybuf_writer_ctx_free((tinybuf_writer_ctx *)ctx);
+}
+static void default_reader_exit(void *ctx)
+{
+    tinybuf_reader_ctx_free((tinybuf_reader_ctx *)ctx);
+}
+
+#ifdef _WIN32
+static DWORD s_writer_key = FLS_OUT_OF_INDEXES;
+static DWORD s_reader_key = FLS_OUT_OF_INDEXES;
+static INIT_ONCE s_key_once = INIT_ONCE_STATIC_INIT;
+static VOID WINAPI writer_fls_cb(PVOID ctx) { default_writer_exit(ctx); }
+static VOID WINAPI reader_fls_cb(PVOID ctx) { default_reader_exit(ctx); }
+static BOOL CALLBACK create_keys(PINIT_ONCE once, PVOID param, PVOID *out)
+{
+    (void)once;
+    (void)param;
+    (void)out;
+    s_writer_key = FlsAlloc(writer_fls_cb);
+    s_reader_key = FlsAlloc(reader_fls_cb);
+    return TRUE;
+}
+static void track_writer(tinybuf_writer_ctx *ctx)
+{
+    InitOnceExecuteOnce(&s_key_once, create_keys, NULL, NULL);
+    if (s_writer_key != FLS_OUT_OF_INDEXES)
+        FlsSetValue(s_writer_key, ctx);
+}
+static void track_reader(tinybuf_reader_ctx *ctx)
+{
+    InitOnceExecuteOnce(&s_key_once, create_keys, NULL, NULL);
+    if (s_reader_key != FLS_OUT_OF_INDEXES)
+        FlsSetValue(s_reader_key, ctx);
+}
+#else
+static pthread_key_t s_writer_key;
+static pthread_key_t s_reader_key;
+static pthread_once_t s_key_once = PTHREAD_ONCE_INIT;
+static void create_keys(void)
+{
+    pthread_key_create(&s_writer_key, default_writer_exit);
+    pthread_key_create(&s_reader_key, default_reader_exit);
+}
+static void track_writer(tinybuf_writer_ctx *ctx)
+{
+    pthread_once(&s_key_once, create_keys);
+    pthread_setspecific(s_writer_key, ctx);
+}
+static void track_reader(tinybuf_reader_ctx *ctx)
+{
+    pthread_once(&s_key_once, create_keys);
+    pthread_setspecific(s_reader_key, ctx);
+}
+#endif
+
+tinybuf_writer_ctx *tinybuf_writer_ctx_new(void)
+{
+    tinybuf_writer_ctx *ctx = (tinybuf_writer_ctx *)tinybuf_malloc(sizeof(tinybuf_writer_ctx));
+    assert(ctx);
+    memset(ctx, 0, sizeof(tinybuf_writer_ctx));
+    ctx->strpool_slot_mask = -1;
+    ctx->precache_slot_mask = -1;
+    return ctx;
+}
+
+void tinybuf_writer_ctx_free(tinybuf_writer_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    for (int i = 0; i < ctx->strpool_count; ++i)
+    {
+        buffer_free(ctx->strpool[i].buf);
+    }
+    tinybuf_free(ctx->strpool);
+    tinybuf_free(ctx->strpool_slots);
+    tinybuf_free(ctx->precache);
+    tinybuf_free(ctx->precache_slots);
+    tinybuf_free(ctx->precache_hash_slots);
+    tinybuf_free(ctx);
+}
+
+tinybuf_reader_ctx *tinybuf_reader_ctx_new(void)
+{
+    tinybuf_reader_ctx *ctx = (tinybuf_reader_ctx *)tinybuf_malloc(sizeof(tinybuf_reader_ctx));
+    assert(ctx);
+    memset(ctx, 0, sizeof(tinybuf_reader_ctx));
+    ctx->strpool_offset = -1;
+    ctx->offset_pool_slot_mask = -1;
+    return ctx;
+}
+
+void tinybuf_reader_ctx_free(tinybuf_reader_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    tinybuf_free(ctx->views);
+    tinybuf_free(ctx->text);
+    tinybuf_free(ctx->trie_scratch);
+    tinybuf_free(ctx->offset_pool);
+    tinybuf_free(ctx->offset_pool_slots);
+    tinybuf_free(ctx);
+}
+
+tinybuf_writer_ctx *tinybuf_writer_ctx_current(void)
+{
+    if (s_bound_writer)
+        return s_bound_writer;
+    if (!s_default_writer)
+    {
+        s_default_writer = tinybuf_writer_ctx_new();
+        track_writer(s_default_writer);
+    }
+    return s_default_writer;
+}
+
+tinybuf_reader_ctx *tinybuf_reader_ctx_current(void)
+{
+    if (s_bound_reader)
+        return s_bound_reader;
+    if (!s_default_reader)
+    {
+        s_default_reader = tinybuf_reader_ctx_new();
+        track_reader(s_default_reader);
+    }
+    return s_default_reader;
+}
+
+tinybuf_writer_ctx *tinybuf_writer_ctx_bind(tinybuf_writer_ctx *ctx)
+{
+    tinybuf_writer_ctx *old = s_bound_writer;
+    s_bound_writer = ctx;
+    return old;
+}
+
+tinybuf_reader_ctx *tinybuf_reader_ctx_bind(tinybuf_reader_ctx *ctx)
+{
+    tinybuf_reader_ctx *old = s_bound_reader;
+    s_bound_reader = ctx;
+    return old;
+}
+
+// 在threads个线程上运行fn(arg) 调用线程算作其中一个 全部结束后返回
+// 任务分配由fn自己完成 创建线程失败时由已有线程完成剩余任务
+#ifdef _WIN32
+typedef struct
+{
+    void (*fn)(void *);
+    void *arg;
+} worker_start;
+static DWORD WINAPI worker_main(LPVOID p)
+{
+    worker_start *ws = (worker_start *)p;
+    ws->fn(ws->arg);
+    return 0;
+}
+int tinybuf_cpu_count(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+}
+void tinybuf_run_workers(int threads, void (*fn)(void *), void *arg)
+{
+    worker_start ws = {fn, arg};
+    int started = 0;
+    HANDLE *ts = threads > 1 ? (HANDLE *)tinybuf_malloc(sizeof(HANDLE) * (threads - 1)) : NULL;
+    for (int i = 0; i < threads - 1; ++i)
+    {
+        ts[started] = CreateThread(NULL, 0, worker_main, &ws, 0, NULL);
+        if (ts[started])
+            ++started;
+    }
+    fn(arg);
+    if (started)
+        WaitForMultipleObjects((DWORD)started, ts, TRUE, INFINITE);
+    for (int i = 0; i < started; ++i)
+        CloseHandle(ts[i]);
+    tinybuf_free(ts);
+}
+#else
+typedef struct
+{
+    void (*fn)(void *);
+    void *arg;
+} worker_start;
+static void *worker_main(void *p)
+{
+    worker_start *ws = (worker_start *)p;
+    ws->fn(ws->arg);
+    return NULL;
+}
+int tinybuf_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+void tinybuf_run_workers(int threads, void (*fn)(void *), void *arg)
+{
+    worker_start ws = {fn, arg};
+    int started = 0;
+    pthread_t *ts = threads > 1 ? (pthread_t *)tinybuf_malloc(sizeof(pthread_t) * (threads - 1)) : NULL;
+    for (int i = 0; i < threads - 1; ++i)
+    {
+        if (pthread_create(&ts[started], NULL, worker_main, &ws) == 0)
+            ++started;
+    }
+    fn(arg);
+    for (int i = 0; i < started; ++i)
+        pthread_join(ts[i], NULL);
+    tinybuf_free(ts);
+}
+#endif
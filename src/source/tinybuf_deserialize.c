@@ -2,13 +2,14 @@
 #include "tinybuf_buffer.h"
 #include "tinybuf_plugin.h"
 #include <string.h>
+#include <limits.h>
 #ifdef _WIN32
 #include <winsock2.h>
 #else
 #include <arpa/inet.h>
 #endif
 
-const char *s_last_error_msg = NULL;
+TB_THREAD_LOCAL const char *s_last_error_msg = NULL;
 const char *tinybuf_last_error_message(void){ return s_last_error_msg; }
 
 uint32_t load_be32(const void *p)
@@ -26,9 +27,9 @@ double read_double(uint8_t *ptr)
     return db;
 }
 
-int try_read_int_tovar(BOOL isneg, const char *ptr, int size, QWORD *out_val)
+int try_read_int_tovar(BOOL isneg, const char *ptr, int64_t size, QWORD *out_val)
 {
-    int len = int_deserialize((uint8_t *)ptr, size, out_val);
+    int len = int_deserialize((uint8_t *)ptr, size > INT_MAX ? INT_MAX : (int)size, out_val);
     if (len < 0)
     {
         return len;
@@ -53,210 +54,139 @@ int try_read_int(serialize_type type, const char *ptr, int size, tinybuf_value *
     return len;
 }
 
-static int tinybuf_deserialize_vector_tensor(const char *ptr, int size, tinybuf_value *out);
-static int tinybuf_deserialize_dense_tensor(const char *ptr, int size, tinybuf_value *out);
-static int tinybuf_deserialize_sparse_tensor(const char *ptr, int size, tinybuf_value *out);
+// varint最长10字节 超过2GB的剩余长度截断后传给int_deserialize不影响结果
+static inline int int_deserialize64(const char *ptr, int64_t size, uint64_t *out)
+{
+    return int_deserialize((const uint8_t *)ptr, size > INT_MAX ? INT_MAX : (int)size, out);
+}
 
-static int tinybuf_deserialize_vector_tensor(const char *ptr, int size, tinybuf_value *out)
+// 解码tensor的payload到新申请的内存 返回消耗的字节数 0表示数据不完整
+static int64_t tensor_payload_decode(const char *ptr, int64_t size, int dtype, int64_t count, void **data)
 {
-    uint64_t cnt = 0;
-    uint64_t dt = 0;
-    int a = 0;
-    int b = 0;
-    int64_t count = 0;
-    tinybuf_tensor_t *tensor = NULL;
-    uint8_t *buf_u8 = NULL;
-    int64_t *buf_i64 = NULL;
-    a = int_deserialize((uint8_t *)ptr, size, &cnt);
-    if (a <= 0)
-        return a;
-    ptr += a;
-    size -= a;
-    b = int_deserialize((uint8_t *)ptr, size, &dt);
-    if (b <= 0)
-        return b;
-    ptr += b;
-    size -= b;
-    count = (int64_t)cnt;
-    tensor = (tinybuf_tensor_t *)tinybuf_malloc(sizeof(tinybuf_tensor_t));
-    tensor->dtype = (int)dt;
-    tensor->dims = 1;
-    tensor->count = count;
-    tensor->shape = NULL;
-    if ((int)dt == 8)
-    {
-        if (size < 8 * count)
-            return 0;
-        double *buf = (double *)tinybuf_malloc((int)(sizeof(double) * count));
-        for (int64_t i = 0; i < count; ++i)
-        {
-            buf[i] = read_double((uint8_t *)ptr + i * 8);
-        }
-        tensor->data = buf;
-        out->_type = tinybuf_tensor;
-        out->_data._custom = tensor;
-        out->_custom_free = NULL;
-        return 1 + a + b + (int)(8 * count);
-    }
-    else if ((int)dt == 10)
+    *data = NULL;
+    if (count < 0)
+        return -1;
+    if (dtype == 8 || dtype == 10)
     {
-        if (size < 4 * count)
+        int64_t width = dtype == 8 ? 8 : 4;
+        if (count > size / width)
             return 0;
-        float *buf = (float *)tinybuf_malloc((int)(sizeof(float) * count));
-        for (int64_t i = 0; i < count; ++i)
-        {
-            uint32_t raw = load_be32((uint8_t *)ptr + i * 4);
-            memcpy(&buf[i], &raw, 4);
-        }
-        tensor->data = buf;
-        out->_type = tinybuf_tensor;
-        out->_data._custom = tensor;
-        out->_custom_free = NULL;
-        return 1 + a + b + (int)(4 * count);
+        char *buf = (char *)tinybuf_malloc64((size_t)(count ? width * count : 1));
+        if (!buf)
+            return -1;
+        if (dtype == 8)
+            tensor_bswap64_copy(buf, ptr, count);
+        else
+            tensor_bswap32_copy(buf, ptr, count);
+        *data = buf;
+        return width * count;
     }
-    else if ((int)dt == 11)
+    if (dtype == 11)
     {
         int64_t bytes = (count + 7) / 8;
         if (size < bytes)
             return 0;
-        buf_u8 = (uint8_t *)tinybuf_malloc((int)bytes);
-        memcpy(buf_u8, ptr, (size_t)bytes);
-        tensor->data = buf_u8;
-        out->_type = tinybuf_tensor;
-        out->_data._custom = tensor;
-        out->_custom_free = NULL;
-        return 1 + a + b + (int)bytes;
+        uint8_t *buf = (uint8_t *)tinybuf_malloc64((size_t)(bytes ? bytes : 1));
+        if (!buf)
+            return -1;
+        memcpy(buf, ptr, (size_t)bytes);
+        *data = buf;
+        return bytes;
     }
-    else
+    // 每个整数至少占类型和varint两个字节
+    if (count > size / 2)
+        return 0;
+    int64_t *buf = (int64_t *)tinybuf_malloc64(sizeof(int64_t) * (size_t)(count ? count : 1));
+    if (!buf)
+        return -1;
+    int64_t off = 0;
+    for (int64_t i = 0; i < count; ++i)
     {
-        buf_i64 = (int64_t *)tinybuf_malloc((int)(sizeof(int64_t) * count));
-        int r = 0;
-        for (int64_t i = 0; i < count; ++i)
+        if (size - off < 2)
         {
-            if (size < 1)
-                return 0;
-            serialize_type tt = (serialize_type)ptr[0];
-            ++ptr;
-            --size;
-            uint64_t v = 0;
-            int c = int_deserialize((uint8_t *)ptr, size, &v);
-            if (c <= 0)
-                return c;
-            ptr += c;
-            size -= c;
-            int64_t sv = (tt == serialize_negtive_int) ? -(int64_t)v : (int64_t)v;
-            buf_i64[i] = sv;
+            tinybuf_free(buf);
+            return 0;
         }
-        tensor->data = buf_i64;
-        out->_type = tinybuf_tensor;
-        out->_data._custom = tensor;
-        out->_custom_free = NULL;
-        return 1;
+        serialize_type tt = (serialize_type)ptr[off];
+        uint64_t v = 0;
+        int c = int_deserialize64(ptr + off + 1, size - off - 1, &v);
+        if (c <= 0)
+        {
+            tinybuf_free(buf);
+            return c;
+        }
+        off += 1 + c;
+        buf[i] = (tt == serialize_negtive_int) ? -(int64_t)v : (int64_t)v;
     }
+    *data = buf;
+    return off;
 }
 
-static int tinybuf_deserialize_dense_tensor(const char *ptr, int size, tinybuf_value *out)
+static void tensor_attach(tinybuf_value *out, int dtype, int dims, int64_t *shape, int64_t count, void *data, int borrowed)
 {
-    const char *p0 = ptr;
-    uint64_t dims = 0;
-    int a = int_deserialize((uint8_t *)ptr, size, &dims);
-    if (a <= 0)
-        return a;
-    ptr += a;
-    size -= a;
-    int64_t *shape = (int64_t *)tinybuf_malloc((int)(sizeof(int64_t) * (size_t)dims));
-    for (uint64_t i = 0; i < dims; ++i)
-    {
-        uint64_t k = 0;
-        int b = int_deserialize((uint8_t *)ptr, size, &k);
-        if (b <= 0)
-            return b;
-        ptr += b;
-        size -= b;
-        shape[i] = (int64_t)k;
-    }
-    uint64_t dt = 0;
-    int e = int_deserialize((uint8_t *)ptr, size, &dt);
-    if (e <= 0)
-        return e;
-    ptr += e;
-    size -= e;
-    int64_t count = 1;
-    for (uint64_t i = 0; i < dims; ++i)
-        count *= shape[i];
     tinybuf_tensor_t *tensor = (tinybuf_tensor_t *)tinybuf_malloc(sizeof(tinybuf_tensor_t));
-    tensor->dtype = (int)dt;
-    tensor->dims = (int)dims;
+    tensor->dtype = dtype;
+    tensor->dims = dims;
     tensor->count = count;
     tensor->shape = shape;
-    if ((int)dt == 8)
+    tensor->data = data;
+    tensor->borrowed = borrowed;
+    out->_type = tinybuf_tensor;
+    out->_data._custom = tensor;
+    out->_custom_free = tensor_free;
+    // payload在堆上 arena中的节点登记后由arena释放
+    if (value_arena(out))
+        tinybuf_arena_track(value_arena(out), out);
+}
+
+int s_tensor_zero_copy = 0;
+
+// vector/dense/native tensor 头部已由tok解析 ptr指向类型字节
+// native编码在开启零拷贝且数据按元素宽度对齐时data直接指向源数据
+static int64_t deserialize_tensor(const char *ptr, int64_t size, const tinybuf_token *tok, tinybuf_value *out)
+{
+    int64_t *shape = NULL;
+    if (tok->shape)
     {
-        if (size < 8 * count)
-            return 0;
-        double *buf = (double *)tinybuf_malloc((int)(sizeof(double) * count));
-        for (int64_t i = 0; i < count; ++i)
-            buf[i] = read_double((uint8_t *)ptr + i * 8);
-        tensor->data = buf;
-        ptr += (int)(8 * count);
-        size -= (int)(8 * count);
+        shape = (int64_t *)tinybuf_malloc64(sizeof(int64_t) * (size_t)tok->dims);
+        tinybuf_token_shape(tok, shape);
     }
-    else if ((int)dt == 10)
+    const char *payload = ptr + tok->head;
+    int64_t count = tok->count;
+    void *data = NULL;
+    int borrowed = 0;
+    int64_t n;
+    if (tok->type == serialize_native_tensor)
     {
-        if (size < 4 * count)
-            return 0;
-        float *buf = (float *)tinybuf_malloc((int)(sizeof(float) * count));
-        for (int64_t i = 0; i < count; ++i)
+        int width = tensor_elem_width(tok->dtype);
+        borrowed = s_tensor_zero_copy && tensor_host_little_endian() && ((uintptr_t)payload % (uintptr_t)width) == 0;
+        if (borrowed)
         {
-            uint32_t raw = load_be32((uint8_t *)ptr + i * 4);
-            memcpy(&buf[i], &raw, 4);
+            data = (void *)payload;
         }
-        tensor->data = buf;
-        ptr += (int)(4 * count);
-        size -= (int)(4 * count);
-    }
-    else if ((int)dt == 11)
-    {
-        int64_t bytes = (count + 7) / 8;
-        if (size < bytes)
-            return 0;
-        uint8_t *buf = (uint8_t *)tinybuf_malloc((int)bytes);
-        memcpy(buf, ptr, (size_t)bytes);
-        tensor->data = buf;
-        ptr += (int)bytes;
-        size -= (int)bytes;
+        else
+        {
+            data = tinybuf_malloc64((size_t)(tok->body ? tok->body : 1));
+            if (!data)
+            {
+                tinybuf_free(shape);
+                return -1;
+            }
+            tensor_le_copy(data, payload, count, width);
+        }
+        n = tok->body;
     }
     else
     {
-        if (size < count)
-            return 0;
-        int64_t *buf = (int64_t *)tinybuf_malloc((int)(sizeof(int64_t) * count));
-        for (int64_t flat = 0; flat < count; ++flat)
+        n = tensor_payload_decode(payload, size - tok->head, tok->dtype, count, &data);
+        if (n < 0 || (n == 0 && !data))
         {
-            if (size < 1)
-                return 0;
-            serialize_type tt = (serialize_type)ptr[0];
-            ++ptr;
-            --size;
-            uint64_t v = 0;
-            int c = int_deserialize((uint8_t *)ptr, size, &v);
-            if (c <= 0)
-                return c;
-            ptr += c;
-            size -= c;
-            int64_t sv = (tt == serialize_negtive_int) ? -(int64_t)v : (int64_t)v;
-            buf[flat] = sv;
+            tinybuf_free(shape);
+            return n;
         }
-        tensor->data = buf;
     }
-    out->_type = tinybuf_tensor;
-    out->_data._custom = tensor;
-    out->_custom_free = NULL;
-    return 1 + (int)(ptr - p0);
-}
-
-static int tinybuf_deserialize_sparse_tensor(const char *ptr, int size, tinybuf_value *out)
-{
-    return -1;
+    tensor_attach(out, tok->dtype, tok->dims, shape, count, data, borrowed);
+    return tok->head + n;
 }
 
 int tinybuf_value_deserialize_basic(const char *ptr, int size, tinybuf_value *out)
@@ -340,7 +270,116 @@ int int_deserialize(const uint8_t *in, int in_size, uint64_t *out)
 
 int optional_add(int x, int addx){ if(x<0) return x; return x+addx; }
 
+// map/array头部之后的map_size个子值 返回消耗的字节数
+static int64_t deserialize_map_body(const char *ptr, int64_t size, uint64_t map_size, tinybuf_value *out, tinybuf_error *r)
+{
+    int64_t consumed = 0;
+    int len;
+    tinybuf_map_init(out, tinybuf_get_map_backend());
+    int use_hash = out->_map_backend == tinybuf_map_backend_hash;
+    if (use_hash && map_size <= (uint64_t)size && map_size <= INT_MAX)
+    {
+        tinybuf_hash_map_reserve(out->_data._hash_map, (int)map_size);
+    }
+    for (uint64_t i = 0; i < map_size; ++i)
+    {
+        uint64_t key_len;
+        len = int_deserialize64(ptr, size, &key_len);
+        if (len <= 0)
+        {
+            tinybuf_value_clear(out);
+            return len;
+        }
+        ptr += len;
+        size -= len;
+        consumed += len;
+        if ((uint64_t)size < key_len)
+        {
+            tinybuf_value_clear(out);
+            return 0;
+        }
+        char *key_ptr = (char *)ptr;
+        ptr += key_len;
+        size -= key_len;
+        consumed += key_len;
+        tinybuf_value *value = value_alloc_in(value_arena(out));
+        int64_t value_len = tinybuf_value_deserialize64(ptr, size, value, r);
+        if (value_len <= 0)
+        {
+            tinybuf_value_free(value);
+            tinybuf_value_clear(out);
+            tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: map value decode failed");
+            return value_len;
+        }
+        if (use_hash)
+        {
+            value_adopt(out, value);
+            tinybuf_hash_map_set(out->_data._hash_map, key_ptr, (int)key_len, value);
+        }
+        else
+        {
+            buffer *key = value_key_new(out, key_ptr, (int64_t)key_len);
+            tinybuf_value_map_set2(out, key, value);
+        }
+        ptr += value_len;
+        size -= value_len;
+        consumed += value_len;
+    }
+    return consumed;
+}
+
+static int64_t deserialize_array_body(const char *ptr, int64_t size, uint64_t array_size, tinybuf_value *out, tinybuf_error *r)
+{
+    int64_t consumed = 0;
+    out->_type = tinybuf_array;
+    if (array_size <= (uint64_t)size && array_size <= INT_MAX)
+    {
+        // 每个成员至少占1字节 超出剩余长度的size必然是坏数据 不做预留
+        tinybuf_value_array_reserve(out, (int)array_size);
+    }
+    for (uint64_t i = 0; i < array_size; ++i)
+    {
+        tinybuf_value *value = value_alloc_in(value_arena(out));
+        int64_t value_len = tinybuf_value_deserialize64(ptr, size, value, r);
+        if (value_len <= 0)
+        {
+            tinybuf_value_free(value);
+            tinybuf_value_clear(out);
+            tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: array value decode failed");
+            return value_len;
+        }
+        tinybuf_value_array_append(out, value);
+        ptr += value_len;
+        size -= value_len;
+        consumed += value_len;
+    }
+    return consumed;
+}
+
+// 长度超过INT_MAX的字符串不能走tinybuf_value_init_string
+static void init_string64(tinybuf_value *out, const char *ptr, int64_t len)
+{
+    if (len == 0)
+    {
+        // init_string长度为0时会按strlen计算 不能传入未结束的ptr
+        tinybuf_value_init_string(out, "", 0);
+        return;
+    }
+    if (len <= INT_MAX)
+    {
+        tinybuf_value_init_string(out, ptr, (int)len);
+        return;
+    }
+    tinybuf_value_init_string2(out, value_buffer_new(out, ptr, len));
+}
+
 int tinybuf_value_deserialize(const char *ptr, int size, tinybuf_value *out, tinybuf_error *r)
+{
+    // size不超过INT_MAX 消耗的字节数也不会超过
+    return (int)tinybuf_value_deserialize64(ptr, size, out, r);
+}
+
+int64_t tinybuf_value_deserialize64(const char *ptr, int64_t size, tinybuf_value *out, tinybuf_error *r)
 {
     assert(r);
     assert(out);
@@ -351,344 +390,106 @@ int tinybuf_value_deserialize(const char *ptr, int size, tinybuf_value *out, tin
         tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: no more bytes left");
         return 0;
     }
-
-    uint64_t cnt = 0, dt = 0, dims = 0, k = 0;
-    int a = 0, b = 0, e = 0;
-    int64_t count = 0, prod = 1;
-    int64_t *shape = NULL;
-    tinybuf_tensor_t *tnsr = NULL;
-
-    serialize_type type = (serialize_type)ptr[0];
-    --size;
-    ++ptr;
-    switch (type)
+    tinybuf_token tok;
+    int ok = tinybuf_token_read(ptr, size, &tok);
+    if (ok <= 0)
     {
-    case serialize_null:
+        if (ok < 0)
+        {
+            s_last_error_msg = "deserialize type unknown";
+            tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: invalid or unknown type");
+        }
+        return ok;
+    }
+    switch (tok.type)
     {
+    case serialize_null:
         tinybuf_value_clear(out);
         return 1;
-    }
     case serialize_negtive_int:
+        tinybuf_value_init_int(out, -(int64_t)tok.a);
+        return tok.head;
     case serialize_positive_int:
-        return optional_add(try_read_int(type, ptr, size, out), 1);
+        tinybuf_value_init_int(out, (int64_t)tok.a);
+        return tok.head;
     case serialize_bool_false:
     case serialize_bool_true:
-    {
-        tinybuf_value_init_bool(out, type == serialize_bool_true);
+        tinybuf_value_init_bool(out, tok.type == serialize_bool_true);
         return 1;
-    }
     case serialize_double:
-    {
-        if (size < 8)
-        {
-            return 0;
-        }
-        tinybuf_value_init_double(out, read_double((uint8_t *)ptr));
+        tinybuf_value_init_double(out, read_double((uint8_t *)ptr + 1));
         return 9;
-    }
     case serialize_string:
-    {
-        uint64_t bytes_len;
-        int len = int_deserialize((uint8_t *)ptr, size, &bytes_len);
-        if (len <= 0)
-        {
-            return len;
-        }
-        ptr += len;
-        size -= len;
-        if (size < bytes_len)
-        {
-            return 0;
-        }
-        tinybuf_value_init_string(out, ptr, (int)bytes_len);
-        return 1 + len + (int)bytes_len;
-    }
+        init_string64(out, ptr + tok.head, tok.body);
+        return tok.head + tok.body;
     case serialize_str_index:
     {
-        uint64_t idx;
-        int len = int_deserialize((uint8_t *)ptr, size, &idx);
-        if (len <= 0)
-        {
-            return len;
-        }
-        if (s_strpool_offset_read < 0 || s_strpool_base_read == NULL)
+        const tinybuf_reader_ctx *rc = tinybuf_reader_ctx_current();
+        if (rc->strpool_offset < 0 || rc->strpool_base == NULL)
         {
             s_last_error_msg = "strpool not initialized";
             return -1;
         }
-        const char *pool_start = s_strpool_base_read + s_strpool_offset_read;
-        const char *q = pool_start;
-        int64_t r = ((const char *)ptr + size) - pool_start;
-        if (r < 1)
+        const char *pool_start = rc->strpool_base + rc->strpool_offset;
+        int64_t rem = (ptr + size) - pool_start;
+        const char *str = NULL;
+        int str_len = 0;
+        int found = strpool_read_lookup(pool_start, rem, strpool_read_gen(), tok.a, &str, &str_len);
+        if (found <= 0)
         {
-            return 0;
-        }
-        if ((uint8_t)q[0] == serialize_str_pool)
-        {
-            ++q;
-            --r;
-            uint64_t cnt2 = 0;
-            int l2 = int_deserialize((uint8_t *)q, (int)r, &cnt2);
-            if (l2 <= 0)
-            {
-                return -1;
-            }
-            q += l2;
-            r -= l2;
-            if (idx >= cnt2)
-            {
-                return -1;
-            }
-            for (uint64_t i = 0; i < cnt2; ++i)
-            {
-                if (r < 1)
-                {
-                    return 0;
-                }
-                if ((uint8_t)q[0] != serialize_string)
-                {
-                    return -1;
-                }
-                ++q;
-                --r;
-                uint64_t sl;
-                int l3 = int_deserialize((uint8_t *)q, (int)r, &sl);
-                if (l3 <= 0)
-                {
-                    return l3;
-                }
-                q += l3;
-                r -= l3;
-                if (r < (int64_t)sl)
-                {
-                    return 0;
-                }
-                if (i == idx)
-                {
-                    tinybuf_value_init_string(out, q, (int)sl);
-                    return 1 + len;
-                }
-                q += sl;
-                r -= sl;
-            }
-            return -1;
-        }
-        else if ((uint8_t)q[0] == 27)
-        {
-            ++q;
-            --r;
-            uint64_t ncount = 0;
-            int l2 = int_deserialize((uint8_t *)q, (int)r, &ncount);
-            if (l2 <= 0)
-            {
-                return -1;
-            }
-            const char *nodes_base = q + l2;
-            int64_t nodes_size = r - l2;
-            const char *p = nodes_base;
-            int64_t rr = nodes_size;
-            int found = -1;
-            for (uint64_t i = 0; i < ncount; ++i)
-            {
-                uint64_t parent = 0;
-                int lp = int_deserialize((uint8_t *)p, (int)rr, &parent);
-                if (lp <= 0)
-                    return lp;
-                p += lp;
-                rr -= lp;
-                if (rr < 2)
-                    return 0;
-                unsigned char ch = (unsigned char)p[0];
-                unsigned char flag = (unsigned char)p[1];
-                p += 2;
-                rr -= 2;
-                if (flag)
-                {
-                    uint64_t leaf = 0;
-                    int ll = int_deserialize((uint8_t *)p, (int)rr, &leaf);
-                    if (ll <= 0)
-                        return ll;
-                    p += ll;
-                    rr -= ll;
-                    if (leaf == idx)
-                    {
-                        found = (int)i;
-                        break;
-                    }
-                }
-            }
-            if (found < 0)
-            {
-                return -1;
-            }
-            buffer *tmp = buffer_alloc();
-            int current = found;
-            while (1)
-            {
-                const char *p2 = nodes_base;
-                int64_t rr2 = nodes_size;
-                int node_index = 0;
-                int parent_index = -1;
-                unsigned char ch = 0;
-                unsigned char flag = 0;
-                uint64_t leaf = 0;
-                while (node_index <= current)
-                {
-                    uint64_t parent = 0;
-                    int lp = int_deserialize((uint8_t *)p2, (int)rr2, &parent);
-                    p2 += lp;
-                    rr2 -= lp;
-                    if (rr2 < 2)
-                        return 0;
-                    ch = (unsigned char)p2[0];
-                    flag = (unsigned char)p2[1];
-                    p2 += 2;
-                    rr2 -= 2;
-                    if (flag)
-                    {
-                        int ll = int_deserialize((uint8_t *)p2, (int)rr2, &leaf);
-                        p2 += ll;
-                        rr2 -= ll;
-                    }
-                    parent_index = (int)parent;
-                    ++node_index;
-                }
-                if (ch)
-                {
-                    buffer_append(tmp, (const char *)&ch, 1);
-                }
-                if (parent_index <= 0)
-                {
-                    break;
-                }
-                current = parent_index;
-            }
-            int tlen = buffer_get_length_inline(tmp);
-            const char *td = buffer_get_data_inline(tmp);
-            char *rev = (char *)tinybuf_malloc(tlen);
-            for (int i = 0; i < tlen; ++i)
-            {
-                rev[i] = td[tlen - 1 - i];
-            }
-            tinybuf_value_init_string(out, rev, tlen);
-            tinybuf_free(rev);
-            buffer_free(tmp);
-            return 1 + len;
-        }
-        else
-        {
-            return -1;
+            return found;
         }
+        tinybuf_value_init_string(out, str, str_len);
+        return tok.head;
     }
     case serialize_map:
+    case serialize_array:
     {
-        int consumed = 0;
-        uint64_t map_size;
-        int len = int_deserialize((uint8_t *)ptr, size, &map_size);
-        if (len <= 0)
-        {
-            tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: map size decode failed");
-            return len;
-        }
-        ptr += len;
-        size -= len;
-        consumed = 1 + len;
-        out->_type = tinybuf_map;
-        for (int i = 0; i < (int)map_size; ++i)
-        {
-            uint64_t key_len;
-            len = int_deserialize((uint8_t *)ptr, size, &key_len);
-            if (len <= 0)
-            {
-                tinybuf_value_clear(out);
-                return len;
-            }
-            ptr += len;
-            size -= len;
-            consumed += len;
-            if (size < key_len)
-            {
-                tinybuf_value_clear(out);
-                return 0;
-            }
-            char *key_ptr = (char *)ptr;
-            ptr += key_len;
-            size -= key_len;
-            consumed += key_len;
-            tinybuf_value *value = tinybuf_value_alloc();
-            int value_len = tinybuf_value_deserialize(ptr, size, value, r);
-            if (value_len <= 0)
-            {
-                tinybuf_value_free(value);
-                tinybuf_value_clear(out);
-                tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: map value decode failed");
-                return value_len;
-            }
-            buffer *key = buffer_alloc();
-            buffer_assign(key, key_ptr, (int)key_len);
-            tinybuf_value_map_set2(out, key, value);
-            ptr += value_len;
-            size -= value_len;
-            consumed += value_len;
-        }
-        return consumed;
+        int64_t n = tok.type == serialize_map ? deserialize_map_body(ptr + tok.head, size - tok.head, tok.a, out, r)
+                                              : deserialize_array_body(ptr + tok.head, size - tok.head, tok.a, out, r);
+        return n < 0 || (n == 0 && tok.a) ? n : tok.head + n;
     }
-    case serialize_array:
+    case serialize_sized_map:
+    case serialize_sized_array:
     {
-        int consumed = 0;
-        uint64_t array_size;
-        int len = int_deserialize((uint8_t *)ptr, size, &array_size);
-        if (len <= 0)
+        if (tok.body > size - tok.head)
         {
-            tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: array size decode failed");
-            return len;
+            return 0;
         }
-        ptr += len;
-        size -= len;
-        consumed = 1 + len;
-        out->_type = tinybuf_array;
-        for (int i = 0; i < (int)array_size; ++i)
+        // str_index按剩余长度定位pool 所以不截断size 解析后再核对长度
+        int64_t n = tok.type == serialize_sized_map ? deserialize_map_body(ptr + tok.head, size - tok.head, tok.a, out, r)
+                                                    : deserialize_array_body(ptr + tok.head, size - tok.head, tok.a, out, r);
+        if (n < 0 || (n == 0 && tok.a))
         {
-            tinybuf_value *value = tinybuf_value_alloc();
-            int value_len = tinybuf_value_deserialize(ptr, size, value, r);
-            if (value_len <= 0)
-            {
-                tinybuf_value_free(value);
-                tinybuf_value_clear(out);
-                tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: array value decode failed");
-                return value_len;
-            }
-            tinybuf_value_array_append(out, value);
-            ptr += value_len;
-            size -= value_len;
-            consumed += value_len;
+            return n;
+        }
+        if (n != tok.body)
+        {
+            tinybuf_value_clear(out);
+            tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: container length mismatch");
+            return -1;
         }
-        return consumed;
+        return tok.head + n;
     }
     case serialize_vector_tensor:
-        return tinybuf_deserialize_vector_tensor(ptr, size, out);
     case serialize_dense_tensor:
-        return tinybuf_deserialize_dense_tensor(ptr, size, out);
-    case serialize_sparse_tensor:
-        return tinybuf_deserialize_sparse_tensor(ptr, size, out);
+    case serialize_native_tensor:
+        return deserialize_tensor(ptr, size, &tok, out);
     case serialize_bool_map:
     {
-        uint64_t cntb = 0;
-        int ab = int_deserialize((uint8_t *)ptr, size, &cntb);
-        if (ab <= 0) return ab;
-        ptr += ab; size -= ab;
-        int64_t bytes = ((int64_t)cntb + 7) / 8;
-        if (size < bytes) return 0;
         tinybuf_bool_map_t *bm = (tinybuf_bool_map_t *)tinybuf_malloc(sizeof(tinybuf_bool_map_t));
-        bm->count = (int64_t)cntb;
-        bm->bits = (uint8_t *)tinybuf_malloc((int)bytes);
-        memcpy(bm->bits, ptr, (size_t)bytes);
+        bm->count = (int64_t)tok.a;
+        bm->bits = (uint8_t *)tinybuf_malloc64((size_t)(tok.body ? tok.body : 1));
+        memcpy(bm->bits, ptr + tok.head, (size_t)tok.body);
         out->_type = tinybuf_bool_map;
         out->_data._custom = bm;
         out->_custom_free = NULL;
-        return 1 + ab + (int)bytes;
+        if (value_arena(out))
+            tinybuf_arena_track(value_arena(out), out);
+        return tok.head + tok.body;
     }
     default:
+        // 指针/version/str_pool_table等由try_read_box处理
         s_last_error_msg = "deserialize type unknown";
         tinybuf_result_add_msg_const(r, "tinybuf_value_deserialize: type unknown");
         return -1;
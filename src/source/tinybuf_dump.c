@@ -18,7 +18,7 @@ static inline void append_newline(buffer *dst)
 {
     buffer_append(dst, "\r\n", 2);
 }
-static int s_dump_indent = 0;
+static TB_THREAD_LOCAL int s_dump_indent = 0;
 static inline void append_indent(buffer *dst)
 {
     for(int i=0;i<s_dump_indent;++i)
@@ -31,9 +31,15 @@ static int dump_box_text(buf_ref *buf, buffer *dst);
 static int collect_box_labels(buf_ref *buf);
 
 typedef struct { int64_t pos; int label; } dump_label;
-static dump_label *s_dump_labels = NULL; static int s_dump_labels_count = 0; static int s_dump_labels_capacity = 0;
-static const char *s_dump_base = NULL; static int64_t s_dump_total = 0;
-static int64_t *s_dump_box_starts = NULL; static int s_dump_box_starts_count = 0; static int s_dump_box_starts_capacity = 0;
+static TB_THREAD_LOCAL dump_label *s_dump_labels = NULL; static TB_THREAD_LOCAL int s_dump_labels_count = 0; static TB_THREAD_LOCAL int s_dump_labels_capacity = 0;
+static TB_THREAD_LOCAL const char *s_dump_base = NULL; static TB_THREAD_LOCAL int64_t s_dump_total = 0;
+static TB_THREAD_LOCAL int64_t *s_dump_box_starts = NULL; static TB_THREAD_LOCAL int s_dump_box_starts_count = 0; static TB_THREAD_LOCAL int s_dump_box_starts_capacity = 0;
+
+static inline const char *dump_pool_start(void)
+{
+    const tinybuf_reader_ctx *rc = tinybuf_reader_ctx_current();
+    return rc->strpool_base + rc->strpool_offset;
+}
 
 static inline void dump_labels_reset(const buf_ref *buf)
 {
@@ -113,7 +119,7 @@ static int dump_string_text(buf_ref *buf, buffer *dst)
 {
     QWORD slen = 0;
     int consumed = 0;
-    int add = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &slen);
+    int add = try_read_int_tovar(FALSE, buf->ptr, buf->size, &slen);
     if (add <= 0) return add;
     consumed += add;
     buf_offset(buf, add);
@@ -128,11 +134,21 @@ static int dump_string_text(buf_ref *buf, buffer *dst)
     return consumed;
 }
 
+// 带长度的map/array 跳过长度字段后与普通容器相同
+static int skip_container_len(buf_ref *buf)
+{
+    QWORD body_len = 0;
+    int add = try_read_int_tovar(FALSE, buf->ptr, buf->size, &body_len);
+    if (add <= 0) return add;
+    buf_offset(buf, add);
+    return add;
+}
+
 static int dump_array_text(buf_ref *buf, buffer *dst)
 {
     QWORD cnt = 0;
     int consumed = 0;
-    int add = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &cnt);
+    int add = try_read_int_tovar(FALSE, buf->ptr, buf->size, &cnt);
     if (add <= 0) return add;
     consumed += add;
     buf_offset(buf, add);
@@ -159,7 +175,7 @@ static int dump_map_text(buf_ref *buf, buffer *dst)
 {
     QWORD cnt = 0;
     int consumed = 0;
-    int add = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &cnt);
+    int add = try_read_int_tovar(FALSE, buf->ptr, buf->size, &cnt);
     if (add <= 0) return add;
     consumed += add;
     buf_offset(buf, add);
@@ -204,7 +220,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_negtive_int:
         {
             QWORD v = 0;
-            int a = try_read_int_tovar(t == serialize_negtive_int, buf->ptr, (int)buf->size, &v);
+            int a = try_read_int_tovar(t == serialize_negtive_int, buf->ptr, buf->size, &v);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(buf, a);
@@ -238,15 +254,24 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_array:
             consumed += dump_array_text(buf, dst);
             break;
+        case serialize_sized_map:
+        case serialize_sized_array:
+        {
+            int a = skip_container_len(buf);
+            if (a <= 0) return a;
+            consumed += a;
+            consumed += t == serialize_sized_map ? dump_map_text(buf, dst) : dump_array_text(buf, dst);
+            break;
+        }
         case serialize_vector_tensor:
         {
             QWORD cnt = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &cnt);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &cnt);
             if (a <= 0) return a;
             buf_offset(buf, a);
             consumed += a;
             QWORD dt = 0;
-            int b = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &dt);
+            int b = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dt);
             if (b <= 0) return b;
             buf_offset(buf, b);
             consumed += b;
@@ -278,7 +303,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
                     buf_offset(buf, 1);
                     consumed += 1;
                     QWORD v = 0;
-                    int c = try_read_int_tovar(t2 == serialize_negtive_int, buf->ptr, (int)buf->size, &v);
+                    int c = try_read_int_tovar(t2 == serialize_negtive_int, buf->ptr, buf->size, &v);
                     if (c <= 0) return c;
                     buf_offset(buf, c);
                     consumed += c;
@@ -289,21 +314,21 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_dense_tensor:
         {
             QWORD dims = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &dims);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dims);
             if (a <= 0) return a;
             buf_offset(buf, a);
             consumed += a;
             int64_t prod = 1;
             for (QWORD i = 0; i < dims; ++i) {
                 QWORD d = 0;
-                int c = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &d);
+                int c = try_read_int_tovar(FALSE, buf->ptr, buf->size, &d);
                 if (c <= 0) return c;
                 buf_offset(buf, c);
                 consumed += c;
                 prod *= (int64_t)d;
             }
             QWORD dt = 0;
-            int b = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &dt);
+            int b = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dt);
             if (b <= 0) return b;
             buf_offset(buf, b);
             consumed += b;
@@ -337,7 +362,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
                     buf_offset(buf, 1);
                     consumed += 1;
                     QWORD v = 0;
-                    int c = try_read_int_tovar(t2 == serialize_negtive_int, buf->ptr, (int)buf->size, &v);
+                    int c = try_read_int_tovar(t2 == serialize_negtive_int, buf->ptr, buf->size, &v);
                     if (c <= 0) return c;
                     buf_offset(buf, c);
                     consumed += c;
@@ -348,16 +373,16 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_name_idx:
         {
             QWORD idx = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &idx);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &idx);
             if (a <= 0) return a;
             buf_offset(buf, a);
             consumed += a;
             QWORD blen = 0;
-            int b = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &blen);
+            int b = try_read_int_tovar(FALSE, buf->ptr, buf->size, &blen);
             if (b <= 0) return b;
             buf_offset(buf, b);
             consumed += b;
-            const char *pool_start = s_strpool_base_read + s_strpool_offset_read;
+            const char *pool_start = dump_pool_start();
             const char *q = pool_start;
             int64_t r = ((const char*)buf->ptr + buf->size) - pool_start;
             char *name_out = NULL;
@@ -466,10 +491,46 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
             consumed += (int)blen;
             break;
         }
+        case serialize_native_tensor:
+        {
+            QWORD dims = 0;
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dims);
+            if (a <= 0) return a;
+            buf_offset(buf, a);
+            consumed += a;
+            append_cstr(dst, "tensor(shape=[");
+            int64_t prod = 1;
+            for (QWORD i = 0; i < dims; ++i) {
+                QWORD d = 0;
+                int c = try_read_int_tovar(FALSE, buf->ptr, buf->size, &d);
+                if (c <= 0) return c;
+                buf_offset(buf, c);
+                consumed += c;
+                if (i) append_cstr(dst, ",");
+                append_int_dec(dst, (int64_t)d);
+                prod *= (int64_t)d;
+            }
+            QWORD dt = 0;
+            int b = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dt);
+            if (b <= 0) return b;
+            buf_offset(buf, b);
+            consumed += b;
+            append_cstr(dst, "], dtype=");
+            append_int_dec(dst, (int64_t)dt);
+            append_cstr(dst, ", count=");
+            append_int_dec(dst, prod);
+            append_cstr(dst, ", native)");
+            if (buf->size < 1) return 0;
+            int64_t need = 1 + (uint8_t)buf->ptr[0] + prod * tensor_elem_width((int)dt);
+            if (buf->size < need) return 0;
+            buf_offset(buf, need);
+            consumed += (int)need;
+            return consumed;
+        }
         case serialize_bool_map:
         {
             QWORD cnt = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &cnt);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &cnt);
             if (a <= 0) return a;
             buf_offset(buf, a);
             consumed += a;
@@ -485,24 +546,24 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_sparse_tensor:
         {
             QWORD dims = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &dims);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dims);
             if (a <= 0) return a;
             buf_offset(buf, a);
             consumed += a;
             for (QWORD i = 0; i < dims; ++i) {
                 QWORD d = 0;
-                int c = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &d);
+                int c = try_read_int_tovar(FALSE, buf->ptr, buf->size, &d);
                 if (c <= 0) return c;
                 buf_offset(buf, c);
                 consumed += c;
             }
             QWORD dt = 0;
-            int b = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &dt);
+            int b = try_read_int_tovar(FALSE, buf->ptr, buf->size, &dt);
             if (b <= 0) return b;
             buf_offset(buf, b);
             consumed += b;
             QWORD k = 0;
-            int e = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &k);
+            int e = try_read_int_tovar(FALSE, buf->ptr, buf->size, &k);
             if (e <= 0) return e;
             buf_offset(buf, e);
             consumed += e;
@@ -512,7 +573,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
             for (QWORD i = 0; i < k; ++i) {
                 for (QWORD j = 0; j < dims; ++j) {
                     QWORD idx = 0;
-                    int c = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &idx);
+                    int c = try_read_int_tovar(FALSE, buf->ptr, buf->size, &idx);
                     if (c <= 0) return c;
                     buf_offset(buf, c);
                     consumed += c;
@@ -530,7 +591,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
                     buf_offset(buf, 1);
                     consumed += 1;
                     QWORD v = 0;
-                    int c = try_read_int_tovar(t2 == serialize_negtive_int, buf->ptr, (int)buf->size, &v);
+                    int c = try_read_int_tovar(t2 == serialize_negtive_int, buf->ptr, buf->size, &v);
                     if (c <= 0) return c;
                     buf_offset(buf, c);
                     consumed += c;
@@ -547,7 +608,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         {
             int neg = (t == serialize_pointer_from_current_n || t == serialize_pointer_from_start_n || t == serialize_pointer_from_end_n);
             QWORD mag = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &mag);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &mag);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(buf, a);
@@ -581,7 +642,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_version:
         {
             QWORD ver = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &ver);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &ver);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(buf, a);
@@ -591,7 +652,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_version_list:
         {
             QWORD cnt = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &cnt);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &cnt);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(buf, a);
@@ -599,7 +660,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
             for (QWORD i = 0; i < cnt; ++i) {
                 if (i) append_cstr(dst, ",");
                 QWORD ver = 0;
-                int b = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &ver);
+                int b = try_read_int_tovar(FALSE, buf->ptr, buf->size, &ver);
                 if (b <= 0) return b;
                 consumed += b;
                 buf_offset(buf, b);
@@ -614,7 +675,7 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
         case serialize_plugin_map_table:
         {
             QWORD cnt = 0;
-            int a = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &cnt);
+            int a = try_read_int_tovar(FALSE, buf->ptr, buf->size, &cnt);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(buf, a);
@@ -626,16 +687,16 @@ static int dump_box_text(buf_ref *buf, buffer *dst)
                 buf_offset(buf, 1);
                 consumed += 1;
                 QWORD idx = 0;
-                int l1 = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &idx);
+                int l1 = try_read_int_tovar(FALSE, buf->ptr, buf->size, &idx);
                 if (l1 <= 0) return l1;
                 buf_offset(buf, l1);
                 consumed += l1;
                 QWORD blen = 0;
-                int l2 = try_read_int_tovar(FALSE, buf->ptr, (int)buf->size, &blen);
+                int l2 = try_read_int_tovar(FALSE, buf->ptr, buf->size, &blen);
                 if (l2 <= 0) return l2;
                 buf_offset(buf, l2);
                 consumed += l2;
-                const char *pool_start = s_strpool_base_read + s_strpool_offset_read;
+                const char *pool_start = dump_pool_start();
                 const char *q = pool_start;
                 int64_t rleft = ((const char*)buf->ptr + buf->size) - pool_start;
                 char *name_out = NULL;
@@ -700,7 +761,7 @@ static int collect_string(buf_ref *br)
 {
     QWORD slen = 0;
     int consumed = 0;
-    int add = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &slen);
+    int add = try_read_int_tovar(FALSE, br->ptr, br->size, &slen);
     if (add <= 0) return add;
     consumed += add;
     buf_offset(br, add);
@@ -714,7 +775,7 @@ static int collect_array(buf_ref *br)
 {
     QWORD cnt = 0;
     int consumed = 0;
-    int add = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &cnt);
+    int add = try_read_int_tovar(FALSE, br->ptr, br->size, &cnt);
     if (add <= 0) return add;
     consumed += add;
     buf_offset(br, add);
@@ -727,7 +788,7 @@ static int collect_map(buf_ref *br)
 {
     QWORD cnt = 0;
     int consumed = 0;
-    int add = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &cnt);
+    int add = try_read_int_tovar(FALSE, br->ptr, br->size, &cnt);
     if (add <= 0) return add;
     consumed += add;
     buf_offset(br, add);
@@ -762,7 +823,7 @@ static int collect_box_labels(buf_ref *br)
         case serialize_negtive_int:
         {
             QWORD v = 0;
-            int a = try_read_int_tovar(t == serialize_negtive_int, br->ptr, (int)br->size, &v);
+            int a = try_read_int_tovar(t == serialize_negtive_int, br->ptr, br->size, &v);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(br, a);
@@ -788,6 +849,15 @@ static int collect_box_labels(buf_ref *br)
         case serialize_array:
             consumed += collect_array(br);
             break;
+        case serialize_sized_map:
+        case serialize_sized_array:
+        {
+            int a = skip_container_len(br);
+            if (a <= 0) return a;
+            consumed += a;
+            consumed += t == serialize_sized_map ? collect_map(br) : collect_array(br);
+            break;
+        }
         case serialize_pointer_from_current_n:
         case serialize_pointer_from_start_n:
         case serialize_pointer_from_end_n:
@@ -797,7 +867,7 @@ static int collect_box_labels(buf_ref *br)
         {
             int neg = (t == serialize_pointer_from_current_n || t == serialize_pointer_from_start_n || t == serialize_pointer_from_end_n);
             QWORD mag = 0;
-            int a = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &mag);
+            int a = try_read_int_tovar(FALSE, br->ptr, br->size, &mag);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(br, a);
@@ -820,7 +890,7 @@ static int collect_box_labels(buf_ref *br)
         case serialize_version:
         {
             QWORD ver = 0;
-            int a = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &ver);
+            int a = try_read_int_tovar(FALSE, br->ptr, br->size, &ver);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(br, a);
@@ -830,13 +900,13 @@ static int collect_box_labels(buf_ref *br)
         case serialize_version_list:
         {
             QWORD cnt = 0;
-            int a = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &cnt);
+            int a = try_read_int_tovar(FALSE, br->ptr, br->size, &cnt);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(br, a);
             for (QWORD i = 0; i < cnt; ++i) {
                 QWORD ver = 0;
-                int b = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &ver);
+                int b = try_read_int_tovar(FALSE, br->ptr, br->size, &ver);
                 if (b <= 0) return b;
                 consumed += b;
                 buf_offset(br, b);
@@ -847,12 +917,12 @@ static int collect_box_labels(buf_ref *br)
         case serialize_name_idx:
         {
             QWORD idx = 0;
-            int a = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &idx);
+            int a = try_read_int_tovar(FALSE, br->ptr, br->size, &idx);
             if (a <= 0) return a;
             consumed += a;
             buf_offset(br, a);
             QWORD blen = 0;
-            int b = try_read_int_tovar(FALSE, br->ptr, (int)br->size, &blen);
+            int b = try_read_int_tovar(FALSE, br->ptr, br->size, &blen);
             if (b <= 0) return b;
             consumed += b;
             buf_offset(br, b);
@@ -0,0 +1,309 @@
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+
+// 开放寻址hash表 作为map的可选后端
+// entries按插入顺序保存 slots只保存entries下标 key的buffer结构体和数据放在分块arena中
+// entries扩容时会移动 key不随之移动 tinybuf_hash_map_at返回的key在map生命周期内不变
+
+#define HASH_MAP_MIN_SLOTS 16
+#define HASH_MAP_KEY_BLOCK 4096
+
+typedef struct
+{
+    struct T_buffer *key; // 在key_block或arena中 不可buffer_free
+    tinybuf_value *value;
+    uint32_t hash;
+} hash_map_entry;
+
+typedef struct key_block
+{
+    struct key_block *next;
+    int used;
+    int capacity;
+} key_block;
+
+// 块头和每个key的buffer结构体都按KEY_ALIGN对齐 key数据紧跟在结构体之后
+#define KEY_ALIGN 8
+#define KEY_ROUND(n) (((n) + KEY_ALIGN - 1) & ~(KEY_ALIGN - 1))
+#define KEY_BLOCK_HEAD ((int)KEY_ROUND(sizeof(key_block)))
+#define KEY_HEAD ((int)KEY_ROUND(sizeof(struct T_buffer)))
+
+struct T_tinybuf_hash_map
+{
+    hash_map_entry *entries;
+    int count;
+    int capacity;
+    int *slots; // -1为空 其余为entries下标
+    int slot_mask;
+    key_block *keys;
+    tinybuf_arena *arena; // 不为NULL时全部内存从arena分配 扩容时旧内存不释放
+    tb_atomic_t shares;   // 除所有者外的引用数 见tinybuf_hash_map_share
+    uint64_t hash;        // 结构哈希缓存 见tinybuf_value_hash
+};
+
+static inline uint32_t hash_key(const char *key, int len)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; ++i)
+    {
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline void *map_alloc(tinybuf_hash_map *map, int size)
+{
+    return map->arena ? tinybuf_arena_alloc(map->arena, (size_t)size) : tinybuf_malloc(size);
+}
+
+static struct T_buffer *key_new(tinybuf_hash_map *map, const char *key, int len)
+{
+    if (map->arena)
+    {
+        struct T_buffer *buf = (struct T_buffer *)tinybuf_arena_buffer(map->arena, key, len);
+        assert(buf);
+        return buf;
+    }
+    key_block *blk = map->keys;
+    // 多留1字节存放'\0' 方便把key当c字符串使用 下一个key的结构体从对齐位置开始
+    int need = KEY_ROUND(KEY_HEAD + len + 1);
+    if (!blk || blk->capacity - blk->used < need)
+    {
+        int cap = need > HASH_MAP_KEY_BLOCK ? need : HASH_MAP_KEY_BLOCK;
+        blk = (key_block *)tinybuf_malloc(KEY_BLOCK_HEAD + cap);
+        assert(blk);
+        blk->next = map->keys;
+        blk->used = 0;
+        blk->capacity = cap;
+        map->keys = blk;
+    }
+    struct T_buffer *buf = (struct T_buffer *)((char *)blk + KEY_BLOCK_HEAD + blk->used);
+    buf->_data = (char *)buf + KEY_HEAD;
+    memcpy(buf->_data, key, len);
+    buf->_data[len] = '\0';
+    buf->_len = len;
+    buf->_capacity = len + 1;
+    buf->_fixed = 1;
+    // 随map一起释放 buffer_free不释放
+    buf->_in_arena = 1;
+    blk->used += need;
+    return buf;
+}
+
+static void rebuild_slots(tinybuf_hash_map *map, int slot_count)
+{
+    if (!map->arena)
+    {
+        tinybuf_free(map->slots);
+    }
+    map->slots = (int *)map_alloc(map, (int)sizeof(int) * slot_count);
+    assert(map->slots);
+    memset(map->slots, 0xff, sizeof(int) * slot_count);
+    map->slot_mask = slot_count - 1;
+    for (int i = 0; i < map->count; ++i)
+    {
+        int pos = (int)(map->entries[i].hash & (uint32_t)map->slot_mask);
+        while (map->slots[pos] != -1)
+        {
+            pos = (pos + 1) & map->slot_mask;
+        }
+        map->slots[pos] = i;
+    }
+}
+
+// 负载因子保持在3/4以下 slots重建时返回1
+static int ensure_capacity(tinybuf_hash_map *map, int count)
+{
+    if (map->capacity < count)
+    {
+        int newcap = map->capacity ? map->capacity * 2 : 8;
+        if (newcap < count)
+        {
+            newcap = count;
+        }
+        if (map->arena)
+        {
+            hash_map_entry *entries = (hash_map_entry *)tinybuf_arena_alloc(map->arena, sizeof(hash_map_entry) * (size_t)newcap);
+            assert(entries);
+            if (map->count)
+            {
+                memcpy(entries, map->entries, sizeof(hash_map_entry) * (size_t)map->count);
+            }
+            map->entries = entries;
+        }
+        else
+        {
+            map->entries = (hash_map_entry *)tinybuf_realloc(map->entries, (int)sizeof(hash_map_entry) * newcap);
+            assert(map->entries);
+        }
+        map->capacity = newcap;
+    }
+    int slot_count = map->slots ? map->slot_mask + 1 : 0;
+    if (count * 4 >= slot_count * 3)
+    {
+        int newslots = slot_count ? slot_count : HASH_MAP_MIN_SLOTS;
+        while (count * 4 >= newslots * 3)
+        {
+            newslots *= 2;
+        }
+        rebuild_slots(map, newslots);
+        return 1;
+    }
+    return 0;
+}
+
+static int find_slot(const tinybuf_hash_map *map, const char *key, int len, uint32_t hash)
+{
+    if (!map->slots)
+    {
+        return -1;
+    }
+    int pos = (int)(hash & (uint32_t)map->slot_mask);
+    while (map->slots[pos] != -1)
+    {
+        const hash_map_entry *e = &map->entries[map->slots[pos]];
+        if (e->hash == hash && e->key->_len == len && memcmp(e->key->_data, key, len) == 0)
+        {
+            return pos;
+        }
+        pos = (pos + 1) & map->slot_mask;
+    }
+    return -1 - pos;
+}
+
+tinybuf_hash_map *tinybuf_hash_map_new(void)
+{
+    tinybuf_hash_map *map = (tinybuf_hash_map *)tinybuf_malloc(sizeof(tinybuf_hash_map));
+    assert(map);
+    memset(map, 0, sizeof(tinybuf_hash_map));
+    return map;
+}
+
+tinybuf_hash_map *tinybuf_hash_map_new_arena(tinybuf_arena *arena)
+{
+    tinybuf_hash_map *map = (tinybuf_hash_map *)tinybuf_arena_alloc(arena, sizeof(tinybuf_hash_map));
+    assert(map);
+    memset(map, 0, sizeof(tinybuf_hash_map));
+    map->arena = arena;
+    return map;
+}
+
+void tinybuf_hash_map_share(tinybuf_hash_map *map)
+{
+    tb_atomic_add(&map->shares, 1);
+}
+
+int tinybuf_hash_map_is_shared(tinybuf_hash_map *map)
+{
+    return tb_atomic_load(&map->shares) > 0;
+}
+
+uint64_t tinybuf_hash_map_get_hash(const tinybuf_hash_map *map)
+{
+    return map->hash;
+}
+
+void tinybuf_hash_map_set_hash(tinybuf_hash_map *map, uint64_t hash)
+{
+    map->hash = hash;
+}
+
+void tinybuf_hash_map_free(tinybuf_hash_map *map)
+{
+    if (!map)
+    {
+        return;
+    }
+    if (tb_atomic_load(&map->shares) > 0 && tb_atomic_add(&map->shares, -1) >= 0)
+    {
+        // 还有其他引用
+        return;
+    }
+    for (int i = 0; i < map->count; ++i)
+    {
+        tinybuf_value_free(map->entries[i].value);
+    }
+    if (map->arena)
+    {
+        return;
+    }
+    key_block *blk = map->keys;
+    while (blk)
+    {
+        key_block *next = blk->next;
+        tinybuf_free(blk);
+        blk = next;
+    }
+    tinybuf_free(map->entries);
+    tinybuf_free(map->slots);
+    tinybuf_free(map);
+}
+
+void tinybuf_hash_map_reserve(tinybuf_hash_map *map, int count)
+{
+    assert(map);
+    if (count > map->count)
+    {
+        (void)ensure_capacity(map, count);
+    }
+}
+
+int tinybuf_hash_map_size(const tinybuf_hash_map *map)
+{
+    return map ? map->count : 0;
+}
+
+int tinybuf_hash_map_set(tinybuf_hash_map *map, const char *key, int key_len, tinybuf_value *value)
+{
+    assert(map);
+    assert(value);
+    uint32_t hash = hash_key(key, key_len);
+    int pos = find_slot(map, key, key_len, hash);
+    if (pos >= 0)
+    {
+        // 与avl后端一致 相同key时替换并释放旧value
+        hash_map_entry *e = &map->entries[map->slots[pos]];
+        if (e->value != value)
+        {
+            tinybuf_value_free(e->value);
+            e->value = value;
+        }
+        return 0;
+    }
+    if (ensure_capacity(map, map->count + 1))
+    {
+        pos = find_slot(map, key, key_len, hash);
+    }
+    hash_map_entry *e = &map->entries[map->count];
+    e->key = key_new(map, key, key_len);
+    e->value = value;
+    e->hash = hash;
+    map->slots[-1 - pos] = map->count++;
+    return 0;
+}
+
+tinybuf_value *tinybuf_hash_map_get(const tinybuf_hash_map *map, const char *key, int key_len)
+{
+    if (!map)
+    {
+        return NULL;
+    }
+    int pos = find_slot(map, key, key_len, hash_key(key, key_len));
+    return pos >= 0 ? map->entries[map->slots[pos]].value : NULL;
+}
+
+tinybuf_value *tinybuf_hash_map_at(const tinybuf_hash_map *map, int index, buffer **key)
+{
+    if (!map || index < 0 || index >= map->count)
+    {
+        return NULL;
+    }
+    hash_map_entry *e = &map->entries[index];
+    if (key)
+    {
+        *key = e->key;
+    }
+    return e->value;
+}
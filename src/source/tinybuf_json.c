@@ -124,9 +124,7 @@ typedef struct{
 
 static int tinybuf_value_serialize_as_json_level(int level,int compact, const tinybuf_value *value, buffer *out);
 
-static int avl_tree_for_each_node_dump_array(void *user_data,AVLTreeNode *node){
-    for_each_context *context = (for_each_context *)user_data;
-    tinybuf_value *val = (tinybuf_value *)avl_tree_node_value(node);
+static int dump_array_item(for_each_context *context,const tinybuf_value *val){
     if(val->_type != tinybuf_map && val->_type != tinybuf_array && !context->compact){
         add_blank(context->out,4 * context->level + 4);
     }
@@ -138,15 +136,11 @@ static int avl_tree_for_each_node_dump_array(void *user_data,AVLTreeNode *node){
     if(!context->compact) {
         buffer_append(context->out, "\r\n", 2);
     }
-
-    //继续遍历
     return 0;
 }
 
-static int avl_tree_for_each_node_dump_map(void *user_data,AVLTreeNode *node){
+static int map_visit_dump_json(void *user_data,buffer *key,tinybuf_value *val){
     for_each_context *context = (for_each_context *)user_data;
-    buffer *key = (buffer*)avl_tree_node_key(node);
-    tinybuf_value *val = (tinybuf_value *)avl_tree_node_value(node);
     if(!context->compact) {
         add_blank(context->out, 4 * context->level + 4);
     }
@@ -235,9 +229,9 @@ static int tinybuf_value_serialize_as_json_level(int level,int compact, const ti
 
         case tinybuf_string:{
             buffer_append(out,"\"",1);
-            int len = buffer_get_length_inline(value->_data._string);
+            int len = (int) value_str_len(value);
             if(len){
-                json_encode_string(out, (uint8_t *) buffer_get_data_inline(value->_data._string),len);
+                json_encode_string(out, (uint8_t *) value_str_data(value),len);
             }
             buffer_append(out,"\"",1);
         }
@@ -251,7 +245,7 @@ static int tinybuf_value_serialize_as_json_level(int level,int compact, const ti
                 buffer_push_inline(out,'{');
             }
 
-            int map_size = avl_tree_num_entries(value->_data._map_array);
+            int map_size = tinybuf_map_size(value);
             if(map_size){
                 for_each_context context;
                 context.size = map_size;
@@ -259,7 +253,7 @@ static int tinybuf_value_serialize_as_json_level(int level,int compact, const ti
                 context.i = 0;
                 context.out = out;
                 context.level = level;
-                avl_tree_for_each_node(value->_data._map_array,&context,avl_tree_for_each_node_dump_map);
+                tinybuf_map_for_each(value,&context,map_visit_dump_json);
             }
 
             if(!compact) {
@@ -278,7 +272,7 @@ static int tinybuf_value_serialize_as_json_level(int level,int compact, const ti
                 buffer_push_inline(out,'[');
             }
 
-            int array_size = avl_tree_num_entries(value->_data._map_array);
+            int array_size = tinybuf_array_size(value);
             if(array_size){
                 for_each_context context;
                 context.size = array_size;
@@ -286,7 +280,9 @@ static int tinybuf_value_serialize_as_json_level(int level,int compact, const ti
                 context.i = 0;
                 context.out = out;
                 context.level = level;
-                avl_tree_for_each_node(value->_data._map_array,&context,avl_tree_for_each_node_dump_array);
+                for(int i = 0; i < array_size; ++i){
+                    dump_array_item(&context,value->_data._array->items[i]);
+                }
             }
 
             if(!compact){
@@ -821,7 +817,7 @@ static inline int tinybuf_json_load_for_map(const char *ptr, int size, tinybuf_v
         //加上冒号偏移量
         total_consumed += consumed;
 
-        tinybuf_value *value = tinybuf_value_alloc();
+        tinybuf_value *value = value_alloc_in(value_arena(map));
         {
             tinybuf_error rr = tinybuf_result_ok(0);
             consumed = tinybuf_value_deserialize_from_json(ptr + total_consumed, size - total_consumed, value, &rr);
@@ -870,7 +866,7 @@ static inline int tinybuf_json_load_for_array(const char *ptr, int size, tinybuf
     int total_consumed = 0;
     while (1) {
         //搜索子对象
-        tinybuf_value *child = tinybuf_value_alloc();
+        tinybuf_value *child = value_alloc_in(value_arena(array));
         int consumed = tinybuf_value_deserialize_from_json_l(ptr + total_consumed, size - total_consumed, child,0);
         if (consumed <= 0) {
             //未找到子对象
@@ -1,13 +1,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 #include "tinybuf_memory.h"
 #include "tinybuf_log.h"
+#include "tb_lock.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef TINYBUF_USE_JEMALLOC
+// jemalloc默认不带前缀 链接后进程内的malloc/free都由它提供
+#include <jemalloc/jemalloc.h>
+#define TB_SYSTEM_ALLOCATOR "jemalloc"
+#else
+#define TB_SYSTEM_ALLOCATOR "malloc"
+#endif
+
+#if defined(_MSC_VER)
+#define TB_THREAD_LOCAL __declspec(thread)
+#else
+#define TB_THREAD_LOCAL _Thread_local
+#endif
 
 static malloc_ptr s_malloc_ptr = NULL;
 static free_ptr s_free_ptr = NULL;
 static realloc_ptr s_realloc_ptr = NULL;
 static strdup_ptr s_strdup_ptr = NULL;
+static malloc64_ptr s_malloc64_ptr = NULL;
+static realloc64_ptr s_realloc64_ptr = NULL;
 
 
 void set_malloc_ptr(malloc_ptr ptr){
@@ -26,9 +49,39 @@ void set_strdup_ptr(strdup_ptr ptr){
     s_strdup_ptr = ptr;
 }
 
-void *tinybuf_malloc(int size){
+void set_malloc64_ptr(malloc64_ptr ptr){
+    s_malloc64_ptr = ptr;
+}
+
+void set_realloc64_ptr(realloc64_ptr ptr){
+    s_realloc64_ptr = ptr;
+}
+
+void *tinybuf_malloc64(size_t size){
+    assert(size);
+    if(s_malloc64_ptr){
+        return s_malloc64_ptr(size);
+    }
+    if(s_malloc_ptr){
+        return size > INT_MAX ? NULL : s_malloc_ptr((int)size);
+    }
+    return malloc(size);
+}
+
+void *tinybuf_realloc64(void *ptr,size_t size){
     assert(size);
-    void *ptr = s_malloc_ptr ? s_malloc_ptr(size) : malloc(size);
+    if(s_realloc64_ptr){
+        return s_realloc64_ptr(ptr,size);
+    }
+    if(s_realloc_ptr){
+        return size > INT_MAX ? NULL : s_realloc_ptr(ptr,(int)size);
+    }
+    return realloc(ptr,size);
+}
+
+void *tinybuf_malloc(int size){
+    assert(size > 0);
+    void *ptr = tinybuf_malloc64((size_t)size);
     assert(ptr);
     return ptr;
 }
@@ -41,8 +94,8 @@ void tinybuf_free(void *ptr){
 }
 
 void *tinybuf_realloc(void *ptr,int size){
-    assert(size);
-    void *ret = s_realloc_ptr ? s_realloc_ptr(ptr,size) : realloc(ptr,size);
+    assert(size > 0);
+    void *ret = tinybuf_realloc64(ptr,(size_t)size);
     assert(ret);
     return ret;
 }
@@ -61,3 +114,270 @@ char *tinybuf_strdup(const char *str){
     assert(ret);
     return ret;
 }
+
+const char *tinybuf_allocator_name(void){
+    return TB_SYSTEM_ALLOCATOR;
+}
+
+///////////////////小对象池/////////////////////////////
+// 对象前没有头 池中的块16字节对齐 来源由地址决定:
+// 每个slab登记在按64K窗口索引的表中 tinybuf_small_free查不到的地址就是直接来自tinybuf_malloc64的
+// 所以池关闭时分配和释放都直接透传 池可以随时开关 之前分配的对象照常释放
+// 空闲块的前两个字分别链接同一批的下一块和全局仓库中的下一批
+
+#define SMALL_ALIGN 16
+#define SMALL_SLAB (64 * 1024)
+#define SMALL_WINDOW_SHIFT 16
+#define SMALL_BATCH 256
+#define SMALL_CLASSES 7
+// slab登记表的槽数 每个slab占1~2个槽 表满后不再切新slab 新对象直接来自堆
+#define SMALL_TABLE_BITS 14
+#define SMALL_TABLE_SIZE (1 << SMALL_TABLE_BITS)
+
+static const uint32_t s_small_sizes[SMALL_CLASSES] = {16, 32, 48, 64, 80, 96, 128};
+
+typedef struct small_block{
+    struct small_block *next;
+    struct small_block *next_batch;
+}small_block;
+
+typedef struct{
+    small_block *head;
+    int count;
+}small_list;
+
+typedef struct{
+    char *base;
+    uint32_t cls;
+}small_slab;
+
+static int s_small_pool = 0;
+static TB_THREAD_LOCAL small_list s_small_local[SMALL_CLASSES];
+// 0 本线程还没有空闲块 1 已登记退出回调 2 已经退出 之后的释放直接交给全局
+static TB_THREAD_LOCAL int s_small_state = 0;
+// 线程空闲块过多时按批交给全局仓库 其他线程取用 仓库中每批正好SMALL_BATCH块
+// 线程退出时链表上的块逐个放入s_small_loose 凑满一批再放入仓库
+static small_block *s_small_depot[SMALL_CLASSES];
+static small_list s_small_loose[SMALL_CLASSES];
+static tb_spinlock_t s_small_lock = 0;
+// 只增不删 在锁内写入 块交给其他线程之前所在的slab已经登记 读取不加锁
+static small_slab s_small_table[SMALL_TABLE_SIZE];
+static int s_small_slabs = 0;
+
+void tinybuf_set_small_pool(int enable){
+    s_small_pool = enable ? 1 : 0;
+}
+
+int tinybuf_is_small_pool(void){
+    return s_small_pool;
+}
+
+static inline int small_class_of(size_t need){
+    for(int i = 0; i < SMALL_CLASSES; ++i){
+        if(need <= s_small_sizes[i]){
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline uint32_t small_window_slot(uintptr_t window){
+    return (uint32_t)((window * 0x9E3779B97F4A7C15ull) >> (64 - SMALL_TABLE_BITS));
+}
+
+// 把slab登记到它覆盖的每个64K窗口 同一窗口可能有前后两个slab 线性探测
+static int small_register(char *base, uint32_t cls){
+    uintptr_t first = (uintptr_t)base >> SMALL_WINDOW_SHIFT;
+    uintptr_t last = ((uintptr_t)base + SMALL_SLAB - 1) >> SMALL_WINDOW_SHIFT;
+    if(s_small_slabs + (int)(last - first + 1) > SMALL_TABLE_SIZE / 2){
+        return -1;
+    }
+    for(uintptr_t w = first; w <= last; ++w){
+        uint32_t i = small_window_slot(w);
+        while(s_small_table[i].base){
+            i = (i + 1) & (SMALL_TABLE_SIZE - 1);
+        }
+        s_small_table[i].cls = cls;
+        s_small_table[i].base = base;
+        ++s_small_slabs;
+    }
+    return 0;
+}
+
+// 返回ptr所在slab的级别 不在池中返回-1
+static inline int small_lookup(const char *ptr){
+    if(!s_small_slabs){
+        return -1;
+    }
+    uintptr_t w = (uintptr_t)ptr >> SMALL_WINDOW_SHIFT;
+    for(uint32_t i = small_window_slot(w);; i = (i + 1) & (SMALL_TABLE_SIZE - 1)){
+        char *base = s_small_table[i].base;
+        if(!base){
+            return -1;
+        }
+        if(ptr >= base && ptr < base + SMALL_SLAB){
+            return (int)s_small_table[i].cls;
+        }
+    }
+}
+
+// 在s_small_lock内调用
+static void small_return_locked(int cls, small_block *head){
+    small_list *loose = &s_small_loose[cls];
+    while(head){
+        small_block *next = head->next;
+        head->next = loose->head;
+        loose->head = head;
+        if(++loose->count == SMALL_BATCH){
+            loose->head->next_batch = s_small_depot[cls];
+            s_small_depot[cls] = loose->head;
+            loose->head = NULL;
+            loose->count = 0;
+        }
+        head = next;
+    }
+}
+
+static void small_thread_exit(void *unused){
+    (void)unused;
+    s_small_state = 2;
+    tb_spinlock_lock(&s_small_lock);
+    for(int cls = 0; cls < SMALL_CLASSES; ++cls){
+        small_return_locked(cls, s_small_local[cls].head);
+        s_small_local[cls].head = NULL;
+        s_small_local[cls].count = 0;
+    }
+    tb_spinlock_unlock(&s_small_lock);
+}
+
+// 线程退出时归还空闲块 与tinybuf_context.c中默认上下文的释放相同 tinybuf_run_workers每次都新建线程
+#ifdef _WIN32
+static DWORD s_small_key = FLS_OUT_OF_INDEXES;
+static INIT_ONCE s_small_key_once = INIT_ONCE_STATIC_INIT;
+static VOID WINAPI small_fls_cb(PVOID unused){ small_thread_exit(unused); }
+static BOOL CALLBACK small_create_key(PINIT_ONCE once, PVOID param, PVOID *out){
+    (void)once;
+    (void)param;
+    (void)out;
+    s_small_key = FlsAlloc(small_fls_cb);
+    return TRUE;
+}
+static void small_track(void){
+    s_small_state = 1;
+    InitOnceExecuteOnce(&s_small_key_once, small_create_key, NULL, NULL);
+    if(s_small_key != FLS_OUT_OF_INDEXES){
+        FlsSetValue(s_small_key, &s_small_state);
+    }
+}
+#else
+static pthread_key_t s_small_key;
+static pthread_once_t s_small_key_once = PTHREAD_ONCE_INIT;
+static void small_create_key(void){
+    pthread_key_create(&s_small_key, small_thread_exit);
+}
+static void small_track(void){
+    s_small_state = 1;
+    pthread_once(&s_small_key_once, small_create_key);
+    pthread_setspecific(s_small_key, &s_small_state);
+}
+#endif
+
+static int small_refill(int cls){
+    small_list *l = &s_small_local[cls];
+    if(s_small_state != 1){
+        if(s_small_state == 2){
+            //其他退出回调中分配 不再建本线程的链表
+            return -1;
+        }
+        small_track();
+    }
+    tb_spinlock_lock(&s_small_lock);
+    small_block *batch = s_small_depot[cls];
+    if(batch){
+        s_small_depot[cls] = batch->next_batch;
+    }
+    tb_spinlock_unlock(&s_small_lock);
+    if(batch){
+        l->head = batch;
+        l->count = SMALL_BATCH;
+        return 0;
+    }
+    //切一块新的slab 不单独释放 替换的分配函数不保证16字节对齐 多申请一点自己对齐
+    char *raw = (char *)tinybuf_malloc64(SMALL_SLAB + SMALL_ALIGN);
+    if(!raw){
+        return -1;
+    }
+    char *slab = (char *)(((uintptr_t)raw + SMALL_ALIGN - 1) & ~(uintptr_t)(SMALL_ALIGN - 1));
+    tb_spinlock_lock(&s_small_lock);
+    int ret = small_register(slab, (uint32_t)cls);
+    tb_spinlock_unlock(&s_small_lock);
+    if(ret < 0){
+        tinybuf_free(raw);
+        return -1;
+    }
+    uint32_t size = s_small_sizes[cls];
+    int n = SMALL_SLAB / (int)size;
+    for(int i = n - 1; i >= 0; --i){
+        small_block *b = (small_block *)(slab + (size_t)i * size);
+        b->next = l->head;
+        l->head = b;
+    }
+    l->count += n;
+    return 0;
+}
+
+void *tinybuf_small_alloc(size_t size){
+    int cls = s_small_pool ? small_class_of(size) : -1;
+    small_list *l = cls < 0 ? NULL : &s_small_local[cls];
+    if(!l || (!l->head && small_refill(cls) < 0)){
+        void *ptr = tinybuf_malloc64(size);
+        assert(ptr);
+        return ptr;
+    }
+    small_block *b = l->head;
+    l->head = b->next;
+    l->count--;
+    return b;
+}
+
+void tinybuf_small_free(void *ptr){
+    if(ptr == NULL){
+        return;
+    }
+    int cls = small_lookup((const char *)ptr);
+    if(cls < 0){
+        tinybuf_free(ptr);
+        return;
+    }
+    small_block *b = (small_block *)ptr;
+    if(s_small_state != 1){
+        if(s_small_state == 2){
+            //本线程的退出回调已经执行 其他退出回调中的释放直接交给全局
+            b->next = NULL;
+            tb_spinlock_lock(&s_small_lock);
+            small_return_locked(cls, b);
+            tb_spinlock_unlock(&s_small_lock);
+            return;
+        }
+        small_track();
+    }
+    small_list *l = &s_small_local[cls];
+    b->next = l->head;
+    l->head = b;
+    if(++l->count < 2 * SMALL_BATCH){
+        return;
+    }
+    //把前SMALL_BATCH块作为一批交出去
+    small_block *last = l->head;
+    for(int i = 1; i < SMALL_BATCH; ++i){
+        last = last->next;
+    }
+    small_block *batch = l->head;
+    l->head = last->next;
+    l->count -= SMALL_BATCH;
+    last->next = NULL;
+    tb_spinlock_lock(&s_small_lock);
+    batch->next_batch = s_small_depot[cls];
+    s_small_depot[cls] = batch;
+    tb_spinlock_unlock(&s_small_lock);
+}
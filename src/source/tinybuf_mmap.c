@@ -0,0 +1,214 @@
+// 以-std=c17编译时<sys/mman.h>默认不声明posix_madvise 需在所有include之前打开POSIX接口
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 只读映射整个文件 长度全部使用int64_t
+// 文件以serialize_part_table开头时打开时解析分区表(见tinybuf_part.c) 读取分区只访问分区表和该分区所在的页
+
+struct T_tinybuf_file
+{
+    const char *data;
+    int64_t size;
+    // 不是分区文件为NULL
+    tinybuf_part_table *parts;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static inline void *mmap_fail(tinybuf_error *r, const char *msg)
+{
+    s_last_error_msg = msg;
+    tinybuf_result_add_msg_const(r, msg);
+    return NULL;
+}
+
+tinybuf_file *tinybuf_file_open_mmap(const char *path, tinybuf_error *r)
+{
+    assert(path);
+    tinybuf_file *f = (tinybuf_file *)tinybuf_malloc(sizeof(tinybuf_file));
+    assert(f);
+    memset(f, 0, sizeof(tinybuf_file));
+#ifdef _WIN32
+    f->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f->file == INVALID_HANDLE_VALUE)
+    {
+        tinybuf_free(f);
+        return mmap_fail(r, "tinybuf_file_open_mmap: open failed");
+    }
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f->file, &sz))
+    {
+        CloseHandle(f->file);
+        tinybuf_free(f);
+        return mmap_fail(r, "tinybuf_file_open_mmap: stat failed");
+    }
+    f->size = (int64_t)sz.QuadPart;
+    if (f->size > 0)
+    {
+        f->mapping = CreateFileMappingA(f->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        f->data = f->mapping ? (const char *)MapViewOfFile(f->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (!f->data)
+        {
+            if (f->mapping)
+                CloseHandle(f->mapping);
+            CloseHandle(f->file);
+            tinybuf_free(f);
+            return mmap_fail(r, "tinybuf_file_open_mmap: map failed");
+        }
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        tinybuf_free(f);
+        return mmap_fail(r, "tinybuf_file_open_mmap: open failed");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        tinybuf_free(f);
+        return mmap_fail(r, "tinybuf_file_open_mmap: stat failed");
+    }
+    f->size = (int64_t)st.st_size;
+    if (f->size > 0)
+    {
+        void *m = mmap(NULL, (size_t)f->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED)
+        {
+            close(fd);
+            tinybuf_free(f);
+            return mmap_fail(r, "tinybuf_file_open_mmap: map failed");
+        }
+        f->data = (const char *)m;
+    }
+    // 映射建立后不再需要fd
+    close(fd);
+#endif
+    if (f->size > 0 && (uint8_t)f->data[0] == serialize_part_table)
+    {
+        buf_ref all = tinybuf_file_buf(f);
+        tinybuf_error ignore = tinybuf_result_ok(0);
+        f->parts = tinybuf_part_table_open(&all, &ignore);
+        tinybuf_result_unref(&ignore);
+    }
+    // 分区文件按分区随机访问 关闭整个文件范围的预读
+    if (f->parts)
+        tinybuf_file_advise(f, 0, f->size, tinybuf_advise_random);
+    return f;
+}
+
+void tinybuf_file_close(tinybuf_file *f)
+{
+    if (!f)
+        return;
+#ifdef _WIN32
+    if (f->data)
+        UnmapViewOfFile(f->data);
+    if (f->mapping)
+        CloseHandle(f->mapping);
+    CloseHandle(f->file);
+#else
+    if (f->data)
+        munmap((void *)f->data, (size_t)f->size);
+#endif
+    tinybuf_part_table_close(f->parts);
+    tinybuf_free(f);
+}
+
+buf_ref tinybuf_file_buf(const tinybuf_file *f)
+{
+    assert(f);
+    buf_ref br = {f->data, f->size, f->data, f->size};
+    return br;
+}
+
+int tinybuf_file_advise(tinybuf_file *f, int64_t offset, int64_t len, tinybuf_advise advice)
+{
+    assert(f);
+    if (offset < 0 || len < 0 || offset > f->size)
+        return -1;
+    if (len > f->size - offset)
+        len = f->size - offset;
+    if (len == 0)
+        return 0;
+#ifdef _WIN32
+    // Windows只有预取 其余提示忽略
+    if (advice == tinybuf_advise_willneed)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range = {(PVOID)(f->data + offset), (SIZE_T)len};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    return 0;
+#else
+    // posix_madvise要求起始地址按页对齐
+    long page = sysconf(_SC_PAGESIZE);
+    int64_t start = offset - offset % page;
+    int how = POSIX_MADV_NORMAL;
+    switch (advice)
+    {
+    case tinybuf_advise_sequential:
+        how = POSIX_MADV_SEQUENTIAL;
+        break;
+    case tinybuf_advise_random:
+        how = POSIX_MADV_RANDOM;
+        break;
+    case tinybuf_advise_willneed:
+        how = POSIX_MADV_WILLNEED;
+        break;
+    default:
+        break;
+    }
+    return posix_madvise((void *)(f->data + start), (size_t)(offset + len - start), how) == 0 ? 0 : -1;
+#endif
+}
+
+int64_t tinybuf_file_part_count(const tinybuf_file *f)
+{
+    assert(f);
+    return f->parts ? tinybuf_part_table_count(f->parts) : -1;
+}
+
+const tinybuf_part_table *tinybuf_file_part_table(const tinybuf_file *f)
+{
+    assert(f);
+    return f->parts;
+}
+
+int tinybuf_file_part_ref(tinybuf_file *f, int64_t index, buf_ref *out, tinybuf_error *r)
+{
+    assert(f);
+    if (!f->parts)
+    {
+        mmap_fail(r, "tinybuf_file_part_ref: not a part file");
+        return -1;
+    }
+    return tinybuf_part_ref(f->parts, index, out, r);
+}
+
+int64_t tinybuf_file_read_part(tinybuf_file *f, int64_t index, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+{
+    buf_ref part;
+    if (tinybuf_file_part_ref(f, index, &part, r) != 0)
+        return -1;
+    // 分区从头到尾解码一次 先整体预取再按顺序读
+    int64_t start = part.base - f->data;
+    tinybuf_file_advise(f, start, part.all_size, tinybuf_advise_willneed);
+    tinybuf_file_advise(f, start, part.all_size, tinybuf_advise_sequential);
+    int64_t rr = tinybuf_try_read_box64(&part, out, contain_handler, r);
+    tinybuf_file_advise(f, start, part.all_size, tinybuf_advise_random);
+    return rr;
+}
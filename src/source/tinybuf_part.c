@@ -0,0 +1,208 @@
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+#include "tb_lock.h"
+#include <limits.h>
+
+// 分区表: [part_table][个数][各分区offset] offset相对于分区表起始
+// 每个分区: [part][内容长度][内容] 内容是单独写出的box 其中的指针和字符串池offset都相对于内容起始
+// 打开后只读 不依赖任何全局读状态 可在多个线程中同时读取不同分区
+
+struct T_tinybuf_part_table
+{
+    const char *base;
+    int64_t size;
+    int64_t count;
+    uint64_t *offs;
+};
+
+static inline void part_fail(tinybuf_error *r, const char *msg)
+{
+    s_last_error_msg = msg;
+    tinybuf_result_add_msg_const(r, msg);
+}
+
+static inline int part_varint(const char *p, int64_t size, uint64_t *out)
+{
+    if (size <= 0)
+    {
+        return 0;
+    }
+    return int_deserialize((const uint8_t *)p, size > INT_MAX ? INT_MAX : (int)size, out);
+}
+
+tinybuf_part_table *tinybuf_part_table_open(const buf_ref *buf, tinybuf_error *r)
+{
+    assert(buf);
+    const char *p = buf->ptr;
+    int64_t size = buf->size;
+    if (size < 1 || (uint8_t)p[0] != serialize_part_table)
+    {
+        part_fail(r, "tinybuf_part_table_open: not a part table");
+        return NULL;
+    }
+    int64_t used = 1;
+    uint64_t count = 0;
+    int n = part_varint(p + used, size - used, &count);
+    // 每个offset至少占一个字节
+    if (n <= 0 || count == 0 || count > (uint64_t)(size - used - n))
+    {
+        part_fail(r, "tinybuf_part_table_open: bad part count");
+        return NULL;
+    }
+    used += n;
+    uint64_t *offs = (uint64_t *)tinybuf_malloc64(sizeof(uint64_t) * (size_t)count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        n = part_varint(p + used, size - used, &offs[i]);
+        if (n <= 0 || offs[i] >= (uint64_t)size)
+        {
+            tinybuf_free(offs);
+            part_fail(r, "tinybuf_part_table_open: bad part offset");
+            return NULL;
+        }
+        used += n;
+    }
+    tinybuf_part_table *t = (tinybuf_part_table *)tinybuf_malloc(sizeof(tinybuf_part_table));
+    assert(t);
+    t->base = p;
+    t->size = size;
+    t->count = (int64_t)count;
+    t->offs = offs;
+    return t;
+}
+
+void tinybuf_part_table_close(tinybuf_part_table *t)
+{
+    if (!t)
+        return;
+    tinybuf_free(t->offs);
+    tinybuf_free(t);
+}
+
+int64_t tinybuf_part_table_count(const tinybuf_part_table *t)
+{
+    assert(t);
+    return t->count;
+}
+
+const uint64_t *tinybuf_part_table_offsets(const tinybuf_part_table *t)
+{
+    assert(t);
+    return t->offs;
+}
+
+int tinybuf_part_ref(const tinybuf_part_table *t, int64_t index, buf_ref *out, tinybuf_error *r)
+{
+    assert(t);
+    assert(out);
+    if (index < 0 || index >= t->count)
+    {
+        part_fail(r, "tinybuf_part_ref: index out of range");
+        return -1;
+    }
+    int64_t off = (int64_t)t->offs[index];
+    if ((uint8_t)t->base[off] != serialize_part)
+    {
+        part_fail(r, "tinybuf_part_ref: not a part");
+        return -1;
+    }
+    uint64_t len = 0;
+    int n = part_varint(t->base + off + 1, t->size - off - 1, &len);
+    int64_t body = off + 1 + n;
+    if (n <= 0 || len > (uint64_t)(t->size - body))
+    {
+        part_fail(r, "tinybuf_part_ref: part truncated");
+        return -1;
+    }
+    out->base = t->base + body;
+    out->all_size = (int64_t)len;
+    out->ptr = out->base;
+    out->size = out->all_size;
+    return 0;
+}
+
+int64_t tinybuf_part_read(const tinybuf_part_table *t, int64_t index, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+{
+    buf_ref part;
+    if (tinybuf_part_ref(t, index, &part, r) != 0)
+        return -1;
+    return tinybuf_try_read_box64(&part, out, contain_handler, r);
+}
+
+// 并行读取: 每个工作线程绑定独立的reader_ctx(strpool解码表/offset池) 按下标领取分区
+typedef struct
+{
+    const tinybuf_part_table *table;
+    const int64_t *indexes;
+    tinybuf_value **outs;
+    CONTAIN_HANDLER contain_handler;
+    int64_t *rets;
+    tinybuf_error *errs;
+    int count;
+    int next;
+    tb_spinlock_t lock;
+} part_read_jobs;
+
+static void run_part_reads(void *arg)
+{
+    part_read_jobs *jobs = (part_read_jobs *)arg;
+    tinybuf_reader_ctx *ctx = tinybuf_reader_ctx_new();
+    tinybuf_reader_ctx *old = tinybuf_reader_ctx_bind(ctx);
+    while (1)
+    {
+        int i;
+        tb_spinlock_lock(&jobs->lock);
+        i = jobs->next++;
+        tb_spinlock_unlock(&jobs->lock);
+        if (i >= jobs->count)
+            break;
+        int64_t index = jobs->indexes ? jobs->indexes[i] : i;
+        jobs->rets[i] = tinybuf_part_read(jobs->table, index, jobs->outs[i], jobs->contain_handler, &jobs->errs[i]);
+    }
+    tinybuf_reader_ctx_bind(old);
+    tinybuf_reader_ctx_free(ctx);
+}
+
+int tinybuf_parts_read_parallel(const tinybuf_part_table *t, const int64_t *indexes, int count, tinybuf_value **outs, int threads, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+{
+    assert(t);
+    assert(outs);
+    if (count <= 0)
+        return 0;
+    if (threads <= 0)
+        threads = tinybuf_cpu_count();
+    if (threads > count)
+        threads = count;
+
+    part_read_jobs jobs;
+    jobs.table = t;
+    jobs.indexes = indexes;
+    jobs.outs = outs;
+    jobs.contain_handler = contain_handler;
+    jobs.count = count;
+    jobs.next = 0;
+    tb_spinlock_init(&jobs.lock);
+    jobs.rets = (int64_t *)tinybuf_malloc(sizeof(int64_t) * count);
+    jobs.errs = (tinybuf_error *)tinybuf_malloc(sizeof(tinybuf_error) * count);
+    for (int i = 0; i < count; ++i)
+        jobs.errs[i] = tinybuf_result_ok(0);
+    tinybuf_run_workers(threads, run_part_reads, &jobs);
+
+    // 按顺序合并结果 只报告第一个失败的分区
+    int rc = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (rc == 0)
+        {
+            tinybuf_result_append_merge(r, &jobs.errs[i], tinybuf_merger_sum);
+            if (jobs.rets[i] <= 0)
+                rc = -1;
+        }
+        tinybuf_result_unref(&jobs.errs[i]);
+    }
+    tinybuf_free(jobs.rets);
+    tinybuf_free(jobs.errs);
+    if (rc != 0)
+        part_fail(r, "tinybuf_parts_read_parallel: part read failed");
+    return rc;
+}
@@ -1,89 +1,182 @@
 #include "tinybuf_private.h"
 #include "tinybuf_buffer.h"
 
-typedef struct { const tinybuf_value *value; buffer *stream; int64_t start; } precache_entry;
-static precache_entry *s_precache = NULL;
-static int s_precache_count = 0;
-static int s_precache_capacity = 0;
-static buffer *s_precache_stream = NULL;
-static int s_precache_redirect = 0; // 当为1时，序列化遇到已注册对象则输出指针而非内容
+// precache状态保存在当前线程的tinybuf_writer_ctx中
+// 按对象地址和内容哈希各建一个开放寻址索引 查找不随注册数量线性增长
 
-static inline void precache_reset(buffer *out)
+static inline void precache_reset(tinybuf_writer_ctx *w, buffer *out)
 {
-    s_precache_stream = out;
-    s_precache_count = 0;
+    w->precache_stream = out;
+    w->precache_count = 0;
+    if(w->precache_slots)
+    {
+        memset(w->precache_slots, 0xff, sizeof(int) * (w->precache_slot_mask + 1));
+        memset(w->precache_hash_slots, 0xff, sizeof(int) * (w->precache_slot_mask + 1));
+    }
+}
+
+// 只有这些类型按内容比较 其余类型tinybuf_value_is_same只认同一个对象
+static inline int precache_comparable(const tinybuf_value *value)
+{
+    switch(value->_type)
+    {
+    case tinybuf_null:
+    case tinybuf_int:
+    case tinybuf_bool:
+    case tinybuf_double:
+    case tinybuf_string:
+    case tinybuf_map:
+    case tinybuf_array:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static inline int precache_addr_slot(const tinybuf_writer_ctx *w, const tinybuf_value *value)
+{
+    return (int)(((uint64_t)(uintptr_t)value * 0x9E3779B97F4A7C15ull) >> 32) & w->precache_slot_mask;
+}
+
+static inline int precache_hash_slot(const tinybuf_writer_ctx *w, uint64_t hash)
+{
+    return (int)(hash & (uint64_t)w->precache_slot_mask);
+}
+
+static void precache_index(tinybuf_writer_ctx *w, int i)
+{
+    int pos = precache_addr_slot(w, w->precache[i].value);
+    while(w->precache_slots[pos] != -1)
+        pos = (pos + 1) & w->precache_slot_mask;
+    w->precache_slots[pos] = i;
+    if(!w->precache[i].hash)
+        return;
+    pos = precache_hash_slot(w, w->precache[i].hash);
+    while(w->precache_hash_slots[pos] != -1)
+        pos = (pos + 1) & w->precache_slot_mask;
+    w->precache_hash_slots[pos] = i;
+}
+
+static void precache_rehash(tinybuf_writer_ctx *w, int slot_count)
+{
+    tinybuf_free(w->precache_slots);
+    tinybuf_free(w->precache_hash_slots);
+    w->precache_slots = (int *)tinybuf_malloc((int)sizeof(int) * slot_count);
+    w->precache_hash_slots = (int *)tinybuf_malloc((int)sizeof(int) * slot_count);
+    memset(w->precache_slots, 0xff, sizeof(int) * slot_count);
+    memset(w->precache_hash_slots, 0xff, sizeof(int) * slot_count);
+    w->precache_slot_mask = slot_count - 1;
+    for(int i = 0; i < w->precache_count; ++i)
+    {
+        precache_index(w, i);
+    }
+}
+
+static inline int precache_find_addr(const tinybuf_writer_ctx *w, const tinybuf_value *value)
+{
+    if(!w->precache_slots)
+        return -1;
+    for(int pos = precache_addr_slot(w, value); w->precache_slots[pos] != -1; pos = (pos + 1) & w->precache_slot_mask)
+    {
+        if(w->precache[w->precache_slots[pos]].value == value)
+            return w->precache_slots[pos];
+    }
+    return -1;
 }
 
-static inline int64_t precache_find_start(buffer *out, const tinybuf_value *value)
+static inline int64_t precache_find_start(tinybuf_writer_ctx *w, buffer *out, const tinybuf_value *value)
 {
-    if(out != s_precache_stream)
+    if(out != w->precache_stream || !w->precache_count)
+    {
+        return -1;
+    }
+    int i = precache_find_addr(w, value);
+    if(i >= 0)
+    {
+        return w->precache[i].start;
+    }
+    if(!w->precache_match_equal || !precache_comparable(value))
     {
         return -1;
     }
-    for(int i=0;i<s_precache_count;++i)
+    // 哈希相同时再比较内容 map/array的哈希有缓存 序列化时逐层查找不会重复遍历子树
+    uint64_t hash = tinybuf_value_hash(value);
+    for(int pos = precache_hash_slot(w, hash); w->precache_hash_slots[pos] != -1; pos = (pos + 1) & w->precache_slot_mask)
     {
-        if(s_precache[i].value == value)
+        const precache_entry *e = &w->precache[w->precache_hash_slots[pos]];
+        if(e->hash == hash && precache_comparable(e->value) && tinybuf_value_is_same(e->value, value))
         {
-            return s_precache[i].start;
+            return e->start;
         }
     }
     return -1;
 }
 
-static inline void precache_add(buffer *out, const tinybuf_value *value, int64_t start)
+static inline void precache_add(tinybuf_writer_ctx *w, buffer *out, const tinybuf_value *value, int64_t start)
 {
-    if(out != s_precache_stream)
+    if(out != w->precache_stream)
     {
-        s_precache_stream = out;
-        s_precache_count = 0;
+        precache_reset(w, out);
     }
-    for(int i=0;i<s_precache_count;++i)
+    int i = precache_find_addr(w, value);
+    if(i >= 0)
     {
-        if(s_precache[i].value == value)
-        {
-            s_precache[i].start = start;
-            return;
-        }
+        w->precache[i].start = start;
+        return;
     }
-    if(s_precache_count == s_precache_capacity)
+    if(w->precache_count == w->precache_capacity)
     {
-        int newcap = s_precache_capacity ? s_precache_capacity*2 : 16;
-        s_precache = (precache_entry*)tinybuf_realloc(s_precache, sizeof(precache_entry)*newcap);
-        s_precache_capacity = newcap;
+        int newcap = w->precache_capacity ? w->precache_capacity*2 : 16;
+        w->precache = (precache_entry*)tinybuf_realloc(w->precache, sizeof(precache_entry)*newcap);
+        w->precache_capacity = newcap;
     }
-    s_precache[s_precache_count].value = value;
-    s_precache[s_precache_count].stream = out;
-    s_precache[s_precache_count].start = start;
-    ++s_precache_count;
+    precache_entry *e = &w->precache[w->precache_count];
+    e->value = value;
+    e->stream = out;
+    e->start = start;
+    e->hash = w->precache_match_equal ? tinybuf_value_hash(value) : 0;
+    // 负载因子保持在1/2以下
+    if(!w->precache_slots || (w->precache_count + 1) * 2 > w->precache_slot_mask + 1)
+    {
+        precache_rehash(w, w->precache_slots ? (w->precache_slot_mask + 1) * 2 : 64);
+    }
+    precache_index(w, w->precache_count);
+    ++w->precache_count;
 }
 
 void tinybuf_precache_reset(buffer *out)
 {
-    precache_reset(out);
+    precache_reset(tinybuf_writer_ctx_current(), out);
 }
 
 int64_t tinybuf_precache_register(buffer *out, const tinybuf_value *value, tinybuf_error *r)
 {
+    tinybuf_writer_ctx *w = tinybuf_writer_ctx_current();
     int64_t start = (int64_t)buffer_get_length_inline(out);
-    precache_add(out, value, start);
-    int old = s_precache_redirect; s_precache_redirect = 0; // 禁用重定向，写入真实内容
+    precache_add(w, out, value, start);
+    int old = w->precache_redirect; w->precache_redirect = 0; // 禁用重定向，写入真实内容
     int before = buffer_get_length_inline(out);
     (void)tinybuf_value_serialize(value, out, r);
     int after = buffer_get_length_inline(out);
-    s_precache_redirect = old;
+    w->precache_redirect = old;
     return (after - before) > 0 ? start : -1;
 }
 
 void tinybuf_precache_set_redirect(int enable)
 {
-    s_precache_redirect = (enable != 0);
+    tinybuf_writer_ctx_current()->precache_redirect = (enable != 0);
+}
+
+void tinybuf_precache_set_match_equal(int enable)
+{
+    tinybuf_writer_ctx_current()->precache_match_equal = (enable != 0);
 }
 
 int tinybuf_precache_is_redirect(void)
 {
-    return s_precache_redirect;
+    return tinybuf_writer_ctx_current()->precache_redirect;
 }
 int64_t tinybuf_precache_find_start_for(buffer *out, const tinybuf_value *value)
 {
-    return precache_find_start(out, value);
+    return precache_find_start(tinybuf_writer_ctx_current(), out, value);
 }
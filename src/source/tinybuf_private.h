@@ -11,28 +11,71 @@
 #include "tinybuf_common.h"
 #include "tinybuf_log.h"
 #include "tinybuf_buffer_private.h"
+#include "tb_lock.h"
 #include <stdbool.h>
 typedef void (*free_handler)(void *);
+// array的连续存储 按下标顺序保存子节点指针
+typedef struct
+{
+    tinybuf_value **items;
+    int count;
+    int capacity;
+    tinybuf_arena *arena; // 不为NULL时items从arena分配 扩容不释放旧的
+    tb_atomic_t shares;   // 除所有者外共享这组子节点的value个数 大于0时只读
+    uint64_t hash;        // tinybuf_value_hash的缓存 所有者的_hash_valid为1时有效
+} tinybuf_value_vec;
+// map的hash后端 见tinybuf_hashmap.c
+typedef struct T_tinybuf_hash_map tinybuf_hash_map;
 // 动态值表示
 struct T_tinybuf_value
 {
     union
     {
-        int64_t _int;
-        int _bool;
-        double _double;
-        buffer *_string;     // 变长缓冲区
-        AVLTree *_map_array; // kvpairs versionlist也会使用此字段保存不同版本的buf引用
-        void *_custom;       // 自定义类型指针 支持任何struct
-        tinybuf_value *_ref; // 引用类型指针 value_ref version都会使用此字段
-    } _data;
-    // 自定义类型的释放函数 不存在时为NULL 表示直接free
-    free_handler _custom_free;
+        struct
+        {
+            union
+            {
+                int64_t _int;
+                int _bool;
+                double _double;
+                buffer *_string;     // 变长缓冲区
+                AVLTree *_map_array; // kvpairs versionlist也会使用此字段保存不同版本的buf引用
+                tinybuf_value_vec *_array; // array 连续存储
+                tinybuf_hash_map *_hash_map; // _map_backend为hash时的map
+                void *_custom;       // 自定义类型指针 支持任何struct
+                tinybuf_value *_ref; // 引用类型指针 value_ref version都会使用此字段
+            } _data;
+            // 自定义类型的释放函数 不存在时为NULL 表示直接free
+            free_handler _custom_free;
+        };
+        // _str_inline时的短字符串 最后一字节为剩余容量 写满时正好是'\0'
+        char _sso[16];
+    };
     tinybuf_type _type;
     int _plugin_index;
     int _custom_box_tag;
+    unsigned char _map_backend; // tinybuf_map_backend 仅map类型有效
+    unsigned char _str_inline;  // string内容在_sso中 没有buffer
+    unsigned char _hash_valid;  // map/array在子节点表上缓存的哈希有效 修改自身或任一后代时清零 见value_touch
+    unsigned char _shared_table; // 子节点表被tinybuf_value_share共享过 成员的_parent为NULL 不缓存哈希 换成私有的表后清零
+    // 节点所属的arena 非NULL时tinybuf_value_free/clear不释放内存 修改时新建的子结构也从这里分配 见tinybuf_arena.c
+    struct T_tinybuf_arena *_arena;
+    // 所在的map/array 由map_set/array_append和_mut接口设置 修改时沿它使祖先的哈希缓存失效
+    tinybuf_value *_parent;
 };
 
+#define TB_SSO_CAPACITY 15
+
+static inline const char *value_str_data(const tinybuf_value *value)
+{
+    return value->_str_inline ? value->_sso : buffer_get_data_inline(value->_data._string);
+}
+
+static inline int64_t value_str_len(const tinybuf_value *value)
+{
+    return value->_str_inline ? TB_SSO_CAPACITY - value->_sso[TB_SSO_CAPACITY] : buffer_get_length_inline(value->_data._string);
+}
+
 // internal types for tensor and advanced values
 typedef struct
 {
@@ -41,7 +84,17 @@ typedef struct
     int64_t *shape;
     void *data;
     int64_t count;
+    // data指向源buffer(native编码零拷贝读取) 不归tensor所有
+    int borrowed;
 } tinybuf_tensor_t;
+
+// 每个元素在内存中的字节数 与tinybuf_value_init_tensor一致
+static inline int tensor_elem_width(int dtype)
+{
+    return dtype == 10 ? 4 : (dtype == 11 ? 1 : 8);
+}
+// tensor的_custom_free 释放shape和自有的data
+void tensor_free(void *tensor);
 typedef struct
 {
     int64_t count;
@@ -99,6 +152,12 @@ typedef enum
     serialize_sparse_tensor = 45,
     serialize_bool_map = 46,
     serialize_name_idx = 48,
+    // 带字节长度的map/array: [type][后续内容的字节长度][count][children] 读取时可以直接跳过整个容器
+    serialize_sized_map = 49,
+    serialize_sized_array = 50,
+    // 主机小端原样存储的tensor: [type][dims][shape...][dtype][pad][pad个0][count*元素宽度]
+    // pad使数据在最终输出中按TENSOR_NATIVE_ALIGN对齐(见writer_ctx的align_shift) 读取时可直接引用源buffer
+    serialize_native_tensor = 51,
     serialize_uri = 52,
     serialize_router_link = 53,
     serialize_extern_str_idx = 253,
@@ -140,7 +199,7 @@ static inline BOOL validate_buf(buf_ref *buf)
 }
 static inline BOOL buf_ptr_ok(buf_ref *buf)
 {
-    return buf->ptr >= buf->base && buf->ptr < buf->base + buf->all_size;
+    return buf->ptr >= buf->base && buf->ptr <= buf->base + buf->all_size; // 允许读到末尾
 }
 #define ENABLE_STRICT_VALIDATE
 static inline void maybe_validate(buf_ref *buf)
@@ -150,38 +209,292 @@ static inline void maybe_validate(buf_ref *buf)
 #endif
 }
 
+// array子节点个数 空数组时_array可能为NULL
+static inline int tinybuf_array_size(const tinybuf_value *value)
+{
+    return value->_data._array ? value->_data._array->count : 0;
+}
+
+// map hash后端
+tinybuf_hash_map *tinybuf_hash_map_new(void);
+// 表结构和key都从arena分配 不能用tinybuf_hash_map_free释放
+tinybuf_hash_map *tinybuf_hash_map_new_arena(tinybuf_arena *arena);
+// 共享后只读 每个持有者各调用一次tinybuf_hash_map_free 最后一次才释放
+void tinybuf_hash_map_share(tinybuf_hash_map *map);
+int tinybuf_hash_map_is_shared(tinybuf_hash_map *map);
+// tinybuf_value_hash的缓存 是否有效由所有者的_hash_valid决定
+uint64_t tinybuf_hash_map_get_hash(const tinybuf_hash_map *map);
+void tinybuf_hash_map_set_hash(tinybuf_hash_map *map, uint64_t hash);
+void tinybuf_hash_map_free(tinybuf_hash_map *map);
+void tinybuf_hash_map_reserve(tinybuf_hash_map *map, int count);
+int tinybuf_hash_map_size(const tinybuf_hash_map *map);
+int tinybuf_hash_map_set(tinybuf_hash_map *map, const char *key, int key_len, tinybuf_value *value);
+tinybuf_value *tinybuf_hash_map_get(const tinybuf_hash_map *map, const char *key, int key_len);
+tinybuf_value *tinybuf_hash_map_at(const tinybuf_hash_map *map, int index, buffer **key);
+
+// 与后端无关的map访问 avl后端按key排序遍历 hash后端按插入顺序遍历
+typedef int (*tinybuf_map_visitor)(void *user_data, buffer *key, tinybuf_value *value);
+void tinybuf_map_init(tinybuf_value *value, tinybuf_map_backend backend);
+int tinybuf_map_size(const tinybuf_value *value);
+tinybuf_value *tinybuf_map_lookup(const tinybuf_value *value, const char *key, int key_len);
+int tinybuf_map_for_each(const tinybuf_value *value, void *user_data, tinybuf_map_visitor visitor);
+
+// 哈希缓存的约定: 节点的缓存有效时其所有后代的缓存也有效
+// 所以修改一个节点时沿_parent向上清零 遇到已失效的祖先即可停止 均摊O(1)
+static inline void value_touch(tinybuf_value *value)
+{
+    value->_hash_valid = 0;
+    for (tinybuf_value *p = value->_parent; p && p->_hash_valid; p = p->_parent)
+    {
+        p->_hash_valid = 0;
+    }
+}
+
+// 子节点加入parent或从parent交给调用方修改
+static inline void value_adopt(tinybuf_value *parent, tinybuf_value *child)
+{
+    child->_parent = parent;
+}
+
+// 节点内容整体搬到value后 让子节点指向新的位置
+void value_adopt_children(tinybuf_value *value);
+// 子节点表开始被多个value共享时调用 成员不再属于某一个所有者 任一所有者释放后也不会留下悬空的_parent
+void value_orphan_children(tinybuf_value *value);
+// 共享结束 value独占子节点表后成员重新指向value 之后又可以缓存哈希
+static inline void value_reclaim_children(tinybuf_value *value)
+{
+    if (value->_shared_table)
+    {
+        value_adopt_children(value);
+        value->_shared_table = 0;
+    }
+}
+
+// map/array缓存在子节点表上的tinybuf_value_hash 没有有效缓存时返回0
+static inline uint64_t value_cached_hash(const tinybuf_value *value)
+{
+    if (!value->_hash_valid)
+    {
+        return 0;
+    }
+    if (value->_type == tinybuf_array)
+    {
+        return value->_data._array->hash;
+    }
+    if (value->_map_backend == tinybuf_map_backend_hash)
+    {
+        return tinybuf_hash_map_get_hash(value->_data._hash_map);
+    }
+    return avl_tree_get_tag(value->_data._map_array);
+}
+
+// 计算时value可能是const 多个线程同时计算同一个对象时写入的都是相同的值
+static inline void value_set_cached_hash(const tinybuf_value *value, uint64_t hash)
+{
+    tinybuf_value *v = (tinybuf_value *)value;
+    if (v->_type == tinybuf_array)
+    {
+        if (!v->_data._array)
+            return;
+        v->_data._array->hash = hash;
+    }
+    else if (v->_type != tinybuf_map || !v->_data._map_array)
+    {
+        return;
+    }
+    else if (v->_map_backend == tinybuf_map_backend_hash)
+    {
+        tinybuf_hash_map_set_hash(v->_data._hash_map, hash);
+    }
+    else
+    {
+        avl_tree_set_tag(v->_data._map_array, hash);
+    }
+    v->_hash_valid = 1;
+}
+
 // internal write helpers used across modules
 int try_write_type(buffer *out, serialize_type type, tinybuf_error *r);
 int try_write_int_data(int isneg, buffer *out, uint64_t val, tinybuf_error *r);
 int try_write_pointer_value(buffer *out, enum offset_type t, int64_t offset, tinybuf_error *r);
 int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_error *r);
+// tinybuf_value_serialize将写入的字节数 失败返回-1 pos为值的最终位置 决定native tensor的填充
+int64_t value_serialized_size(const tinybuf_value *value, int64_t pos);
 int dump_int(uint64_t len, buffer *out);
 
+// 一个值的编码头部 tinybuf_value_deserialize/view/sax/push parser共用的类型分派 见tinybuf_token.c
+typedef struct
+{
+    serialize_type type;
+    int64_t head; // 类型字节及头部占用的字节数
+    // int/pointer的绝对值 string的长度 str_index/name_idx的pool下标 map/array的元素个数
+    // version的版本号 bool_map的位数 str_pool_table的pool offset
+    uint64_t a;
+    // head之后属于这个值的字节数 除sized map/array的子值外都已确认可读
+    // 为-1时需要继续解析: map/array/version的子值 逐元素varint的tensor str_pool_table的body与pool
+    int64_t body;
+    // tensor
+    int dtype;
+    int dims;
+    int64_t count;
+    const char *shape; // dims个varint vector tensor为NULL
+} tinybuf_token;
+// 解析p处值的头部 返回1成功 0数据不足 -1无效
+int tinybuf_token_read(const char *p, int64_t size, tinybuf_token *tok);
+static inline int tinybuf_token_is_pointer(const tinybuf_token *tok)
+{
+    return tok->type >= serialize_pointer_from_current_n && tok->type <= serialize_pointer_from_end_p;
+}
+// 指针指向的位置相对于整个字节流起始的偏移 at为指针本身的偏移 越界返回-1
+int64_t tinybuf_token_pointer_target(const tinybuf_token *tok, int64_t at, int64_t all_size);
+// tensor的shape写入shape(至少dims个) 返回dims
+int tinybuf_token_shape(const tinybuf_token *tok, int64_t *shape);
+// count个逐元素varint的tensor数据长度 0数据不足 -1无效
+int64_t tinybuf_token_varint_body(const char *p, int64_t size, int64_t count);
+// 一个值编码占用的字节数 0数据不足 -1无效或无法确定(str_pool_table)
+int64_t tinybuf_value_skip(const char *p, int64_t size);
+
 // internal read helpers used across modules
 int buf_offset(buf_ref *buf, int64_t offset);
 int try_read_type(buf_ref *buf, serialize_type *type, tinybuf_error *r);
-int try_read_int_tovar(BOOL isneg, const char *ptr, int size, QWORD *out_val);
+int try_read_int_tovar(BOOL isneg, const char *ptr, int64_t size, QWORD *out_val);
 int int_deserialize(const uint8_t *in, int in_size, uint64_t *out);
 int optional_add(int x, int addx);
 int int_serialize(uint64_t in, uint8_t *out);
-int dump_string(int len, const char *str, buffer *out);
-int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER target_version, tinybuf_error *r);
+int64_t dump_string(int64_t len, const char *str, buffer *out);
+int64_t try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER target_version, tinybuf_error *r);
 int tinybuf_value_deserialize(const char *ptr, int size, tinybuf_value *out, tinybuf_error *r);
 const char *tinybuf_last_error_message(void);
 int contain_any(uint64_t v);
 uint32_t load_be32(const void *p);
 double read_double(uint8_t *ptr);
+// 大端编码与主机字节序之间整段转换count个4/8字节元素 见tinybuf_bswap.c
+void tensor_bswap32_copy(void *dst, const void *src, int64_t count);
+void tensor_bswap64_copy(void *dst, const void *src, int64_t count);
+// 小端存储与主机字节序之间的转换 小端主机上就是memcpy
+void tensor_le_copy(void *dst, const void *src, int64_t count, int width);
+int tensor_host_little_endian(void);
+
+#if defined(_MSC_VER)
+#define TB_THREAD_LOCAL __declspec(thread)
+#else
+#define TB_THREAD_LOCAL _Thread_local
+#endif
+
+// 读写上下文 之前散落在各文件中的进程全局状态 见tinybuf_context.c
+typedef struct
+{
+    buffer *buf;
+    uint32_t hash;
+} strpool_entry;
+typedef struct
+{
+    const char *data;
+    int len;
+} strpool_view;
+typedef struct
+{
+    const tinybuf_value *value;
+    buffer *stream;
+    int64_t start;
+    uint64_t hash; // 仅precache_match_equal时计算 注册时的tinybuf_value_hash 按它建索引
+} precache_entry;
+typedef struct
+{
+    int64_t offset;
+    tinybuf_value *value;
+    int complete;
+} offset_pool_entry;
+
+struct T_tinybuf_writer_ctx
+{
+    // strpool 写入时的字符串表及其hash索引
+    strpool_entry *strpool;
+    int strpool_count;
+    int strpool_capacity;
+    int *strpool_slots;
+    int strpool_slot_mask;
+    // precache
+    precache_entry *precache;
+    int precache_count;
+    int precache_capacity;
+    // 开放寻址索引 -1为空 其余为precache下标 precache_slots按对象地址 precache_hash_slots按内容哈希
+    int *precache_slots;
+    int *precache_hash_slots;
+    int precache_slot_mask;
+    buffer *precache_stream;
+    int precache_redirect; // 当为1时，序列化遇到已注册对象则输出指针而非内容
+    int precache_match_equal; // 当为1时，与已注册对象内容相同的值也输出指针
+    // 写入out的位置pos最终位于pos + align_shift native tensor按最终位置对齐
+    // 先写入临时buffer再拼接的part在写body前设置
+    int64_t align_shift;
+};
 
-// shared strpool read state for dumping
-extern int64_t s_strpool_offset_read;
-extern const char *s_strpool_base_read;
-extern const char *s_last_error_msg;
+struct T_tinybuf_reader_ctx
+{
+    // 当前box的strpool位置
+    const char *strpool_base;
+    int64_t strpool_offset;
+    // strpool解码表
+    const char *pool_start;
+    strpool_view *views;
+    int view_count;
+    int view_capacity;
+    int views_truncated;
+    char *text; // trie pool还原出的字符串
+    int text_capacity;
+    char *trie_scratch; // 解码trie pool用的临时数组
+    int64_t trie_scratch_capacity;
+    // 解码表只在一次读取内有效 接收内存被复用时地址相同内容不同
+    // read_gen为这个线程当前读取的编号 由进程内的计数器分配 pool_gen为解码表所属的读取
+    uint32_t read_gen;
+    uint32_t pool_gen;
+    // 指针解析用的offset pool 只在一次读取内有效
+    offset_pool_entry *offset_pool;
+    int offset_pool_count;
+    int offset_pool_capacity;
+    int *offset_pool_slots;
+    int offset_pool_slot_mask;
+    int read_depth;
+    int pointer_depth;
+};
+
+// 当前线程绑定的上下文 未绑定时为线程自己的默认上下文
+tinybuf_writer_ctx *tinybuf_writer_ctx_current(void);
+tinybuf_reader_ctx *tinybuf_reader_ctx_current(void);
+// 简单的并行执行 见tinybuf_context.c
+int tinybuf_cpu_count(void);
+void tinybuf_run_workers(int threads, void (*fn)(void *), void *arg);
+
+extern TB_THREAD_LOCAL const char *s_last_error_msg;
+
+// arena 见tinybuf_arena.c
+extern TB_THREAD_LOCAL tinybuf_arena *s_value_arena;
+void *tinybuf_arena_alloc(tinybuf_arena *arena, size_t size);
+// 结构体和数据都在arena中的只读buffer
+buffer *tinybuf_arena_buffer(tinybuf_arena *arena, const char *data, int64_t len);
+// arena中持有堆上payload的节点 reset时释放payload
+void tinybuf_arena_track(tinybuf_arena *arena, tinybuf_value *value);
+void tinybuf_value_release_payload(tinybuf_value *value);
+// 新建的子结构应使用的arena 即节点所属的arena 与当前线程绑定的arena无关 堆上的节点为NULL
+static inline tinybuf_arena *value_arena(const tinybuf_value *value)
+{
+    return value->_arena;
+}
+// 在arena中(NULL时在堆上)新建节点 tinybuf_value_alloc使用线程绑定的arena
+tinybuf_value *value_alloc_in(tinybuf_arena *arena);
+// 克隆到arena中 子节点也在同一arena share为1时同tinybuf_value_share
+tinybuf_value *value_clone_in(const tinybuf_value *value, int share, tinybuf_arena *arena);
+// 按owner所在的位置新建字符串buffer
+buffer *value_buffer_new(const tinybuf_value *owner, const char *data, int64_t len);
+// 按owner所在的位置新建map的key 堆上时结构体和数据一次分配
+buffer *value_key_new(const tinybuf_value *owner, const char *data, int64_t len);
 
 #define SET_FAILED(s) (reason = s, s_last_error_msg = s, failed = TRUE)
 #define SET_SUCCESS() (failed = FALSE, reason = NULL, s_last_error_msg = NULL)
 #define CHECK_FAILED (failed && buf_offset(buf, -len));
 #define INIT_STATE       \
-    int len = 0;         \
+    int64_t len = 0;     \
     BOOL failed = FALSE; \
     const char *reason = NULL;
 #define READ_RETURN return (failed ? -1 : len);
@@ -196,17 +509,36 @@ void tinybuf_precache_set_redirect(int enable);
 int tinybuf_precache_is_redirect(void);
 int64_t tinybuf_precache_find_start_for(buffer *out, const tinybuf_value *value);
 // internal write APIs
-int try_write_box(buffer *out, const tinybuf_value *value, tinybuf_error *r);
+int64_t try_write_box(buffer *out, const tinybuf_value *value, tinybuf_error *r);
 int try_write_version_box(buffer *out, uint64_t version, const tinybuf_value *box, tinybuf_error *r);
 int try_write_version_list(buffer *out, const uint64_t *versions, const tinybuf_value **boxes, int count, tinybuf_error *r);
 int try_write_plugin_map_table(buffer *out, tinybuf_error *r);
-int try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r);
-int try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r);
+int64_t try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r);
+int64_t try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r);
 
 // string pool (write side)
 extern int s_use_strpool;
+extern int s_strpool_fixed_offset;
+extern int s_sized_container_min_count;
+#define TENSOR_NATIVE_ALIGN 64
+// int_deserialize接受的最长varint native模式下长度字段按此宽度预留 写完后回填不移动数据
+#define VARINT_MAX_WIDTH 9
+extern int s_tensor_native;
+// pad字节位于最终位置pos时 使其后的数据对齐所需的填充长度
+static inline int native_tensor_pad(int64_t pos)
+{
+    return (int)((TENSOR_NATIVE_ALIGN - (pos + 1) % TENSOR_NATIVE_ALIGN) % TENSOR_NATIVE_ALIGN);
+}
+extern int s_tensor_zero_copy;
 void strpool_reset_write(const buffer *out);
 int strpool_add(const char *data, int len);
 int strpool_write_tail(buffer *out, tinybuf_error *r);
+// read side pool表 pool_size为pool_start之后可读的字节数 返回1找到 0数据不足 -1无效
+void strpool_read_reset(void);
+// 新一次读取开始 返回这次读取的编号 之前解码的表不再使用
+uint32_t strpool_read_begin(void);
+// 当前读取的编号 嵌套在try_read_box中的查找使用
+uint32_t strpool_read_gen(void);
+int strpool_read_lookup(const char *pool_start, int64_t pool_size, uint32_t gen, uint64_t idx, const char **data, int *len);
 
 #endif // TINYBUF_PRIVATE_H
@@ -1,18 +1,8 @@
 #include "tinybuf_private.h"
+#include <limits.h>
 #include "tinybuf_buffer.h"
 #include "tinybuf_plugin.h"
-#ifdef _WIN32
-#include <windows.h>
-static volatile LONG s_pool_lock_var = 0;
-#else
-#include <stdatomic.h>
-#include <time.h>
-#include <sched.h>
-static atomic_flag s_pool_lock_var = ATOMIC_FLAG_INIT;
-#endif
 
-static inline void pool_lock(void);
-static inline void pool_unlock(void);
 static inline BOOL is_simple_pointer_type(serialize_type type);
 static inline bool is_pointer_neg(serialize_type type);
 static inline enum offset_type get_offset_type(serialize_type type);
@@ -24,8 +14,6 @@ const char *buf_end_ptr(buf_ref *buf)
 {
     return buf->base + buf->all_size;
 }
-int64_t s_strpool_offset_read = -1;
-const char *s_strpool_base_read = NULL;
 int64_t buf_current_offset(const buf_ref *buf)
 {
     return buf->ptr - buf->base;
@@ -87,102 +75,142 @@ typedef struct
 } read_result;
 #define RESULT_OK(x) (x.len > 0)
 
-typedef struct
+// offset池属于当前线程的tinybuf_reader_ctx 一个ctx同一时间只被一个线程使用 无需加锁
+// 池只在一次读取内有效 最外层读取开始时清空 offset通过开放寻址hash索引 slots中-1为空 其余为offset_pool下标
+
+static inline uint32_t pool_hash(int64_t offset)
 {
-    int64_t offset;
-    tinybuf_value *value;
-    int complete;
-} offset_pool_entry;
-static const char *s_pool_base = NULL;
-static offset_pool_entry *s_pool = NULL;
-static int s_pool_count = 0;
-static int s_pool_capacity = 0;
+    return (uint32_t)(((uint64_t)offset * 0x9E3779B97F4A7C15ull) >> 32);
+}
 
-static inline void pool_reset(const buf_ref *buf)
+static void pool_rehash(tinybuf_reader_ctx *c, int slot_count)
 {
-    if (s_pool_base != buf->base)
+    tinybuf_free(c->offset_pool_slots);
+    c->offset_pool_slots = (int *)tinybuf_malloc((int)sizeof(int) * slot_count);
+    assert(c->offset_pool_slots);
+    memset(c->offset_pool_slots, 0xff, sizeof(int) * slot_count);
+    c->offset_pool_slot_mask = slot_count - 1;
+    for (int i = 0; i < c->offset_pool_count; ++i)
     {
-        if (s_pool)
+        int pos = (int)(pool_hash(c->offset_pool[i].offset) & (uint32_t)c->offset_pool_slot_mask);
+        while (c->offset_pool_slots[pos] != -1)
         {
-            tinybuf_free(s_pool);
-            s_pool = NULL;
-            s_pool_capacity = 0;
+            pos = (pos + 1) & c->offset_pool_slot_mask;
         }
-        s_pool_base = buf->base;
+        c->offset_pool_slots[pos] = i;
     }
-    s_pool_count = 0;
 }
 
-const char *tinybuf_last_error_message(void);
-
-static inline offset_pool_entry *pool_find(int64_t offset)
+// 找到时返回offset_pool下标 否则返回-1-空slot位置
+static inline int pool_slot_of(const tinybuf_reader_ctx *c, int64_t offset)
 {
-    pool_lock();
-    for (int i = 0; i < s_pool_count; ++i)
+    if (!c->offset_pool_slots)
+    {
+        return -1;
+    }
+    int pos = (int)(pool_hash(offset) & (uint32_t)c->offset_pool_slot_mask);
+    while (c->offset_pool_slots[pos] != -1)
     {
-        if (s_pool[i].offset == offset)
+        int idx = c->offset_pool_slots[pos];
+        if (c->offset_pool[idx].offset == offset)
         {
-            offset_pool_entry *ret = &s_pool[i];
-            pool_unlock();
-            return ret;
+            return idx;
         }
+        pos = (pos + 1) & c->offset_pool_slot_mask;
     }
-    pool_unlock();
-    return NULL;
+    return -1 - pos;
 }
 
-static offset_pool_entry *pool_register(int64_t offset, tinybuf_value *value)
+static inline void pool_reset(void)
 {
-    pool_lock();
-    offset_pool_entry *e = NULL;
-    for (int i = 0; i < s_pool_count; ++i)
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    if (c->offset_pool_count && c->offset_pool_slots)
     {
-        if (s_pool[i].offset == offset)
+        if (c->offset_pool_count * 8 > c->offset_pool_slot_mask + 1)
         {
-            e = &s_pool[i];
-            break;
+            memset(c->offset_pool_slots, 0xff, sizeof(int) * (c->offset_pool_slot_mask + 1));
+        }
+        else
+        {
+            // 之前读过大文档时slots会很大 小读取只清掉用过的slot
+            for (int i = 0; i < c->offset_pool_count; ++i)
+            {
+                int pos = (int)(pool_hash(c->offset_pool[i].offset) & (uint32_t)c->offset_pool_slot_mask);
+                while (c->offset_pool_slots[pos] != i)
+                {
+                    pos = (pos + 1) & c->offset_pool_slot_mask;
+                }
+                c->offset_pool_slots[pos] = -1;
+            }
         }
     }
-    if (e)
+    c->offset_pool_count = 0;
+}
+
+// 最外层读取的开始与结束 嵌套调用(指针/插件/分区)共用同一个池
+static inline void read_scope_begin(void)
+{
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    if (c->read_depth++ == 0)
     {
+        pool_reset();
+        strpool_read_begin();
+    }
+}
+
+static inline void read_scope_end(void)
+{
+    tinybuf_reader_ctx_current()->read_depth--;
+}
+
+const char *tinybuf_last_error_message(void);
+
+static inline offset_pool_entry *pool_find(int64_t offset)
+{
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    int idx = pool_slot_of(c, offset);
+    return idx >= 0 ? &c->offset_pool[idx] : NULL;
+}
+
+static offset_pool_entry *pool_register(int64_t offset, tinybuf_value *value)
+{
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    int idx = pool_slot_of(c, offset);
+    if (idx >= 0)
+    {
+        offset_pool_entry *e = &c->offset_pool[idx];
         if (value)
         {
             e->value = value;
         }
-        pool_unlock();
         return e;
     }
-    if (s_pool_count == s_pool_capacity)
+    // 负载因子保持在1/2以下
+    if (!c->offset_pool_slots || (c->offset_pool_count + 1) * 2 > c->offset_pool_slot_mask + 1)
+    {
+        pool_rehash(c, c->offset_pool_slots ? (c->offset_pool_slot_mask + 1) * 2 : 64);
+        idx = pool_slot_of(c, offset);
+    }
+    if (c->offset_pool_count == c->offset_pool_capacity)
     {
-        int newcap = s_pool_capacity ? (s_pool_capacity * 2) : 16;
-        s_pool = (offset_pool_entry *)tinybuf_realloc(s_pool, sizeof(offset_pool_entry) * newcap);
-        s_pool_capacity = newcap;
+        int newcap = c->offset_pool_capacity ? (c->offset_pool_capacity * 2) : 16;
+        c->offset_pool = (offset_pool_entry *)tinybuf_realloc(c->offset_pool, sizeof(offset_pool_entry) * newcap);
+        c->offset_pool_capacity = newcap;
     }
-    s_pool[s_pool_count].offset = offset;
-    s_pool[s_pool_count].value = value;
-    s_pool[s_pool_count].complete = 0;
-    offset_pool_entry *ret = &s_pool[s_pool_count++];
-    pool_unlock();
-    return ret;
+    c->offset_pool[c->offset_pool_count].offset = offset;
+    c->offset_pool[c->offset_pool_count].value = value;
+    c->offset_pool[c->offset_pool_count].complete = 0;
+    c->offset_pool_slots[-1 - idx] = c->offset_pool_count;
+    return &c->offset_pool[c->offset_pool_count++];
 }
 
 static inline void pool_mark_complete(int64_t offset)
 {
-    pool_lock();
-    offset_pool_entry *e = NULL;
-    for (int i = 0; i < s_pool_count; ++i)
-    {
-        if (s_pool[i].offset == offset)
-        {
-            e = &s_pool[i];
-            break;
-        }
-    }
+    offset_pool_entry *e = pool_find(offset);
     if (e)
     {
         e->complete = 1;
     }
-    pool_unlock();
 }
 
 static inline void set_out_ref(tinybuf_value *out, tinybuf_value *target)
@@ -192,10 +220,18 @@ static inline void set_out_ref(tinybuf_value *out, tinybuf_value *target)
 }
 static inline void set_out_deref(tinybuf_value *out, const tinybuf_value *target)
 {
-    tinybuf_value *clone = tinybuf_value_clone(target);
+    // 克隆到out所属的arena 子节点与out一起释放
+    tinybuf_value *clone = value_clone_in(target, 0, value_arena(out));
     tinybuf_value_clear(out);
+    tinybuf_arena *arena = out->_arena;
+    tinybuf_value *parent = out->_parent;
     memcpy(out, clone, sizeof(tinybuf_value));
-    tinybuf_free(clone);
+    out->_arena = arena;
+    out->_parent = parent;
+    // 子节点原来挂在clone上
+    value_adopt_children(out);
+    if (!arena)
+        tinybuf_small_free(clone);
 }
 static inline void set_out_by_mode(tinybuf_value *out, tinybuf_value *target, int deref)
 {
@@ -205,7 +241,7 @@ static inline void set_out_by_mode(tinybuf_value *out, tinybuf_value *target, in
         set_out_ref(out, target);
 }
 
-int _read_box_by_offset(buf_ref *buf, int64_t offset, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+int64_t _read_box_by_offset(buf_ref *buf, int64_t offset, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
 {
     INIT_STATE
     const char *cur = buf->ptr;
@@ -213,7 +249,7 @@ int _read_box_by_offset(buf_ref *buf, int64_t offset, tinybuf_value *out, CONTAI
     buf->ptr = buf->base + offset;
     buf->size = buf->all_size - offset;
     pool_register(offset, out);
-    int rr = try_read_box(buf, out, contain_handler, r);
+    int64_t rr = try_read_box(buf, out, contain_handler, r);
     buf->ptr = cur;
     buf->size = cursize;
     if (rr > 0)
@@ -224,25 +260,25 @@ int _read_box_by_offset(buf_ref *buf, int64_t offset, tinybuf_value *out, CONTAI
     return rr;
 }
 
-int read_box_by_pointer(buf_ref *buf, pointer_value pointer, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+int64_t read_box_by_pointer(buf_ref *buf, pointer_value pointer, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
 {
-    static int s_read_pointer_depth = 0;
-    s_read_pointer_depth++;
-    int rr = -1;
-    if (s_read_pointer_depth <= 64)
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    c->pointer_depth++;
+    int64_t rr = -1;
+    if (c->pointer_depth <= 64)
     {
         pointer_to_start(buf, &pointer);
         assert(pointer.type == start);
         rr = _read_box_by_offset(buf, pointer.offset, out, contain_handler, r);
     }
-    s_read_pointer_depth--;
+    c->pointer_depth--;
     return rr;
 }
 
 static inline int try_read_int_data(BOOL isneg, buf_ref *buf, QWORD *out, tinybuf_error *r)
 {
     INIT_STATE
-    int temp = try_read_int_tovar(isneg, buf->ptr, (int)buf->size, out);
+    int temp = try_read_int_tovar(isneg, buf->ptr, buf->size, out);
     if (temp > 0)
     {
         len += temp;
@@ -365,35 +401,75 @@ inline int try_read_pointer(buf_ref *buf, pointer_value *pointer, tinybuf_error
 int tinybuf_try_read_box_with_mode(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_read_pointer_mode mode, tinybuf_error *r)
 {
     (void)mode;
-    int n = try_read_box(buf, out, contain_handler, r);
+    read_scope_begin();
+    int64_t n = try_read_box(buf, out, contain_handler, r);
+    read_scope_end();
+    if (n > INT_MAX)
+    {
+        s_last_error_msg = "box larger than 2GB, use tinybuf_try_read_box64";
+        tinybuf_result_add_msg_const(r, s_last_error_msg);
+        return -1;
+    }
     if (n > 0)
     {
-        r->res = n;
-        return n;
+        r->res = (int)n;
+        return (int)n;
     }
     tinybuf_result_add_msg_const(r, "tinybuf_try_read_box_with_mode_r");
-    return n;
+    return (int)n;
 }
 
-int tinybuf_try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+int64_t tinybuf_try_read_box64(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
 {
-    s_strpool_base_read = buf->base;
-    int n = try_read_box(buf, out, contain_handler, r);
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    if (c->strpool_base != buf->base)
+    {
+        c->strpool_base = buf->base;
+        strpool_read_reset();
+    }
+    read_scope_begin();
+    int64_t n = try_read_box(buf, out, contain_handler, r);
+    read_scope_end();
     if (n > 0)
     {
-        r->res = n;
+        r->res = n > INT_MAX ? INT_MAX : (int)n;
         return n;
     }
     tinybuf_result_add_msg_const(r, "tinybuf_try_read_box_r");
     return n;
 }
 
-int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+int tinybuf_try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+{
+    buf_ref saved = *buf;
+    int64_t n = tinybuf_try_read_box64(buf, out, contain_handler, r);
+    if (n > INT_MAX)
+    {
+        // 返回值放不下 不移动buf
+        *buf = saved;
+        s_last_error_msg = "box larger than 2GB, use tinybuf_try_read_box64";
+        tinybuf_result_add_msg_const(r, s_last_error_msg);
+        return -1;
+    }
+    return (int)n;
+}
+
+int tinybuf_try_read_box_ctx(tinybuf_reader_ctx *ctx, buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
+{
+    assert(ctx);
+    tinybuf_reader_ctx *old = tinybuf_reader_ctx_bind(ctx);
+    int n = tinybuf_try_read_box(buf, out, contain_handler, r);
+    tinybuf_reader_ctx_bind(old);
+    return n;
+}
+
+int64_t try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r)
 {
     INIT_STATE
     tinybuf_result_add_msg_const(r, "try_read_box");
-    if (!s_strpool_base_read)
-        s_strpool_base_read = buf->base;
+    tinybuf_reader_ctx *rc = tinybuf_reader_ctx_current();
+    if (!rc->strpool_base)
+        rc->strpool_base = buf->base;
     if (buf->size >= 1 && (uint8_t)buf->ptr[0] == serialize_str_pool_table)
     {
         buf_ref hb = *buf;
@@ -405,7 +481,8 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
             int c2 = try_read_int_data(FALSE, &hb, &off, r);
             if (c2 > 0)
             {
-                s_strpool_offset_read = (int64_t)off;
+                rc->strpool_offset = (int64_t)off;
+                strpool_read_reset();
                 buf_offset(buf, c + c2);
             }
         }
@@ -414,7 +491,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
     pool_register(box_offset, out);
     {
         tinybuf_error rr_local = tinybuf_result_ok(0);
-        int l0 = tinybuf_value_deserialize(buf->ptr, (int)buf->size, out, &rr_local);
+        int64_t l0 = tinybuf_value_deserialize64(buf->ptr, buf->size, out, &rr_local);
         if (l0 > 0)
         {
             buf_offset(buf, l0);
@@ -435,6 +512,44 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
             len += rt_main;
             switch (type)
             {
+            case serialize_pointer_from_current_n:
+            case serialize_pointer_from_start_n:
+            case serialize_pointer_from_end_n:
+            case serialize_pointer_from_current_p:
+            case serialize_pointer_from_start_p:
+            case serialize_pointer_from_end_p:
+            {
+                QWORD mag = 0;
+                int rp = try_read_int_data(FALSE, buf, &mag, r);
+                if (rp <= 0)
+                {
+                    SET_FAILED("read pointer failed");
+                    break;
+                }
+                len += rp;
+                pointer_value pv;
+                pv.offset = is_pointer_neg(type) ? -(int64_t)mag : (int64_t)mag;
+                pv.type = get_offset_type(type);
+                pointer_to_start(buf, &pv);
+                if (pv.offset < 0 || pv.offset >= buf->all_size)
+                {
+                    SET_FAILED("pointer out of range");
+                    break;
+                }
+                // 目标还在读取中说明形成了环 输出引用 否则重新读取目标内容
+                offset_pool_entry *target = pool_find(pv.offset);
+                if (target && !target->complete && target->value)
+                {
+                    set_out_ref(out, target->value);
+                }
+                else if (read_box_by_pointer(buf, pv, out, contain_handler, r) <= 0)
+                {
+                    SET_FAILED("read pointer target failed");
+                    break;
+                }
+                pool_mark_complete(box_offset);
+                return len;
+            }
             case serialize_version:
             {
                 QWORD version;
@@ -454,7 +569,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                     if (contain_handler(version))
                     {
                         {
-                            int rr2 = try_read_box(buf, out, contain_handler, r);
+                            int64_t rr2 = try_read_box(buf, out, contain_handler, r);
                             if (rr2 > 0)
                             {
                                 len += rr2;
@@ -507,7 +622,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                         {
                             if (contain_handler(version))
                             {
-                                int inner = try_read_box(buf, out, contain_handler, r);
+                                int64_t inner = try_read_box(buf, out, contain_handler, r);
                                 if (inner > 0)
                                 {
                                     len += inner;
@@ -522,7 +637,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                             else
                             {
                                 tinybuf_value *skip = tinybuf_value_alloc();
-                                int consumed = try_read_box(buf, skip, contain_handler, r);
+                                int64_t consumed = try_read_box(buf, skip, contain_handler, r);
                                 if (consumed <= 0)
                                 {
                                     tinybuf_value_free(skip);
@@ -559,7 +674,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                 }
                 {
                     {
-                        int rr3 = try_read_box(buf, out, contain_handler, r);
+                        int64_t rr3 = try_read_box(buf, out, contain_handler, r);
                         if (rr3 > 0)
                         {
                             len += rr3;
@@ -595,7 +710,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                         SET_FAILED("empty part table");
                         break;
                     }
-                    QWORD *offs = (QWORD *)tinybuf_malloc((int)(cnt * sizeof(QWORD)));
+                    QWORD *offs = (QWORD *)tinybuf_malloc64((size_t)(cnt * sizeof(QWORD)));
                     for (QWORD i = 0; i < cnt; ++i)
                     {
                         QWORD off = 0;
@@ -615,7 +730,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                         }
                     }
                     {
-                        int rbo = _read_box_by_offset(buf, (int64_t)offs[0], out, contain_handler, r);
+                        int64_t rbo = _read_box_by_offset(buf, (int64_t)offs[0], out, contain_handler, r);
                         if (rbo > 0)
                         {
                             pool_mark_complete(box_offset);
@@ -655,7 +770,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                 }
                 len += blen_read;
                 {
-                    const char *body_end = s_strpool_base_read ? (s_strpool_base_read + s_strpool_offset_read) : NULL;
+                    const char *body_end = rc->strpool_base ? (rc->strpool_base + rc->strpool_offset) : NULL;
                     if (body_end && body_end >= buf->ptr)
                     {
                         int64_t body_rem = (int64_t)(body_end - buf->ptr);
@@ -676,155 +791,24 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                     SET_FAILED("payload too small");
                     break;
                 }
-                if (s_strpool_offset_read < 0 || s_strpool_base_read == NULL)
+                if (rc->strpool_offset < 0 || rc->strpool_base == NULL)
                 {
                     s_last_error_msg = "strpool not initialized";
                     SET_FAILED("strpool not initialized");
                     break;
                 }
-                const char *pool_start = s_strpool_base_read + s_strpool_offset_read;
-                const char *q = pool_start;
+                const char *pool_start = rc->strpool_base + rc->strpool_offset;
                 int64_t rem = ((const char *)buf->ptr + buf->size) - pool_start;
                 char *name_out = NULL;
                 int name_len = 0;
-                if (rem > 0)
                 {
-                    if ((uint8_t)q[0] == serialize_str_pool)
-                    {
-                        tinybuf_result_add_msg_const(r, "pool=flat");
-                        ++q;
-                        --rem;
-                        QWORD cnt = 0;
-                        int l2 = try_read_int_tovar(FALSE, q, (int)rem, &cnt);
-                        if (l2 > 0)
-                        {
-                            q += l2;
-                            rem -= l2;
-                            for (QWORD i = 0; i < cnt; ++i)
-                            {
-                                if (rem < 1)
-                                    break;
-                                if ((uint8_t)q[0] != serialize_string)
-                                    break;
-                                ++q;
-                                --rem;
-                                QWORD sl = 0;
-                                int l3 = try_read_int_tovar(FALSE, q, (int)rem, &sl);
-                                if (l3 <= 0)
-                                    break;
-                                q += l3;
-                                rem -= l3;
-                                if (rem < (int64_t)sl)
-                                    break;
-                                if (i == idx)
-                                {
-                                    name_out = (char *)tinybuf_malloc((int)sl + 1);
-                                    memcpy(name_out, q, (size_t)sl);
-                                    name_out[sl] = '\0';
-                                    name_len = (int)sl;
-                                    break;
-                                }
-                                q += sl;
-                                rem -= sl;
-                            }
-                        }
-                    }
-                    else if ((uint8_t)q[0] == serialize_str_trie_pool)
+                    const char *str = NULL;
+                    if (strpool_read_lookup(pool_start, rem, strpool_read_gen(), idx, &str, &name_len) > 0)
                     {
-                        tinybuf_result_add_msg_const(r, "pool=trie");
-                        ++q;
-                        --rem;
-                        QWORD ncount = 0;
-                        int l2 = try_read_int_tovar(FALSE, q, (int)rem, &ncount);
-                        if (l2 > 0)
-                        {
-                            const char *nodes_base = q + l2;
-                            int64_t nodes_size = rem - l2;
-                            const char *p = nodes_base;
-                            int64_t rr = nodes_size;
-                            int found = -1;
-                            for (QWORD i = 0; i < ncount; ++i)
-                            {
-                                QWORD parent = 0;
-                                int lp = try_read_int_tovar(FALSE, p, (int)rr, &parent);
-                                if (lp <= 0)
-                                    break;
-                                p += lp;
-                                rr -= lp;
-                                if (rr < 2)
-                                    break;
-                                unsigned char ch = (unsigned char)p[0];
-                                unsigned char flag = (unsigned char)p[1];
-                                p += 2;
-                                rr -= 2;
-                                if (flag)
-                                {
-                                    QWORD leaf = 0;
-                                    int ll = try_read_int_tovar(FALSE, p, (int)rr, &leaf);
-                                    if (ll <= 0)
-                                        break;
-                                    p += ll;
-                                    rr -= ll;
-                                    if (leaf == (QWORD)idx)
-                                    {
-                                        found = (int)i;
-                                        break;
-                                    }
-                                }
-                            }
-                            if (found >= 0)
-                            {
-                                buffer *tmp = buffer_alloc();
-                                int current = found;
-                                while (1)
-                                {
-                                    const char *p2 = nodes_base;
-                                    int64_t rr2 = nodes_size;
-                                    int node_index = 0;
-                                    int parent_index = -1;
-                                    unsigned char ch = 0;
-                                    unsigned char flag = 0;
-                                    QWORD leaf = 0;
-                                    while (node_index <= current)
-                                    {
-                                        QWORD parent = 0;
-                                        int lp = try_read_int_tovar(FALSE, p2, (int)rr2, &parent);
-                                        p2 += lp;
-                                        rr2 -= lp;
-                                        if (rr2 < 2)
-                                            break;
-                                        ch = (unsigned char)p2[0];
-                                        flag = (unsigned char)p2[1];
-                                        p2 += 2;
-                                        rr2 -= 2;
-                                        if (flag)
-                                        {
-                                            int ll = try_read_int_tovar(FALSE, p2, (int)rr2, &leaf);
-                                            p2 += ll;
-                                            rr2 -= ll;
-                                        }
-                                        parent_index = (int)parent - 1;
-                                        ++node_index;
-                                    }
-                                    if (ch)
-                                    {
-                                        buffer_append(tmp, (const char *)&ch, 1);
-                                    }
-                                    if (parent_index < 0)
-                                        break;
-                                    current = parent_index;
-                                }
-                                int tlen = buffer_get_length_inline(tmp);
-                                const char *td = buffer_get_data_inline(tmp);
-                                char *name_out2 = (char *)tinybuf_malloc(tlen + 1);
-                                for (int i = 0; i < tlen; ++i)
-                                    name_out2[i] = td[tlen - 1 - i];
-                                name_out2[tlen] = '\0';
-                                name_out = name_out2;
-                                name_len = tlen;
-                                buffer_free(tmp);
-                            }
-                        }
+                        tinybuf_result_add_msg_const(r, (uint8_t)pool_start[0] == serialize_str_trie_pool ? "pool=trie" : "pool=flat");
+                        name_out = (char *)tinybuf_malloc(name_len + 1);
+                        memcpy(name_out, str, (size_t)name_len);
+                        name_out[name_len] = '\0';
                     }
                 }
                 if (name_out)
@@ -855,7 +839,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                     {
                         int64_t prefix = (int64_t)(buf->ptr - buf->base);
                         buf_ref br3 = (buf_ref){(char *)buf->base, prefix + (int64_t)blen, (char *)buf->ptr, (int64_t)blen};
-                        int rl2 = tinybuf_try_read_box(&br3, out, contain_handler, r);
+                        int64_t rl2 = tinybuf_try_read_box64(&br3, out, contain_handler, r);
                         if (rl2 > 0)
                         {
                             buf_offset(buf, rl2);
@@ -874,7 +858,7 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
                 {
                     int64_t prefix2 = (int64_t)(buf->ptr - buf->base);
                     buf_ref br3 = (buf_ref){(char *)buf->base, prefix2 + (int64_t)blen, (char *)buf->ptr, (int64_t)blen};
-                    int rl2 = tinybuf_try_read_box(&br3, out, contain_handler, r);
+                    int64_t rl2 = tinybuf_try_read_box64(&br3, out, contain_handler, r);
                     if (rl2 > 0)
                     {
                         buf_offset(buf, rl2);
@@ -917,55 +901,6 @@ int try_read_box(buf_ref *buf, tinybuf_value *out, CONTAIN_HANDLER contain_handl
     }
     return -1;
 }
-static inline void pool_lock(void)
-{
-#ifdef _WIN32
-    int spins = 0;
-    while (InterlockedCompareExchange(&s_pool_lock_var, 1, 0) != 0)
-    {
-        if (spins < 64)
-        {
-            ++spins;
-        }
-        else if (spins < 1024)
-        {
-            Sleep(0);
-            ++spins;
-        }
-        else
-        {
-            Sleep(1);
-        }
-    }
-#else
-    int spins = 0;
-    while (atomic_flag_test_and_set(&s_pool_lock_var))
-    {
-        if (spins < 64)
-        {
-            ++spins;
-        }
-        else if (spins < 1024)
-        {
-            sched_yield();
-            ++spins;
-        }
-        else
-        {
-            struct timespec ts = {0, 1000000};
-            nanosleep(&ts, NULL);
-        }
-    }
-#endif
-}
-static inline void pool_unlock(void)
-{
-#ifdef _WIN32
-    InterlockedExchange(&s_pool_lock_var, 0);
-#else
-    atomic_flag_clear(&s_pool_lock_var);
-#endif
-}
 static inline BOOL is_simple_pointer_type(serialize_type type)
 {
     return type == serialize_pointer_from_current_n ||
@@ -54,17 +54,36 @@ static void strlist_free(holestrlist *l)
 
 static inline int *_new_refcnt(void)
 {
-    int *p = (int *)tinybuf_malloc(sizeof(int));
+    int *p = (int *)tinybuf_small_alloc(sizeof(int));
     *p = 1;
     return p;
 }
 
+/* fast mode: ok results own no heap state; refcnt/msgs are created on the first message or ref */
+static int s_result_fast_mode = 1;
+
+void tinybuf_result_set_fast_mode(int enable)
+{
+    s_result_fast_mode = enable ? 1 : 0;
+}
+
+int tinybuf_result_is_fast_mode(void)
+{
+    return s_result_fast_mode;
+}
+
+static inline void _ensure_refcnt(tinybuf_error *r)
+{
+    if (!r->refcnt)
+        r->refcnt = _new_refcnt();
+}
+
 tinybuf_error tinybuf_result_ok(int res)
 {
     tinybuf_error r;
     r.res = res;
     r.msgs = NULL;
-    r.refcnt = _new_refcnt();
+    r.refcnt = s_result_fast_mode ? NULL : _new_refcnt();
     return r;
 }
 tinybuf_error tinybuf_result_err(int res, const char *msg, tinybuf_deleter_fn deleter)
@@ -95,6 +114,7 @@ int tinybuf_result_add_msg(tinybuf_error *r, const char *msg, tinybuf_deleter_fn
 {
     if (!r || !msg)
         return -1;
+    _ensure_refcnt(r);
     if (!r->msgs)
         r->msgs = strlist_new();
     strlist_add_owned(r->msgs, msg, deleter);
@@ -104,6 +124,7 @@ int tinybuf_result_add_hole_msg(tinybuf_error *r, hole_string *msg)
 {
     if (!r || !msg)
         return -1;
+    _ensure_refcnt(r);
     if (!r->msgs)
         r->msgs = strlist_new();
     strlist_add_hole(r->msgs, msg);
@@ -162,16 +183,27 @@ int tinybuf_result_format_msgs(const tinybuf_error *r, char *dst, int dst_len)
 
 int tinybuf_result_ref(tinybuf_error *r)
 {
-    if (!r || !r->refcnt)
+    if (!r)
         return -1;
+    _ensure_refcnt(r);
     (*r->refcnt)++;
     return *r->refcnt;
 }
 
 int tinybuf_result_unref(tinybuf_error *r)
 {
-    if (!r || !r->refcnt)
+    if (!r)
         return -1;
+    if (!r->refcnt)
+    {
+        /* fast-mode ok result: no refcnt, but msgs may have been merged in */
+        if (r->msgs)
+        {
+            strlist_free(r->msgs);
+            r->msgs = NULL;
+        }
+        return 0;
+    }
     (*r->refcnt)--;
     int v = *r->refcnt;
     if (v <= 0)
@@ -181,7 +213,7 @@ int tinybuf_result_unref(tinybuf_error *r)
             strlist_free(r->msgs);
             r->msgs = NULL;
         }
-        tinybuf_free(r->refcnt);
+        tinybuf_small_free(r->refcnt);
         r->refcnt = NULL;
     }
     return v;
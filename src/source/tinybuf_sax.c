@@ -0,0 +1,633 @@
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+#include <limits.h>
+
+// 事件流读取 值的头部由tinybuf_token_read解析 与tinybuf_value_deserialize/view共用 指针与str_pool_table的处理与try_read_box一致
+// 只有tensor需要把数据解码到本机格式 使用每次读取共用的临时内存
+
+#define SAX_MAX_POINTER_DEPTH 64
+// 指针目标每次引用都重新展开 展开的总字节数不超过整个buffer的SAX_POINTER_EXPAND_RATIO倍 小buffer至少允许SAX_POINTER_EXPAND_FLOOR
+#define SAX_POINTER_EXPAND_RATIO 16
+#define SAX_POINTER_EXPAND_FLOOR (1 << 20)
+
+typedef struct
+{
+    const tinybuf_sax_handler *h;
+    void *ud;
+    tinybuf_error *r;
+    const char *base;
+    int64_t all_size;
+    const char *pool;
+    int64_t pool_size;
+    uint32_t pool_gen;
+    int pointer_depth;
+    int64_t pointer_expanded;
+    void *scratch;
+    int64_t scratch_size;
+    int64_t *shape;
+    int shape_capacity;
+} sax_state;
+
+#define SAX_EMIT(st, cb, ...)                                               \
+    do                                                                      \
+    {                                                                       \
+        if ((st)->h->cb && (st)->h->cb((st)->ud, ##__VA_ARGS__) != 0)       \
+            return sax_fail(st, "tinybuf_sax_read: aborted by handler");    \
+    } while (0)
+
+static inline int64_t sax_fail(sax_state *st, const char *msg)
+{
+    s_last_error_msg = msg;
+    tinybuf_result_add_msg_const(st->r, msg);
+    return -1;
+}
+
+static inline int sax_varint(const char *p, int64_t size, uint64_t *out)
+{
+    if (size <= 0)
+    {
+        return 0;
+    }
+    return int_deserialize((const uint8_t *)p, size > INT_MAX ? INT_MAX : (int)size, out);
+}
+
+static void *sax_scratch(sax_state *st, int64_t bytes)
+{
+    if (bytes > st->scratch_size)
+    {
+        tinybuf_free(st->scratch);
+        st->scratch = tinybuf_malloc64((size_t)bytes);
+        st->scratch_size = st->scratch ? bytes : 0;
+    }
+    return st->scratch;
+}
+
+static int64_t sax_value(sax_state *st, const char *p, int64_t size);
+
+// 与tinybuf_deserialize_vector_tensor/dense_tensor/native_tensor相同的payload编码 头部已由tok给出
+static void sax_shape(sax_state *st, const tinybuf_token *tok)
+{
+    if (st->shape_capacity < tok->dims)
+    {
+        int cap = tok->dims < 4 ? 4 : tok->dims;
+        st->shape = (int64_t *)tinybuf_realloc(st->shape, (int)sizeof(int64_t) * cap);
+        st->shape_capacity = cap;
+    }
+    tinybuf_token_shape(tok, st->shape);
+}
+
+static int64_t sax_tensor(sax_state *st, const char *p, int64_t size, const tinybuf_token *tok)
+{
+    sax_shape(st, tok);
+    const char *payload = p + tok->head;
+    int64_t left = size - tok->head;
+    int64_t count = tok->count;
+    int dtype = tok->dtype;
+    int64_t body = tok->body;
+    const void *data = NULL;
+    if (tok->type == serialize_native_tensor)
+    {
+        int width = tensor_elem_width(dtype);
+        if (dtype == 11)
+        {
+            // native按字节存储bool 回调约定为按位打包
+            int64_t bytes = (count + 7) / 8;
+            uint8_t *bits = (uint8_t *)sax_scratch(st, bytes ? bytes : 1);
+            memset(bits, 0, (size_t)bytes);
+            for (int64_t i = 0; i < count; ++i)
+            {
+                if (payload[i])
+                    bits[i / 8] |= (uint8_t)(1 << (7 - i % 8));
+            }
+            data = bits;
+        }
+        // 小端主机上对齐的数据直接交给handler
+        else if (tensor_host_little_endian() && ((uintptr_t)payload % (uintptr_t)width) == 0)
+        {
+            data = payload;
+        }
+        else
+        {
+            void *buf = sax_scratch(st, body);
+            tensor_le_copy(buf, payload, count, width);
+            data = buf;
+        }
+    }
+    else if (dtype == 8 || dtype == 10)
+    {
+        void *buf = sax_scratch(st, body);
+        if (dtype == 8)
+            tensor_bswap64_copy(buf, payload, count);
+        else
+            tensor_bswap32_copy(buf, payload, count);
+        data = buf;
+    }
+    else if (dtype == 11)
+    {
+        data = payload;
+    }
+    else
+    {
+        // 每个元素至少2字节 先确认数据够长 scratch大小受输入长度限制
+        if (count > left / 2)
+            return 0;
+        int64_t *buf = (int64_t *)sax_scratch(st, (int64_t)sizeof(int64_t) * count);
+        int64_t off = 0;
+        for (int64_t i = 0; i < count; ++i)
+        {
+            uint64_t v = 0;
+            int n;
+            if (left - off < 2)
+                return 0;
+            int neg = (uint8_t)payload[off] == serialize_negtive_int;
+            if ((n = sax_varint(payload + off + 1, left - off - 1, &v)) <= 0)
+                return n;
+            off += 1 + n;
+            buf[i] = neg ? -(int64_t)v : (int64_t)v;
+        }
+        data = buf;
+        body = off;
+    }
+    SAX_EMIT(st, on_tensor, dtype, st->shape, tok->dims, data, count);
+    return tok->head + body;
+}
+
+static int64_t sax_container(sax_state *st, const char *p, int64_t size, const tinybuf_token *tok)
+{
+    int is_map = tok->type == serialize_map || tok->type == serialize_sized_map;
+    int64_t used = tok->head;
+    uint64_t klen = 0;
+    int n;
+    if (is_map)
+        SAX_EMIT(st, on_map_begin, (int64_t)tok->a);
+    else
+        SAX_EMIT(st, on_array_begin, (int64_t)tok->a);
+    for (uint64_t i = 0; i < tok->a; ++i)
+    {
+        if (is_map)
+        {
+            if ((n = sax_varint(p + used, size - used, &klen)) <= 0)
+                return n;
+            used += n;
+            if (klen > (uint64_t)(size - used))
+                return 0;
+            if (klen > INT_MAX)
+                return sax_fail(st, "tinybuf_sax_read: key longer than 2GB");
+            SAX_EMIT(st, on_key, p + used, (int)klen);
+            used += (int64_t)klen;
+        }
+        int64_t child = sax_value(st, p + used, size - used);
+        if (child <= 0)
+            return child;
+        used += child;
+    }
+    if (tok->body >= 0 && used != tok->head + tok->body)
+        return sax_fail(st, "tinybuf_sax_read: container length mismatch");
+    SAX_EMIT(st, on_end);
+    return used;
+}
+
+static int64_t sax_pointer(sax_state *st, const char *p, const tinybuf_token *tok)
+{
+    int64_t off = tinybuf_token_pointer_target(tok, p - st->base, st->all_size);
+    if (off < 0)
+        return sax_fail(st, "tinybuf_sax_read: pointer out of range");
+    // 事件流无法表示引用 成环的指针会一直展开 超过深度即报错
+    if (st->pointer_depth >= SAX_MAX_POINTER_DEPTH)
+        return sax_fail(st, "tinybuf_sax_read: pointer cycle");
+    ++st->pointer_depth;
+    int64_t target = sax_value(st, st->base + off, st->all_size - off);
+    --st->pointer_depth;
+    if (target <= 0)
+        return target < 0 ? target : sax_fail(st, "tinybuf_sax_read: pointer target truncated");
+    // 多个指针互相引用时展开量可以随层数指数增长 嵌套的展开已经先计入
+    st->pointer_expanded += target;
+    int64_t limit = st->all_size > INT64_MAX / SAX_POINTER_EXPAND_RATIO ? INT64_MAX : st->all_size * SAX_POINTER_EXPAND_RATIO;
+    if (st->pointer_expanded > (limit < SAX_POINTER_EXPAND_FLOOR ? SAX_POINTER_EXPAND_FLOOR : limit))
+        return sax_fail(st, "tinybuf_sax_read: pointer expansion too large");
+    return tok->head;
+}
+
+// 头部已解析的值 按类型产生事件 返回消耗的字节数 0表示数据不够
+static int64_t sax_token(sax_state *st, const char *p, int64_t size, const tinybuf_token *tok)
+{
+    switch (tok->type)
+    {
+    case serialize_null:
+        SAX_EMIT(st, on_null);
+        return 1;
+    case serialize_bool_true:
+    case serialize_bool_false:
+        SAX_EMIT(st, on_bool, tok->type == serialize_bool_true);
+        return 1;
+    case serialize_positive_int:
+    case serialize_negtive_int:
+        SAX_EMIT(st, on_int, tok->type == serialize_negtive_int ? -(int64_t)tok->a : (int64_t)tok->a);
+        return tok->head;
+    case serialize_double:
+        SAX_EMIT(st, on_double, read_double((uint8_t *)p + 1));
+        return 9;
+    case serialize_string:
+        if (tok->a > INT_MAX)
+            return sax_fail(st, "tinybuf_sax_read: string longer than 2GB");
+        SAX_EMIT(st, on_string, p + tok->head, (int)tok->a);
+        return tok->head + tok->body;
+    case serialize_str_index:
+    {
+        const char *str = NULL;
+        int len = 0;
+        if (!st->pool || strpool_read_lookup(st->pool, st->pool_size, st->pool_gen, tok->a, &str, &len) <= 0)
+            return sax_fail(st, "tinybuf_sax_read: strpool lookup failed");
+        SAX_EMIT(st, on_string, str, len);
+        return tok->head;
+    }
+    case serialize_map:
+    case serialize_sized_map:
+    case serialize_array:
+    case serialize_sized_array:
+        return sax_container(st, p, size, tok);
+    case serialize_vector_tensor:
+    case serialize_dense_tensor:
+    case serialize_native_tensor:
+        return sax_tensor(st, p, size, tok);
+    case serialize_bool_map:
+        SAX_EMIT(st, on_bool_map, (const uint8_t *)p + tok->head, (int64_t)tok->a);
+        return tok->head + tok->body;
+    case serialize_pointer_from_current_n:
+    case serialize_pointer_from_start_n:
+    case serialize_pointer_from_end_n:
+    case serialize_pointer_from_current_p:
+    case serialize_pointer_from_start_p:
+    case serialize_pointer_from_end_p:
+        return sax_pointer(st, p, tok);
+    case serialize_version:
+    {
+        int64_t inner = sax_value(st, p + tok->head, size - tok->head);
+        return inner <= 0 ? inner : tok->head + inner;
+    }
+    case serialize_str_pool_table:
+    {
+        // offset相对于box起始 与try_read_box一样只返回body的长度
+        const char *old_pool = st->pool;
+        int64_t old_pool_size = st->pool_size;
+        st->pool = p + tok->a;
+        st->pool_size = size - (int64_t)tok->a;
+        int64_t inner = sax_value(st, p + tok->head, (int64_t)tok->a - tok->head);
+        st->pool = old_pool;
+        st->pool_size = old_pool_size;
+        return inner <= 0 ? inner : tok->head + inner;
+    }
+    default:
+        return sax_fail(st, "tinybuf_sax_read: unsupported type");
+    }
+}
+
+static int64_t sax_value(sax_state *st, const char *p, int64_t size)
+{
+    tinybuf_token tok;
+    int ok = tinybuf_token_read(p, size, &tok);
+    if (ok < 0)
+        return sax_fail(st, "tinybuf_sax_read: invalid or unsupported value");
+    if (ok == 0)
+        return 0;
+    return sax_token(st, p, size, &tok);
+}
+
+int tinybuf_sax_read(buf_ref *buf, const tinybuf_sax_handler *handler, void *user_data, tinybuf_error *r)
+{
+    assert(buf);
+    assert(handler);
+    sax_state st;
+    memset(&st, 0, sizeof(st));
+    st.h = handler;
+    st.ud = user_data;
+    st.r = r;
+    st.base = buf->base;
+    st.all_size = buf->all_size;
+    // 接收buffer可能被复用 pool地址相同不代表内容相同 解码表只在这次读取内复用
+    st.pool_gen = strpool_read_begin();
+    int64_t n = sax_value(&st, buf->ptr, buf->size);
+    tinybuf_free(st.scratch);
+    tinybuf_free(st.shape);
+    if (n > INT_MAX)
+    {
+        // 返回值放不下 事件已经产生 不推进buf
+        return (int)sax_fail(&st, "tinybuf_sax_read: box larger than 2GB");
+    }
+    if (n > 0)
+    {
+        buf_offset(buf, n);
+    }
+    return (int)n;
+}
+
+// 增量解析 以token为单位推进: 标量/字符串/tensor/bool_map整体交给sax_value 容器只解析头部后入栈
+// 不完整的token尾部保存在carry中 下一块数据到达后拼接继续 每个字节最多被拷贝一次
+
+typedef struct
+{
+    int is_map;
+    int expect_key;
+    uint64_t left;
+    // sized容器body结束时的pos 非sized为-1
+    int64_t body_end;
+} push_frame;
+
+struct T_tinybuf_push_parser
+{
+    sax_state st;
+    push_frame *frames;
+    int depth;
+    int frames_capacity;
+    char *carry;
+    int64_t carry_len;
+    int64_t carry_capacity;
+    // 当前box已消耗的字节数
+    int64_t pos;
+    int done;
+    // 逐元素varint的tensor 已解码的元素跨feed保留 下一块从断点继续 shape在st.shape中
+    int tensor_open;
+    int tensor_dtype;
+    int tensor_dims;
+    int64_t tensor_count;
+    int64_t tensor_done;
+    int64_t *tensor_vals;
+    int64_t tensor_capacity;
+};
+
+tinybuf_push_parser *tinybuf_push_parser_new(const tinybuf_sax_handler *handler, void *user_data)
+{
+    assert(handler);
+    tinybuf_push_parser *pp = (tinybuf_push_parser *)tinybuf_malloc(sizeof(tinybuf_push_parser));
+    assert(pp);
+    memset(pp, 0, sizeof(tinybuf_push_parser));
+    pp->st.h = handler;
+    pp->st.ud = user_data;
+    return pp;
+}
+
+void tinybuf_push_parser_free(tinybuf_push_parser *pp)
+{
+    if (!pp)
+        return;
+    tinybuf_free(pp->st.scratch);
+    tinybuf_free(pp->st.shape);
+    tinybuf_free(pp->frames);
+    tinybuf_free(pp->carry);
+    tinybuf_free(pp->tensor_vals);
+    tinybuf_free(pp);
+}
+
+void tinybuf_push_parser_reset(tinybuf_push_parser *pp)
+{
+    assert(pp);
+    pp->depth = 0;
+    pp->carry_len = 0;
+    pp->pos = 0;
+    pp->done = 0;
+    pp->tensor_open = 0;
+}
+
+// 一个值结束 向上逐层结算已读完的容器
+static int64_t push_value_done(tinybuf_push_parser *pp)
+{
+    sax_state *st = &pp->st;
+    while (pp->depth > 0)
+    {
+        push_frame *top = &pp->frames[pp->depth - 1];
+        top->expect_key = top->is_map;
+        if (--top->left > 0)
+            return 0;
+        if (top->body_end >= 0 && top->body_end != pp->pos)
+            return sax_fail(st, "tinybuf_push_parser: container length mismatch");
+        SAX_EMIT(st, on_end);
+        --pp->depth;
+    }
+    pp->done = 1;
+    return 0;
+}
+
+static int64_t push_container(tinybuf_push_parser *pp, const tinybuf_token *tok)
+{
+    sax_state *st = &pp->st;
+    int is_map = tok->type == serialize_map || tok->type == serialize_sized_map;
+    uint64_t count = tok->a;
+    if (is_map)
+        SAX_EMIT(st, on_map_begin, (int64_t)count);
+    else
+        SAX_EMIT(st, on_array_begin, (int64_t)count);
+    int64_t body_end = tok->body >= 0 ? pp->pos + tok->head + tok->body : -1;
+    pp->pos += tok->head;
+    if (count == 0)
+    {
+        if (body_end >= 0 && body_end != pp->pos)
+            return sax_fail(st, "tinybuf_push_parser: container length mismatch");
+        SAX_EMIT(st, on_end);
+        if (push_value_done(pp) < 0)
+            return -1;
+        return tok->head;
+    }
+    if (pp->depth == pp->frames_capacity)
+    {
+        int cap = pp->frames_capacity ? pp->frames_capacity * 2 : 16;
+        pp->frames = (push_frame *)tinybuf_realloc(pp->frames, (int)sizeof(push_frame) * cap);
+        pp->frames_capacity = cap;
+    }
+    push_frame *f = &pp->frames[pp->depth++];
+    f->is_map = is_map;
+    f->expect_key = is_map;
+    f->left = count;
+    f->body_end = body_end;
+    return tok->head;
+}
+
+// 逐元素varint的tensor 解码已到达的完整元素 全部到齐后产生事件
+static int64_t push_tensor_body(tinybuf_push_parser *pp, const char *p, int64_t size)
+{
+    sax_state *st = &pp->st;
+    int64_t used = 0;
+    while (pp->tensor_done < pp->tensor_count)
+    {
+        uint64_t v = 0;
+        int n;
+        if (size - used < 2)
+            break;
+        int neg = (uint8_t)p[used] == serialize_negtive_int;
+        if ((n = sax_varint(p + used + 1, size - used - 1, &v)) < 0)
+            return sax_fail(st, "tinybuf_push_parser: bad varint");
+        if (n == 0)
+            break;
+        if (pp->tensor_done == pp->tensor_capacity)
+        {
+            // 按到达的元素扩容 不信任头部的count
+            int64_t cap = pp->tensor_capacity ? pp->tensor_capacity * 2 : 64;
+            if (cap > pp->tensor_count)
+                cap = pp->tensor_count;
+            pp->tensor_vals = (int64_t *)tinybuf_realloc64(pp->tensor_vals, sizeof(int64_t) * (size_t)cap);
+            if (!pp->tensor_vals)
+                return sax_fail(st, "tinybuf_push_parser: out of memory");
+            pp->tensor_capacity = cap;
+        }
+        pp->tensor_vals[pp->tensor_done++] = neg ? -(int64_t)v : (int64_t)v;
+        used += 1 + n;
+    }
+    pp->pos += used;
+    if (pp->tensor_done < pp->tensor_count)
+        return used;
+    pp->tensor_open = 0;
+    SAX_EMIT(st, on_tensor, pp->tensor_dtype, st->shape, pp->tensor_dims, pp->tensor_vals, pp->tensor_count);
+    if (push_value_done(pp) < 0)
+        return -1;
+    return used;
+}
+
+// 解析一个完整token 返回消耗的字节数 0表示数据不够 小于0失败
+static int64_t push_step(tinybuf_push_parser *pp, const char *p, int64_t size)
+{
+    sax_state *st = &pp->st;
+    uint64_t a = 0;
+    int n;
+    if (pp->tensor_open)
+        return push_tensor_body(pp, p, size);
+    if (pp->depth > 0 && pp->frames[pp->depth - 1].expect_key)
+    {
+        if ((n = sax_varint(p, size, &a)) <= 0)
+            return n < 0 ? sax_fail(st, "tinybuf_push_parser: bad varint") : 0;
+        if (a > INT_MAX)
+            return sax_fail(st, "tinybuf_push_parser: key longer than 2GB");
+        if (a > (uint64_t)(size - n))
+            return 0;
+        SAX_EMIT(st, on_key, p + n, (int)a);
+        pp->frames[pp->depth - 1].expect_key = 0;
+        pp->pos += n + (int64_t)a;
+        return n + (int64_t)a;
+    }
+    // str_pool_table的头部要等到pool可读才算完整 不必等数据到齐再报错
+    if ((uint8_t)p[0] == serialize_str_pool_table)
+        return sax_fail(st, "tinybuf_push_parser: strpool and pointers need the whole buffer");
+    tinybuf_token tok;
+    int ok = tinybuf_token_read(p, size, &tok);
+    if (ok <= 0)
+        return ok < 0 ? sax_fail(st, "tinybuf_push_parser: invalid or unsupported value") : 0;
+    if (tok.body < 0 && (tok.type == serialize_vector_tensor || tok.type == serialize_dense_tensor))
+    {
+        // 逐元素varint的tensor可能分多块到达 头部只解析一次 之后逐块累积元素
+        sax_shape(st, &tok);
+        pp->tensor_open = 1;
+        pp->tensor_dtype = tok.dtype;
+        pp->tensor_dims = tok.dims;
+        pp->tensor_count = tok.count;
+        pp->tensor_done = 0;
+        pp->pos += tok.head;
+        return tok.head;
+    }
+    switch (tok.type)
+    {
+    case serialize_map:
+    case serialize_sized_map:
+    case serialize_array:
+    case serialize_sized_array:
+        return push_container(pp, &tok);
+    case serialize_version:
+        // 版本号之后紧跟被包装的值 不产生事件
+        pp->pos += tok.head;
+        return tok.head;
+
+    case serialize_str_index:
+    case serialize_pointer_from_current_n:
+    case serialize_pointer_from_start_n:
+    case serialize_pointer_from_end_n:
+    case serialize_pointer_from_current_p:
+    case serialize_pointer_from_start_p:
+    case serialize_pointer_from_end_p:
+        return sax_fail(st, "tinybuf_push_parser: strpool and pointers need the whole buffer");
+    default:
+    {
+        int64_t used = sax_token(st, p, size, &tok);
+        if (used <= 0)
+            return used;
+        pp->pos += used;
+        if (push_value_done(pp) < 0)
+            return -1;
+        return used;
+    }
+    }
+}
+
+// 从p开始尽量多地解析完整token 返回消耗的字节数 小于0失败
+static int64_t push_run(tinybuf_push_parser *pp, const char *p, int64_t size)
+{
+    int64_t off = 0;
+    while (off < size && !pp->done)
+    {
+        int64_t k = push_step(pp, p + off, size - off);
+        if (k < 0)
+            return k;
+        if (k == 0)
+            break;
+        off += k;
+    }
+    return off;
+}
+
+// carry至少能放下need字节 失败时保持原样
+static int push_carry_reserve(tinybuf_push_parser *pp, int64_t need)
+{
+    if (pp->carry_capacity >= need)
+        return 0;
+    int64_t cap = pp->carry_capacity ? pp->carry_capacity : 256;
+    while (cap < need)
+        cap *= 2;
+    char *carry = (char *)tinybuf_realloc64(pp->carry, (size_t)cap);
+    if (!carry)
+        return -1;
+    pp->carry = carry;
+    pp->carry_capacity = cap;
+    return 0;
+}
+
+int tinybuf_push_parser_feed(tinybuf_push_parser *pp, const char *data, int len, tinybuf_error *r)
+{
+    assert(pp);
+    sax_state *st = &pp->st;
+    st->r = r;
+    if (pp->done)
+        return (int)sax_fail(st, "tinybuf_push_parser: box already complete, reset first");
+    if (len <= 0)
+        return 0;
+    const char *src = data;
+    int64_t size = len;
+    int64_t old_carry = pp->carry_len;
+    if (old_carry > 0)
+    {
+        // 上一块留下了半个token 拼接后从carry解析
+        if (push_carry_reserve(pp, old_carry + len) < 0)
+            return (int)sax_fail(st, "tinybuf_push_parser: out of memory");
+        memcpy(pp->carry + old_carry, data, len);
+        src = pp->carry;
+        size = old_carry + len;
+    }
+    int64_t off = push_run(pp, src, size);
+    if (off < 0)
+        return -1;
+    if (pp->done)
+    {
+        pp->carry_len = 0;
+        return (int)(off - old_carry);
+    }
+    int64_t tail = size - off;
+    if (src == pp->carry)
+    {
+        // 大字符串分多块到达时off为0 不要反复搬动
+        if (off > 0)
+            memmove(pp->carry, pp->carry + off, tail);
+    }
+    else if (tail > 0)
+    {
+        if (push_carry_reserve(pp, tail) < 0)
+            return (int)sax_fail(st, "tinybuf_push_parser: out of memory");
+        memcpy(pp->carry, src + off, tail);
+    }
+    pp->carry_len = tail;
+    return 0;
+}
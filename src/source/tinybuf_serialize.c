@@ -2,6 +2,7 @@
 #include "tinybuf_buffer.h"
 #include "tinybuf_plugin.h"
 #include <string.h>
+#include <limits.h>
 
 static inline int dump_double(double db, buffer *out)
 {
@@ -14,10 +15,50 @@ static inline int dump_double(double db, buffer *out)
     return 8;
 }
 
-int dump_string(int len, const char *str, buffer *out)
+// double/float tensor的payload 整段翻转为大端后直接写入out末尾
+static inline void dump_tensor_words(const void *data, int64_t count, int width, buffer *out)
 {
-    int ret = dump_int(len, out);
-    buffer_append(out, str, len);
+    if (count <= 0)
+        return;
+    char *dst = buffer_append_space64(out, count * width);
+    if (!dst)
+        return;
+    if (width == 8)
+        tensor_bswap64_copy(dst, data, count);
+    else
+        tensor_bswap32_copy(dst, data, count);
+}
+
+// native编码 数据前填充到最终输出中TENSOR_NATIVE_ALIGN对齐 填充长度单字节记录
+static void dump_native_tensor(const tinybuf_tensor_t *t, buffer *out)
+{
+    char type = serialize_native_tensor;
+    buffer_append(out, &type, 1);
+    dump_int((uint64_t)t->dims, out);
+    for (int i = 0; i < t->dims; ++i)
+    {
+        // 由vector编码读回的tensor没有shape
+        dump_int((uint64_t)(t->shape ? t->shape[i] : t->count), out);
+    }
+    dump_int((uint64_t)t->dtype, out);
+    int pad = native_tensor_pad(buffer_get_length_inline(out) + tinybuf_writer_ctx_current()->align_shift);
+    char *dst = buffer_append_space64(out, 1 + pad);
+    if (!dst)
+        return;
+    dst[0] = (char)pad;
+    memset(dst + 1, 0, (size_t)pad);
+    int width = tensor_elem_width(t->dtype);
+    if (t->count <= 0)
+        return;
+    dst = buffer_append_space64(out, t->count * width);
+    if (dst)
+        tensor_le_copy(dst, t->data, t->count, width);
+}
+
+int64_t dump_string(int64_t len, const char *str, buffer *out)
+{
+    int ret = dump_int((uint64_t)len, out);
+    buffer_append64(out, str, len);
     return ret + len;
 }
 
@@ -36,41 +77,92 @@ int int_serialize(uint64_t in, uint8_t *out)
 
 int dump_int(uint64_t len, buffer *out)
 {
-    int buf_len = buffer_get_length_inline(out);
-    if (buffer_get_capacity_inline(out) - buf_len < 16)
+    int64_t buf_len = buffer_get_length_inline(out);
+    if (buffer_get_capacity_inline(out) - buf_len < 16 && buffer_ensure_free(out, 16) < 0)
     {
-        buffer_add_capacity(out, 16);
+        // 外部内存剩余不足16字节 按实际长度追加
+        uint8_t tmp[16];
+        int n = int_serialize(len, tmp);
+        return buffer_append(out, (const char *)tmp, n) < 0 ? -1 : n;
     }
     int add = int_serialize(len, (uint8_t *)buffer_get_data_inline(out) + buf_len);
-    buffer_set_length(out, buf_len + add);
+    buffer_set_length64(out, buf_len + add);
     return add;
 }
 
+// 带长度容器的长度字段固定5字节 用0x80补齐的varint 写完children后回填 不需要移动数据
+#define SIZED_CONTAINER_LEN_WIDTH 5
+int s_sized_container_min_count = 0;
+int s_tensor_native = 0;
+
+static inline int use_sized_container(int count)
+{
+    return s_sized_container_min_count > 0 && count >= s_sized_container_min_count;
+}
+
+static inline int64_t container_begin(buffer *out, serialize_type plain, serialize_type sized, int count)
+{
+    static const char zeros[SIZED_CONTAINER_LEN_WIDTH] = {0};
+    if (!use_sized_container(count))
+    {
+        char type = plain;
+        buffer_append(out, &type, 1);
+        dump_int(count, out);
+        return -1;
+    }
+    char type = sized;
+    buffer_append(out, &type, 1);
+    int64_t slot = buffer_get_length_inline(out);
+    buffer_append(out, zeros, SIZED_CONTAINER_LEN_WIDTH);
+    dump_int(count, out);
+    return slot;
+}
+
+static inline void container_end(buffer *out, int64_t slot)
+{
+    if (slot < 0 || buffer_get_length_inline(out) < slot + SIZED_CONTAINER_LEN_WIDTH)
+    {
+        return;
+    }
+    uint64_t len = (uint64_t)(buffer_get_length_inline(out) - slot - SIZED_CONTAINER_LEN_WIDTH);
+    uint8_t *dst = (uint8_t *)buffer_get_data_inline(out) + slot;
+    for (int i = 0; i < SIZED_CONTAINER_LEN_WIDTH; ++i)
+    {
+        dst[i] = (uint8_t)((len & 0x7F) | (i + 1 < SIZED_CONTAINER_LEN_WIDTH ? 0x80 : 0));
+        len >>= 7;
+    }
+}
+
 typedef struct { buffer *out; tinybuf_error *r; } _tb_ser_ctx;
-static int avl_tree_for_each_node_dump_map(void *user_data, AVLTreeNode *node)
+static int map_visit_dump(void *user_data, buffer *key, tinybuf_value *val)
 {
     _tb_ser_ctx *ctx = (_tb_ser_ctx *)user_data;
     buffer *out = ctx->out;
-    buffer *key = (buffer *)avl_tree_node_key(node);
-    tinybuf_value *val = (tinybuf_value *)avl_tree_node_value(node);
     dump_string(buffer_get_length_inline(key), buffer_get_data_inline(key), out);
-    (void)tinybuf_value_serialize(val, out, ctx->r);
+    (void)tinybuf_value_serialize64(val, out, ctx->r);
     return 0;
 }
 
-static int avl_tree_for_each_node_dump_array(void *user_data, AVLTreeNode *node)
+int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_error *r)
 {
-    _tb_ser_ctx *ctx = (_tb_ser_ctx *)user_data;
-    buffer *out = ctx->out;
-    (void)tinybuf_value_serialize(avl_tree_node_value(node), out, ctx->r);
-    return 0;
+    int64_t before = buffer_get_length64(out);
+    int64_t n = tinybuf_value_serialize64(value, out, r);
+    if (n > INT_MAX)
+    {
+        // 长度无法用int返回 撤销本次写入
+        buffer_set_length64(out, before);
+        s_last_error_msg = "value larger than 2GB, use tinybuf_value_serialize64";
+        tinybuf_result_add_msg_const(r, s_last_error_msg);
+        return -1;
+    }
+    return (int)n;
 }
 
-int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_error *r)
+int64_t tinybuf_value_serialize64(const tinybuf_value *value, buffer *out, tinybuf_error *r)
 {
     assert(value);
     assert(out);
-    int before = buffer_get_length_inline(out);
+    int64_t before = buffer_get_length_inline(out);
     if (value && value->_custom_box_tag >= 0)
     {
         const char *g = tinybuf_plugin_get_guid_by_tag((uint8_t)value->_custom_box_tag);
@@ -130,10 +222,10 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
 
     case tinybuf_string:
     {
-        int len = buffer_get_length_inline(value->_data._string);
+        int64_t len = value_str_len(value);
         if (s_use_strpool)
         {
-            int idx = strpool_add(buffer_get_data_inline(value->_data._string), len);
+            int idx = strpool_add(value_str_data(value), (int)len);
             char type = serialize_str_index;
             buffer_append(out, &type, 1);
             dump_int((uint64_t)idx, out);
@@ -144,7 +236,7 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
             buffer_append(out, &type, 1);
             if (len)
             {
-                dump_string(len, buffer_get_data_inline(value->_data._string), out);
+                dump_string(len, value_str_data(value), out);
             }
             else
             {
@@ -156,23 +248,23 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
 
     case tinybuf_map:
     {
-        char type = serialize_map;
-        buffer_append(out, &type, 1);
-        int map_size = avl_tree_num_entries(value->_data._map_array);
-        dump_int(map_size, out);
+        int map_size = tinybuf_map_size(value);
+        int64_t slot = container_begin(out, serialize_map, serialize_sized_map, map_size);
         _tb_ser_ctx ctx = { out, r };
-        avl_tree_for_each_node(value->_data._map_array, &ctx, avl_tree_for_each_node_dump_map);
+        tinybuf_map_for_each(value, &ctx, map_visit_dump);
+        container_end(out, slot);
     }
     break;
 
     case tinybuf_array:
     {
-        char type = serialize_array;
-        buffer_append(out, &type, 1);
-        int array_size = avl_tree_num_entries(value->_data._map_array);
-        dump_int(array_size, out);
-        _tb_ser_ctx ctx2 = { out, r };
-        avl_tree_for_each_node(value->_data._map_array, &ctx2, avl_tree_for_each_node_dump_array);
+        int array_size = tinybuf_array_size(value);
+        int64_t slot = container_begin(out, serialize_array, serialize_sized_array, array_size);
+        for (int i = 0; i < array_size; ++i)
+        {
+            (void)tinybuf_value_serialize64(value->_data._array->items[i], out, r);
+        }
+        container_end(out, slot);
     }
     break;
     case tinybuf_tensor:
@@ -183,7 +275,11 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
             break;
         }
         int64_t elem = t->count;
-        if (t->dims == 1)
+        if (s_tensor_native)
+        {
+            dump_native_tensor(t, out);
+        }
+        else if (t->dims == 1)
         {
             char type = serialize_vector_tensor;
             buffer_append(out, &type, 1);
@@ -191,22 +287,11 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
             dump_int((uint64_t)t->dtype, out);
             if (t->dtype == 8)
             {
-                const double *pd = (const double *)t->data;
-                for (int64_t i = 0; i < elem; ++i)
-                {
-                    dump_double(pd[i], out);
-                }
+                dump_tensor_words(t->data, elem, 8, out);
             }
             else if (t->dtype == 10)
             {
-                const float *pf = (const float *)t->data;
-                for (int64_t i = 0; i < elem; ++i)
-                {
-                    uint32_t raw = 0;
-                    memcpy(&raw, &pf[i], 4);
-                    raw = htonl(raw);
-                    buffer_append(out, (char *)&raw, 4);
-                }
+                dump_tensor_words(t->data, elem, 4, out);
             }
             else if (t->dtype == 11)
             {
@@ -250,22 +335,11 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
             dump_int((uint64_t)t->dtype, out);
             if (t->dtype == 8)
             {
-                const double *pd = (const double *)t->data;
-                for (int64_t i = 0; i < elem; ++i)
-                {
-                    dump_double(pd[i], out);
-                }
+                dump_tensor_words(t->data, elem, 8, out);
             }
             else if (t->dtype == 10)
             {
-                const float *pf = (const float *)t->data;
-                for (int64_t i = 0; i < elem; ++i)
-                {
-                    uint32_t raw = 0;
-                    memcpy(&raw, &pf[i], 4);
-                    raw = htonl(raw);
-                    buffer_append(out, (char *)&raw, 4);
-                }
+                dump_tensor_words(t->data, elem, 4, out);
             }
             else if (t->dtype == 11)
             {
@@ -312,7 +386,7 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
         int64_t bytes = (bm->count + 7) / 8;
         if (bytes > 0)
         {
-            buffer_append(out, (const char *)bm->bits, (int)bytes);
+            buffer_append64(out, (const char *)bm->bits, bytes);
         }
     }
     break;
@@ -322,8 +396,183 @@ int tinybuf_value_serialize(const tinybuf_value *value, buffer *out, tinybuf_err
         break;
     }
 
-    int after = buffer_get_length_inline(out);
-    tinybuf_error ok = tinybuf_result_ok(after - before);
+    int64_t after = buffer_get_length_inline(out);
+    tinybuf_error ok = tinybuf_result_ok(after - before > INT_MAX ? INT_MAX : (int)(after - before));
     tinybuf_result_append_merge(r, &ok, tinybuf_merger_sum);
     return after - before;
 }
+
+static inline int64_t varint_size(uint64_t v)
+{
+    int64_t n = 1;
+    while (v >>= 7)
+    {
+        ++n;
+    }
+    return n;
+}
+
+typedef struct { int64_t pos; int64_t sum; int failed; } _tb_size_ctx;
+static int map_visit_size(void *user_data, buffer *key, tinybuf_value *val)
+{
+    _tb_size_ctx *ctx = (_tb_size_ctx *)user_data;
+    int64_t klen = buffer_get_length_inline(key);
+    ctx->sum += varint_size((uint64_t)klen) + klen;
+    int64_t n = value_serialized_size(val, ctx->pos + ctx->sum);
+    if (n < 0)
+    {
+        ctx->failed = 1;
+        return -1;
+    }
+    ctx->sum += n;
+    return 0;
+}
+
+static int64_t tensor_payload_size(const tinybuf_tensor_t *t)
+{
+    switch (t->dtype)
+    {
+    case 8:
+        return 8 * t->count;
+    case 10:
+        return 4 * t->count;
+    case 11:
+        return (t->count + 7) / 8;
+    default:
+    {
+        const int64_t *pi64 = (const int64_t *)t->data;
+        int64_t sum = t->count;
+        for (int64_t i = 0; i < t->count; ++i)
+        {
+            sum += varint_size((uint64_t)(pi64[i] < 0 ? -pi64[i] : pi64[i]));
+        }
+        return sum;
+    }
+    }
+}
+
+// 与tinybuf_value_serialize逐分支对应 不处理precache重定向 开启重定向时只是估计值
+// strpool模式下与序列化一样调用strpool_add 之后再序列化得到的下标不变
+// pos与序列化时的buffer长度+align_shift对应 只影响native tensor的填充
+int64_t value_serialized_size(const tinybuf_value *value, int64_t pos)
+{
+    assert(value);
+    if (value->_custom_box_tag >= 0)
+    {
+        const char *g = tinybuf_plugin_get_guid_by_tag((uint8_t)value->_custom_box_tag);
+        if (g)
+        {
+            // 插件自行编码 只能写入临时buffer后取长度 临时buffer的起始对应pos
+            buffer *tmp = buffer_alloc();
+            tinybuf_error rr = tinybuf_result_ok(0);
+            tinybuf_writer_ctx *wc = tinybuf_writer_ctx_current();
+            int64_t saved = wc->align_shift;
+            wc->align_shift = pos;
+            int w = tinybuf_try_write_plugin_id_box(tmp, g, value, &rr);
+            wc->align_shift = saved;
+            tinybuf_result_unref(&rr);
+            buffer_free(tmp);
+            return w <= 0 ? -1 : w;
+        }
+    }
+    switch (value->_type)
+    {
+    case tinybuf_null:
+    case tinybuf_bool:
+        return 1;
+    case tinybuf_int:
+        return 1 + varint_size(value->_data._int > 0 ? value->_data._int : -value->_data._int);
+    case tinybuf_double:
+        return 9;
+    case tinybuf_string:
+    {
+        int64_t len = value_str_len(value);
+        if (s_use_strpool)
+        {
+            int idx = strpool_add(value_str_data(value), (int)len);
+            return 1 + varint_size((uint64_t)idx);
+        }
+        return 1 + varint_size((uint64_t)len) + len;
+    }
+    case tinybuf_map:
+    {
+        int map_size = tinybuf_map_size(value);
+        _tb_size_ctx ctx = {pos, 1 + varint_size((uint64_t)map_size), 0};
+        if (use_sized_container(map_size))
+        {
+            ctx.sum += SIZED_CONTAINER_LEN_WIDTH;
+        }
+        tinybuf_map_for_each(value, &ctx, map_visit_size);
+        return ctx.failed ? -1 : ctx.sum;
+    }
+    case tinybuf_array:
+    {
+        int array_size = tinybuf_array_size(value);
+        int64_t sum = 1 + varint_size((uint64_t)array_size);
+        if (use_sized_container(array_size))
+        {
+            sum += SIZED_CONTAINER_LEN_WIDTH;
+        }
+        for (int i = 0; i < array_size; ++i)
+        {
+            int64_t n = value_serialized_size(value->_data._array->items[i], pos + sum);
+            if (n < 0)
+            {
+                return -1;
+            }
+            sum += n;
+        }
+        return sum;
+    }
+    case tinybuf_tensor:
+    {
+        const tinybuf_tensor_t *t = (const tinybuf_tensor_t *)value->_data._custom;
+        if (!t)
+        {
+            return 0;
+        }
+        if (s_tensor_native)
+        {
+            int64_t head = 1 + varint_size((uint64_t)t->dims) + varint_size((uint64_t)t->dtype);
+            for (int i = 0; i < t->dims; ++i)
+            {
+                head += varint_size((uint64_t)(t->shape ? t->shape[i] : t->count));
+            }
+            // 填充取决于pad字节的最终位置
+            return head + 1 + native_tensor_pad(pos + head) + t->count * tensor_elem_width(t->dtype);
+        }
+        int64_t sum = 1 + varint_size((uint64_t)t->dtype) + tensor_payload_size(t);
+        if (t->dims == 1)
+        {
+            return sum + varint_size((uint64_t)t->count);
+        }
+        sum += varint_size((uint64_t)t->dims);
+        for (int i = 0; i < t->dims; ++i)
+        {
+            sum += varint_size((uint64_t)t->shape[i]);
+        }
+        return sum;
+    }
+    case tinybuf_bool_map:
+    {
+        const tinybuf_bool_map_t *bm = (const tinybuf_bool_map_t *)value->_data._custom;
+        return bm ? 1 + varint_size((uint64_t)bm->count) + (bm->count + 7) / 8 : 0;
+    }
+    default:
+        assert(0);
+        return -1;
+    }
+}
+
+int tinybuf_value_serialize_with_reserve(const tinybuf_value *value, buffer *out, tinybuf_error *r)
+{
+    assert(value);
+    assert(out);
+    int64_t len = buffer_get_length_inline(out);
+    int64_t want = len + value_serialized_size(value, len + tinybuf_writer_ctx_current()->align_shift);
+    if (want > buffer_get_capacity_inline(out))
+    {
+        buffer_reserve64(out, want);
+    }
+    return tinybuf_value_serialize(value, out, r);
+}
@@ -2,52 +2,102 @@
 #include "tinybuf_buffer.h"
 #include "tinybuf_memory.h"
 #include "tinybuf_private.h"
+#include <limits.h>
 
-typedef struct
-{
-    buffer *buf;
-} strpool_entry;
-static strpool_entry *s_strpool = NULL;
-static int s_strpool_count = 0;
-static int s_strpool_capacity = 0;
-static const char *s_strpool_base = NULL;
 int s_use_strpool = 0;
 static int s_use_strpool_trie = 1;
+// 写入状态保存在tinybuf_writer_ctx中 strpool_slots为开放寻址索引 -1为空 其余为strpool下标
+
+static inline uint32_t strpool_hash(const char *data, int len)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; ++i)
+    {
+        h ^= (uint8_t)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
 void strpool_reset_write(const buffer *out)
 {
-    s_strpool_count = 0;
-    s_strpool_base = (const char *)out;
+    (void)out;
+    tinybuf_writer_ctx *w = tinybuf_writer_ctx_current();
+    for (int i = 0; i < w->strpool_count; ++i)
+    {
+        buffer_free(w->strpool[i].buf);
+    }
+    w->strpool_count = 0;
+    if (w->strpool_slots)
+    {
+        memset(w->strpool_slots, 0xff, sizeof(int) * (w->strpool_slot_mask + 1));
+    }
+}
+
+static void strpool_rehash(tinybuf_writer_ctx *w, int slot_count)
+{
+    tinybuf_free(w->strpool_slots);
+    w->strpool_slots = (int *)tinybuf_malloc((int)sizeof(int) * slot_count);
+    memset(w->strpool_slots, 0xff, sizeof(int) * slot_count);
+    w->strpool_slot_mask = slot_count - 1;
+    for (int i = 0; i < w->strpool_count; ++i)
+    {
+        int pos = (int)(w->strpool[i].hash & (uint32_t)w->strpool_slot_mask);
+        while (w->strpool_slots[pos] != -1)
+            pos = (pos + 1) & w->strpool_slot_mask;
+        w->strpool_slots[pos] = i;
+    }
 }
 
-static inline int strpool_find(const char *data, int len)
+// 返回找到的下标 未找到时返回-1并通过slot给出可插入的位置
+static inline int strpool_find(tinybuf_writer_ctx *w, const char *data, int len, uint32_t hash, int *slot)
 {
-    for (int i = 0; i < s_strpool_count; ++i)
+    int pos = (int)(hash & (uint32_t)w->strpool_slot_mask);
+    while (w->strpool_slots[pos] != -1)
     {
-        int l = buffer_get_length_inline(s_strpool[i].buf);
-        if (l == len && memcmp(buffer_get_data_inline(s_strpool[i].buf), data, len) == 0)
+        const strpool_entry *e = &w->strpool[w->strpool_slots[pos]];
+        int l = buffer_get_length_inline(e->buf);
+        // 空字符串的buffer没有数据 data也可能为NULL 不能交给memcmp
+        if (e->hash == hash && l == len && (len == 0 || memcmp(buffer_get_data_inline(e->buf), data, len) == 0))
         {
-            return i;
+            return w->strpool_slots[pos];
         }
+        pos = (pos + 1) & w->strpool_slot_mask;
     }
+    *slot = pos;
     return -1;
 }
 
 int strpool_add(const char *data, int len)
 {
-    int idx = strpool_find(data, len);
+    tinybuf_writer_ctx *w = tinybuf_writer_ctx_current();
+    uint32_t hash = strpool_hash(data, len);
+    // 负载因子保持在1/2以下
+    if (!w->strpool_slots || (w->strpool_count + 1) * 2 > w->strpool_slot_mask + 1)
+    {
+        strpool_rehash(w, w->strpool_slots ? (w->strpool_slot_mask + 1) * 2 : 64);
+    }
+    int slot = -1;
+    int idx = strpool_find(w, data, len, hash, &slot);
     if (idx >= 0)
         return idx;
-    if (s_strpool_count == s_strpool_capacity)
+    if (w->strpool_count == w->strpool_capacity)
     {
-        int newcap = s_strpool_capacity ? s_strpool_capacity * 2 : 16;
-        s_strpool = (strpool_entry *)tinybuf_realloc(s_strpool, sizeof(strpool_entry) * newcap);
-        s_strpool_capacity = newcap;
+        int newcap = w->strpool_capacity ? w->strpool_capacity * 2 : 16;
+        w->strpool = (strpool_entry *)tinybuf_realloc(w->strpool, sizeof(strpool_entry) * newcap);
+        w->strpool_capacity = newcap;
     }
     buffer *b = buffer_alloc();
-    buffer_assign(b, data, len);
-    s_strpool[s_strpool_count].buf = b;
-    return s_strpool_count++;
+    if (len > 0)
+    {
+        // buffer_assign把0长度当作c字符串处理
+        buffer_assign(b, data, len);
+    }
+    w->strpool[w->strpool_count].buf = b;
+    w->strpool[w->strpool_count].hash = hash;
+    w->strpool_slots[slot] = w->strpool_count;
+    return w->strpool_count++;
 }
 
 typedef struct
@@ -58,9 +108,15 @@ typedef struct
     int leaf_id;
 } trie_node;
 
+static inline uint32_t trie_child_hash(int parent, unsigned char ch)
+{
+    return ((uint32_t)parent * 2654435761u) ^ ((uint32_t)ch * 40503u);
+}
+
 int strpool_write_tail(buffer *out, tinybuf_error *r)
 {
-    if (s_strpool_count == 0)
+    tinybuf_writer_ctx *w = tinybuf_writer_ctx_current();
+    if (w->strpool_count == 0)
         return 0;
     if (!s_use_strpool_trie)
     {
@@ -69,13 +125,13 @@ int strpool_write_tail(buffer *out, tinybuf_error *r)
         if (r1 <= 0)
             return r1;
         len += r1;
-        int r2 = try_write_int_data(0, out, (uint64_t)s_strpool_count, r);
+        int r2 = try_write_int_data(0, out, (uint64_t)w->strpool_count, r);
         if (r2 <= 0)
             return r2;
         len += r2;
-        for (int i = 0; i < s_strpool_count; ++i)
+        for (int i = 0; i < w->strpool_count; ++i)
         {
-            int sl = buffer_get_length_inline(s_strpool[i].buf);
+            int sl = buffer_get_length_inline(w->strpool[i].buf);
             int r3 = try_write_type(out, serialize_string, r);
             if (r3 <= 0)
                 return r3;
@@ -86,7 +142,7 @@ int strpool_write_tail(buffer *out, tinybuf_error *r)
             len += r4;
             if (sl)
             {
-                buffer_append(out, buffer_get_data_inline(s_strpool[i].buf), sl);
+                buffer_append(out, buffer_get_data_inline(w->strpool[i].buf), sl);
             }
         }
         return len;
@@ -97,49 +153,79 @@ int strpool_write_tail(buffer *out, tinybuf_error *r)
         if (r0 <= 0)
             return r0;
     } /* trie pool */
-    trie_node *nodes = NULL;
+    // 节点按创建顺序编号 与逐个扫描的旧实现输出一致
+    // (parent,ch)到子节点的查找走开放寻址表 节点数组按倍数增长
+    int ncap = 64;
     int ncount = 1;
-    nodes = (trie_node *)tinybuf_malloc(sizeof(trie_node) * 1);
+    trie_node *nodes = (trie_node *)tinybuf_malloc(sizeof(trie_node) * ncap);
     nodes[0].parent = -1;
     nodes[0].ch = 0;
     nodes[0].is_leaf = 0;
     nodes[0].leaf_id = -1;
-    for (int i = 0; i < s_strpool_count; ++i)
+    int child_mask = 127;
+    int *child_slots = (int *)tinybuf_malloc((int)sizeof(int) * (child_mask + 1));
+    memset(child_slots, 0xff, sizeof(int) * (child_mask + 1));
+    for (int i = 0; i < w->strpool_count; ++i)
     {
-        const char *p = buffer_get_data_inline(s_strpool[i].buf);
-        int sl = buffer_get_length_inline(s_strpool[i].buf);
+        const char *p = buffer_get_data_inline(w->strpool[i].buf);
+        int sl = buffer_get_length_inline(w->strpool[i].buf);
         int cur = 0;
         for (int k = 0; k < sl; ++k)
         {
             unsigned char c = (unsigned char)p[k];
+            int pos = (int)(trie_child_hash(cur, c) & (uint32_t)child_mask);
             int found = -1;
-            for (int j = 1; j < ncount; ++j)
+            while (child_slots[pos] != -1)
             {
+                int j = child_slots[pos];
                 if (nodes[j].parent == cur && nodes[j].ch == c)
                 {
                     found = j;
                     break;
                 }
+                pos = (pos + 1) & child_mask;
             }
             if (found < 0)
             {
-                nodes = (trie_node *)tinybuf_realloc(nodes, sizeof(trie_node) * (ncount + 1));
+                if (ncount == ncap)
+                {
+                    ncap *= 2;
+                    nodes = (trie_node *)tinybuf_realloc(nodes, sizeof(trie_node) * ncap);
+                }
                 nodes[ncount].parent = cur;
                 nodes[ncount].ch = c;
                 nodes[ncount].is_leaf = 0;
                 nodes[ncount].leaf_id = -1;
                 found = ncount;
                 ++ncount;
+                child_slots[pos] = found;
+                if (ncount * 2 > child_mask + 1)
+                {
+                    child_mask = (child_mask + 1) * 2 - 1;
+                    child_slots = (int *)tinybuf_realloc(child_slots, (int)sizeof(int) * (child_mask + 1));
+                    memset(child_slots, 0xff, sizeof(int) * (child_mask + 1));
+                    for (int j = 1; j < ncount; ++j)
+                    {
+                        int pj = (int)(trie_child_hash(nodes[j].parent, nodes[j].ch) & (uint32_t)child_mask);
+                        while (child_slots[pj] != -1)
+                            pj = (pj + 1) & child_mask;
+                        child_slots[pj] = j;
+                    }
+                }
             }
             cur = found;
         }
         nodes[cur].is_leaf = 1;
         nodes[cur].leaf_id = i;
     }
+    tinybuf_free(child_slots);
     {
         int rn = try_write_int_data(0, out, (uint64_t)ncount, r);
         if (rn <= 0)
+        {
+            tinybuf_free(nodes);
             return rn;
+        }
     }
     for (int i = 0; i < ncount; ++i)
     {
@@ -147,7 +233,10 @@ int strpool_write_tail(buffer *out, tinybuf_error *r)
             uint64_t enc_parent = (nodes[i].parent < 0) ? 0 : (uint64_t)nodes[i].parent + 1;
             int rp = try_write_int_data(0, out, enc_parent, r);
             if (rp <= 0)
+            {
+                tinybuf_free(nodes);
                 return rp;
+            }
         }
         buffer_append(out, (const char *)&nodes[i].ch, 1);
         uint8_t flag = nodes[i].is_leaf ? 1 : 0;
@@ -156,10 +245,275 @@ int strpool_write_tail(buffer *out, tinybuf_error *r)
         {
             int rl = try_write_int_data(0, out, (uint64_t)nodes[i].leaf_id, r);
             if (rl <= 0)
+            {
+                tinybuf_free(nodes);
                 return rl;
+            }
         }
     }
     tinybuf_free(nodes);
     int after = buffer_get_length_inline(out);
     return after - before;
 }
+
+// read side: 第一次按下标取pool字符串时把整个pool解码成表 之后每次都是数组下标访问
+// 解码表保存在tinybuf_reader_ctx中
+void strpool_read_reset(void)
+{
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    c->pool_start = NULL;
+    c->view_count = 0;
+    c->views_truncated = 0;
+}
+
+// 编号在进程内唯一 视图可以交给其他线程读取 那个线程的解码表不会把它当成自己某次读取的编号
+static tb_atomic_t s_read_gen = 0;
+
+uint32_t strpool_read_begin(void)
+{
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    uint32_t gen;
+    // 0留给从未解码过的表
+    do
+    {
+        gen = (uint32_t)tb_atomic_add(&s_read_gen, 1);
+    } while (gen == 0);
+    c->read_gen = gen;
+    return gen;
+}
+
+uint32_t strpool_read_gen(void)
+{
+    return tinybuf_reader_ctx_current()->read_gen;
+}
+
+// pool来自不可信的输入 各处的计数和长度都先检查再收窄为int
+static inline int varint_room(int64_t rem)
+{
+    return rem > INT_MAX ? INT_MAX : (int)rem;
+}
+
+static int read_views_reserve(tinybuf_reader_ctx *c, int count)
+{
+    if (count <= c->view_capacity)
+        return 0;
+    int64_t newcap = c->view_capacity ? c->view_capacity : 16;
+    while (newcap < count)
+        newcap *= 2;
+    if (newcap > INT_MAX)
+        newcap = count;
+    strpool_view *views = (strpool_view *)tinybuf_realloc64(c->views, sizeof(strpool_view) * (size_t)newcap);
+    if (!views)
+        return -1;
+    c->views = views;
+    c->view_capacity = (int)newcap;
+    return 0;
+}
+
+// 返回解码用到的字节数 -1无效
+static int64_t read_build_flat(tinybuf_reader_ctx *c, const char *q, int64_t rem)
+{
+    const char *begin = q;
+    uint64_t cnt = 0;
+    int l = int_deserialize((const uint8_t *)q, varint_room(rem), &cnt);
+    if (l <= 0)
+        return -1;
+    q += l;
+    rem -= l;
+    if (cnt > (uint64_t)rem)
+    {
+        // 每个条目至少占2字节 条目数超出剩余长度时只能解码出前一部分
+        c->views_truncated = 1;
+        cnt = (uint64_t)rem;
+    }
+    if (cnt > INT_MAX || read_views_reserve(c, (int)cnt) < 0)
+        return -1;
+    for (uint64_t i = 0; i < cnt; ++i)
+    {
+        if (rem < 1)
+        {
+            c->views_truncated = 1;
+            return 0;
+        }
+        if ((uint8_t)q[0] != serialize_string)
+            return -1;
+        ++q;
+        --rem;
+        uint64_t sl = 0;
+        int l2 = int_deserialize((const uint8_t *)q, varint_room(rem), &sl);
+        if (l2 <= 0 || (uint64_t)(rem - l2) < sl)
+        {
+            c->views_truncated = 1;
+            return 0;
+        }
+        if (sl > INT_MAX)
+            return -1;
+        q += l2;
+        rem -= l2;
+        c->views[c->view_count].data = q;
+        c->views[c->view_count].len = (int)sl;
+        ++c->view_count;
+        q += sl;
+        rem -= sl;
+    }
+    return q - begin;
+}
+
+// trie还原出的字符串总长是各叶子深度之和 一条链上每个节点都是叶子时随节点数平方增长
+// 超过pool本身这个倍数且超过下限时视为构造的输入 拒绝解码
+#define STRPOOL_TRIE_TEXT_RATIO 256
+#define STRPOOL_TRIE_TEXT_FLOOR (16 << 20)
+
+static int64_t read_build_trie(tinybuf_reader_ctx *c, const char *q, int64_t rem)
+{
+    const char *begin = q;
+    int64_t text_limit = rem * STRPOOL_TRIE_TEXT_RATIO;
+    if (text_limit < STRPOOL_TRIE_TEXT_FLOOR)
+        text_limit = STRPOOL_TRIE_TEXT_FLOOR;
+    if (text_limit > INT_MAX)
+        text_limit = INT_MAX;
+    uint64_t ncount = 0;
+    int l = int_deserialize((const uint8_t *)q, varint_room(rem), &ncount);
+    if (l <= 0)
+        return -1;
+    q += l;
+    rem -= l;
+    if (ncount > (uint64_t)rem)
+    {
+        // 每个节点至少占3字节
+        c->views_truncated = 1;
+        return 0;
+    }
+    if (ncount > INT_MAX)
+        return -1;
+    int n = (int)ncount;
+    // 每次读取都会重新解码 临时数组放在ctx中复用 parent/depth/leaf各n个int 之后是n字节的字符
+    int64_t need = (int64_t)n * (3 * (int64_t)sizeof(int) + 1);
+    if (need > c->trie_scratch_capacity)
+    {
+        char *scratch = (char *)tinybuf_realloc64(c->trie_scratch, (size_t)need);
+        if (!scratch)
+            return -1;
+        c->trie_scratch = scratch;
+        c->trie_scratch_capacity = need;
+    }
+    int *parent = (int *)c->trie_scratch;
+    int *depth = parent + n;
+    int *leaf = depth + n;
+    unsigned char *chs = (unsigned char *)(leaf + n);
+    int leaf_count = 0;
+    int64_t total = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        uint64_t p = 0;
+        int lp = int_deserialize((const uint8_t *)q, varint_room(rem), &p);
+        if (lp <= 0 || rem - lp < 2)
+        {
+            c->views_truncated = 1;
+            return 0;
+        }
+        q += lp;
+        rem -= lp;
+        // parent编码为下标+1 0表示根 父节点总在子节点之前
+        if (p > (uint64_t)i)
+        {
+            return -1;
+        }
+        parent[i] = (int)p - 1;
+        chs[i] = (unsigned char)q[0];
+        unsigned char flag = (unsigned char)q[1];
+        q += 2;
+        rem -= 2;
+        depth[i] = parent[i] < 0 ? 0 : depth[parent[i]] + 1;
+        leaf[i] = -1;
+        if (flag)
+        {
+            uint64_t id = 0;
+            int ll = int_deserialize((const uint8_t *)q, varint_room(rem), &id);
+            if (ll <= 0)
+            {
+                c->views_truncated = 1;
+                return 0;
+            }
+            q += ll;
+            rem -= ll;
+            if (id >= (uint64_t)n)
+            {
+                return -1;
+            }
+            leaf[i] = (int)id;
+            if ((int)id + 1 > leaf_count)
+                leaf_count = (int)id + 1;
+            total += depth[i];
+            if (total > text_limit)
+                return -1;
+        }
+    }
+    if (total > c->text_capacity)
+    {
+        char *text = (char *)tinybuf_realloc64(c->text, (size_t)total);
+        if (!text)
+            return -1;
+        c->text = text;
+        c->text_capacity = (int)total;
+    }
+    if (read_views_reserve(c, leaf_count) < 0)
+        return -1;
+    for (int i = 0; i < leaf_count; ++i)
+    {
+        c->views[i].data = NULL;
+        c->views[i].len = -1;
+    }
+    {
+        int64_t off = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            if (leaf[i] < 0)
+                continue;
+            char *dst = c->text + off;
+            int pos = depth[i];
+            for (int cur = i; parent[cur] >= 0; cur = parent[cur])
+            {
+                dst[--pos] = (char)chs[cur];
+            }
+            c->views[leaf[i]].data = dst;
+            c->views[leaf[i]].len = depth[i];
+            off += depth[i];
+        }
+    }
+    c->view_count = leaf_count;
+    return q - begin;
+}
+
+int strpool_read_lookup(const char *pool_start, int64_t pool_size, uint32_t gen, uint64_t idx, const char **data, int *len)
+{
+    tinybuf_reader_ctx *c = tinybuf_reader_ctx_current();
+    // 同一次读取内同一pool只解码一次 不同读取即使地址相同也重新解码
+    if (pool_start != c->pool_start || gen != c->pool_gen)
+    {
+        if (pool_size < 1)
+            return 0;
+        strpool_read_reset();
+        int64_t rb;
+        if ((uint8_t)pool_start[0] == serialize_str_pool)
+            rb = read_build_flat(c, pool_start + 1, pool_size - 1);
+        else if ((uint8_t)pool_start[0] == serialize_str_trie_pool)
+            rb = read_build_trie(c, pool_start + 1, pool_size - 1);
+        else
+            rb = -1;
+        if (rb < 0)
+        {
+            strpool_read_reset();
+            return -1;
+        }
+        c->pool_start = pool_start;
+        c->pool_gen = gen;
+    }
+    if (idx >= (uint64_t)c->view_count || c->views[idx].len < 0)
+    {
+        return (c->views_truncated && idx >= (uint64_t)c->view_count) ? 0 : -1;
+    }
+    *data = c->views[idx].data;
+    *len = c->views[idx].len;
+    return 1;
+}
@@ -1,7 +1,7 @@
 #include "tinybuf_support.h"
 
 hole_value *hole_value_new(void) {
-    hole_value *p = (hole_value *)tinybuf_malloc(sizeof(hole_value));
+    hole_value *p = (hole_value *)tinybuf_small_alloc(sizeof(hole_value));
     if (p) memset(p, 0, sizeof(hole_value));
     return p;
 }
@@ -251,7 +251,7 @@ void hole_string_clear(hole_string *s) {
         if (p->tpid == 0 && p->data.ptr && p->deleter) p->deleter((void *)p->data.ptr);
         if (p->tpid == 4 && p->data.bytes_ptr && p->deleter) p->deleter((void *)p->data.bytes_ptr);
         if (p->tpid == 3 && p->data.sub_ptr) hole_string_clear(p->data.sub_ptr);
-        tinybuf_free(p);
+        tinybuf_small_free(p);
         p = n;
     }
     if (s) { s->head = s->tail = NULL; s->count = 0; }
@@ -0,0 +1,304 @@
+#include "tinybuf_private.h"
+#include <limits.h>
+
+// 值的编码头部解析 tinybuf_value_deserialize/tinybuf_view/tinybuf_sax_read/push parser共用
+// 新增编码类型时在这里描述它的布局 各读取方式只需处理语义
+
+static inline int token_varint(const char *p, int64_t size, uint64_t *out)
+{
+    if (size <= 0)
+    {
+        return 0;
+    }
+    return int_deserialize((const uint8_t *)p, size > INT_MAX ? INT_MAX : (int)size, out);
+}
+
+// tensor头部 [dims][shape...][dtype] 或vector的[count][dtype] native另有[pad][pad个0]
+static int token_read_tensor(const char *p, int64_t size, tinybuf_token *tok)
+{
+    int64_t used = 1;
+    uint64_t a = 0;
+    int n;
+    if (tok->type == serialize_vector_tensor)
+    {
+        if ((n = token_varint(p + used, size - used, &a)) <= 0)
+            return n;
+        if (a > INT64_MAX)
+            return -1;
+        used += n;
+        tok->dims = 1;
+        tok->count = (int64_t)a;
+        tok->shape = NULL;
+    }
+    else
+    {
+        if ((n = token_varint(p + used, size - used, &a)) <= 0)
+            return n;
+        used += n;
+        if (a == 0 || a > INT_MAX)
+            return -1;
+        // 每一维至少占一个字节
+        if (a > (uint64_t)(size - used))
+            return 0;
+        tok->dims = (int)a;
+        tok->shape = p + used;
+        tok->count = 1;
+        for (int i = 0; i < tok->dims; ++i)
+        {
+            if ((n = token_varint(p + used, size - used, &a)) <= 0)
+                return n;
+            used += n;
+            if (a > INT64_MAX || (a && (uint64_t)tok->count > (uint64_t)INT64_MAX / a))
+                return -1;
+            tok->count *= (int64_t)a;
+        }
+    }
+    if ((n = token_varint(p + used, size - used, &a)) <= 0)
+        return n;
+    used += n;
+    if (a > INT_MAX)
+        return -1;
+    tok->dtype = (int)a;
+    if (tok->type == serialize_native_tensor)
+    {
+        if (size - used < 1)
+            return 0;
+        int pad = (uint8_t)p[used];
+        if (pad >= TENSOR_NATIVE_ALIGN)
+            return -1;
+        used += 1 + pad;
+        if (used > size)
+            return 0;
+        int width = tensor_elem_width(tok->dtype);
+        if (tok->count > INT64_MAX / width)
+            return -1;
+        tok->body = tok->count * width;
+    }
+    else if (tok->dtype == 8 || tok->dtype == 10)
+    {
+        int width = tok->dtype == 8 ? 8 : 4;
+        if (tok->count > INT64_MAX / width)
+            return -1;
+        tok->body = tok->count * width;
+    }
+    else if (tok->dtype == 11)
+    {
+        tok->body = tok->count / 8 + (tok->count % 8 != 0);
+    }
+    else
+    {
+        // 逐个元素带类型字节的varint 长度要逐个解析才知道 与map/array一样只要求头部完整
+        tok->body = tok->count ? -1 : 0;
+        tok->head = used;
+        return 1;
+    }
+    tok->head = used;
+    return tok->body > size - used ? 0 : 1;
+}
+
+int tinybuf_token_read(const char *p, int64_t size, tinybuf_token *tok)
+{
+    if (size < 1)
+    {
+        return 0;
+    }
+    tok->type = (serialize_type)(uint8_t)p[0];
+    tok->a = 0;
+    tok->head = 1;
+    tok->body = 0;
+    uint64_t b = 0;
+    int n, m;
+    switch (tok->type)
+    {
+    case serialize_null:
+    case serialize_bool_true:
+    case serialize_bool_false:
+        return 1;
+    case serialize_double:
+        tok->body = 8;
+        return size >= 9 ? 1 : 0;
+    case serialize_positive_int:
+    case serialize_negtive_int:
+    case serialize_str_index:
+    case serialize_pointer_from_current_n:
+    case serialize_pointer_from_start_n:
+    case serialize_pointer_from_end_n:
+    case serialize_pointer_from_current_p:
+    case serialize_pointer_from_start_p:
+    case serialize_pointer_from_end_p:
+        if ((n = token_varint(p + 1, size - 1, &tok->a)) <= 0)
+            return n;
+        tok->head = 1 + n;
+        return 1;
+    case serialize_string:
+    case serialize_bool_map:
+        if ((n = token_varint(p + 1, size - 1, &tok->a)) <= 0)
+            return n;
+        if (tok->a > INT64_MAX - 7)
+            return -1;
+        tok->head = 1 + n;
+        tok->body = tok->type == serialize_string ? (int64_t)tok->a : (int64_t)(tok->a + 7) / 8;
+        return tok->body > size - tok->head ? 0 : 1;
+    case serialize_version:
+    case serialize_map:
+    case serialize_array:
+        // 之后是被包装的值或逐个子值 长度需要继续解析
+        if ((n = token_varint(p + 1, size - 1, &tok->a)) <= 0)
+            return n;
+        tok->head = 1 + n;
+        tok->body = -1;
+        return 1;
+    case serialize_str_pool_table:
+        // offset相对于值的起始 指向body之后的pool
+        if ((n = token_varint(p + 1, size - 1, &tok->a)) <= 0)
+            return n;
+        tok->head = 1 + n;
+        if (tok->a < (uint64_t)tok->head)
+            return -1;
+        if (tok->a > (uint64_t)size)
+            return 0;
+        // body之后的pool长度要解析pool才知道
+        tok->body = -1;
+        return 1;
+    case serialize_name_idx:
+        if ((n = token_varint(p + 1, size - 1, &tok->a)) <= 0)
+            return n;
+        if ((m = token_varint(p + 1 + n, size - 1 - n, &b)) <= 0)
+            return m;
+        if (b > INT64_MAX)
+            return -1;
+        tok->head = 1 + n + m;
+        tok->body = (int64_t)b;
+        return tok->body > size - tok->head ? 0 : 1;
+    case serialize_sized_map:
+    case serialize_sized_array:
+    {
+        // [字节长度][个数][子值...] 字节长度包含个数 子值可以逐个到达 这里不要求body已可读
+        uint64_t body_len = 0;
+        if ((n = token_varint(p + 1, size - 1, &body_len)) <= 0)
+            return n;
+        if (body_len > INT64_MAX)
+            return -1;
+        if ((m = token_varint(p + 1 + n, size - 1 - n, &tok->a)) <= 0)
+            return m;
+        if ((uint64_t)m > body_len)
+            return -1;
+        tok->head = 1 + n + m;
+        tok->body = (int64_t)body_len - m;
+        return 1;
+    }
+    case serialize_vector_tensor:
+    case serialize_dense_tensor:
+    case serialize_native_tensor:
+        return token_read_tensor(p, size, tok);
+    default:
+        return -1;
+    }
+}
+
+int64_t tinybuf_token_pointer_target(const tinybuf_token *tok, int64_t at, int64_t all_size)
+{
+    int64_t off = tok->type <= serialize_pointer_from_end_n ? -(int64_t)tok->a : (int64_t)tok->a;
+    switch (tok->type)
+    {
+    case serialize_pointer_from_current_n:
+    case serialize_pointer_from_current_p:
+        off += at + tok->head;
+        break;
+    case serialize_pointer_from_end_n:
+    case serialize_pointer_from_end_p:
+        off = all_size - off;
+        break;
+    default:
+        break;
+    }
+    return off < 0 || off >= all_size ? -1 : off;
+}
+
+int64_t tinybuf_token_varint_body(const char *p, int64_t size, int64_t count)
+{
+    int64_t used = 0;
+    for (int64_t i = 0; i < count; ++i)
+    {
+        uint64_t v;
+        if (size - used < 2)
+            return 0;
+        int n = token_varint(p + used + 1, size - used - 1, &v);
+        if (n <= 0)
+            return n;
+        used += 1 + n;
+    }
+    return used;
+}
+
+int tinybuf_token_shape(const tinybuf_token *tok, int64_t *shape)
+{
+    if (!tok->shape)
+    {
+        shape[0] = tok->count;
+        return 1;
+    }
+    const char *q = tok->shape;
+    for (int i = 0; i < tok->dims; ++i)
+    {
+        uint64_t k = 0;
+        // 头部已完整解析过 这里不会越界
+        q += token_varint(q, 10, &k);
+        shape[i] = (int64_t)k;
+    }
+    return tok->dims;
+}
+
+int64_t tinybuf_value_skip(const char *p, int64_t size)
+{
+    tinybuf_token tok;
+    int ok = tinybuf_token_read(p, size, &tok);
+    if (ok <= 0)
+    {
+        return ok;
+    }
+    if (tok.body >= 0)
+    {
+        // 只有sized容器的body可能还不可读
+        return tok.body > size - tok.head ? 0 : tok.head + tok.body;
+    }
+    int64_t used = tok.head;
+    switch (tok.type)
+    {
+    case serialize_version:
+    {
+        int64_t inner = tinybuf_value_skip(p + used, size - used);
+        return inner <= 0 ? inner : used + inner;
+    }
+    case serialize_map:
+    case serialize_array:
+        for (uint64_t i = 0; i < tok.a; ++i)
+        {
+            if (tok.type == serialize_map)
+            {
+                uint64_t klen;
+                int m = token_varint(p + used, size - used, &klen);
+                if (m <= 0)
+                    return m;
+                if (klen > (uint64_t)(size - used - m))
+                    return 0;
+                used += m + (int64_t)klen;
+            }
+            int64_t child = tinybuf_value_skip(p + used, size - used);
+            if (child <= 0)
+                return child;
+            used += child;
+        }
+        return used;
+    case serialize_vector_tensor:
+    case serialize_dense_tensor:
+    {
+        // 逐元素varint的tensor
+        int64_t body = tinybuf_token_varint_body(p + used, size - used, tok.count);
+        return body <= 0 ? body : used + body;
+    }
+    default:
+        // str_pool_table的pool长度未知
+        return -1;
+    }
+}
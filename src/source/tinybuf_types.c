@@ -45,6 +45,15 @@ void* tinybuf_tensor_get_data(tinybuf_value *value, tinybuf_error *r)
     assert(r);
     if(!value || value->_type != tinybuf_tensor){ tinybuf_result_add_msg_const(r, "tinybuf_tensor_get_data: not tensor"); return NULL; }
     tinybuf_tensor_t *t = (tinybuf_tensor_t*)value->_data._custom;
+    if(t && t->borrowed){
+        // 零拷贝读取的数据可能在只读映射中 可写访问前先拷贝一份
+        int64_t bytes = t->count * tensor_elem_width(t->dtype);
+        void *own = tinybuf_malloc64((size_t)(bytes ? bytes : 1));
+        if(!own){ tinybuf_result_add_msg_const(r, "tinybuf_tensor_get_data: out of memory"); return NULL; }
+        memcpy(own, t->data, (size_t)bytes);
+        t->data = own;
+        t->borrowed = 0;
+    }
     return t ? t->data : NULL;
 }
 
@@ -56,6 +65,15 @@ const void* tinybuf_tensor_get_data_const(const tinybuf_value *value, tinybuf_er
     return t ? t->data : NULL;
 }
 
+void tensor_free(void *tensor)
+{
+    tinybuf_tensor_t *t = (tinybuf_tensor_t*)tensor;
+    if(!t) return;
+    tinybuf_free(t->shape);
+    if(!t->borrowed) tinybuf_free(t->data);
+    tinybuf_free(t);
+}
+
 int tinybuf_value_init_tensor(tinybuf_value *value, int dtype, const int64_t *shape, int dims, const void *data, int64_t elem_count)
 {
     if (!value || !shape || dims <= 0 || elem_count < 0) return -1;
@@ -66,6 +84,7 @@ int tinybuf_value_init_tensor(tinybuf_value *value, int dtype, const int64_t *sh
     t->shape = (int64_t*)tinybuf_malloc(sizeof(int64_t)*(size_t)dims);
     for (int i = 0; i < dims; ++i) { t->shape[i] = shape[i]; }
     t->count = elem_count;
+    t->borrowed = 0;
     size_t bytes;
     switch (dtype) {
     case 8:  bytes = (size_t)(elem_count * 8); break;
@@ -73,11 +92,12 @@ int tinybuf_value_init_tensor(tinybuf_value *value, int dtype, const int64_t *sh
     case 11: bytes = (size_t)(elem_count);     break;
     default: bytes = (size_t)(elem_count * sizeof(int64_t)); break;
     }
-    t->data = tinybuf_malloc(bytes);
+    t->data = tinybuf_malloc64(bytes ? bytes : 1);
     if (data && bytes) { memcpy(t->data, data, bytes); }
     value->_type = tinybuf_tensor;
     value->_data._custom = t;
-    value->_custom_free = NULL;
+    value->_custom_free = tensor_free;
+    if (value_arena(value)) { tinybuf_arena_track(value_arena(value), value); }
     return 0;
 }
 
@@ -105,7 +125,7 @@ int tinybuf_value_init_bool_map(tinybuf_value *value, const uint8_t *bits, int64
     tinybuf_bool_map_t *bm=(tinybuf_bool_map_t*)tinybuf_malloc(sizeof(tinybuf_bool_map_t));
     bm->count=count;
     int64_t bytes=(count+7)/8;
-    bm->bits=(uint8_t*)tinybuf_malloc((int)bytes);
+    bm->bits=(uint8_t*)tinybuf_malloc64((size_t)(bytes ? bytes : 1));
     if(bits && bytes>0)
     {
         memcpy(bm->bits, bits, (size_t)bytes);
@@ -115,6 +135,7 @@ int tinybuf_value_init_bool_map(tinybuf_value *value, const uint8_t *bits, int64
         memset(bm->bits, 0, (size_t)bytes);
     }
     value->_type=tinybuf_bool_map; value->_data._custom=bm; value->_custom_free=NULL;
+    if(value_arena(value)){ tinybuf_arena_track(value_arena(value), value); }
     return 0;
 }
 
@@ -3,9 +3,9 @@
 #include "tinybuf_private.h"
 #include <stdlib.h>
 
-static tinybuf_value **s_clear_stack = NULL;
-static int s_clear_stack_count = 0;
-static int s_clear_stack_capacity = 0;
+static TB_THREAD_LOCAL tinybuf_value **s_clear_stack = NULL;
+static TB_THREAD_LOCAL int s_clear_stack_count = 0;
+static TB_THREAD_LOCAL int s_clear_stack_capacity = 0;
 
 static inline int clear_stack_contains(tinybuf_value *v)
 {
@@ -61,6 +61,25 @@ static inline bool has_sub_ref(const tinybuf_value *value)
 }
 
 int tinybuf_value_clear(tinybuf_value *value);
+
+// 还有其他value共享时只减少引用 最后一个引用释放子节点
+static void vec_free(tinybuf_value_vec *vec)
+{
+    if (!vec || (tb_atomic_load(&vec->shares) > 0 && tb_atomic_add(&vec->shares, -1) >= 0))
+    {
+        return;
+    }
+    for (int i = 0; i < vec->count; ++i)
+    {
+        tinybuf_value_free(vec->items[i]);
+    }
+    if (!vec->arena)
+    {
+        tinybuf_free(vec->items);
+        tinybuf_small_free(vec);
+    }
+}
+
 static inline bool maybe_free_sub_ref(tinybuf_value *value)
 {
     if (has_sub_ref(value))
@@ -98,17 +117,28 @@ static inline bool maybe_free_custom(tinybuf_value *value)
     return false;
 }
 
-tinybuf_value *tinybuf_value_alloc(void)
+void tinybuf_value_release_payload(tinybuf_value *value)
+{
+    maybe_free_custom(value);
+}
+
+tinybuf_value *value_alloc_in(tinybuf_arena *arena)
 {
-    tinybuf_value *ret = tinybuf_malloc(sizeof(tinybuf_value));
+    tinybuf_value *ret = arena ? tinybuf_arena_alloc(arena, sizeof(tinybuf_value)) : tinybuf_small_alloc(sizeof(tinybuf_value));
     assert(ret);
     memset(ret, 0, sizeof(tinybuf_value));
+    ret->_arena = arena;
     ret->_type = tinybuf_null;
     ret->_plugin_index = -1;
     ret->_custom_box_tag = -1;
     return ret;
 }
 
+tinybuf_value *tinybuf_value_alloc(void)
+{
+    return value_alloc_in(s_value_arena);
+}
+
 tinybuf_value *tinybuf_value_alloc_with_type(tinybuf_type type)
 {
     tinybuf_value *value = tinybuf_value_alloc();
@@ -119,14 +149,155 @@ tinybuf_value *tinybuf_value_alloc_with_type(tinybuf_type type)
 int tinybuf_value_free(tinybuf_value *value)
 {
     assert(value);
+    if (value->_arena)
+    {
+        // 随arena整体释放
+        return 0;
+    }
+    // 父节点正在释放或已经在替换它时失效 不再向上通知
+    value->_parent = NULL;
     tinybuf_value_clear(value);
-    tinybuf_free(value);
+    tinybuf_small_free(value);
     return 0;
 }
 
+// tinybuf_value_get_string对短字符串返回的buffer 按value地址放在这张表里 value本身不修改 多个线程可以同时读取
+// value的短字符串改写或清空时释放对应的buffer 开放寻址 容量为2的幂 最多用一半
+typedef struct
+{
+    const tinybuf_value *value;
+    buffer *buf;
+} str_box;
+
+static tb_spinlock_t s_str_box_lock = 0;
+static str_box *s_str_boxes = NULL;
+static int s_str_box_capacity = 0;
+// 只在锁内修改 锁外用来跳过表为空的情况
+static tb_atomic_t s_str_box_count = 0;
+
+static inline int str_box_slot(const tinybuf_value *value, int capacity)
+{
+    uint64_t h = (uint64_t)(uintptr_t)value * 0x9E3779B97F4A7C15ULL;
+    return (int)(h >> 32) & (capacity - 1);
+}
+
+static int str_box_find(const tinybuf_value *value)
+{
+    if (!s_str_box_capacity)
+    {
+        return -1;
+    }
+    int mask = s_str_box_capacity - 1;
+    for (int i = str_box_slot(value, s_str_box_capacity);; i = (i + 1) & mask)
+    {
+        if (s_str_boxes[i].value == value)
+        {
+            return i;
+        }
+        if (!s_str_boxes[i].value)
+        {
+            return -1;
+        }
+    }
+}
+
+static void str_box_insert(const tinybuf_value *value, buffer *buf)
+{
+    int mask = s_str_box_capacity - 1;
+    int i = str_box_slot(value, s_str_box_capacity);
+    while (s_str_boxes[i].value)
+    {
+        i = (i + 1) & mask;
+    }
+    s_str_boxes[i].value = value;
+    s_str_boxes[i].buf = buf;
+}
+
+// 锁内调用
+static buffer *str_box_get(const tinybuf_value *value)
+{
+    int i = str_box_find(value);
+    if (i >= 0)
+    {
+        return s_str_boxes[i].buf;
+    }
+    int count = tb_atomic_load_relaxed(&s_str_box_count);
+    if ((count + 1) * 2 > s_str_box_capacity)
+    {
+        str_box *old = s_str_boxes;
+        int old_capacity = s_str_box_capacity;
+        s_str_box_capacity = old_capacity ? old_capacity * 2 : 64;
+        s_str_boxes = (str_box *)tinybuf_malloc64(sizeof(str_box) * (size_t)s_str_box_capacity);
+        assert(s_str_boxes);
+        memset(s_str_boxes, 0, sizeof(str_box) * (size_t)s_str_box_capacity);
+        for (int j = 0; j < old_capacity; ++j)
+        {
+            if (old[j].value)
+            {
+                str_box_insert(old[j].value, old[j].buf);
+            }
+        }
+        tinybuf_free(old);
+    }
+    buffer *buf = buffer_alloc();
+    assert(buf);
+    str_box_insert(value, buf);
+    tb_atomic_add(&s_str_box_count, 1);
+    return buf;
+}
+
+// value的短字符串将被改写或清空 调用方持有value 与读取它的线程之间已经同步
+static void str_box_drop(const tinybuf_value *value)
+{
+    if (!tb_atomic_load_relaxed(&s_str_box_count))
+    {
+        return;
+    }
+    buffer *buf = NULL;
+    tb_spinlock_lock(&s_str_box_lock);
+    int i = str_box_find(value);
+    if (i >= 0)
+    {
+        buf = s_str_boxes[i].buf;
+        // 后面同一段连续占用的槽位往前移 保证查找不会提前遇到空位
+        int mask = s_str_box_capacity - 1;
+        for (int j = (i + 1) & mask; s_str_boxes[j].value; j = (j + 1) & mask)
+        {
+            int k = str_box_slot(s_str_boxes[j].value, s_str_box_capacity);
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            {
+                continue;
+            }
+            s_str_boxes[i] = s_str_boxes[j];
+            i = j;
+        }
+        s_str_boxes[i].value = NULL;
+        s_str_boxes[i].buf = NULL;
+        tb_atomic_add(&s_str_box_count, -1);
+    }
+    tb_spinlock_unlock(&s_str_box_lock);
+    if (buf)
+    {
+        buffer_free(buf);
+    }
+}
+
 int tinybuf_value_clear(tinybuf_value *value)
 {
     assert(value);
+    if (value->_arena)
+    {
+        // 子节点归arena所有 只释放自身在堆上的payload 不遍历
+        tinybuf_arena *arena = value->_arena;
+        tinybuf_value *parent = value->_parent;
+        maybe_free_custom(value);
+        memset(value, 0, sizeof(tinybuf_value));
+        value->_type = tinybuf_null;
+        value->_arena = arena;
+        value->_parent = parent;
+        value_touch(value);
+        return 0;
+    }
     if (clear_stack_contains(value))
     {
         return 0;
@@ -136,7 +307,13 @@ int tinybuf_value_clear(tinybuf_value *value)
     {
     case tinybuf_string:
     {
-        if (value->_data._string)
+        if (value->_str_inline)
+        {
+            str_box_drop(value);
+            value->_str_inline = 0;
+            memset(value->_sso, 0, sizeof(value->_sso));
+        }
+        else if (value->_data._string)
         {
             buffer_free(value->_data._string);
             value->_data._string = NULL;
@@ -145,9 +322,14 @@ int tinybuf_value_clear(tinybuf_value *value)
     break;
 
     case tinybuf_map:
-    case tinybuf_array:
     {
-        if (value->_data._map_array)
+        if (value->_map_backend == tinybuf_map_backend_hash)
+        {
+            tinybuf_hash_map *map = value->_data._hash_map;
+            value->_data._hash_map = NULL;
+            tinybuf_hash_map_free(map);
+        }
+        else if (value->_data._map_array)
         {
             avl_tree_free(value->_data._map_array);
             value->_data._map_array = NULL;
@@ -155,6 +337,14 @@ int tinybuf_value_clear(tinybuf_value *value)
     }
     break;
 
+    case tinybuf_array:
+    {
+        tinybuf_value_vec *vec = value->_data._array;
+        value->_data._array = NULL;
+        vec_free(vec);
+    }
+    break;
+
     default:
         break;
     }
@@ -164,9 +354,13 @@ int tinybuf_value_clear(tinybuf_value *value)
 
     if (value->_type != tinybuf_null)
     {
+        // 仍留在父节点中
+        tinybuf_value *parent = value->_parent;
         memset(value, 0, sizeof(tinybuf_value));
         value->_type = tinybuf_null;
+        value->_parent = parent;
     }
+    value_touch(value);
     clear_stack_pop(value);
     return 0;
 }
@@ -196,19 +390,166 @@ static void buffer_key_free(AVLTreeKey key)
     buffer_free((buffer *)key);
 }
 
+static tinybuf_map_backend s_map_backend = tinybuf_map_backend_avl;
+
+static void *arena_alloc_func(void *ctx, size_t size)
+{
+    return tinybuf_arena_alloc((tinybuf_arena *)ctx, size);
+}
+
+static inline AVLTree *map_tree_new(const tinybuf_value *value)
+{
+    tinybuf_arena *arena = value_arena(value);
+    return arena ? avl_tree_new_with_alloc(mapKeyCompare, arena_alloc_func, arena) : avl_tree_new(mapKeyCompare);
+}
+
+static inline tinybuf_hash_map *map_hash_new(const tinybuf_value *value)
+{
+    tinybuf_arena *arena = value_arena(value);
+    return arena ? tinybuf_hash_map_new_arena(arena) : tinybuf_hash_map_new();
+}
+
+buffer *value_buffer_new(const tinybuf_value *owner, const char *data, int64_t len)
+{
+    tinybuf_arena *arena = value_arena(owner);
+    if (arena)
+    {
+        return tinybuf_arena_buffer(arena, data, len);
+    }
+    buffer *buf = buffer_alloc();
+    if (len > 0)
+    {
+        buffer_assign64(buf, data, len);
+    }
+    return buf;
+}
+
+buffer *value_key_new(const tinybuf_value *owner, const char *data, int64_t len)
+{
+    tinybuf_arena *arena = value_arena(owner);
+    if (arena)
+    {
+        return tinybuf_arena_buffer(arena, data, len);
+    }
+    return buffer_alloc_packed(data, len);
+}
+
+void tinybuf_set_map_backend(tinybuf_map_backend backend)
+{
+    s_map_backend = backend;
+}
+
+tinybuf_map_backend tinybuf_get_map_backend(void)
+{
+    return s_map_backend;
+}
+
+void tinybuf_map_init(tinybuf_value *value, tinybuf_map_backend backend)
+{
+    assert(value);
+    tinybuf_value_clear(value);
+    value->_type = tinybuf_map;
+    value->_map_backend = backend;
+    if (backend == tinybuf_map_backend_hash)
+    {
+        value->_data._hash_map = map_hash_new(value);
+    }
+    else
+    {
+        value->_data._map_array = map_tree_new(value);
+    }
+}
+
+static inline int is_hash_map(const tinybuf_value *value)
+{
+    return value->_type == tinybuf_map && value->_map_backend == tinybuf_map_backend_hash;
+}
+
+static int map_visit_unshare(void *user_data, buffer *key, tinybuf_value *val)
+{
+    tinybuf_value *parent = (tinybuf_value *)user_data;
+    tinybuf_value_map_set2(parent, value_key_new(parent, buffer_get_data_inline(key), buffer_get_length_inline(key)), tinybuf_value_share(val));
+    return 0;
+}
+
+// 子节点表被其他tinybuf_value_share的副本共享时 修改前复制这一层 子节点同样共享 继续共享下一层
+static void map_unshare(tinybuf_value *parent)
+{
+    tinybuf_value shared = *parent;
+    if (is_hash_map(parent))
+    {
+        if (!tinybuf_hash_map_is_shared(parent->_data._hash_map))
+        {
+            value_reclaim_children(parent);
+            return;
+        }
+        parent->_shared_table = 0;
+        parent->_data._hash_map = map_hash_new(parent);
+        tinybuf_hash_map_reserve(parent->_data._hash_map, tinybuf_hash_map_size(shared._data._hash_map));
+        tinybuf_map_for_each(&shared, parent, map_visit_unshare);
+        tinybuf_hash_map_free(shared._data._hash_map);
+        return;
+    }
+    if (!avl_tree_is_shared(parent->_data._map_array))
+    {
+        value_reclaim_children(parent);
+        return;
+    }
+    parent->_shared_table = 0;
+    parent->_data._map_array = map_tree_new(parent);
+    tinybuf_map_for_each(&shared, parent, map_visit_unshare);
+    avl_tree_free(shared._data._map_array);
+}
+
+// 非map类型时转换为map 新建的map使用当前设置的后端 versionlist始终使用avl
+// 子节点表是共享的时复制一份 之后可以修改
+static void map_prepare(tinybuf_value *parent)
+{
+    value_touch(parent);
+    if (parent->_type != tinybuf_map && parent->_type != tinybuf_versionlist)
+    {
+        tinybuf_map_init(parent, s_map_backend);
+    }
+    else if (!parent->_data._map_array)
+    {
+        if (parent->_type == tinybuf_map && s_map_backend == tinybuf_map_backend_hash)
+        {
+            parent->_map_backend = tinybuf_map_backend_hash;
+            parent->_data._hash_map = map_hash_new(parent);
+        }
+        else
+        {
+            parent->_map_backend = tinybuf_map_backend_avl;
+            parent->_data._map_array = map_tree_new(parent);
+        }
+    }
+    else
+    {
+        map_unshare(parent);
+    }
+}
+
 int tinybuf_value_map_set2(tinybuf_value *parent, buffer *key, tinybuf_value *value)
 {
     assert(parent);
     assert(key);
     assert(value);
-    if (parent->_type != tinybuf_map && parent->_type != tinybuf_versionlist)
+    map_prepare(parent);
+    value_adopt(parent, value);
+    if (is_hash_map(parent))
     {
-        tinybuf_value_clear(parent);
-        parent->_type = tinybuf_map;
+        // key拷贝进hash表自己的arena
+        tinybuf_hash_map_set(parent->_data._hash_map, buffer_get_data_inline(key), buffer_get_length_inline(key), value);
+        buffer_free(key);
+        return 0;
     }
-    if (!parent->_data._map_array)
+    tinybuf_arena *arena = value_arena(parent);
+    if (arena && !key->_in_arena)
     {
-        parent->_data._map_array = avl_tree_new(mapKeyCompare);
+        // arena中的树不能引用堆上的key 拷贝后释放
+        buffer *copy = tinybuf_arena_buffer(arena, buffer_get_data_inline(key), buffer_get_length_inline(key));
+        buffer_free(key);
+        key = copy;
     }
     avl_tree_insert(parent->_data._map_array, key, value, buffer_key_free, mapFreeValueFunc);
     return 0;
@@ -217,9 +558,16 @@ int tinybuf_value_map_set2(tinybuf_value *parent, buffer *key, tinybuf_value *va
 int tinybuf_value_map_set(tinybuf_value *parent, const char *key, tinybuf_value *value)
 {
     assert(key);
-    buffer *key_buf = buffer_alloc();
+    assert(parent);
+    map_prepare(parent);
+    if (is_hash_map(parent))
+    {
+        assert(value);
+        value_adopt(parent, value);
+        return tinybuf_hash_map_set(parent->_data._hash_map, key, (int)strlen(key), value);
+    }
+    buffer *key_buf = value_key_new(parent, key, (int64_t)strlen(key));
     assert(key_buf);
-    buffer_assign(key_buf, key, 0);
     return tinybuf_value_map_set2(parent, key_buf, value);
 }
 
@@ -231,26 +579,196 @@ int tinybuf_value_map_set_int(tinybuf_value *parent, uint64_t key, tinybuf_value
     return tinybuf_value_map_set2(parent, key_buf, value);
 }
 
-static int arrayKeyCompare(AVLTreeKey key1, AVLTreeKey key2)
+int tinybuf_map_size(const tinybuf_value *value)
 {
-    return (int)(((intptr_t)key1) - ((intptr_t)key2));
+    if (is_hash_map(value))
+    {
+        return tinybuf_hash_map_size(value->_data._hash_map);
+    }
+    return avl_tree_num_entries(value->_data._map_array);
 }
 
-int tinybuf_value_array_append(tinybuf_value *parent, tinybuf_value *value)
+tinybuf_value *tinybuf_map_lookup(const tinybuf_value *value, const char *key, int key_len)
 {
-    assert(parent);
-    assert(value);
+    if (is_hash_map(value))
+    {
+        return tinybuf_hash_map_get(value->_data._hash_map, key, key_len);
+    }
+    if (!value->_data._map_array)
+    {
+        return NULL;
+    }
+    struct T_buffer buf;
+    buf._data = (char *)key;
+    buf._len = key_len;
+    buf._capacity = key_len + 1;
+    buf._fixed = 1;
+    buf._in_arena = 0;
+    return (tinybuf_value *)avl_tree_lookup(value->_data._map_array, &buf);
+}
+
+typedef struct
+{
+    void *user_data;
+    tinybuf_map_visitor visitor;
+} map_visit_ctx;
+
+static int avl_tree_for_each_node_visit(void *user_data, AVLTreeNode *node)
+{
+    map_visit_ctx *ctx = (map_visit_ctx *)user_data;
+    return ctx->visitor(ctx->user_data, (buffer *)avl_tree_node_key(node), (tinybuf_value *)avl_tree_node_value(node));
+}
+
+int tinybuf_map_for_each(const tinybuf_value *value, void *user_data, tinybuf_map_visitor visitor)
+{
+    if (is_hash_map(value))
+    {
+        int size = tinybuf_hash_map_size(value->_data._hash_map);
+        for (int i = 0; i < size; ++i)
+        {
+            buffer *key = NULL;
+            tinybuf_value *child = tinybuf_hash_map_at(value->_data._hash_map, i, &key);
+            if (visitor(user_data, key, child))
+            {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    map_visit_ctx ctx = {user_data, visitor};
+    return avl_tree_for_each_node(value->_data._map_array, &ctx, avl_tree_for_each_node_visit);
+}
+
+static void array_vec_grow(tinybuf_value_vec *vec, int min_capacity)
+{
+    if (vec->capacity >= min_capacity)
+    {
+        return;
+    }
+    int newcap = vec->capacity ? vec->capacity * 2 : 8;
+    if (newcap < min_capacity)
+    {
+        newcap = min_capacity;
+    }
+    if (vec->arena)
+    {
+        tinybuf_value **items = (tinybuf_value **)tinybuf_arena_alloc(vec->arena, sizeof(tinybuf_value *) * (size_t)newcap);
+        assert(items);
+        if (vec->count)
+        {
+            memcpy(items, vec->items, sizeof(tinybuf_value *) * (size_t)vec->count);
+        }
+        vec->items = items;
+    }
+    else
+    {
+        vec->items = (tinybuf_value **)tinybuf_realloc(vec->items, (int)sizeof(tinybuf_value *) * newcap);
+        assert(vec->items);
+    }
+    vec->capacity = newcap;
+}
+
+static tinybuf_value_vec *array_vec_of(tinybuf_value *parent)
+{
+    value_touch(parent);
     if (parent->_type != tinybuf_array)
     {
         tinybuf_value_clear(parent);
         parent->_type = tinybuf_array;
     }
-    if (!parent->_data._map_array)
+    if (!parent->_data._array)
+    {
+        tinybuf_arena *arena = value_arena(parent);
+        parent->_data._array = (tinybuf_value_vec *)(arena ? tinybuf_arena_alloc(arena, sizeof(tinybuf_value_vec)) : tinybuf_small_alloc(sizeof(tinybuf_value_vec)));
+        assert(parent->_data._array);
+        memset(parent->_data._array, 0, sizeof(tinybuf_value_vec));
+        parent->_data._array->arena = arena;
+    }
+    else if (tb_atomic_load(&parent->_data._array->shares) > 0)
+    {
+        // 与其他副本共享 复制这一层后再修改
+        tinybuf_value_vec *shared = parent->_data._array;
+        tinybuf_value_vec *vec = (tinybuf_value_vec *)tinybuf_small_alloc(sizeof(tinybuf_value_vec));
+        assert(vec);
+        memset(vec, 0, sizeof(tinybuf_value_vec));
+        array_vec_grow(vec, shared->count);
+        for (int i = 0; i < shared->count; ++i)
+        {
+            vec->items[i] = tinybuf_value_share(shared->items[i]);
+            value_adopt(parent, vec->items[i]);
+        }
+        vec->count = shared->count;
+        parent->_data._array = vec;
+        parent->_shared_table = 0;
+        vec_free(shared);
+    }
+    else
+    {
+        value_reclaim_children(parent);
+    }
+    return parent->_data._array;
+}
+
+// 已经相同时不写 多个线程同时share同一个对象时只读
+static inline void set_parent(tinybuf_value *value, tinybuf_value *parent)
+{
+    if (value->_parent != parent)
+    {
+        value->_parent = parent;
+    }
+}
+
+static int map_visit_adopt(void *user_data, buffer *key, tinybuf_value *val)
+{
+    (void)key;
+    set_parent(val, (tinybuf_value *)user_data);
+    return 0;
+}
+
+static void set_children_parent(tinybuf_value *value, tinybuf_value *parent)
+{
+    if (value->_type == tinybuf_array)
+    {
+        for (int i = 0; i < tinybuf_array_size(value); ++i)
+        {
+            set_parent(value->_data._array->items[i], parent);
+        }
+    }
+    else if (value->_type == tinybuf_map && value->_data._map_array)
+    {
+        tinybuf_map_for_each(value, parent, map_visit_adopt);
+    }
+}
+
+void value_adopt_children(tinybuf_value *value)
+{
+    set_children_parent(value, value);
+}
+
+void value_orphan_children(tinybuf_value *value)
+{
+    set_children_parent(value, NULL);
+}
+
+int tinybuf_value_array_reserve(tinybuf_value *parent, int count)
+{
+    assert(parent);
+    if (count < 0)
     {
-        parent->_data._map_array = avl_tree_new(arrayKeyCompare);
+        return -1;
     }
-    int key = avl_tree_num_entries(parent->_data._map_array);
-    avl_tree_insert(parent->_data._map_array, (AVLTreeKey)key, value, NULL, mapFreeValueFunc);
+    array_vec_grow(array_vec_of(parent), count);
+    return 0;
+}
+
+int tinybuf_value_array_append(tinybuf_value *parent, tinybuf_value *value)
+{
+    assert(parent);
+    assert(value);
+    tinybuf_value_vec *vec = array_vec_of(parent);
+    array_vec_grow(vec, vec->count + 1);
+    value_adopt(parent, value);
+    vec->items[vec->count++] = value;
     return 0;
 }
 int tinybuf_value_get_child_size(const tinybuf_value *value, tinybuf_error *r)
@@ -261,18 +779,26 @@ int tinybuf_value_get_child_size(const tinybuf_value *value, tinybuf_error *r)
         tinybuf_result_add_msg_const(r, "tinybuf_value_get_child_size: not map/array");
         return 0;
     }
-    return avl_tree_num_entries(value->_data._map_array);
+    if (value->_type == tinybuf_array)
+    {
+        return tinybuf_array_size(value);
+    }
+    return tinybuf_map_size(value);
 }
 
 const tinybuf_value *tinybuf_value_get_array_child(const tinybuf_value *value, int index, tinybuf_error *r)
 {
     assert(r);
-    if (!value || value->_type != tinybuf_array || !value->_data._map_array)
+    if (!value || value->_type != tinybuf_array || !value->_data._array)
     {
         tinybuf_result_add_msg_const(r, "tinybuf_value_get_array_child: not array or empty");
         return NULL;
     }
-    return (tinybuf_value *)avl_tree_lookup(value->_data._map_array, (AVLTreeKey)index);
+    if (index < 0 || index >= value->_data._array->count)
+    {
+        return NULL;
+    }
+    return value->_data._array->items[index];
 }
 
 const tinybuf_value *tinybuf_value_get_map_child(const tinybuf_value *value, const char *key, tinybuf_error *r)
@@ -288,11 +814,7 @@ const tinybuf_value *tinybuf_value_get_map_child2(const tinybuf_value *value, co
         tinybuf_result_add_msg_const(r, "tinybuf_value_get_map_child: not map or empty");
         return NULL;
     }
-    struct T_buffer buf;
-    buf._data = (char*)key;
-    buf._len = key_len;
-    buf._capacity = key_len + 1;
-    return (tinybuf_value *)avl_tree_lookup(value->_data._map_array, &buf);
+    return tinybuf_map_lookup(value, key, key_len);
 }
 
 const tinybuf_value *tinybuf_value_get_map_child_and_key(const tinybuf_value *value, int index, buffer **key, tinybuf_error *r)
@@ -303,6 +825,15 @@ const tinybuf_value *tinybuf_value_get_map_child_and_key(const tinybuf_value *va
         tinybuf_result_add_msg_const(r, "tinybuf_value_get_map_child_and_key: not map or empty");
         return NULL;
     }
+    if (is_hash_map(value))
+    {
+        tinybuf_value *child = tinybuf_hash_map_at(value->_data._hash_map, index, key);
+        if (!child)
+        {
+            tinybuf_result_add_msg_const(r, "tinybuf_value_get_map_child_and_key: index out of range");
+        }
+        return child;
+    }
     AVLTreeNode *node = avl_tree_get_node_by_index(value->_data._map_array, index);
     if (!node)
     {
@@ -316,6 +847,41 @@ const tinybuf_value *tinybuf_value_get_map_child_and_key(const tinybuf_value *va
     return (tinybuf_value *)avl_tree_node_value(node);
 }
 
+tinybuf_value *tinybuf_value_get_array_child_mut(tinybuf_value *value, int index, tinybuf_error *r)
+{
+    assert(r);
+    if (!value || value->_type != tinybuf_array || !value->_data._array)
+    {
+        tinybuf_result_add_msg_const(r, "tinybuf_value_get_array_child_mut: not array or empty");
+        return NULL;
+    }
+    if (index < 0 || index >= value->_data._array->count)
+    {
+        return NULL;
+    }
+    // 共享过的成员_parent为NULL 交出前改为value 之后对它的修改使value的哈希缓存失效
+    tinybuf_value *child = array_vec_of(value)->items[index];
+    value_adopt(value, child);
+    return child;
+}
+
+tinybuf_value *tinybuf_value_get_map_child_mut(tinybuf_value *value, const char *key, tinybuf_error *r)
+{
+    assert(r);
+    if (!value || !key || value->_type != tinybuf_map || !value->_data._map_array)
+    {
+        tinybuf_result_add_msg_const(r, "tinybuf_value_get_map_child_mut: not map or empty");
+        return NULL;
+    }
+    map_prepare(value);
+    tinybuf_value *child = tinybuf_map_lookup(value, key, (int)strlen(key));
+    if (child)
+    {
+        value_adopt(value, child);
+    }
+    return child;
+}
+
 void tinybuf_versionlist_add(tinybuf_value *versionlist, int64_t version, tinybuf_value *value)
 {
     buffer* key_buf = buffer_alloc();
@@ -377,9 +943,38 @@ buffer *tinybuf_value_get_string(const tinybuf_value *value, tinybuf_error *r)
         tinybuf_result_add_msg_const(r, "tinybuf_value_get_string: not string");
         return NULL;
     }
+    if (value->_str_inline)
+    {
+        // 短字符串取出表里对应的buffer 内容不一致(地址被新的value复用)时重新填充 value本身不修改
+        const char *data = value_str_data(value);
+        int64_t len = value_str_len(value);
+        tb_spinlock_lock(&s_str_box_lock);
+        buffer *buf = str_box_get(value);
+        if (buffer_get_length_inline(buf) != len || (len && memcmp(buffer_get_data_inline(buf), data, (size_t)len)))
+        {
+            buffer_assign(buf, data, (int)len);
+        }
+        tb_spinlock_unlock(&s_str_box_lock);
+        return buf;
+    }
     return value->_data._string;
 }
 
+int tinybuf_value_get_string_view(const tinybuf_value *value, const char **data, int64_t *len, tinybuf_error *r)
+{
+    assert(r);
+    if (!value || value->_type != tinybuf_string)
+    {
+        tinybuf_result_add_msg_const(r, "tinybuf_value_get_string_view: not string");
+        return -1;
+    }
+    if (data)
+        *data = value_str_len(value) ? value_str_data(value) : "";
+    if (len)
+        *len = value_str_len(value);
+    return 0;
+}
+
 int tinybuf_value_init_bool(tinybuf_value *value, int flag)
 {
     assert(value);
@@ -409,6 +1004,7 @@ int tinybuf_value_init_intlike_with_type(tinybuf_value *value, tinybuf_type type
 int tinybuf_value_set_type(tinybuf_value *value, tinybuf_type type)
 {
     assert(value);
+    value_touch(value);
     value->_type = type;
     return 0;
 }
@@ -456,7 +1052,14 @@ int tinybuf_value_init_string2(tinybuf_value *value, buffer *buf)
     {
         tinybuf_value_clear(value);
     }
-    if (value->_data._string)
+    value_touch(value);
+    if (value->_str_inline)
+    {
+        str_box_drop(value);
+        value->_str_inline = 0;
+        value->_custom_free = NULL;
+    }
+    else if (value->_data._string)
     {
         buffer_free(value->_data._string);
     }
@@ -473,16 +1076,54 @@ static inline int tinybuf_value_init_string_l(tinybuf_value *value, const char *
     {
         tinybuf_value_clear(value);
     }
-    if (!value->_data._string)
+    value_touch(value);
+    if (value->_str_inline)
     {
-        value->_data._string = buffer_alloc();
+        str_box_drop(value);
+    }
+    tinybuf_arena *arena = value_arena(value);
+    if (arena)
+    {
+        // arena中的buffer不扩容 每次新建
+        if (len <= 0 && use_strlen)
+        {
+            len = (int)strlen(str);
+        }
+        value->_type = tinybuf_string;
+        value->_data._string = tinybuf_arena_buffer(arena, str, len > 0 ? len : 0);
         assert(value->_data._string);
+        return 0;
     }
-    value->_type = tinybuf_string;
     if (len <= 0 && use_strlen)
     {
         len = (int)strlen(str);
     }
+    if (len < 0)
+    {
+        len = 0;
+    }
+    if (len <= TB_SSO_CAPACITY && (value->_str_inline || !value->_data._string))
+    {
+        // 短字符串直接放在value里 不申请buffer 已有buffer时继续复用
+        value->_type = tinybuf_string;
+        value->_str_inline = 1;
+        memmove(value->_sso, str, (size_t)len);
+        memset(value->_sso + len, 0, (size_t)(TB_SSO_CAPACITY - len));
+        value->_sso[TB_SSO_CAPACITY] = (char)(TB_SSO_CAPACITY - len);
+        return 0;
+    }
+    if (value->_str_inline)
+    {
+        value->_str_inline = 0;
+        value->_custom_free = NULL;
+        value->_data._string = NULL;
+    }
+    if (!value->_data._string)
+    {
+        value->_data._string = buffer_alloc();
+        assert(value->_data._string);
+    }
+    value->_type = tinybuf_string;
     if (len > 0)
     {
         buffer_assign(value->_data._string, str, len);
@@ -1,12 +1,10 @@
 #include "tinybuf_private.h"
 #include "tinybuf_buffer.h"
 
-static int avl_tree_for_each_node_is_same(void *user_data, AVLTreeNode *node)
+static int map_visit_is_same(void *user_data, buffer *key, tinybuf_value *child1)
 {
-    AVLTree *tree2 = (AVLTree *)user_data;
-    AVLTreeKey key = avl_tree_node_key(node);
-    tinybuf_value *child1 = (tinybuf_value *)avl_tree_node_value(node);
-    tinybuf_value *child2 = avl_tree_lookup(tree2, key);
+    const tinybuf_value *map2 = (const tinybuf_value *)user_data;
+    tinybuf_value *child2 = tinybuf_map_lookup(map2, buffer_get_data_inline(key), buffer_get_length_inline(key));
     if (!child2)
     {
         return 1;
@@ -18,6 +16,141 @@ static int avl_tree_for_each_node_is_same(void *user_data, AVLTreeNode *node)
     return 0;
 }
 
+// 64位结构哈希 与tinybuf_value_is_same一致: is_same为1的两个值哈希相同
+// map按key无序合并(与后端和插入顺序无关) array按顺序合并
+// map/array的结果缓存在子节点表上 修改时沿_parent失效 见value_touch
+
+static inline uint64_t hash_mix(uint64_t h)
+{
+    // splitmix64的finalizer
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static uint64_t hash_bytes(const char *data, int64_t len, uint64_t seed)
+{
+    uint64_t h = hash_mix(seed ^ (uint64_t)len);
+    while (len >= 8)
+    {
+        uint64_t k;
+        memcpy(&k, data, 8);
+        h = hash_mix(h ^ k);
+        data += 8;
+        len -= 8;
+    }
+    if (len > 0)
+    {
+        uint64_t k = 0;
+        memcpy(&k, data, (size_t)len);
+        h = hash_mix(h ^ k ^ 0xff);
+    }
+    return h;
+}
+
+// cacheable: 整棵子树都能通过_parent通知到value 有共享的子节点表时置0 这一路上都不缓存
+static uint64_t value_hash(const tinybuf_value *value, int *cacheable);
+
+typedef struct
+{
+    uint64_t sum;
+    int cacheable;
+} map_hash_state;
+
+static int map_visit_hash(void *user_data, buffer *key, tinybuf_value *child)
+{
+    map_hash_state *state = (map_hash_state *)user_data;
+    uint64_t kh = hash_bytes(buffer_get_data_inline(key), buffer_get_length_inline(key), tinybuf_string);
+    state->sum += hash_mix(kh ^ (value_hash(child, &state->cacheable) * 0x9e3779b97f4a7c15ULL));
+    return 0;
+}
+
+uint64_t tinybuf_value_hash(const tinybuf_value *value)
+{
+    assert(value);
+    int cacheable = 1;
+    return value_hash(value, &cacheable);
+}
+
+static uint64_t value_hash(const tinybuf_value *value, int *cacheable)
+{
+    uint64_t seed = (uint64_t)value->_type * 0x9e3779b97f4a7c15ULL;
+    switch (value->_type)
+    {
+    case tinybuf_null:
+        return hash_mix(seed);
+    case tinybuf_int:
+        return hash_mix(seed ^ (uint64_t)value->_data._int);
+    case tinybuf_bool:
+        return hash_mix(seed ^ (uint64_t)(value->_data._bool != 0));
+    case tinybuf_double:
+    {
+        // -0.0 == 0.0
+        double d = value->_data._double == 0 ? 0.0 : value->_data._double;
+        uint64_t bits;
+        memcpy(&bits, &d, 8);
+        return hash_mix(seed ^ bits);
+    }
+    case tinybuf_string:
+        return hash_bytes(value_str_data(value), value_str_len(value), seed);
+    case tinybuf_array:
+    case tinybuf_map:
+    {
+        uint64_t h = value_cached_hash(value);
+        if (h)
+        {
+            return h;
+        }
+        // 共享表的成员被其他副本修改时通知不到这里
+        int sub_cacheable = !value->_shared_table;
+        if (value->_type == tinybuf_array)
+        {
+            int size = tinybuf_array_size(value);
+            h = hash_mix(seed ^ (uint64_t)size);
+            for (int i = 0; i < size; ++i)
+            {
+                h = hash_mix(h + value_hash(value->_data._array->items[i], &sub_cacheable));
+            }
+        }
+        else
+        {
+            map_hash_state state = {0, sub_cacheable};
+            if (value->_data._map_array)
+            {
+                tinybuf_map_for_each(value, &state, map_visit_hash);
+            }
+            h = hash_mix(seed ^ state.sum);
+            sub_cacheable = state.cacheable;
+        }
+        // 0留给未缓存
+        h = h ? h : 1;
+        if (sub_cacheable)
+        {
+            value_set_cached_hash(value, h);
+        }
+        else
+        {
+            *cacheable = 0;
+        }
+        return h;
+    }
+    default:
+        // 其余类型只和自身相同
+        return hash_mix(seed ^ (uint64_t)(uintptr_t)value);
+    }
+}
+
+// 两边都有有效缓存且不同时一定不相同 不在这里计算哈希
+static inline int hash_differs(const tinybuf_value *value1, const tinybuf_value *value2)
+{
+    uint64_t h1 = value_cached_hash(value1);
+    uint64_t h2 = value_cached_hash(value2);
+    return h1 && h2 && h1 != h2;
+}
+
 int tinybuf_value_is_same(const tinybuf_value *value1, const tinybuf_value *value2)
 {
     assert(value1);
@@ -45,8 +178,8 @@ int tinybuf_value_is_same(const tinybuf_value *value1, const tinybuf_value *valu
     }
     case tinybuf_string:
     {
-        int len1 = buffer_get_length_inline(value1->_data._string);
-        int len2 = buffer_get_length_inline(value2->_data._string);
+        int64_t len1 = value_str_len(value1);
+        int64_t len2 = value_str_len(value2);
         if (len1 != len2)
         {
             return 0;
@@ -55,14 +188,48 @@ int tinybuf_value_is_same(const tinybuf_value *value1, const tinybuf_value *valu
         {
             return 1;
         }
-        return buffer_is_same(value1->_data._string, value2->_data._string);
+        return memcmp(value_str_data(value1), value_str_data(value2), (size_t)len1) == 0;
     }
 
     case tinybuf_array:
+    {
+        if (value1->_data._array == value2->_data._array)
+        {
+            // tinybuf_value_share的副本共享同一组子节点
+            return 1;
+        }
+        if (hash_differs(value1, value2))
+        {
+            return 0;
+        }
+        int array_size1 = tinybuf_array_size(value1);
+        int array_size2 = tinybuf_array_size(value2);
+        if (array_size1 != array_size2)
+        {
+            return 0;
+        }
+        for (int i = 0; i < array_size1; ++i)
+        {
+            if (!tinybuf_value_is_same(value1->_data._array->items[i], value2->_data._array->items[i]))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
     case tinybuf_map:
     {
-        int map_size1 = avl_tree_num_entries(value1->_data._map_array);
-        int map_size2 = avl_tree_num_entries(value2->_data._map_array);
+        if (value1->_data._map_array == value2->_data._map_array && value1->_map_backend == value2->_map_backend)
+        {
+            return 1;
+        }
+        if (hash_differs(value1, value2))
+        {
+            return 0;
+        }
+        int map_size1 = tinybuf_map_size(value1);
+        int map_size2 = tinybuf_map_size(value2);
         if (map_size1 != map_size2)
         {
             return 0;
@@ -71,7 +238,7 @@ int tinybuf_value_is_same(const tinybuf_value *value1, const tinybuf_value *valu
         {
             return 1;
         }
-        return avl_tree_for_each_node(value1->_data._map_array, value2->_data._map_array, avl_tree_for_each_node_is_same) == 0;
+        return tinybuf_map_for_each(value1, (void *)value2, map_visit_is_same) == 0;
     }
 
     default:
@@ -80,28 +247,47 @@ int tinybuf_value_is_same(const tinybuf_value *value1, const tinybuf_value *valu
     }
 }
 
-static int avl_tree_for_each_node_clone_map(void *user_data, AVLTreeNode *node)
+static int map_visit_clone(void *user_data, buffer *key, tinybuf_value *val)
 {
     tinybuf_value *ret = (tinybuf_value *)user_data;
-    buffer *key = (buffer *)avl_tree_node_key(node);
-    tinybuf_value *val = (tinybuf_value *)avl_tree_node_value(node);
-
-    buffer *key_clone = buffer_alloc();
-    buffer_append_buffer(key_clone, key);
-    tinybuf_value_map_set2(ret, key_clone, tinybuf_value_clone(val));
+    buffer *key_clone = value_key_new(ret, buffer_get_data_inline(key), buffer_get_length_inline(key));
+    tinybuf_value_map_set2(ret, key_clone, value_clone_in(val, 0, value_arena(ret)));
 
     return 0;
 }
 
-static int avl_tree_for_each_node_clone_array(void *user_data, AVLTreeNode *node)
+static int map_visit_share(void *user_data, buffer *key, tinybuf_value *val)
 {
-    tinybuf_value_array_append((tinybuf_value *)user_data, tinybuf_value_clone(avl_tree_node_value(node)));
+    tinybuf_value *ret = (tinybuf_value *)user_data;
+    buffer *key_clone = value_key_new(ret, buffer_get_data_inline(key), buffer_get_length_inline(key));
+    tinybuf_value_map_set2(ret, key_clone, value_clone_in(val, 1, value_arena(ret)));
+
     return 0;
 }
 
-tinybuf_value *tinybuf_value_clone(const tinybuf_value *value)
+// 子节点表即将被共享 成员不再通知value 之前缓存在value和祖先上的哈希作废
+// 第一次之后只读 多个线程同时share同一个对象时不再写入
+static void mark_table_shared(tinybuf_value *value)
+{
+    if (!value->_shared_table)
+    {
+        value_orphan_children(value);
+        value->_shared_table = 1;
+        value_touch(value);
+    }
+}
+
+// 堆上的子节点表可以共享 arena中的随arena整体释放 不能被其他value引用
+static inline int can_share(const tinybuf_value *value, const tinybuf_value *ret)
+{
+    return !value->_arena && !ret->_arena;
+}
+
+// share为1时map/array的子节点表与原对象共享 见tinybuf_value_share
+static tinybuf_value *value_clone(const tinybuf_value *value, int share, tinybuf_arena *arena)
 {
-    tinybuf_value *ret = tinybuf_value_alloc_with_type(value->_type);
+    tinybuf_value *ret = value_alloc_in(arena);
+    ret->_type = value->_type;
     switch (value->_type)
     {
     case tinybuf_null:
@@ -110,31 +296,100 @@ tinybuf_value *tinybuf_value_clone(const tinybuf_value *value)
     case tinybuf_double:
     {
         memcpy(ret, value, sizeof(tinybuf_value));
+        ret->_arena = arena;
+        ret->_parent = NULL;
         return ret;
     }
     case tinybuf_string:
-        if (buffer_get_length_inline(value->_data._string))
+        if (value_str_len(value))
         {
-            ret->_data._string = buffer_alloc();
-            assert(ret->_data._string);
-            buffer_append_buffer(ret->_data._string, value->_data._string);
+            tinybuf_value_init_string(ret, value_str_data(value), (int)value_str_len(value));
         }
         return ret;
 
     case tinybuf_map:
     {
-        avl_tree_for_each_node(value->_data._map_array, ret, avl_tree_for_each_node_clone_map);
+        if (share && value->_data._map_array && can_share(value, ret))
+        {
+            // 共享子节点表 修改时由map_prepare复制
+            mark_table_shared((tinybuf_value *)value);
+            if (value->_map_backend == tinybuf_map_backend_hash)
+            {
+                tinybuf_hash_map_share(value->_data._hash_map);
+            }
+            else
+            {
+                avl_tree_share(value->_data._map_array);
+            }
+            ret->_map_backend = value->_map_backend;
+            ret->_data = value->_data;
+            ret->_shared_table = 1;
+            return ret;
+        }
+        // 保持与源map相同的后端和遍历顺序
+        tinybuf_map_init(ret, (tinybuf_map_backend)value->_map_backend);
+        tinybuf_map_for_each(value, ret, share ? map_visit_share : map_visit_clone);
         return ret;
     }
 
     case tinybuf_array:
     {
-        avl_tree_for_each_node(value->_data._map_array, ret, avl_tree_for_each_node_clone_array);
+        if (share && value->_data._array && can_share(value, ret))
+        {
+            mark_table_shared((tinybuf_value *)value);
+            tb_atomic_add(&value->_data._array->shares, 1);
+            ret->_data._array = value->_data._array;
+            ret->_shared_table = 1;
+            return ret;
+        }
+        int array_size = tinybuf_array_size(value);
+        if (array_size)
+        {
+            tinybuf_value_array_reserve(ret, array_size);
+            for (int i = 0; i < array_size; ++i)
+            {
+                const tinybuf_value *child = value->_data._array->items[i];
+                tinybuf_value_array_append(ret, value_clone_in(child, share, arena));
+            }
+        }
+        return ret;
+    }
+    case tinybuf_tensor:
+    {
+        // tensor拥有shape和data 深拷贝 零拷贝读取的tensor克隆后拥有自己的数据
+        const tinybuf_tensor_t *t = (const tinybuf_tensor_t *)value->_data._custom;
+        if (t)
+        {
+            tinybuf_value_init_tensor(ret, t->dtype, t->shape ? t->shape : &t->count, t->dims, t->data, t->count);
+        }
         return ret;
     }
     default:
+    {
         memcpy(ret, value, sizeof(tinybuf_value));
+        ret->_arena = arena;
+        ret->_parent = NULL;
         return ret;
     }
+    }
+}
+
+tinybuf_value *value_clone_in(const tinybuf_value *value, int share, tinybuf_arena *arena)
+{
+    tinybuf_value *ret = value_clone(value, share, arena);
+    // 插件和自定义box的标记随值一起复制
+    ret->_plugin_index = value->_plugin_index;
+    ret->_custom_box_tag = value->_custom_box_tag;
+    return ret;
+}
+
+tinybuf_value *tinybuf_value_clone(const tinybuf_value *value)
+{
+    return value_clone_in(value, 0, s_value_arena);
+}
+
+tinybuf_value *tinybuf_value_share(const tinybuf_value *value)
+{
+    return value_clone_in(value, 1, s_value_arena);
 }
 
@@ -0,0 +1,365 @@
+#include "tinybuf_private.h"
+#include "tinybuf_buffer.h"
+#include <limits.h>
+
+// 只读视图 直接在序列化字节上按需解码 不创建tinybuf_value
+// 数组下标和map查找需要逐个跳过前面的元素 跳过只解析长度不解码内容 带长度的容器可以整体跳过
+
+#define VIEW_MAX_POINTER_HOPS 64
+
+static inline int view_varint(const char *p, int64_t size, uint64_t *out)
+{
+    if (size <= 0)
+    {
+        return -1;
+    }
+    return int_deserialize((const uint8_t *)p, size > INT_MAX ? INT_MAX : (int)size, out);
+}
+
+static inline tinybuf_view view_child(const tinybuf_view *parent, const char *p)
+{
+    tinybuf_view child = *parent;
+    child.ptr = p;
+    child.size = (parent->ptr + parent->size) - p;
+    return child;
+}
+
+// 一个值编码占用的字节数 失败返回-1 视图总是建立在完整的字节上 数据不足也是失败
+static inline int64_t value_len(const char *p, int64_t size)
+{
+    int64_t n = tinybuf_value_skip(p, size);
+    return n > 0 ? n : -1;
+}
+
+// map/array的元素个数和第一个元素的位置
+static int container_header(const tinybuf_token *tok, int want_map, uint64_t *count, int64_t *used)
+{
+    int is_map = tok->type == serialize_map || tok->type == serialize_sized_map;
+    int is_array = tok->type == serialize_array || tok->type == serialize_sized_array;
+    if (want_map ? !is_map : !is_array)
+    {
+        return -1;
+    }
+    *count = tok->a;
+    *used = tok->head;
+    return 0;
+}
+
+// 跟随指针 展开str_pool_table 得到真正的值及其头部
+static int view_resolve(const tinybuf_view *in, tinybuf_view *out, tinybuf_token *tok)
+{
+    *out = *in;
+    for (int hop = 0; hop < VIEW_MAX_POINTER_HOPS; ++hop)
+    {
+        if (tinybuf_token_read(out->ptr, out->size, tok) <= 0)
+        {
+            return -1;
+        }
+        if (tok->type == serialize_str_pool_table)
+        {
+            // offset相对于box起始
+            out->pool = out->ptr + tok->a;
+            out->pool_size = out->size - (int64_t)tok->a;
+            out->size = (int64_t)tok->a - tok->head;
+            out->ptr += tok->head;
+            continue;
+        }
+        if (!tinybuf_token_is_pointer(tok))
+        {
+            return 0;
+        }
+        int64_t off = tinybuf_token_pointer_target(tok, out->ptr - out->base, out->all_size);
+        if (off < 0)
+        {
+            return -1;
+        }
+        out->ptr = out->base + off;
+        out->size = out->all_size - off;
+    }
+    return -1;
+}
+
+int tinybuf_view_init(tinybuf_view *view, const buf_ref *buf)
+{
+    assert(view);
+    assert(buf);
+    view->base = buf->base;
+    view->all_size = buf->all_size;
+    view->ptr = buf->ptr;
+    view->size = buf->size;
+    view->pool = NULL;
+    view->pool_size = 0;
+    // 同一块内存可能已写入新的box 解码表只在这次init得到的视图之间复用
+    view->pool_gen = strpool_read_begin();
+    if (buf->size < 1)
+    {
+        return -1;
+    }
+    if ((uint8_t)buf->ptr[0] == serialize_str_pool_table)
+    {
+        tinybuf_view inner;
+        tinybuf_token tok;
+        if (view_resolve(view, &inner, &tok) < 0)
+        {
+            return -1;
+        }
+        *view = inner;
+    }
+    return 0;
+}
+
+int tinybuf_view_type(const tinybuf_view *view)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0)
+    {
+        return -1;
+    }
+    switch (tok.type)
+    {
+    case serialize_null:
+        return tinybuf_null;
+    case serialize_positive_int:
+    case serialize_negtive_int:
+        return tinybuf_int;
+    case serialize_bool_true:
+    case serialize_bool_false:
+        return tinybuf_bool;
+    case serialize_double:
+        return tinybuf_double;
+    case serialize_string:
+    case serialize_str_index:
+        return tinybuf_string;
+    case serialize_map:
+    case serialize_sized_map:
+        return tinybuf_map;
+    case serialize_array:
+    case serialize_sized_array:
+        return tinybuf_array;
+    case serialize_vector_tensor:
+    case serialize_dense_tensor:
+    case serialize_native_tensor:
+        return tinybuf_tensor;
+    case serialize_bool_map:
+        return tinybuf_bool_map;
+    case serialize_name_idx:
+        return tinybuf_custom;
+    case serialize_version:
+        return tinybuf_version;
+    default:
+        return -1;
+    }
+}
+
+int tinybuf_view_get_int(const tinybuf_view *view, int64_t *out)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0)
+    {
+        return -1;
+    }
+    if (tok.type != serialize_positive_int && tok.type != serialize_negtive_int)
+    {
+        return -1;
+    }
+    *out = tok.type == serialize_negtive_int ? -(int64_t)tok.a : (int64_t)tok.a;
+    return 0;
+}
+
+int tinybuf_view_get_double(const tinybuf_view *view, double *out)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0 || tok.type != serialize_double)
+    {
+        return -1;
+    }
+    // 与dump_double一致 按大端保存
+    uint64_t encoded = 0;
+    for (int i = 1; i <= 8; ++i)
+    {
+        encoded = (encoded << 8) | (uint8_t)v.ptr[i];
+    }
+    memcpy(out, &encoded, 8);
+    return 0;
+}
+
+int tinybuf_view_get_bool(const tinybuf_view *view, int *out)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0)
+    {
+        return -1;
+    }
+    if (tok.type != serialize_bool_true && tok.type != serialize_bool_false)
+    {
+        return -1;
+    }
+    *out = tok.type == serialize_bool_true;
+    return 0;
+}
+
+int tinybuf_view_get_string(const tinybuf_view *view, const char **data, int *len)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0)
+    {
+        return -1;
+    }
+    switch (tok.type)
+    {
+    case serialize_string:
+        if (tok.a > INT_MAX)
+        {
+            return -1;
+        }
+        *data = v.ptr + tok.head;
+        *len = (int)tok.a;
+        return 0;
+    case serialize_str_index:
+        if (!v.pool)
+        {
+            return -1;
+        }
+        return strpool_read_lookup(v.pool, v.pool_size, v.pool_gen, tok.a, data, len) > 0 ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+int tinybuf_view_version(const tinybuf_view *view, uint64_t *version, tinybuf_view *out)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0 || tok.type != serialize_version)
+    {
+        return -1;
+    }
+    if (version)
+    {
+        *version = tok.a;
+    }
+    // 被包装的值紧跟在版本号之后 与try_read_box一样不检查版本
+    v.ptr += tok.head;
+    v.size -= tok.head;
+    if (v.size < 1)
+    {
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+int64_t tinybuf_view_size(const tinybuf_view *view)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    if (view_resolve(view, &v, &tok) < 0)
+    {
+        return -1;
+    }
+    uint64_t count;
+    int64_t used;
+    if (container_header(&tok, 1, &count, &used) < 0 && container_header(&tok, 0, &count, &used) < 0)
+    {
+        return -1;
+    }
+    return (int64_t)count;
+}
+
+int tinybuf_view_array_at(const tinybuf_view *view, int64_t index, tinybuf_view *out)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    uint64_t count;
+    int64_t used;
+    if (view_resolve(view, &v, &tok) < 0 || container_header(&tok, 0, &count, &used) < 0)
+    {
+        return -1;
+    }
+    if (index < 0 || (uint64_t)index >= count)
+    {
+        return -1;
+    }
+    for (int64_t i = 0; i < index; ++i)
+    {
+        int64_t child = value_len(v.ptr + used, v.size - used);
+        if (child < 0)
+        {
+            return -1;
+        }
+        used += child;
+    }
+    *out = view_child(&v, v.ptr + used);
+    return 0;
+}
+
+// 定位map中第index项 或key匹配的项 key为NULL时按index查找
+static int map_find(const tinybuf_view *view, int64_t index, const char *key, int key_len,
+                    const char **key_out, int *key_len_out, tinybuf_view *out)
+{
+    tinybuf_view v;
+    tinybuf_token tok;
+    uint64_t count;
+    int64_t used;
+    if (view_resolve(view, &v, &tok) < 0 || container_header(&tok, 1, &count, &used) < 0)
+    {
+        return -1;
+    }
+    if (!key && (index < 0 || (uint64_t)index >= count))
+    {
+        return -1;
+    }
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t klen;
+        int m = view_varint(v.ptr + used, v.size - used, &klen);
+        if (m <= 0 || klen > (uint64_t)(v.size - used - m))
+        {
+            return -1;
+        }
+        const char *k = v.ptr + used + m;
+        used += m + (int64_t)klen;
+        if (key ? (klen == (uint64_t)key_len && memcmp(k, key, key_len) == 0) : i == (uint64_t)index)
+        {
+            if (key_out)
+            {
+                *key_out = k;
+                *key_len_out = (int)klen;
+            }
+            *out = view_child(&v, v.ptr + used);
+            return 0;
+        }
+        int64_t child = value_len(v.ptr + used, v.size - used);
+        if (child < 0)
+        {
+            return -1;
+        }
+        used += child;
+    }
+    return -1;
+}
+
+int tinybuf_view_map_get(const tinybuf_view *view, const char *key, int key_len, tinybuf_view *out)
+{
+    assert(key);
+    if (key_len <= 0)
+    {
+        key_len = (int)strlen(key);
+    }
+    return map_find(view, 0, key, key_len, NULL, NULL, out);
+}
+
+int tinybuf_view_map_at(const tinybuf_view *view, int64_t index, const char **key, int *key_len, tinybuf_view *out)
+{
+    return map_find(view, index, NULL, 0, key, key_len, out);
+}
+
+int64_t tinybuf_view_byte_size(const tinybuf_view *view)
+{
+    return value_len(view->ptr, view->size);
+}
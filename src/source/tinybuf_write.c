@@ -2,7 +2,9 @@
 #include "tinybuf_buffer.h"
 #include "tinybuf_plugin.h"
 #include "tinybuf_memory.h"
+#include "tb_lock.h"
 #include <string.h>
+#include <limits.h>
 
 /* local varint encoder used for length probing */
 static inline int int_serialize_local(uint64_t in, uint8_t *out_bytes)
@@ -45,6 +47,127 @@ int try_write_int_data(int isneg, buffer *out, uint64_t val, tinybuf_error *r)
     return n;
 }
 
+/* str_pool_table直接写入out: 先写类型并预留offset位置 body与pool写完后回填offset
+   默认(fixed模式)预留固定宽度 用0x80补齐的变长整数回填 不移动数据 超过35位的offset才需要后移
+   关闭fixed模式时按最短编码回填 宽度变化时把后面的数据整体后移 输出最紧凑
+   native tensor模式下预留VARINT_MAX_WIDTH 数据永不移动 已写入的tensor保持对齐 */
+#define STRPOOL_FIXED_WIDTH 5
+int s_strpool_fixed_offset = 1;
+
+static inline int slot_reserved_width(void)
+{
+    if (s_tensor_native)
+        return VARINT_MAX_WIDTH;
+    return s_strpool_fixed_offset ? STRPOOL_FIXED_WIDTH : 1;
+}
+
+static inline int64_t varint_reserve(buffer *out)
+{
+    static const char zeros[VARINT_MAX_WIDTH] = {0};
+    int64_t slot = buffer_get_length_inline(out);
+    buffer_append(out, zeros, slot_reserved_width());
+    return slot;
+}
+
+// 把slot处预留的位置回填为width字节的value 返回width
+// 固定容量的buffer写满后预留没有生效 slot之后不足reserved字节 返回-1 不写入
+static int varint_backpatch(buffer *out, int64_t slot, uint64_t value, int width)
+{
+    int reserved = slot_reserved_width();
+    if (buffer_is_overflow(out) || buffer_get_length_inline(out) < slot + reserved)
+    {
+        return -1;
+    }
+    if (width > reserved)
+    {
+        static const char zeros[16] = {0};
+        int64_t tail = buffer_get_length_inline(out) - slot - reserved;
+        if (buffer_append(out, zeros, width - reserved) < 0)
+        {
+            return -1;
+        }
+        char *data = buffer_get_data_inline(out);
+        memmove(data + slot + width, data + slot + reserved, (size_t)tail);
+    }
+    uint8_t *dst = (uint8_t *)buffer_get_data_inline(out) + slot;
+    for (int i = 0; i < width; ++i)
+    {
+        dst[i] = (uint8_t)((value & 0x7F) | (i + 1 < width ? 0x80 : 0));
+        value >>= 7;
+    }
+    return width;
+}
+
+static inline int varint_width_exact(uint64_t value)
+{
+    uint8_t tmp[16];
+    return int_serialize_local(value, tmp);
+}
+
+// 回填value用的宽度 fixed/native模式下不小于预留的宽度
+static inline int varint_slot_width(uint64_t value)
+{
+    int width = varint_width_exact(value);
+    int reserved = slot_reserved_width();
+    return width < reserved ? reserved : width;
+}
+
+// str_pool_table的offset回填宽度 body_len为offset位置之后到pool之前的字节数
+static int strpool_offset_width(uint64_t body_len)
+{
+    int width = slot_reserved_width();
+    while (1)
+    {
+        int l = varint_width_exact(1 + (uint64_t)width + body_len);
+        if (l <= width)
+            return width;
+        width = l;
+    }
+}
+
+static inline int64_t strpool_table_begin(buffer *out)
+{
+    int64_t start = buffer_get_length_inline(out);
+    char type = serialize_str_pool_table;
+    buffer_append(out, &type, 1);
+    varint_reserve(out);
+    return start;
+}
+
+// body已写在out中 追加pool并回填offset 返回整个box的长度 失败时out恢复到start
+static int64_t strpool_table_overflow(buffer *out, int64_t start, tinybuf_error *r)
+{
+    buffer_set_length64(out, start);
+    tinybuf_error er = tinybuf_result_err(-1, "strpool_table_end: buffer overflow", NULL);
+    tinybuf_result_append_merge(r, &er, tinybuf_merger_left);
+    return -1;
+}
+
+static int64_t strpool_table_end(buffer *out, int64_t start, tinybuf_error *r)
+{
+    int reserved = slot_reserved_width();
+    int64_t body_len = buffer_get_length_inline(out) - start - 1 - reserved;
+    if (buffer_is_overflow(out) || body_len < 0)
+    {
+        // 固定容量的buffer已写满 offset没有预留成功
+        return strpool_table_overflow(out, start, r);
+    }
+    int rt = strpool_write_tail(out, r);
+    if (rt < 0)
+    {
+        buffer_set_length64(out, start);
+        return rt;
+    }
+    int width = strpool_offset_width((uint64_t)body_len);
+    if (varint_backpatch(out, start + 1, 1 + (uint64_t)width + (uint64_t)body_len, width) < 0)
+    {
+        return strpool_table_overflow(out, start, r);
+    }
+    tinybuf_error ok = tinybuf_result_ok(1 + width);
+    tinybuf_result_append_merge(r, &ok, tinybuf_merger_sum);
+    return buffer_get_length_inline(out) - start;
+}
+
 int try_write_version_box(buffer *out, uint64_t version, const tinybuf_value *box, tinybuf_error *r)
 {
     int before = buffer_get_length_inline(out);
@@ -58,7 +181,7 @@ int try_write_version_box(buffer *out, uint64_t version, const tinybuf_value *bo
     {
         return n2;
     }
-    int wb = try_write_box(out, box, r);
+    int64_t wb = try_write_box(out, box, r);
     if (wb <= 0)
         return wb;
     int after = buffer_get_length_inline(out);
@@ -85,7 +208,7 @@ int try_write_version_list(buffer *out, const uint64_t *versions, const tinybuf_
         {
             return ra;
         }
-        int wb = try_write_box(out, boxes[i], r);
+        int64_t wb = try_write_box(out, boxes[i], r);
         if (wb <= 0)
             return wb;
     }
@@ -93,85 +216,34 @@ int try_write_version_list(buffer *out, const uint64_t *versions, const tinybuf_
     return after - before;
 }
 
-int try_write_box(buffer *out, const tinybuf_value *value, tinybuf_error *r)
+int64_t try_write_box(buffer *out, const tinybuf_value *value, tinybuf_error *r)
 {
     if (!s_use_strpool)
     {
-        int before = buffer_get_length_inline(out);
+        int64_t before = buffer_get_length_inline(out);
         tinybuf_error rr_local = tinybuf_result_ok(0);
-        int n = tinybuf_value_serialize(value, out, &rr_local);
+        int64_t n = tinybuf_value_serialize64(value, out, &rr_local);
         if (n <= 0)
         {
             tinybuf_result_append_merge(r, &rr_local, tinybuf_merger_left);
             return n;
         }
-        int after = buffer_get_length_inline(out);
+        int64_t after = buffer_get_length_inline(out);
         return after - before;
     }
-    buffer *body = buffer_alloc();
-    buffer *pool = buffer_alloc();
-    strpool_reset_write(body);
+    strpool_reset_write(out);
+    int64_t start = strpool_table_begin(out);
     {
         tinybuf_error rr_body = tinybuf_result_ok(0);
-        int n2 = tinybuf_value_serialize(value, body, &rr_body);
+        int64_t n2 = tinybuf_value_serialize64(value, out, &rr_body);
         if (n2 <= 0)
         {
             tinybuf_result_append_merge(r, &rr_body, tinybuf_merger_left);
-            buffer_free(body);
-            buffer_free(pool);
+            buffer_set_length64(out, start);
             return n2;
         }
     }
-    {
-        int rt = strpool_write_tail(pool, r);
-        if (rt < 0)
-        {
-            buffer_free(body);
-            buffer_free(pool);
-            return rt;
-        }
-    }
-    int body_len = buffer_get_length_inline(body);
-    int pool_len = buffer_get_length_inline(pool);
-    uint64_t offset_guess_len = 1;
-    uint8_t tmp[16];
-    while (1)
-    {
-        uint64_t off = 1 + offset_guess_len + (uint64_t)body_len;
-        int l = int_serialize_local(off, tmp);
-        if ((uint64_t)l == offset_guess_len)
-            break;
-        offset_guess_len = (uint64_t)l;
-    }
-    uint64_t final_off = 1 + offset_guess_len + (uint64_t)body_len;
-    int before = buffer_get_length_inline(out);
-    {
-        int rtype = try_write_type(out, serialize_str_pool_table, r);
-        if (rtype <= 0)
-        {
-            buffer_free(body);
-            buffer_free(pool);
-            return rtype;
-        }
-    }
-    {
-        int rlen = try_write_int_data(0, out, final_off, r);
-        if (rlen <= 0)
-        {
-            buffer_free(body);
-            buffer_free(pool);
-            return rlen;
-        }
-    }
-    buffer_append(out, buffer_get_data_inline(body), body_len);
-    if (pool_len)
-    {
-        buffer_append(out, buffer_get_data_inline(pool), pool_len);
-    }
-    int after = buffer_get_length_inline(out);
-    buffer_free(body);
-    buffer_free(pool);
-    return after - before;
+    return strpool_table_end(out, start, r);
 }
 
 int try_write_plugin_map_table(buffer *out, tinybuf_error *r)
@@ -182,25 +254,22 @@ int try_write_plugin_map_table(buffer *out, tinybuf_error *r)
         tinybuf_result_append_merge(r, &er, tinybuf_merger_left);
         return -1;
     }
-    buffer *body = buffer_alloc();
-    buffer *pool = buffer_alloc();
-    strpool_reset_write(body);
+    strpool_reset_write(out);
+    int64_t start = strpool_table_begin(out);
     int pc = tinybuf_plugin_get_count();
     {
-        int rt = try_write_type(body, serialize_plugin_map_table, r);
+        int rt = try_write_type(out, serialize_plugin_map_table, r);
         if (rt <= 0)
         {
-            buffer_free(body);
-            buffer_free(pool);
+            buffer_set_length64(out, start);
             return rt;
         }
     }
     {
-        int rc = try_write_int_data(0, body, (uint64_t)pc, r);
+        int rc = try_write_int_data(0, out, (uint64_t)pc, r);
         if (rc <= 0)
         {
-            buffer_free(body);
-            buffer_free(pool);
+            buffer_set_length64(out, start);
             return rc;
         }
     }
@@ -211,72 +280,79 @@ int try_write_plugin_map_table(buffer *out, tinybuf_error *r)
             g = "";
         int idx = strpool_add(g, (int)strlen(g));
         uint8_t ty = serialize_name_idx;
-        buffer_append(body, (const char *)&ty, 1);
-        dump_int((uint64_t)idx, body);
-        dump_int(0, body);
+        buffer_append(out, (const char *)&ty, 1);
+        dump_int((uint64_t)idx, out);
+        dump_int(0, out);
     }
-    int rpool = strpool_write_tail(pool, r);
-    if (rpool < 0)
-    {
-        buffer_free(body);
-        buffer_free(pool);
-        return rpool;
-    }
-    int body_len = buffer_get_length_inline(body);
-    int pool_len = buffer_get_length_inline(pool);
-    uint64_t offset_guess_len = 1;
-    uint8_t tmp[16];
-    while (1)
-    {
-        uint64_t off = 1 + offset_guess_len + (uint64_t)body_len;
-        int l = int_serialize_local(off, tmp);
-        if ((uint64_t)l == offset_guess_len)
-            break;
-        offset_guess_len = (uint64_t)l;
-    }
-    uint64_t final_off = 1 + offset_guess_len + (uint64_t)body_len;
-    int before = buffer_get_length_inline(out);
+    return strpool_table_end(out, start, r);
+}
+
+// 与try_write_box的输出长度一致 strpool模式在临时的writer_ctx中计算 不影响当前线程的pool
+// pos为box的最终位置 决定native tensor的填充
+// precache重定向写出的指针长度取决于输出位置 无法预先计算 开启时返回-1
+static int64_t box_serialized_size(const tinybuf_value *value, int64_t pos)
+{
+    if (tinybuf_precache_is_redirect())
     {
-        int rtype = try_write_type(out, serialize_str_pool_table, r);
-        if (rtype <= 0)
-        {
-            buffer_free(body);
-            buffer_free(pool);
-            return rtype;
-        }
+        return -1;
     }
+    if (!s_use_strpool)
     {
-        int rlen = try_write_int_data(0, out, final_off, r);
-        if (rlen <= 0)
+        return value_serialized_size(value, pos);
+    }
+    tinybuf_writer_ctx *scratch = tinybuf_writer_ctx_new();
+    tinybuf_writer_ctx *old = tinybuf_writer_ctx_bind(scratch);
+    // 只有native模式的填充与位置有关 此时offset宽度固定
+    int64_t body_len = value_serialized_size(value, pos + 1 + slot_reserved_width());
+    int64_t total = -1;
+    if (body_len >= 0)
+    {
+        // pool在body之后写入 trie编码较复杂 直接写到临时buffer取长度
+        buffer *tail = buffer_alloc();
+        tinybuf_error rr = tinybuf_result_ok(0);
+        int rt = strpool_write_tail(tail, &rr);
+        tinybuf_result_unref(&rr);
+        if (rt >= 0)
         {
-            buffer_free(body);
-            buffer_free(pool);
-            return rlen;
+            int width = strpool_offset_width((uint64_t)body_len);
+            total = 1 + width + body_len + buffer_get_length_inline(tail);
         }
+        buffer_free(tail);
     }
-    buffer_append(out, buffer_get_data_inline(body), body_len);
-    if (pool_len)
-    {
-        buffer_append(out, buffer_get_data_inline(pool), pool_len);
-    }
-    int after = buffer_get_length_inline(out);
-    buffer_free(body);
-    buffer_free(pool);
-    return after - before;
+    tinybuf_writer_ctx_bind(old);
+    tinybuf_writer_ctx_free(scratch);
+    return total;
 }
 
-int try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r)
+// part头部的长度字段 native模式下固定VARINT_MAX_WIDTH 使body的最终位置在写body前已知
+static inline int part_len_width(uint64_t body_len)
+{
+    return s_tensor_native ? VARINT_MAX_WIDTH : varint_width_exact(body_len);
+}
+
+static inline int64_t part_serialized_size(const tinybuf_value *value, int64_t pos)
+{
+    int64_t body_len = box_serialized_size(value, pos + 1 + (s_tensor_native ? VARINT_MAX_WIDTH : 0));
+    return body_len <= 0 ? -1 : 1 + part_len_width((uint64_t)body_len) + body_len;
+}
+
+int64_t try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r)
 {
     buffer *body = buffer_alloc();
     tinybuf_error rbody_acc = tinybuf_result_ok(0);
-    int rbody = try_write_box(body, value, &rbody_acc);
+    // body写在单独的buffer中 之后拼接到out中part头部之后
+    tinybuf_writer_ctx *wc = tinybuf_writer_ctx_current();
+    int64_t saved_shift = wc->align_shift;
+    wc->align_shift = buffer_get_length_inline(out) + saved_shift + 1 + (s_tensor_native ? VARINT_MAX_WIDTH : 0);
+    int64_t rbody = try_write_box(body, value, &rbody_acc);
+    wc->align_shift = saved_shift;
     if (rbody <= 0)
     {
         buffer_free(body);
         return rbody;
     }
-    int body_len = rbody;
-    int before = buffer_get_length_inline(out);
+    int64_t body_len = rbody;
+    int64_t before = buffer_get_length_inline(out);
     {
         int rt = try_write_type(out, serialize_part, r);
         if (rt <= 0)
@@ -285,6 +361,22 @@ int try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r)
             return rt;
         }
     }
+    if (s_tensor_native)
+    {
+        // 用0x80补齐的固定宽度varint
+        int64_t slot = varint_reserve(out);
+        if (varint_backpatch(out, slot, (uint64_t)body_len, part_len_width((uint64_t)body_len)) < 0)
+        {
+            buffer_free(body);
+            buffer_set_length64(out, before);
+            tinybuf_error er = tinybuf_result_err(-1, "try_write_part: buffer overflow", NULL);
+            tinybuf_result_append_merge(r, &er, tinybuf_merger_left);
+            return -1;
+        }
+        tinybuf_error ok = tinybuf_result_ok(VARINT_MAX_WIDTH);
+        tinybuf_result_append_merge(r, &ok, tinybuf_merger_sum);
+    }
+    else
     {
         int ri = try_write_int_data(0, out, (uint64_t)body_len, r);
         if (ri <= 0)
@@ -293,59 +385,36 @@ int try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r)
             return ri;
         }
     }
-    buffer_append(out, buffer_get_data_inline(body), body_len);
-    int after = buffer_get_length_inline(out);
+    buffer_append64(out, buffer_get_data_inline(body), body_len);
+    int64_t after = buffer_get_length_inline(out);
     buffer_free(body);
     return after - before;
 }
 
-int try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r)
+// 分区起始的offset base为分区表的最终位置
+// native模式下各分区以自身起始为基准对齐 分区起始也放到TENSOR_NATIVE_ALIGN对齐的位置 中间补0
+static inline uint64_t part_start(uint64_t off, int64_t base)
 {
-    int total = 1 + count;
-    buffer **parts = (buffer **)tinybuf_malloc(sizeof(buffer *) * total);
-    int *lens = (int *)tinybuf_malloc(sizeof(int) * total);
-    for (int i = 0; i < total; ++i)
-    {
-        parts[i] = buffer_alloc();
-    }
-    {
-        int rmain = try_write_part(parts[0], mainbox, r);
-        if (rmain <= 0)
-        {
-            for (int i = 0; i < total; ++i)
-                buffer_free(parts[i]);
-            tinybuf_free(parts);
-            tinybuf_free(lens);
-            return rmain;
-        }
-        lens[0] = rmain;
-    }
-    for (int i = 0; i < count; ++i)
-    {
-        int rsub = try_write_part(parts[1 + i], subs[i], r);
-        if (rsub <= 0)
-        {
-            for (int k = 0; k < total; ++k)
-                buffer_free(parts[k]);
-            tinybuf_free(parts);
-            tinybuf_free(lens);
-            return rsub;
-        }
-        lens[1 + i] = rsub;
-    }
-    uint64_t *offs = (uint64_t *)tinybuf_malloc(sizeof(uint64_t) * total);
-    uint64_t *vlen = (uint64_t *)tinybuf_malloc(sizeof(uint64_t) * total);
+    if (!s_tensor_native)
+        return off;
+    uint64_t mis = ((uint64_t)base + off) % TENSOR_NATIVE_ALIGN;
+    return mis ? off + TENSOR_NATIVE_ALIGN - mis : off;
+}
+
+// 分区表中的offset与自身长度相关 迭代到各offset的varint宽度不再变化 返回分区表长度
+static uint64_t part_table_layout(const uint64_t *lens, int total, int64_t base, uint64_t *offs, uint64_t *vlen)
+{
+    uint8_t tmp[32];
     for (int i = 0; i < total; ++i)
         vlen[i] = 1;
-    uint8_t tmp[32];
     while (1)
     {
         uint64_t table_len = 1 + (uint64_t)int_serialize_local((uint64_t)total, tmp);
         for (int i = 0; i < total; ++i)
             table_len += vlen[i];
-        offs[0] = table_len;
+        offs[0] = part_start(table_len, base);
         for (int i = 1; i < total; ++i)
-            offs[i] = offs[i - 1] + (uint64_t)lens[i - 1];
+            offs[i] = part_start(offs[i - 1] + lens[i - 1], base);
         int stable = 1;
         for (int i = 0; i < total; ++i)
         {
@@ -357,61 +426,169 @@ int try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybu
             }
         }
         if (stable)
-            break;
+            return table_len;
     }
-    int before = buffer_get_length_inline(out);
+}
+
+static void free_parts(buffer **parts, int total)
+{
+    for (int i = 0; i < total; ++i)
+        buffer_free(parts[i]);
+    tinybuf_free(parts);
+}
+
+// 各分区已写好 写分区表后依次拼接 释放parts
+static int64_t stitch_parts(buffer *out, buffer **parts, int total, tinybuf_error *r)
+{
+    uint64_t *lens = (uint64_t *)tinybuf_malloc(sizeof(uint64_t) * total);
+    uint64_t *offs = (uint64_t *)tinybuf_malloc(sizeof(uint64_t) * total);
+    uint64_t *vlen = (uint64_t *)tinybuf_malloc(sizeof(uint64_t) * total);
+    for (int i = 0; i < total; ++i)
     {
-        int rt = try_write_type(out, serialize_part_table, r);
-        if (rt <= 0)
-        {
-            for (int k = 0; k < total; ++k)
-                buffer_free(parts[k]);
-            tinybuf_free(parts);
-            tinybuf_free(lens);
-            tinybuf_free(offs);
-            tinybuf_free(vlen);
-            return rt;
-        }
+        lens[i] = (uint64_t)buffer_get_length_inline(parts[i]);
     }
+    int64_t before = buffer_get_length_inline(out);
+    part_table_layout(lens, total, before + tinybuf_writer_ctx_current()->align_shift, offs, vlen);
+    int64_t rc = 1;
+    // 总长度已知 一次预留 拼接时不再扩容
+    buffer_reserve64(out, before + (int64_t)(offs[total - 1] + lens[total - 1]));
+    if (try_write_type(out, serialize_part_table, r) <= 0 || try_write_int_data(0, out, (uint64_t)total, r) <= 0)
+        rc = -1;
+    for (int i = 0; rc > 0 && i < total; ++i)
     {
-        int ri = try_write_int_data(0, out, (uint64_t)total, r);
-        if (ri <= 0)
-        {
-            for (int k = 0; k < total; ++k)
-                buffer_free(parts[k]);
-            tinybuf_free(parts);
-            tinybuf_free(lens);
-            tinybuf_free(offs);
-            tinybuf_free(vlen);
-            return ri;
-        }
+        if (try_write_int_data(0, out, offs[i], r) <= 0)
+            rc = -1;
+    }
+    for (int i = 0; rc > 0 && i < total; ++i)
+    {
+        int64_t gap = before + (int64_t)offs[i] - buffer_get_length_inline(out);
+        char *fill = gap > 0 ? buffer_append_space64(out, gap) : NULL;
+        if (fill)
+            memset(fill, 0, (size_t)gap);
+        buffer_append64(out, buffer_get_data_inline(parts[i]), (int64_t)lens[i]);
+    }
+    free_parts(parts, total);
+    tinybuf_free(lens);
+    tinybuf_free(offs);
+    tinybuf_free(vlen);
+    if (rc <= 0)
+    {
+        buffer_set_length64(out, before);
+        return rc;
     }
+    return buffer_get_length_inline(out) - before;
+}
+
+int64_t try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r)
+{
+    int total = 1 + count;
+    buffer **parts = (buffer **)tinybuf_malloc(sizeof(buffer *) * total);
     for (int i = 0; i < total; ++i)
     {
-        int rj = try_write_int_data(0, out, (uint64_t)offs[i], r);
-        if (rj <= 0)
+        parts[i] = buffer_alloc();
+    }
+    // 各分区以自身起始为对齐基准 与并行版本的工作线程一致
+    tinybuf_writer_ctx *wc = tinybuf_writer_ctx_current();
+    int64_t saved_shift = wc->align_shift;
+    wc->align_shift = 0;
+    for (int i = 0; i < total; ++i)
+    {
+        int64_t rp = try_write_part(parts[i], i == 0 ? mainbox : subs[i - 1], r);
+        if (rp <= 0)
         {
-            for (int k = 0; k < total; ++k)
-                buffer_free(parts[k]);
-            tinybuf_free(parts);
-            tinybuf_free(lens);
-            tinybuf_free(offs);
-            tinybuf_free(vlen);
-            return rj;
+            wc->align_shift = saved_shift;
+            free_parts(parts, total);
+            return rp;
         }
     }
+    wc->align_shift = saved_shift;
+    return stitch_parts(out, parts, total, r);
+}
+
+// 并行写分区: 各分区互不引用 每个工作线程绑定独立的writer_ctx(strpool/precache)
+// 按下标领取分区 全部完成后在调用线程写分区表并拼接 输出与串行版本逐字节一致
+typedef struct
+{
+    const tinybuf_value *mainbox;
+    const tinybuf_value **subs;
+    buffer **parts;
+    int64_t *rets;
+    tinybuf_error *errs;
+    int total;
+    int next;
+    tb_spinlock_t lock;
+} part_jobs;
+
+static void run_part_jobs(void *arg)
+{
+    part_jobs *jobs = (part_jobs *)arg;
+    tinybuf_writer_ctx *ctx = tinybuf_writer_ctx_new();
+    tinybuf_writer_ctx *old = tinybuf_writer_ctx_bind(ctx);
+    while (1)
+    {
+        int i;
+        tb_spinlock_lock(&jobs->lock);
+        i = jobs->next++;
+        tb_spinlock_unlock(&jobs->lock);
+        if (i >= jobs->total)
+            break;
+        const tinybuf_value *v = i == 0 ? jobs->mainbox : jobs->subs[i - 1];
+        jobs->rets[i] = try_write_part(jobs->parts[i], v, &jobs->errs[i]);
+    }
+    tinybuf_writer_ctx_bind(old);
+    tinybuf_writer_ctx_free(ctx);
+}
+
+int64_t tinybuf_try_write_partitions_parallel(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, int threads, tinybuf_error *r)
+{
+    int total = 1 + count;
+    if (threads <= 0)
+        threads = tinybuf_cpu_count();
+    if (threads > total)
+        threads = total;
+    if (threads <= 1)
+        return tinybuf_try_write_partitions64(out, mainbox, subs, count, r);
+
+    part_jobs jobs;
+    jobs.mainbox = mainbox;
+    jobs.subs = subs;
+    jobs.total = total;
+    jobs.next = 0;
+    tb_spinlock_init(&jobs.lock);
+    jobs.parts = (buffer **)tinybuf_malloc(sizeof(buffer *) * total);
+    jobs.rets = (int64_t *)tinybuf_malloc(sizeof(int64_t) * total);
+    jobs.errs = (tinybuf_error *)tinybuf_malloc(sizeof(tinybuf_error) * total);
     for (int i = 0; i < total; ++i)
     {
-        buffer_append(out, buffer_get_data_inline(parts[i]), buffer_get_length_inline(parts[i]));
+        jobs.parts[i] = buffer_alloc();
+        jobs.errs[i] = tinybuf_result_ok(0);
     }
-    int after = buffer_get_length_inline(out);
+    tinybuf_run_workers(threads, run_part_jobs, &jobs);
+
+    // 按分区顺序合并结果 与串行版本一样遇到第一个失败的分区即返回
+    int64_t rc = 1;
     for (int i = 0; i < total; ++i)
-        buffer_free(parts[i]);
-    tinybuf_free(parts);
-    tinybuf_free(lens);
-    tinybuf_free(offs);
-    tinybuf_free(vlen);
-    return after - before;
+    {
+        if (rc > 0)
+        {
+            tinybuf_result_append_merge(r, &jobs.errs[i], tinybuf_merger_sum);
+            if (jobs.rets[i] <= 0)
+                rc = jobs.rets[i];
+        }
+        tinybuf_result_unref(&jobs.errs[i]);
+    }
+    tinybuf_free(jobs.rets);
+    tinybuf_free(jobs.errs);
+    if (rc <= 0)
+    {
+        free_parts(jobs.parts, total);
+        tinybuf_result_add_msg_const(r, "tinybuf_try_write_partitions_parallel");
+        return rc;
+    }
+    rc = stitch_parts(out, jobs.parts, total, r);
+    if (rc <= 0)
+        tinybuf_result_add_msg_const(r, "tinybuf_try_write_partitions_parallel");
+    return rc;
 }
 
 /* removed duplicate tinybuf_value_serialize; keep single definition in tinybuf.c */
@@ -452,12 +629,84 @@ static inline tinybuf_error _err_with(const char *msg, int rc)
     return tinybuf_result_err(rc, msg, NULL);
 }
 
+// 写入超过2GB时int版本返回-1 并把out恢复到写入前的长度
+static inline int narrow_written(buffer *out, int64_t before, int64_t n, const char *api, tinybuf_error *r)
+{
+    if (n > INT_MAX)
+    {
+        buffer_set_length64(out, before);
+        s_last_error_msg = "written more than 2GB, use the 64-bit variant";
+        tinybuf_result_add_msg_const(r, s_last_error_msg);
+        return -1;
+    }
+    if (n <= 0)
+        tinybuf_result_add_msg_const(r, api);
+    return (int)n;
+}
+
+int64_t tinybuf_try_write_box64(buffer *out, const tinybuf_value *value, tinybuf_error *r)
+{
+    int64_t n = try_write_box(out, value, r);
+    if (n <= 0)
+        tinybuf_result_add_msg_const(r, "tinybuf_try_write_box_r");
+    return n;
+}
+
 int tinybuf_try_write_box(buffer *out, const tinybuf_value *value, tinybuf_error *r)
 {
-    int n = try_write_box(out, value, r);
-    if (n > 0)
-        return n;
-    tinybuf_result_add_msg_const(r, "tinybuf_try_write_box_r");
+    int64_t before = buffer_get_length64(out);
+    return narrow_written(out, before, try_write_box(out, value, r), "tinybuf_try_write_box_r", r);
+}
+
+int tinybuf_try_write_box_ctx(tinybuf_writer_ctx *ctx, buffer *out, const tinybuf_value *value, tinybuf_error *r)
+{
+    assert(ctx);
+    tinybuf_writer_ctx *old = tinybuf_writer_ctx_bind(ctx);
+    int n = tinybuf_try_write_box(out, value, r);
+    tinybuf_writer_ctx_bind(old);
+    return n;
+}
+
+int64_t tinybuf_value_serialized_size(const tinybuf_value *value)
+{
+    assert(value);
+    return box_serialized_size(value, 0);
+}
+
+int64_t tinybuf_partitions_serialized_size(const tinybuf_value *mainbox, const tinybuf_value **subs, int count)
+{
+    int total = 1 + count;
+    uint64_t *lens = (uint64_t *)tinybuf_malloc(sizeof(uint64_t) * total * 3);
+    uint64_t *offs = lens + total;
+    uint64_t *vlen = offs + total;
+    int64_t sum = -1;
+    for (int i = 0; i < total; ++i)
+    {
+        int64_t n = part_serialized_size(i ? subs[i - 1] : mainbox, 0);
+        if (n < 0)
+        {
+            tinybuf_free(lens);
+            return -1;
+        }
+        lens[i] = (uint64_t)n;
+    }
+    part_table_layout(lens, total, 0, offs, vlen);
+    sum = (int64_t)(offs[total - 1] + lens[total - 1]);
+    tinybuf_free(lens);
+    return sum;
+}
+
+int tinybuf_try_write_box_into(char *mem, int capacity, const tinybuf_value *value, tinybuf_error *r)
+{
+    assert(mem);
+    struct T_buffer fixed = {._data = mem, ._len = 0, ._capacity = capacity, ._fixed = 1, ._in_arena = 0};
+    int n = tinybuf_try_write_box(&fixed, value, r);
+    if (buffer_is_overflow(&fixed))
+    {
+        tinybuf_error er = _err_with("tinybuf_try_write_box_into: capacity too small", -1);
+        tinybuf_result_append_merge(r, &er, tinybuf_merger_left);
+        return -1;
+    }
     return n;
 }
 
@@ -490,19 +739,21 @@ int tinybuf_try_write_plugin_map_table(buffer *out, tinybuf_error *r)
 
 int tinybuf_try_write_part(buffer *out, const tinybuf_value *value, tinybuf_error *r)
 {
-    int n = try_write_part(out, value, r);
-    if (n > 0)
-        return n;
-    tinybuf_result_add_msg_const(r, "tinybuf_try_write_part_r");
-    return n;
+    int64_t before = buffer_get_length64(out);
+    return narrow_written(out, before, try_write_part(out, value, r), "tinybuf_try_write_part_r", r);
 }
 
 int tinybuf_try_write_partitions(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r)
 {
-    int n = try_write_partitions(out, mainbox, subs, count, r);
-    if (n > 0)
-        return n;
-    tinybuf_result_add_msg_const(r, "tinybuf_try_write_partitions_r");
+    int64_t before = buffer_get_length64(out);
+    return narrow_written(out, before, try_write_partitions(out, mainbox, subs, count, r), "tinybuf_try_write_partitions_r", r);
+}
+
+int64_t tinybuf_try_write_partitions64(buffer *out, const tinybuf_value *mainbox, const tinybuf_value **subs, int count, tinybuf_error *r)
+{
+    int64_t n = try_write_partitions(out, mainbox, subs, count, r);
+    if (n <= 0)
+        tinybuf_result_add_msg_const(r, "tinybuf_try_write_partitions_r");
     return n;
 }
 
@@ -585,76 +836,43 @@ int tinybuf_try_write_string_raw(buffer *out, const char *str, int len, tinybuf_
     return ret;
 }
 
-int tinybuf_try_write_custom_id_box(buffer *out, const char *name, const tinybuf_value *in, tinybuf_error *r)
+// name_idx box: [name_idx][pool下标][payload长度][payload] payload直接写入out后回填长度
+static int write_name_idx_box(buffer *out, const char *name, int (*write_payload)(const char *, const tinybuf_value *, buffer *, tinybuf_error *), const tinybuf_value *in, tinybuf_error *wr_local)
 {
-    buffer *body = buffer_alloc();
-    buffer *pool = buffer_alloc();
-    strpool_reset_write(body);
     int idx = strpool_add(name, (int)strlen(name));
     uint8_t ty = serialize_name_idx;
-    buffer_append(body, (const char *)&ty, 1);
-    dump_int((uint64_t)idx, body);
-    buffer *payload = buffer_alloc();
-    tinybuf_error wr_local = tinybuf_result_ok(0);
-    int wlen = tinybuf_custom_try_write(name, in, payload, &wr_local);
-    {
-        (void)wlen;
-    }
-    dump_int((uint64_t)(wlen > 0 ? wlen : 0), body);
+    buffer_append(out, (const char *)&ty, 1);
+    dump_int((uint64_t)idx, out);
+    int slot = varint_reserve(out);
+    int payload_start = buffer_get_length_inline(out);
+    int wlen = write_payload(name, in, out, wr_local);
     if (wlen > 0)
     {
-        buffer_append(body, buffer_get_data_inline(payload), buffer_get_length_inline(payload));
-    }
-    int rpool = strpool_write_tail(pool, r);
-    if (rpool < 0)
-    {
-        buffer_free(payload);
-        buffer_free(body);
-        buffer_free(pool);
-        return rpool;
-    }
-    uint64_t body_len = (uint64_t)buffer_get_length_inline(body);
-    uint64_t offset_guess_len = 1;
-    uint8_t tmpv[16];
-    while (1)
-    {
-        uint64_t off = 1 + offset_guess_len + body_len;
-        int l = int_serialize_local(off, tmpv);
-        if ((uint64_t)l == offset_guess_len)
-            break;
-        offset_guess_len = (uint64_t)l;
+        wlen = buffer_get_length_inline(out) - payload_start;
     }
-    uint64_t final_off = 1 + offset_guess_len + body_len;
-    tinybuf_error acc = tinybuf_result_ok(0);
-    int rtype = try_write_type(out, serialize_str_pool_table, r);
-    if (rtype <= 0)
+    else
     {
-        buffer_free(payload);
-        buffer_free(body);
-        buffer_free(pool);
-        return rtype;
+        buffer_set_length(out, payload_start);
     }
-    tinybuf_error rtmp = tinybuf_result_ok(rtype);
-    tinybuf_result_append_merge(&acc, &rtmp, tinybuf_merger_sum);
-    int rlen = try_write_int_data(0, out, final_off, r);
-    if (rlen <= 0)
+    uint64_t plen = (uint64_t)(wlen > 0 ? wlen : 0);
+    if (varint_backpatch(out, slot, plen, varint_slot_width(plen)) < 0)
     {
-        buffer_free(payload);
-        buffer_free(body);
-        buffer_free(pool);
-        return rlen;
+        return -1;
     }
-    tinybuf_error rtmp2 = tinybuf_result_ok(rlen);
-    tinybuf_result_append_merge(&acc, &rtmp2, tinybuf_merger_sum);
-    buffer_append(out, buffer_get_data_inline(body), (int)body_len);
-    int pool_len = buffer_get_length_inline(pool);
-    if (pool_len)
+    return wlen;
+}
+
+int tinybuf_try_write_custom_id_box(buffer *out, const char *name, const tinybuf_value *in, tinybuf_error *r)
+{
+    strpool_reset_write(out);
+    int start = strpool_table_begin(out);
+    tinybuf_error wr_local = tinybuf_result_ok(0);
+    int wlen = write_name_idx_box(out, name, tinybuf_custom_try_write, in, &wr_local);
+    int total = strpool_table_end(out, start, r);
+    if (total < 0)
     {
-        buffer_append(out, buffer_get_data_inline(pool), pool_len);
+        return total;
     }
-    buffer_free(payload);
-    buffer_free(body);
-    buffer_free(pool);
     if (wlen < 0)
     {
         tinybuf_result_append_merge(r, &wr_local, tinybuf_merger_left);
@@ -665,73 +883,21 @@ int tinybuf_try_write_custom_id_box(buffer *out, const char *name, const tinybuf
         tinybuf_result_add_msg_const(r, "tinybuf_try_write_custom_id_box_r");
         return wlen;
     }
-    int total = 1 + (int)offset_guess_len + (int)body_len + pool_len;
     r->res = total;
     return total;
 }
 
 int tinybuf_try_write_plugin_id_box(buffer *out, const char *name, const tinybuf_value *in, tinybuf_error *r)
 {
-    buffer *body = buffer_alloc();
-    buffer *pool = buffer_alloc();
-    strpool_reset_write(body);
-    int idx = strpool_add(name, (int)strlen(name));
-    uint8_t ty = serialize_name_idx;
-    buffer_append(body, (const char *)&ty, 1);
-    dump_int((uint64_t)idx, body);
-    buffer *payload = buffer_alloc();
+    strpool_reset_write(out);
+    int start = strpool_table_begin(out);
     tinybuf_error wr_local = tinybuf_result_ok(0);
-    int wlen = tinybuf_plugins_try_write_by_name(name, in, payload, &wr_local);
-    dump_int((uint64_t)(wlen > 0 ? wlen : 0), body);
-    if (wlen > 0)
-    {
-        buffer_append(body, buffer_get_data_inline(payload), buffer_get_length_inline(payload));
-    }
-    int rpool = strpool_write_tail(pool, r);
-    if (rpool < 0)
-    {
-        buffer_free(payload);
-        buffer_free(body);
-        buffer_free(pool);
-        return rpool;
-    }
-    uint64_t body_len = (uint64_t)buffer_get_length_inline(body);
-    uint64_t offset_guess_len = 1;
-    uint8_t tmpv[16];
-    while (1)
-    {
-        uint64_t off = 1 + offset_guess_len + body_len;
-        int l = int_serialize_local(off, tmpv);
-        if ((uint64_t)l == offset_guess_len)
-            break;
-        offset_guess_len = (uint64_t)l;
-    }
-    uint64_t final_off = 1 + offset_guess_len + body_len;
-    int rtype = try_write_type(out, serialize_str_pool_table, r);
-    if (rtype <= 0)
+    int wlen = write_name_idx_box(out, name, tinybuf_plugins_try_write_by_name, in, &wr_local);
+    int total = strpool_table_end(out, start, r);
+    if (total < 0)
     {
-        buffer_free(payload);
-        buffer_free(body);
-        buffer_free(pool);
-        return rtype;
+        return total;
     }
-    int rlen = try_write_int_data(0, out, final_off, r);
-    if (rlen <= 0)
-    {
-        buffer_free(payload);
-        buffer_free(body);
-        buffer_free(pool);
-        return rlen;
-    }
-    buffer_append(out, buffer_get_data_inline(body), (int)body_len);
-    int pool_len = buffer_get_length_inline(pool);
-    if (pool_len)
-    {
-        buffer_append(out, buffer_get_data_inline(pool), pool_len);
-    }
-    buffer_free(payload);
-    buffer_free(body);
-    buffer_free(pool);
     if (wlen < 0)
     {
         tinybuf_result_append_merge(r, &wr_local, tinybuf_merger_left);
@@ -740,7 +906,6 @@ int tinybuf_try_write_plugin_id_box(buffer *out, const char *name, const tinybuf
         tinybuf_result_add_msg(r, m, (tinybuf_deleter_fn)tinybuf_free);
         return wlen;
     }
-    int total = 1 + (int)offset_guess_len + (int)body_len + pool_len;
     r->res = total;
     return total;
 }
@@ -51,17 +51,16 @@ static int plugin_upper_write(uint8_t type, const tinybuf_value *in, buffer *out
     if (type != TINYBUF_PLUGIN_UPPER_STRING)
         return -1;
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(in, &gr);
-    if (!s)
+    const char *s;
+    int64_t slen;
+    if (tinybuf_value_get_string_view(in, &s, &slen, &gr) != 0)
         return -1;
-    int len = buffer_get_length(s);
-    if (len > 255)
-        len = 255;
+    int len = slen > 255 ? 255 : (int)slen;
     uint8_t t = TINYBUF_PLUGIN_UPPER_STRING;
     buffer_append(out, (const char *)&t, 1);
     uint8_t l = (uint8_t)len;
     buffer_append(out, (const char *)&l, 1);
-    buffer_append(out, buffer_get_data(s), len);
+    buffer_append(out, s, len);
     return 2 + len;
 }
 
@@ -95,25 +94,26 @@ static int plugin_upper_show_value(uint8_t type, const tinybuf_value *in, buffer
     if (type != TINYBUF_PLUGIN_UPPER_STRING)
         return -1;
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(in, &gr);
-    if (!s)
+    const char *s;
+    int64_t len;
+    if (tinybuf_value_get_string_view(in, &s, &len, &gr) != 0)
         return -1;
     buffer_append(out, "upper(", 6);
-    buffer_append(out, buffer_get_data(s), buffer_get_length(s));
+    buffer_append(out, s, (int)len);
     buffer_append(out, ")", 1);
-    return buffer_get_length(s) + 7;
+    return (int)len + 7;
 }
 
 static int plugin_upper_to_lower(tinybuf_value *value, const tinybuf_value *args, tinybuf_value *out)
 {
     (void)args;
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(value, &gr);
-    if (!s)
+    const char *p = NULL;
+    int64_t len64 = 0;
+    if (tinybuf_value_get_string_view(value, &p, &len64, &gr) != 0)
         return -1;
-    int len = buffer_get_length(s);
+    int len = (int)len64;
     char *tmp = (char *)tinybuf_malloc(len);
-    const char *p = buffer_get_data(s);
     for (int i = 0; i < len; ++i)
     {
         char c = p[i];
@@ -163,13 +163,13 @@ static int custom_string_write(const char *name, const tinybuf_value *in, buffer
 {
     (void)name;
     tinybuf_error gr = tinybuf_result_ok(0);
-    buffer *s = tinybuf_value_get_string(in, &gr);
-    if (!s)
+    const char *s;
+    int64_t len;
+    if (tinybuf_value_get_string_view(in, &s, &len, &gr) != 0)
         return -1;
-    int len = buffer_get_length(s);
     if (len > 0)
-        buffer_append(out, buffer_get_data(s), len);
-    return len;
+        buffer_append(out, s, (int)len);
+    return (int)len;
 }
 static int custom_string_dump(const char *name, buf_ref *buf, buffer *out, tinybuf_error *r)
 {
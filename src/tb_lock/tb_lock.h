@@ -7,11 +7,21 @@ typedef long tb_spinlock_t;
 static inline void tb_spinlock_init(tb_spinlock_t *lk) { *lk = 0; }
 static inline void tb_spinlock_lock(tb_spinlock_t *lk) { while (InterlockedExchange(lk, 1) != 0) {} }
 static inline void tb_spinlock_unlock(tb_spinlock_t *lk) { InterlockedExchange(lk, 0); }
+typedef long tb_atomic_t;
+static inline long tb_atomic_add(tb_atomic_t *v, long d) { return InterlockedExchangeAdd(v, d) + d; }
+static inline long tb_atomic_load(tb_atomic_t *v) { return InterlockedCompareExchange(v, 0, 0); }
+static inline long tb_atomic_load_relaxed(tb_atomic_t *v) { return *(volatile long *)v; }
 #else
 typedef int tb_spinlock_t;
 static inline void tb_spinlock_init(tb_spinlock_t *lk) { *lk = 0; }
 static inline void tb_spinlock_lock(tb_spinlock_t *lk) { while (__sync_lock_test_and_set(lk, 1)) {} }
 static inline void tb_spinlock_unlock(tb_spinlock_t *lk) { __sync_lock_release(lk); }
+typedef int tb_atomic_t;
+// 返回加上d之后的值
+static inline int tb_atomic_add(tb_atomic_t *v, int d) { return __sync_add_and_fetch(v, d); }
+static inline int tb_atomic_load(tb_atomic_t *v) { return __sync_add_and_fetch(v, 0); }
+// 不带屏障 只用于快速判断 结果需要在锁内确认
+static inline int tb_atomic_load_relaxed(tb_atomic_t *v) { return __atomic_load_n(v, __ATOMIC_RELAXED); }
 #endif
 
 #define TB_WITH_LOCK(lock) for (int _tb_once = 1; _tb_once && (tb_spinlock_lock(&(lock)), 1); _tb_once = 0, tb_spinlock_unlock(&(lock)))
@@ -7,6 +7,12 @@
 #include <sstream>
 #include <string>
 #include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
 static int ut_string_read(const char *name, const uint8_t *data, int len, tinybuf_value *out, CONTAIN_HANDLER contain_handler, tinybuf_error *r){ (void)name; (void)contain_handler; tinybuf_value_init_string(out, (const char*)data, len); return len; }
 static int ut_string_write(const char *name, const tinybuf_value *in, buffer *out, tinybuf_error *r){ (void)name; tinybuf_error gr = tinybuf_result_ok(0); buffer *s = tinybuf_value_get_string(in, &gr); if(!s){ tinybuf_result_append_merge(r, &gr, tinybuf_merger_left); return -1; } int l = buffer_get_length(s); if(l>0) buffer_append(out, buffer_get_data(s), l); return l; }
 static int ut_string_dump(const char *name, buf_ref *buf, buffer *out, tinybuf_error *r){ (void)name; buffer_append(out, buf->ptr, (int)buf->size); return (int)buf->size; }
@@ -229,3 +235,81 @@ TEST_CASE("custom result wrappers", "[result]")
     tinybuf_set_use_strpool(0);
     LOGI("case end: unit custom result wrappers");
 }
+
+// hlist_*没有tag 不进插件表 直接从描述符中按名字取
+static tinybuf_plugin_value_op_fn ut_extend_op(const char *name)
+{
+#ifdef _WIN32
+    HMODULE h = LoadLibraryA("../tinybuf_plugins/system_extend.dll");
+    void *sym = h ? (void *)GetProcAddress(h, "tinybuf_get_plugin_descriptor") : NULL;
+#else
+    void *h = dlopen("../tinybuf_plugins/libsystem_extend.so", RTLD_NOW);
+    void *sym = h ? dlsym(h, "tinybuf_get_plugin_descriptor") : NULL;
+#endif
+    if (!sym)
+        return NULL;
+    tinybuf_plugin_descriptor *d = ((tinybuf_plugin_descriptor * (*)(void)) sym)();
+    for (int i = 0; i < d->op_count; ++i)
+    {
+        if (strcmp(d->op_names[i], name) == 0)
+            return d->op_fns[i];
+    }
+    return NULL;
+}
+
+TEST_CASE("system.extend hlist ops share elements", "[plugin]")
+{
+    LOGI("case begin: unit hlist ops share");
+    tinybuf_plugin_value_op_fn concat = ut_extend_op("hlist_concat");
+    tinybuf_plugin_value_op_fn del = ut_extend_op("hlist_delete");
+    REQUIRE(concat);
+    REQUIRE(del);
+    // 每个元素是一个较大的数组 结果与输入共享它们的子节点表
+    tinybuf_value *list = tinybuf_value_alloc();
+    for (int i = 0; i < 3; ++i)
+    {
+        tinybuf_value *row = tinybuf_value_alloc();
+        for (int j = 0; j < 1000; ++j)
+        {
+            tinybuf_value *cell = tinybuf_value_alloc();
+            tinybuf_value_init_int(cell, i * 1000 + j);
+            tinybuf_value_array_append(row, cell);
+        }
+        tinybuf_value_array_append(list, row);
+    }
+    tinybuf_value *args = tinybuf_value_alloc();
+    tinybuf_value_array_append(args, tinybuf_value_share(list));
+    tinybuf_value *out = tinybuf_value_alloc();
+    REQUIRE(concat(list, args, out) == 0);
+    tinybuf_error r = tinybuf_result_ok(0);
+    REQUIRE(tinybuf_value_get_child_size(out, &r) == 6);
+    for (int k = 0; k < 6; ++k)
+    {
+        const tinybuf_value *src = tinybuf_value_get_array_child(list, k % 3, &r);
+        const tinybuf_value *dst = tinybuf_value_get_array_child(out, k, &r);
+        REQUIRE(src != dst);
+        // 深拷贝会新建每个子节点 共享时取到的是同一个节点
+        REQUIRE(tinybuf_value_get_array_child(src, 999, &r) == tinybuf_value_get_array_child(dst, 999, &r));
+    }
+    tinybuf_value *idx = tinybuf_value_alloc();
+    tinybuf_value_init_int(idx, 0);
+    tinybuf_value *dargs = tinybuf_value_alloc();
+    tinybuf_value_array_append(dargs, idx);
+    tinybuf_value *rest = tinybuf_value_alloc();
+    REQUIRE(del(list, dargs, rest) == 0);
+    REQUIRE(tinybuf_value_get_array_child(tinybuf_value_get_array_child(rest, 0, &r), 0, &r) == tinybuf_value_get_array_child(tinybuf_value_get_array_child(list, 1, &r), 0, &r));
+    // 通过_mut接口修改结果 输入和其他结果不受影响
+    tinybuf_value *row0 = tinybuf_value_get_array_child_mut(out, 0, &r);
+    tinybuf_value_init_int(tinybuf_value_get_array_child_mut(row0, 0, &r), -1);
+    REQUIRE(tinybuf_value_get_int(tinybuf_value_get_array_child(tinybuf_value_get_array_child(list, 0, &r), 0, &r), &r) == 0);
+    REQUIRE(tinybuf_value_get_int(tinybuf_value_get_array_child(tinybuf_value_get_array_child(out, 3, &r), 0, &r), &r) == 0);
+    tinybuf_value_free(list);
+    REQUIRE(tinybuf_value_get_int(tinybuf_value_get_array_child(tinybuf_value_get_array_child(out, 5, &r), 999, &r), &r) == 2999);
+    REQUIRE(tinybuf_value_get_int(tinybuf_value_get_array_child(tinybuf_value_get_array_child(rest, 1, &r), 0, &r), &r) == 2000);
+    tinybuf_value_free(out);
+    tinybuf_value_free(rest);
+    tinybuf_value_free(args);
+    tinybuf_value_free(dargs);
+    tinybuf_result_unref(&r);
+    LOGI("case end: unit hlist ops share");
+}